@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+'''
+Reader for the structured event log written by OpenVPN with
+'--event-log file'.  It formats the binary records of the memory-mapped
+ring as text or JSON lines, or sends them to syslog, so that OpenVPN
+itself never has to format or write them.  The file layout is described
+in src/openvpn/evlog.h.
+
+Usage example:
+    evlog-read.py /dev/shm/openvpn.evlog
+    evlog-read.py --follow --json /dev/shm/openvpn.evlog >> events.json
+    evlog-read.py --follow --syslog --verb 3 /dev/shm/openvpn.evlog
+
+Output example:
+    2021-06-01 12:00:00.123456 cid=4 peer_id=4 CLIENT_CREATE af=2 addr=192.0.2.10 port=51612
+    2021-06-01 12:00:00.348120 cid=4 peer_id=4 CLIENT_ESTABLISHED handshake_usec=224664 vaddr=10.8.0.6
+'''
+
+import argparse
+import ipaddress
+import json
+import mmap
+import socket
+import struct
+import sys
+import syslog
+import time
+
+EVLOG_MAGIC = 0x4c45564f
+EVLOG_NO_CID = 0xffffffffffffffff
+EVLOG_EXPIRED = 2
+
+HEADER = struct.Struct('=IIIIQII32x')
+RECORD = struct.Struct('=QQHBxIQ4Q')
+
+# event id -> (name, argument names)
+EVENTS = {
+    1: ('CLIENT_CREATE', ('af', 'addr_hi', 'addr_lo', 'port')),
+    2: ('CLIENT_ESTABLISHED', ('handshake_usec', 'vaddr')),
+    3: ('CLIENT_AUTH_FAILED', ()),
+    4: ('CLIENT_HANDSHAKE_FAILED', ()),
+    5: ('CLIENT_CLOSE', ('bytes_in', 'bytes_out')),
+    6: ('DROP_DECRYPT', ('len',)),
+    7: ('DROP_BAD_SOURCE', ('len',)),
+    8: ('DROP_OUTPUT_SATURATION', ()),
+    9: ('DROP_TUN_QUEUE_FULL', ('len',)),
+    10: ('DROP_POLICER', ('len',)),
+}
+
+
+def decode(rec):
+    seq, ts, event, level, peer_id, cid, *args = rec
+    name, argnames = EVENTS.get(event, ('EVENT_%d' % event, ('a0', 'a1', 'a2', 'a3')))
+    out = {'seq': seq, 'time': ts / 1e9, 'level': level, 'event': name}
+    if cid != EVLOG_NO_CID:
+        out['cid'] = cid
+    out['peer_id'] = peer_id
+    fields = dict(zip(argnames, args))
+    if name == 'CLIENT_CREATE':
+        af = fields.pop('af')
+        hi, lo = fields.pop('addr_hi'), fields.pop('addr_lo')
+        addr = hi
+        if af == socket.AF_INET:
+            addr = str(ipaddress.IPv4Address(hi))
+        elif af == socket.AF_INET6:
+            addr = str(ipaddress.IPv6Address((hi << 64) | lo))
+        fields = {'af': af, 'addr': addr, 'port': fields['port']}
+    elif name == 'CLIENT_ESTABLISHED':
+        fields['vaddr'] = str(ipaddress.IPv4Address(fields['vaddr']))
+    out.update(fields)
+    return out
+
+
+def format_text(ev):
+    ts = time.strftime('%Y-%m-%d %H:%M:%S', time.localtime(ev['time']))
+    ts += '.%06d' % int((ev['time'] % 1) * 1e6)
+    skip = ('seq', 'time', 'level', 'event', 'cid', 'peer_id')
+    args = ' '.join('%s=%s' % (k, v) for k, v in ev.items() if k not in skip)
+    cid = 'cid=%s ' % ev['cid'] if 'cid' in ev else ''
+    return ('%s %speer_id=%d %s %s' % (ts, cid, ev['peer_id'], ev['event'], args)).rstrip()
+
+
+def read_record(mm, n, n_records, record_size):
+    '''Return record number n, or None if it was overwritten.'''
+    off = HEADER.size + ((n - 1) % n_records) * record_size
+    for _ in range(3):
+        seq = struct.unpack_from('=Q', mm, off)[0]
+        rec = RECORD.unpack_from(mm, off)
+        if seq == n and struct.unpack_from('=Q', mm, off)[0] == n:
+            return rec
+        if seq > n:
+            return None
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Read an OpenVPN --event-log ring')
+    parser.add_argument('file')
+    parser.add_argument('--follow', '-f', action='store_true',
+                        help='wait for new events, like tail -f')
+    parser.add_argument('--json', action='store_true', help='print JSON lines')
+    parser.add_argument('--syslog', action='store_true', help='send events to syslog')
+    parser.add_argument('--verb', type=int, default=15,
+                        help='only show events at or below this --verb level')
+    args = parser.parse_args()
+
+    with open(args.file, 'rb') as f:
+        mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    magic, version, record_size, n_records, head, pid, state = HEADER.unpack_from(mm, 0)
+    if magic != EVLOG_MAGIC:
+        sys.exit('%s: not an OpenVPN event log' % args.file)
+
+    if args.syslog:
+        syslog.openlog('openvpn[%d]' % pid, 0, syslog.LOG_DAEMON)
+
+    # start with the oldest record still in the ring
+    n = max(1, head - n_records + 1)
+    while True:
+        head, state = struct.unpack_from('=Q4xI', mm, 16)
+        while n <= head:
+            rec = read_record(mm, n, n_records, record_size)
+            if rec is None:
+                # overwritten while we were reading, skip to the oldest
+                print('lost events %d..%d' % (n, head - n_records), file=sys.stderr)
+                n = max(n + 1, head - n_records + 1)
+                continue
+            ev = decode(rec)
+            n += 1
+            if ev['level'] > args.verb:
+                continue
+            if args.json:
+                print(json.dumps(ev))
+            elif args.syslog:
+                syslog.syslog(syslog.LOG_INFO, format_text(ev).split(' ', 2)[2])
+            else:
+                print(format_text(ev))
+        sys.stdout.flush()
+        if not args.follow or state == EVLOG_EXPIRED:
+            break
+        time.sleep(0.2)
+
+
+if __name__ == '__main__':
+    main()
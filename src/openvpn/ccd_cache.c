@@ -0,0 +1,354 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+#include <sys/inotify.h>
+#include <dirent.h>
+
+#include "ccd_cache.h"
+#include "crypto.h"
+#include "list.h"
+#include "platform.h"
+
+#include "memdbg.h"
+
+#define CCD_CACHE_INOTIFY_MASK (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB \
+                                | IN_CREATE | IN_DELETE | IN_MOVED_FROM \
+                                | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+#define CCD_CACHE_EVENT_BUFFER_SIZE 16384
+
+struct ccd_cache_entry
+{
+    char *name;                 /* file name in the directory, hash key */
+    struct options_file *file;  /* NULL if there is no such file */
+    struct gc_arena gc;
+
+    /* list of entries without a file, oldest first */
+    struct ccd_cache_entry *prev;
+    struct ccd_cache_entry *next;
+};
+
+struct ccd_cache
+{
+    char *dir;
+    int inotify_fd;
+    struct hash *hash;
+    DIR *preload;               /* directory being preloaded, if any */
+    int n_preloaded;
+
+    /* every client without a file adds an entry, these are capped */
+    struct ccd_cache_entry *missing_head;
+    struct ccd_cache_entry *missing_tail;
+    int n_missing;
+};
+
+static uint32_t
+ccd_cache_hash_function(const void *key, uint32_t iv)
+{
+    const char *name = (const char *) key;
+    return hash_func((const uint8_t *) name, strlen(name), iv);
+}
+
+static bool
+ccd_cache_compare_function(const void *key1, const void *key2)
+{
+    return streq((const char *) key1, (const char *) key2);
+}
+
+static void
+ccd_cache_entry_free(struct ccd_cache *cc, struct ccd_cache_entry *e)
+{
+    if (!e->file)
+    {
+        if (e->prev)
+        {
+            e->prev->next = e->next;
+        }
+        else
+        {
+            cc->missing_head = e->next;
+        }
+        if (e->next)
+        {
+            e->next->prev = e->prev;
+        }
+        else
+        {
+            cc->missing_tail = e->prev;
+        }
+        --cc->n_missing;
+    }
+    gc_free(&e->gc);
+    free(e->name);
+    free(e);
+}
+
+static void
+ccd_cache_flush(struct ccd_cache *cc)
+{
+    struct hash_iterator hi;
+    struct hash_element *he;
+
+    hash_iterator_init(cc->hash, &hi);
+    while ((he = hash_iterator_next(&hi)))
+    {
+        ccd_cache_entry_free(cc, (struct ccd_cache_entry *) he->value);
+        hash_iterator_delete_element(&hi);
+    }
+    hash_iterator_free(&hi);
+}
+
+static void
+ccd_cache_invalidate(struct ccd_cache *cc, const char *name)
+{
+    struct ccd_cache_entry *e = hash_lookup(cc->hash, name);
+
+    if (e)
+    {
+        msg(D_MULTI_DEBUG, "CCD cache: %s changed", name);
+        hash_remove(cc->hash, name);
+        ccd_cache_entry_free(cc, e);
+    }
+}
+
+/*
+ * Remember that there is no file for entry e, dropping the oldest such
+ * entry if there are too many
+ */
+static void
+ccd_cache_add_missing(struct ccd_cache *cc, struct ccd_cache_entry *e)
+{
+    if (cc->n_missing >= CCD_CACHE_MAX_MISSING)
+    {
+        struct ccd_cache_entry *old = cc->missing_head;
+
+        hash_remove(cc->hash, old->name);
+        ccd_cache_entry_free(cc, old);
+    }
+    e->prev = cc->missing_tail;
+    e->next = NULL;
+    if (cc->missing_tail)
+    {
+        cc->missing_tail->next = e;
+    }
+    else
+    {
+        cc->missing_head = e;
+    }
+    cc->missing_tail = e;
+    ++cc->n_missing;
+}
+
+/*
+ * Stop caching, e.g. because the directory itself went away
+ */
+static void
+ccd_cache_disable(struct ccd_cache *cc, const char *reason)
+{
+    msg(M_WARN, "WARNING: CCD cache for %s disabled: %s", cc->dir, reason);
+    ccd_cache_flush(cc);
+    if (cc->inotify_fd >= 0)
+    {
+        close(cc->inotify_fd);
+        cc->inotify_fd = -1;
+    }
+    if (cc->preload)
+    {
+        closedir(cc->preload);
+        cc->preload = NULL;
+    }
+}
+
+/*
+ * Drop the entries of all files that changed since the last call
+ */
+static void
+ccd_cache_process_events(struct ccd_cache *cc)
+{
+    char buffer[CCD_CACHE_EVENT_BUFFER_SIZE]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t r;
+
+    while (cc->inotify_fd >= 0
+           && (r = read(cc->inotify_fd, buffer, sizeof(buffer))) > 0)
+    {
+        size_t buffer_i = 0;
+
+        while (buffer_i < r)
+        {
+            const struct inotify_event *pevent =
+                (const struct inotify_event *) &buffer[buffer_i];
+            buffer_i += sizeof(struct inotify_event) + pevent->len;
+
+            if (pevent->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+            {
+                ccd_cache_disable(cc, "directory removed or renamed");
+                return;
+            }
+            else if (pevent->mask & IN_Q_OVERFLOW)
+            {
+                msg(D_MULTI_LOW, "CCD cache: event queue overflow, flushing");
+                ccd_cache_flush(cc);
+            }
+            else if (pevent->len)
+            {
+                ccd_cache_invalidate(cc, pevent->name);
+            }
+        }
+    }
+}
+
+struct ccd_cache *
+ccd_cache_new(const char *dir, const bool preload)
+{
+    struct ccd_cache *cc;
+    const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (fd < 0)
+    {
+        msg(M_WARN | M_ERRNO, "WARNING: CCD cache: inotify_init1 failed");
+        return NULL;
+    }
+    if (inotify_add_watch(fd, dir, CCD_CACHE_INOTIFY_MASK) < 0)
+    {
+        msg(M_WARN | M_ERRNO, "WARNING: CCD cache: cannot watch %s", dir);
+        close(fd);
+        return NULL;
+    }
+
+    ALLOC_OBJ_CLEAR(cc, struct ccd_cache);
+    cc->dir = string_alloc(dir, NULL);
+    cc->inotify_fd = fd;
+    cc->hash = hash_init(256, get_random(), ccd_cache_hash_function,
+                         ccd_cache_compare_function);
+    if (preload)
+    {
+        cc->preload = opendir(dir);
+        if (!cc->preload)
+        {
+            msg(M_WARN | M_ERRNO, "WARNING: CCD cache: cannot preload %s", dir);
+        }
+    }
+    msg(D_MULTI_LOW, "CCD cache: watching %s", dir);
+    return cc;
+}
+
+void
+ccd_cache_free(struct ccd_cache *cc)
+{
+    if (cc)
+    {
+        ccd_cache_flush(cc);
+        hash_free(cc->hash);
+        if (cc->inotify_fd >= 0)
+        {
+            close(cc->inotify_fd);
+        }
+        if (cc->preload)
+        {
+            closedir(cc->preload);
+        }
+        free(cc->dir);
+        free(cc);
+    }
+}
+
+const struct options_file *
+ccd_cache_get(struct ccd_cache *cc, const char *name)
+{
+    struct gc_arena gc = gc_new();
+    struct ccd_cache_entry *e = NULL;
+    const char *path;
+
+    ccd_cache_process_events(cc);
+    if (cc->inotify_fd < 0)
+    {
+        /* not caching anymore, entries only live until the next call */
+        ccd_cache_flush(cc);
+    }
+
+    path = platform_gen_path(cc->dir, name, &gc);
+    if (!path)
+    {
+        goto done;
+    }
+
+    /* the name as it appears in the directory, and in inotify events */
+    name = path + strlen(cc->dir) + 1;
+    e = hash_lookup(cc->hash, name);
+    if (!e)
+    {
+        ALLOC_OBJ_CLEAR(e, struct ccd_cache_entry);
+        e->name = string_alloc(name, NULL);
+        e->gc = gc_new();
+        e->file = options_file_parse(path, D_IMPORT_ERRORS|M_OPTERR, &e->gc);
+        if (!e->file)
+        {
+            ccd_cache_add_missing(cc, e);
+        }
+        hash_add(cc->hash, e->name, e, false);
+    }
+
+done:
+    gc_free(&gc);
+    return e ? e->file : NULL;
+}
+
+void
+ccd_cache_preload(struct ccd_cache *cc, const int max)
+{
+    int n = 0;
+
+    while (cc->preload && n < max)
+    {
+        const struct dirent *de = readdir(cc->preload);
+
+        if (!de)
+        {
+            msg(D_MULTI_LOW, "CCD cache: preloaded %d files from %s",
+                cc->n_preloaded, cc->dir);
+            closedir(cc->preload);
+            cc->preload = NULL;
+        }
+        else if (de->d_name[0] != '.')
+        {
+            if (ccd_cache_get(cc, de->d_name))
+            {
+                ++cc->n_preloaded;
+            }
+            ++n;
+        }
+    }
+}
+
+#endif /* ifdef HAVE_SYS_INOTIFY_H */
@@ -0,0 +1,84 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Cache of parsed --client-config-dir files.
+ *
+ * Files are read and tokenized on first use (or by the preload pass) and
+ * kept in memory, including the fact that there is no file for a name
+ * (for at most CCD_CACHE_MAX_MISSING names).
+ * An inotify watch on the directory drops entries when their file is
+ * created, changed, renamed or removed, so the next connect reads the
+ * file again.  Changes made on other hosts sharing the directory over
+ * network storage are not noticed by inotify.
+ */
+
+#ifndef CCD_CACHE_H
+#define CCD_CACHE_H
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+#include "options.h"
+
+/* files read per second by the preload pass */
+#define CCD_CACHE_PRELOAD_BATCH 256
+
+/* names without a file that are remembered, the oldest are dropped */
+#define CCD_CACHE_MAX_MISSING 4096
+
+struct ccd_cache;
+
+/**
+ * Set up a cache for the files in \c dir.
+ *
+ * @param preload  read all files of the directory in the background,
+ *                 see ccd_cache_preload()
+ *
+ * @return the cache, or NULL if the directory cannot be watched
+ */
+struct ccd_cache *ccd_cache_new(const char *dir, const bool preload);
+
+void ccd_cache_free(struct ccd_cache *cc);
+
+/**
+ * Get the parsed file for \c name in the cached directory.  The result
+ * is valid until the next call to a ccd_cache function.
+ *
+ * @param name  the common name, mapped to a file name like
+ *              platform_gen_path() does
+ *
+ * @return the parsed file, or NULL if there is no such file
+ */
+const struct options_file *ccd_cache_get(struct ccd_cache *cc,
+                                         const char *name);
+
+/**
+ * Continue the preload pass, reading at most \c max files.  Called from
+ * the once per second housekeeping, so that a large directory is loaded
+ * without stalling the server.
+ */
+void ccd_cache_preload(struct ccd_cache *cc, const int max);
+
+#endif /* ifdef HAVE_SYS_INOTIFY_H */
+
+#endif /* ifndef CCD_CACHE_H */
@@ -34,20 +34,151 @@
 #include "socket.h"
 #include "memdbg.h"
 
-static bool
+#define CN_HASH_MIN 64
+
+/* grow a gc allocated array so that it can hold one more element */
+static void *
+cn_grow(void *array, const int n, int *capacity, const size_t size,
+        struct gc_arena *gc)
+{
+    void *ret;
+
+    if (n < *capacity)
+    {
+        return array;
+    }
+    *capacity = max_int(*capacity * 2, 16);
+    ret = gc_malloc(array_mult_safe(size, *capacity, 0), false, gc);
+    if (n)
+    {
+        memcpy(ret, array, size * n);
+    }
+    return ret;
+}
+
+static inline in_addr_t
+cn_key(const struct client_nat_entry *e, const int direction)
+{
+    return direction ? e->foreign_network : e->network;
+}
+
+/*
+ * Return the hash slot of the first rule of the given type and direction
+ * whose netmask is mask and whose network is key, or the empty slot
+ * where such a rule would be inserted.
+ */
+static int
+cn_slot(const struct client_nat_option_list *list, const int type,
+        const in_addr_t mask, const in_addr_t key, const int direction)
+{
+    const unsigned int m = list->hash_size - 1;
+    uint32_t h = (key ^ (mask * 0x9e3779b1)) * 0x85ebca6b;
+    unsigned int i = ((h ^ (h >> 16)) + (direction << 1) + type) & m;
+
+    while (list->hash[i])
+    {
+        const int v = list->hash[i] - 1;
+        const struct client_nat_entry *e = &list->entries[v >> 1];
+        if ((v & 1) == direction && e->type == type && e->netmask == mask
+            && cn_key(e, direction) == key)
+        {
+            break;
+        }
+        i = (i + 1) & m;
+    }
+    return i;
+}
+
+static void
+cn_hash_insert(struct client_nat_option_list *list, const int index)
+{
+    const struct client_nat_entry *e = &list->entries[index];
+    int direction;
+
+    for (direction = CN_OUTGOING; direction <= CN_INCOMING; ++direction)
+    {
+        const int i = cn_slot(list, e->type, e->netmask, cn_key(e, direction), direction);
+
+        /* an earlier rule for the same network takes precedence */
+        if (!list->hash[i])
+        {
+            list->hash[i] = ((index << 1) | direction) + 1;
+        }
+    }
+}
+
+static void
+cn_rehash(struct client_nat_option_list *list, const int size)
+{
+    int i;
+
+    list->hash_size = size;
+    ALLOC_ARRAY_CLEAR_GC(list->hash, int, size, list->gc);
+    for (i = 0; i < list->n; ++i)
+    {
+        cn_hash_insert(list, i);
+    }
+}
+
+static void
 add_entry(struct client_nat_option_list *dest,
           const struct client_nat_entry *e)
 {
-    if (dest->n >= MAX_CLIENT_NAT)
+    const int type = e->type;
+    int i;
+
+    dest->entries = cn_grow(dest->entries, dest->n, &dest->capacity,
+                            sizeof(*e), dest->gc);
+    dest->entries[dest->n] = *e;
+
+    for (i = 0; i < dest->n_masks[type]; ++i)
     {
-        msg(M_WARN, "WARNING: client-nat table overflow (max %d entries)", MAX_CLIENT_NAT);
-        return false;
+        if (dest->masks[type][i] == e->netmask)
+        {
+            break;
+        }
     }
-    else
+    if (i == dest->n_masks[type])
+    {
+        dest->masks[type] = cn_grow(dest->masks[type], dest->n_masks[type],
+                                    &dest->masks_capacity[type],
+                                    sizeof(in_addr_t), dest->gc);
+        dest->masks[type][dest->n_masks[type]++] = e->netmask;
+    }
+
+    /* every rule takes two slots, keep the table at most half full */
+    if (4 * (dest->n + 1) > dest->hash_size)
+    {
+        cn_rehash(dest, max_int(dest->hash_size * 2, CN_HASH_MIN));
+    }
+    cn_hash_insert(dest, dest->n++);
+}
+
+/*
+ * Return the first rule of the given type which maps addr in the given
+ * direction, or NULL.
+ */
+static const struct client_nat_entry *
+cn_lookup(const struct client_nat_option_list *list, const int type,
+          const in_addr_t addr, const int direction)
+{
+    const struct client_nat_entry *ret = NULL;
+    int i;
+
+    for (i = 0; i < list->n_masks[type]; ++i)
     {
-        dest->entries[dest->n++] = *e;
-        return true;
+        const in_addr_t mask = list->masks[type][i];
+        const int v = list->hash[cn_slot(list, type, mask, addr & mask, direction)];
+        if (v)
+        {
+            const struct client_nat_entry *e = &list->entries[(v - 1) >> 1];
+            if (!ret || e < ret)
+            {
+                ret = e;
+            }
+        }
     }
+    return ret;
 }
 
 void
@@ -78,15 +209,15 @@ new_client_nat_list(struct gc_arena *gc)
 {
     struct client_nat_option_list *ret;
     ALLOC_OBJ_CLEAR_GC(ret, struct client_nat_option_list, gc);
+    ret->gc = gc;
     return ret;
 }
 
 struct client_nat_option_list *
 clone_client_nat_option_list(const struct client_nat_option_list *src, struct gc_arena *gc)
 {
-    struct client_nat_option_list *ret;
-    ALLOC_OBJ_GC(ret, struct client_nat_option_list, gc);
-    *ret = *src;
+    struct client_nat_option_list *ret = new_client_nat_list(gc);
+    copy_client_nat_option_list(ret, src);
     return ret;
 }
 
@@ -97,10 +228,7 @@ copy_client_nat_option_list(struct client_nat_option_list *dest,
     int i;
     for (i = 0; i < src->n; ++i)
     {
-        if (!add_entry(dest, &src->entries[i]))
-        {
-            break;
-        }
+        add_entry(dest, &src->entries[i]);
     }
 }
 
@@ -191,87 +319,109 @@ print_pkt(struct openvpn_iphdr *iph, const char *prefix, const int direction, co
     gc_free(&gc);
 }
 
+/*
+ * Rewrite the address at addr_ptr with rule e, accumulating the
+ * checksum difference.
+ */
+static void
+cn_rewrite(const struct client_nat_entry *e, const int direction,
+           uint32_t *addr_ptr, int *accumulate)
+{
+    uint32_t addr = *addr_ptr;
+
+    /* pre-adjust IP checksum */
+    ADD_CHECKSUM_32(*accumulate, addr);
+
+    /* do NAT transform */
+    addr = (addr & ~e->netmask) | (direction ? e->network : e->foreign_network);
+
+    /* post-adjust IP checksum */
+    SUB_CHECKSUM_32(*accumulate, addr);
+
+    /* write the modified address to packet */
+    *addr_ptr = addr;
+}
+
 void
 client_nat_transform(const struct client_nat_option_list *list,
-                     struct buffer *ipbuf,
+                     struct buffer *buf,
+                     const struct packet_info *pi,
                      const int direction)
 {
-    struct ip_tcp_udp_hdr *h = (struct ip_tcp_udp_hdr *) BPTR(ipbuf);
-    int i;
-    uint32_t addr, *addr_ptr;
-    const uint32_t *from, *to;
+    struct openvpn_iphdr *iph;
+    const struct client_nat_entry *snat, *dnat;
     int accumulate = 0;
-    unsigned int amask;
-    unsigned int alog = 0;
+
+    if (!list->n || pi->ip_ver != 4)
+    {
+        return;
+    }
+    iph = (struct openvpn_iphdr *) (BPTR(buf) + pi->ip_offset);
 
     if (check_debug_level(D_CLIENT_NAT))
     {
-        print_pkt(&h->ip, "BEFORE", direction, D_CLIENT_NAT);
+        print_pkt(iph, "BEFORE", direction, D_CLIENT_NAT);
     }
 
-    for (i = 0; i < list->n; ++i)
+    /*
+     * Outgoing packets have their source rewritten by snat rules and
+     * their destination by dnat rules, incoming packets the reverse.
+     */
+    snat = cn_lookup(list, direction ? CN_DNAT : CN_SNAT, iph->saddr, direction);
+    dnat = cn_lookup(list, direction ? CN_SNAT : CN_DNAT, iph->daddr, direction);
+    if (!snat && !dnat)
     {
-        const struct client_nat_entry *e = &list->entries[i]; /* current NAT rule */
-        if (e->type ^ direction)
-        {
-            addr = *(addr_ptr = &h->ip.daddr);
-            amask = 2;
-        }
-        else
-        {
-            addr = *(addr_ptr = &h->ip.saddr);
-            amask = 1;
-        }
-        if (direction)
-        {
-            from = &e->foreign_network;
-            to = &e->network;
-        }
-        else
-        {
-            from = &e->network;
-            to = &e->foreign_network;
-        }
+        return;
+    }
 
-        if (((addr & e->netmask) == *from) && !(amask & alog))
-        {
-            /* pre-adjust IP checksum */
-            ADD_CHECKSUM_32(accumulate, addr);
+    if (snat)
+    {
+        cn_rewrite(snat, direction, &iph->saddr, &accumulate);
+    }
+    if (dnat)
+    {
+        cn_rewrite(dnat, direction, &iph->daddr, &accumulate);
+    }
 
-            /* do NAT transform */
-            addr = (addr & ~e->netmask) | *to;
+    if (check_debug_level(D_CLIENT_NAT))
+    {
+        print_pkt(iph, "AFTER", direction, D_CLIENT_NAT);
+    }
 
-            /* post-adjust IP checksum */
-            SUB_CHECKSUM_32(accumulate, addr);
+    ADJUST_CHECKSUM(accumulate, iph->check);
 
-            /* write the modified address to packet */
-            *addr_ptr = addr;
+    /*
+     * The TCP and UDP checksums cover the addresses through the pseudo
+     * header.  packet_info_parse() only locates the L4 header of the
+     * first fragment.
+     */
+    if (!pi->l4_offset)
+    {
+        return;
+    }
 
-            /* mark as modified */
-            alog |= amask;
+    if (pi->l4_proto == OPENVPN_IPPROTO_TCP)
+    {
+        if (pi->l4_len >= (int) sizeof(struct openvpn_tcphdr))
+        {
+            struct openvpn_tcphdr *tc = (struct openvpn_tcphdr *) (BPTR(buf) + pi->l4_offset);
+            ADJUST_CHECKSUM(accumulate, tc->check);
         }
     }
-    if (alog)
+    else if (pi->l4_proto == OPENVPN_IPPROTO_UDP)
     {
-        if (check_debug_level(D_CLIENT_NAT))
+        if (pi->l4_len >= (int) sizeof(struct openvpn_udphdr))
         {
-            print_pkt(&h->ip, "AFTER", direction, D_CLIENT_NAT);
-        }
-
-        ADJUST_CHECKSUM(accumulate, h->ip.check);
+            struct openvpn_udphdr *uh = (struct openvpn_udphdr *) (BPTR(buf) + pi->l4_offset);
 
-        if (h->ip.protocol == OPENVPN_IPPROTO_TCP)
-        {
-            if (BLEN(ipbuf) >= sizeof(struct openvpn_iphdr) + sizeof(struct openvpn_tcphdr))
-            {
-                ADJUST_CHECKSUM(accumulate, h->u.tcp.check);
-            }
-        }
-        else if (h->ip.protocol == OPENVPN_IPPROTO_UDP)
-        {
-            if (BLEN(ipbuf) >= sizeof(struct openvpn_iphdr) + sizeof(struct openvpn_udphdr))
+            /* a zero UDP checksum means none was computed */
+            if (uh->check)
             {
-                ADJUST_CHECKSUM(accumulate, h->u.udp.check);
+                ADJUST_CHECKSUM(accumulate, uh->check);
+                if (!uh->check)
+                {
+                    uh->check = 0xffff;
+                }
             }
         }
     }
@@ -25,8 +25,7 @@
 #define CLINAT_H
 
 #include "buffer.h"
-
-#define MAX_CLIENT_NAT 64
+#include "proto.h"
 
 #define CN_OUTGOING 0
 #define CN_INCOMING 1
@@ -40,9 +39,28 @@ struct client_nat_entry {
     in_addr_t foreign_network;
 };
 
+/*
+ * The rules are kept in configuration order, the first matching rule
+ * wins.  To find it without scanning every rule, each rule is hashed
+ * twice, by network for outgoing packets and by foreign network for
+ * incoming ones, and a packet address is looked up once for each
+ * distinct netmask of the rule type.
+ */
 struct client_nat_option_list {
     int n;
-    struct client_nat_entry entries[MAX_CLIENT_NAT];
+    int capacity;
+    struct client_nat_entry *entries;
+
+    /* distinct netmasks per rule type */
+    int n_masks[2];
+    int masks_capacity[2];
+    in_addr_t *masks[2];
+
+    /* open addressing, slot is ((entry index << 1) | direction) + 1 */
+    int hash_size;              /* power of 2 */
+    int *hash;
+
+    struct gc_arena *gc;
 };
 
 struct client_nat_option_list *new_client_nat_list(struct gc_arena *gc);
@@ -61,7 +79,8 @@ void add_client_nat_to_option_list(struct client_nat_option_list *dest,
                                    int msglevel);
 
 void client_nat_transform(const struct client_nat_option_list *list,
-                          struct buffer *ipbuf,
+                          struct buffer *buf,
+                          const struct packet_info *pi,
                           const int direction);
 
 #endif /* if !defined(CLINAT_H) */
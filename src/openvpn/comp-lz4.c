@@ -35,6 +35,7 @@
 
 #include "comp.h"
 #include "error.h"
+#include "perf.h"
 
 #include "memdbg.h"
 
@@ -52,11 +53,63 @@ lz4v2_compress_init(struct compress_context *compctx)
     msg(D_INIT_MEDIUM, "LZ4v2 compression initializing");
 }
 
+static void
+lz4stream_compress_init(struct compress_context *compctx)
+{
+    struct lz4_workspace *ws = &compctx->wu.lz4;
+
+    /*
+     * Even over TCP a packet can be dropped after it was compressed, for
+     * example by TLS or a full output queue, so epochs are used there
+     * too, only longer.
+     */
+    if (!ws->resync)
+    {
+        ws->resync = compctx->reliable ? COMP_RESYNC_MAX : COMP_RESYNC_DEFAULT;
+    }
+    msg(D_INIT_MEDIUM, "LZ4 stream compression initializing, dictionary %d bytes, "
+        "resync every %d packets", ws->dict_size, ws->resync);
+}
+
 static void
 lz4_compress_uninit(struct compress_context *compctx)
 {
 }
 
+static void
+lz4stream_compress_uninit(struct compress_context *compctx)
+{
+    struct lz4_workspace *ws = &compctx->wu.lz4;
+
+    if (ws->stream)
+    {
+        LZ4_freeStream(ws->stream);
+    }
+    free(ws->enc_hist);
+    free(ws->dec_hist);
+}
+
+static int
+lz4stream_workspace_bytes(const struct compress_context *compctx)
+{
+    const struct lz4_workspace *ws = &compctx->wu.lz4;
+    int ret = 0;
+
+    if (ws->stream)
+    {
+        ret += LZ4_sizeofState();
+    }
+    if (ws->enc_hist)
+    {
+        ret += ws->enc_hist_size;
+    }
+    if (ws->dec_hist)
+    {
+        ret += ws->dec_hist_size;
+    }
+    return ret;
+}
+
 static bool
 do_lz4_compress(struct buffer *buf,
                 struct buffer *work,
@@ -67,10 +120,14 @@ do_lz4_compress(struct buffer *buf,
      * In order to attempt compression, length must be at least COMPRESS_THRESHOLD.
      * and asymmetric compression must be disabled
      */
-    if (buf->len >= COMPRESS_THRESHOLD && (compctx->flags & COMP_F_ALLOW_COMPRESS))
+    uint32_t flow;
+
+    if (buf->len >= COMPRESS_THRESHOLD && (compctx->flags & COMP_F_ALLOW_COMPRESS)
+        && comp_adaptive_test(compctx, buf, &flow))
     {
         const size_t ps = PAYLOAD_SIZE(frame);
         int zlen_max = ps + COMP_EXTRA_BUFFER(ps);
+        const uint64_t start = perf_now();
         int zlen;
 
         ASSERT(buf_init(work, FRAME_HEADROOM(frame)));
@@ -99,6 +156,7 @@ do_lz4_compress(struct buffer *buf,
         dmsg(D_COMP, "LZ4 compress %d -> %d", buf->len, work->len);
         compctx->pre_compress += buf->len;
         compctx->post_compress += work->len;
+        comp_adaptive_result(compctx, flow, buf->len, work->len, start);
         return true;
     }
     return false;
@@ -182,6 +240,154 @@ lz4v2_compress(struct buffer *buf, struct buffer work,
     }
 }
 
+/*
+ * Header of an lz4-stream packet, after COMP_ALGV2_INDICATOR_BYTE and
+ * COMP_ALGV2_LZ4_STREAM_BYTE: the epoch in the high and the log2 of the
+ * dictionary size in KiB in the low nibble, then the sequence number of
+ * the packet in its epoch.  The first packet of an epoch is compressed
+ * without dictionary.
+ */
+#define LZ4STREAM_HEADER_LEN 4
+
+/*
+ * A packet that LZ4 cannot make smaller is sent raw, but stays part of
+ * the dictionary, so that the next packets can refer to it, unless it is
+ * this long.  Longer packets would exceed the MTU.
+ */
+#define LZ4STREAM_RAW_MAX 512
+
+static int
+lz4stream_dict_log(int dict_size)
+{
+    int n = 0;
+    while ((COMP_DICT_MIN << n) < dict_size)
+    {
+        ++n;
+    }
+    return n;
+}
+
+static void
+lz4stream_new_epoch(struct lz4_workspace *ws)
+{
+    ws->enc_started = false;
+    ws->enc_seq = 0;
+    ws->enc_epoch = (ws->enc_epoch + 1) & 0x0F;
+}
+
+static void
+lz4stream_compress(struct buffer *buf, struct buffer work,
+                   struct compress_context *compctx,
+                   const struct frame *frame)
+{
+    struct lz4_workspace *ws = &compctx->wu.lz4;
+    uint32_t flow;
+
+    if (buf->len <= 0)
+    {
+        return;
+    }
+
+    if (buf->len >= COMPRESS_THRESHOLD && (compctx->flags & COMP_F_ALLOW_COMPRESS)
+        && comp_adaptive_test(compctx, buf, &flow))
+    {
+        const size_t ps = PAYLOAD_SIZE(frame);
+        int zlen_max = ps + COMP_EXTRA_BUFFER(ps);
+        const uint64_t start = perf_now();
+        const int len = BLEN(buf);
+        uint8_t *in;
+        int zlen;
+
+        if (len > ps)
+        {
+            dmsg(D_COMP_ERRORS, "LZ4 compression buffer overflow");
+            buf->len = 0;
+            return;
+        }
+
+        if (!ws->stream)
+        {
+            ws->stream = LZ4_createStream();
+            check_malloc_return(ws->stream);
+            ws->enc_hist_size = ws->dict_size + ps;
+            ws->enc_hist = malloc(ws->enc_hist_size);
+            check_malloc_return(ws->enc_hist);
+        }
+
+        /*
+         * Keep the history contiguous with the input, so that LZ4 can use
+         * it as prefix, and short enough that it never references more
+         * than dict_size bytes back.
+         */
+        if (!ws->enc_started)
+        {
+            LZ4_loadDict(ws->stream, NULL, 0);
+            ws->enc_hist_len = 0;
+            ws->enc_started = true;
+        }
+        else if (ws->enc_hist_len + len > ws->dict_size)
+        {
+            ws->enc_hist_len = LZ4_saveDict(ws->stream, (char *)ws->enc_hist,
+                                            ws->dict_size / 2);
+        }
+        in = ws->enc_hist + ws->enc_hist_len;
+        memcpy(in, BPTR(buf), len);
+
+        ASSERT(buf_init(&work, FRAME_HEADROOM(frame)));
+        ASSERT(buf_safe(&work, zlen_max));
+        zlen = LZ4_compress_fast_continue(ws->stream, (const char *)in,
+                                          (char *)BPTR(&work), len, zlen_max, 1);
+        if (zlen <= 0)
+        {
+            dmsg(D_COMP_ERRORS, "LZ4 compression error");
+            lz4stream_new_epoch(ws);
+            buf->len = 0;
+            return;
+        }
+        /* without history, even repetitive packets do not get smaller */
+        comp_adaptive_result(compctx, ws->enc_hist_len ? flow : 0, len, zlen, start);
+
+        if (zlen + LZ4STREAM_HEADER_LEN < len || len <= LZ4STREAM_RAW_MAX)
+        {
+            const bool raw = zlen + LZ4STREAM_HEADER_LEN >= len;
+
+            if (raw)
+            {
+                work = *buf;
+            }
+            else
+            {
+                ASSERT(buf_safe(&work, zlen));
+                work.len = zlen;
+            }
+            dmsg(D_COMP, "LZ4 stream compress %d -> %d, seq=%d", len, work.len, ws->enc_seq);
+            compctx->pre_compress += len;
+            compctx->post_compress += work.len;
+
+            ASSERT(buf_prepend(&work, LZ4STREAM_HEADER_LEN));
+            uint8_t *head = BPTR(&work);
+            head[0] = COMP_ALGV2_INDICATOR_BYTE;
+            head[1] = raw ? COMP_ALGV2_LZ4_STREAM_RAW_BYTE : COMP_ALGV2_LZ4_STREAM_BYTE;
+            head[2] = (ws->enc_epoch << 4) | lz4stream_dict_log(ws->dict_size);
+            head[3] = ws->enc_seq;
+            *buf = work;
+
+            ws->enc_hist_len += len;
+            ++ws->enc_seq;
+            if (ws->enc_seq == ws->resync)
+            {
+                lz4stream_new_epoch(ws);
+            }
+            return;
+        }
+
+        /* sent outside the stream, so take it out of the history again */
+        LZ4_loadDict(ws->stream, (const char *)ws->enc_hist, ws->enc_hist_len);
+    }
+
+    compv2_escape_data_ifneeded(buf);
+}
+
 static void
 do_lz4_decompress(size_t zlen_max,
                   struct buffer *work,
@@ -294,12 +500,140 @@ lz4v2_decompress(struct buffer *buf, struct buffer work,
     }
 }
 
+/*
+ * Decompress an lz4-stream packet, with the packets before it in its
+ * epoch as dictionary.  After a lost or reordered packet, packets are
+ * dropped until the next epoch starts.  Packets which need a larger
+ * dictionary than our own --compress-dict are dropped, so that the
+ * peer cannot make us allocate more.
+ */
+static void
+do_lz4stream_decompress(size_t zlen_max,
+                        struct buffer *work,
+                        struct buffer *buf,
+                        struct compress_context *compctx,
+                        const bool raw)
+{
+    struct lz4_workspace *ws = &compctx->wu.lz4;
+    const uint8_t *head = BPTR(buf);
+    const uint8_t epoch = head[2] >> 4;
+    const int dict_size = COMP_DICT_MIN << (head[2] & 0x0F);
+    const uint8_t seq = head[3];
+    int uncomp_len;
+
+    if (dict_size > ws->dict_size)
+    {
+        dmsg(D_COMP_ERRORS, "LZ4 stream dictionary of %d bytes is larger than "
+             "--compress-dict %d", dict_size, ws->dict_size);
+        buf->len = 0;
+        return;
+    }
+
+    if (seq == 0 && (!ws->dec_synced || epoch != ws->dec_epoch))
+    {
+        /* start of an epoch */
+        if (dict_size != ws->dec_dict_size)
+        {
+            free(ws->dec_hist);
+            ws->dec_dict_size = dict_size;
+            ws->dec_hist_size = dict_size + dict_size / 2 + zlen_max;
+            ws->dec_hist = malloc(ws->dec_hist_size);
+            check_malloc_return(ws->dec_hist);
+        }
+        ws->dec_hist_len = 0;
+        ws->dec_epoch = epoch;
+        ws->dec_synced = true;
+    }
+    else if (!ws->dec_synced || epoch != ws->dec_epoch || seq != ws->dec_seq)
+    {
+        if (ws->dec_synced)
+        {
+            dmsg(D_COMP_LOW, "LZ4 stream lost sync, epoch %d seq %d, expected %d",
+                 epoch, seq, ws->dec_seq);
+        }
+        ws->dec_synced = false;
+        ++compctx->desync_drops;
+        buf->len = 0;
+        return;
+    }
+
+    /* keep at least the last dec_dict_size bytes, contiguous with the output */
+    if (ws->dec_hist_len + zlen_max > ws->dec_hist_size)
+    {
+        memmove(ws->dec_hist, ws->dec_hist + ws->dec_hist_len - ws->dec_dict_size,
+                ws->dec_dict_size);
+        ws->dec_hist_len = ws->dec_dict_size;
+    }
+
+    buf_advance(buf, LZ4STREAM_HEADER_LEN);
+    if (raw)
+    {
+        uncomp_len = min_int(BLEN(buf), zlen_max);
+        memcpy(ws->dec_hist + ws->dec_hist_len, BPTR(buf), uncomp_len);
+    }
+    else
+    {
+        uncomp_len = LZ4_decompress_safe_usingDict((const char *)BPTR(buf),
+                                                   (char *)ws->dec_hist + ws->dec_hist_len,
+                                                   BLEN(buf), zlen_max,
+                                                   (const char *)ws->dec_hist,
+                                                   ws->dec_hist_len);
+    }
+    if (uncomp_len <= 0)
+    {
+        dmsg(D_COMP_ERRORS, "LZ4 stream decompression error: %d", uncomp_len);
+        ws->dec_synced = false;
+        buf->len = 0;
+        return;
+    }
+
+    ASSERT(buf_safe(work, uncomp_len));
+    memcpy(BPTR(work), ws->dec_hist + ws->dec_hist_len, uncomp_len);
+    work->len = uncomp_len;
+    ws->dec_hist_len += uncomp_len;
+    ws->dec_seq = seq + 1;
+
+    dmsg(D_COMP, "LZ4 stream decompress %d -> %d, seq=%d", buf->len, work->len, seq);
+    compctx->pre_decompress += buf->len;
+    compctx->post_decompress += work->len;
+
+    *buf = *work;
+}
+
+static void
+lz4stream_decompress(struct buffer *buf, struct buffer work,
+                     struct compress_context *compctx,
+                     const struct frame *frame)
+{
+    size_t zlen_max = EXPANDED_SIZE(frame);
+
+    if (buf->len <= 0 || *BPTR(buf) != COMP_ALGV2_INDICATOR_BYTE)
+    {
+        return;
+    }
+
+    if (buf->len >= LZ4STREAM_HEADER_LEN
+        && (BPTR(buf)[1] == COMP_ALGV2_LZ4_STREAM_BYTE
+            || BPTR(buf)[1] == COMP_ALGV2_LZ4_STREAM_RAW_BYTE))
+    {
+        ASSERT(buf_init(&work, FRAME_HEADROOM(frame)));
+        do_lz4stream_decompress(zlen_max, &work, buf, compctx,
+                                BPTR(buf)[1] == COMP_ALGV2_LZ4_STREAM_RAW_BYTE);
+    }
+    else
+    {
+        /* packets which were not compressed, or not with a dictionary */
+        lz4v2_decompress(buf, work, compctx, frame);
+    }
+}
+
 const struct compress_alg lz4_alg = {
     "lz4",
     lz4_compress_init,
     lz4_compress_uninit,
     lz4_compress,
-    lz4_decompress
+    lz4_decompress,
+    NULL
 };
 
 const struct compress_alg lz4v2_alg = {
@@ -307,6 +641,16 @@ const struct compress_alg lz4v2_alg = {
     lz4v2_compress_init,
     lz4_compress_uninit,
     lz4v2_compress,
-    lz4v2_decompress
+    lz4v2_decompress,
+    NULL
+};
+
+const struct compress_alg lz4stream_alg = {
+    "lz4-stream",
+    lz4stream_compress_init,
+    lz4stream_compress_uninit,
+    lz4stream_compress,
+    lz4stream_decompress,
+    lz4stream_workspace_bytes
 };
 #endif /* ENABLE_LZ4 */
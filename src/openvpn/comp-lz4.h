@@ -28,13 +28,39 @@
 #if defined(ENABLE_LZ4)
 
 #include "buffer.h"
+#include "common.h"
 
 extern const struct compress_alg lz4_alg;
 extern const struct compress_alg lz4v2_alg;
+extern const struct compress_alg lz4stream_alg;
 
+/*
+ * State of lz4-stream, which compresses each packet with the data of the
+ * previous packets in the same direction as dictionary.  The compressor
+ * references at most dict_size bytes back, the decompressor keeps at least
+ * that many bytes of history.  The buffers are allocated when the first
+ * packet is compressed or decompressed.
+ */
 struct lz4_workspace
 {
-    int dummy;
+    int dict_size;
+    int resync;             /* packets per epoch */
+
+    void *stream;           /* LZ4_stream_t */
+    uint8_t *enc_hist;      /* packets compressed in this epoch */
+    int enc_hist_size;
+    int enc_hist_len;
+    bool enc_started;       /* first packet of the epoch was compressed */
+    uint8_t enc_epoch;
+    uint8_t enc_seq;
+
+    uint8_t *dec_hist;      /* packets decompressed in this epoch */
+    int dec_hist_size;
+    int dec_hist_len;
+    int dec_dict_size;      /* dict_size of our peer */
+    bool dec_synced;
+    uint8_t dec_epoch;
+    uint8_t dec_seq;        /* sequence number of the next packet */
 };
 
 #endif /* ENABLE_LZ4 */
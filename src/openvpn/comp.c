@@ -34,11 +34,14 @@
 #include "comp.h"
 #include "error.h"
 #include "otime.h"
+#include "list.h"
+#include "perf.h"
+#include "proto.h"
 
 #include "memdbg.h"
 
 struct compress_context *
-comp_init(const struct compress_options *opt)
+comp_init(const struct compress_options *opt, bool reliable, int tunnel_type)
 {
     struct compress_context *compctx = NULL;
     switch (opt->alg)
@@ -75,10 +78,20 @@ comp_init(const struct compress_options *opt)
             compctx->flags = opt->flags;
             compctx->alg = lz4v2_alg;
             break;
+
+        case COMP_ALGV2_LZ4_STREAM:
+            ALLOC_OBJ_CLEAR(compctx, struct compress_context);
+            compctx->flags = opt->flags;
+            compctx->alg = lz4stream_alg;
+            compctx->wu.lz4.dict_size = opt->dict_size ? opt->dict_size : COMP_DICT_DEFAULT;
+            compctx->wu.lz4.resync = opt->resync; /* 0 for the default */
+            break;
 #endif
     }
     if (compctx)
     {
+        compctx->reliable = reliable;
+        compctx->tunnel_type = tunnel_type;
         (*compctx->alg.compress_init)(compctx);
     }
 
@@ -136,10 +149,179 @@ comp_print_stats(const struct compress_context *compctx, struct status_output *s
 {
     if (compctx)
     {
+        const struct compress_adaptive *ac = &compctx->ac;
+
         status_printf(so, "pre-compress bytes," counter_format, compctx->pre_compress);
         status_printf(so, "post-compress bytes," counter_format, compctx->post_compress);
         status_printf(so, "pre-decompress bytes," counter_format, compctx->pre_decompress);
         status_printf(so, "post-decompress bytes," counter_format, compctx->post_decompress);
+        if (compctx->flags & COMP_F_ADAPTIVE)
+        {
+            status_printf(so, "compressed packets," counter_format, ac->n_compressed);
+            status_printf(so, "compressed packets without gain," counter_format, ac->n_no_gain);
+            status_printf(so, "compress skipped by sampling," counter_format, ac->n_skip_sample);
+            status_printf(so, "compress skipped by flow," counter_format, ac->n_skip_flow);
+            status_printf(so, "compress time usec," counter_format, ac->compress_ns / 1000);
+        }
+        if (compctx->desync_drops)
+        {
+            status_printf(so, "decompress dictionary desync drops," counter_format,
+                          compctx->desync_drops);
+        }
+    }
+}
+
+int
+comp_memory_bytes(const struct compress_context *compctx)
+{
+    int ret = sizeof(*compctx);
+
+    if (compctx->alg.workspace_bytes)
+    {
+        ret += (*compctx->alg.workspace_bytes)(compctx);
+    }
+    return ret;
+}
+
+/*
+ * Find the TCP/UDP flow and the start of the payload of an IP packet,
+ * or of an ethernet frame carrying one in --dev tap mode.
+ * Returns a flow key of 0 if the packet is not IP.
+ */
+static uint32_t
+comp_flow_key(const struct compress_context *compctx, const struct buffer *buf,
+              int *payload)
+{
+    const uint8_t *p = BPTR(buf);
+    const int len = BLEN(buf);
+    struct packet_info pi;
+    uint8_t tuple[37];
+    int hlen, addrlen;
+
+    *payload = 0;
+    packet_info_parse(&pi, compctx->tunnel_type, buf);
+    if (pi.ip_ver == 4 && len - pi.ip_offset >= 20)
+    {
+        addrlen = 8;
+        memcpy(tuple, p + pi.ip_offset + 12, addrlen);
+    }
+    else if (pi.ip_ver == 6 && pi.l4_offset)
+    {
+        addrlen = 32;
+        memcpy(tuple, p + pi.ip_offset + 8, addrlen);
+    }
+    else
+    {
+        return 0;
+    }
+    tuple[addrlen] = pi.l4_proto;
+    memset(tuple + addrlen + 1, 0, 4);
+
+    hlen = pi.l4_offset ? pi.l4_offset : pi.ip_offset;
+    if (pi.l4_proto == OPENVPN_IPPROTO_TCP && pi.l4_offset && pi.l4_len >= 20)
+    {
+        memcpy(tuple + addrlen + 1, p + hlen, 4);
+        hlen += (p[hlen + 12] >> 4) * 4;
+    }
+    else if (pi.l4_proto == OPENVPN_IPPROTO_UDP && pi.l4_offset && pi.l4_len >= 8)
+    {
+        memcpy(tuple + addrlen + 1, p + hlen, 4);
+        hlen += 8;
+    }
+    *payload = min_int(hlen, len);
+
+    return max_uint(hash_func(tuple, addrlen + 5, 0), 1);
+}
+
+/*
+ * Return true if the sampled bytes look random.  64 random bytes have
+ * about 57 distinct values, text and headers usually less than 40.
+ */
+static bool
+comp_sample_random(const uint8_t *p, const int n)
+{
+    uint32_t seen[8] = { 0 };
+    int distinct = 0;
+
+    for (int i = 0; i < n; ++i)
+    {
+        const uint32_t bit = 1u << (p[i] & 31);
+        if (!(seen[p[i] >> 5] & bit))
+        {
+            seen[p[i] >> 5] |= bit;
+            ++distinct;
+        }
+    }
+    return distinct > n * 3 / 4;
+}
+
+static void
+comp_flow_bypass(struct compress_adaptive *ac, const uint32_t flow)
+{
+    struct compress_flow *f = &ac->flows[flow % COMP_FLOWS];
+
+    f->key = flow;
+    f->bypass_until = now + COMP_FLOW_BYPASS_SEC;
+    dmsg(D_COMP, "Adaptive compression: bypassing flow %08x", flow);
+}
+
+bool
+comp_adaptive_test(struct compress_context *compctx, const struct buffer *buf,
+                   uint32_t *flow)
+{
+    struct compress_adaptive *ac = &compctx->ac;
+    int payload;
+
+    *flow = 0;
+    if (!(compctx->flags & COMP_F_ADAPTIVE))
+    {
+        return true;
+    }
+
+    *flow = comp_flow_key(compctx, buf, &payload);
+    if (*flow)
+    {
+        const struct compress_flow *f = &ac->flows[*flow % COMP_FLOWS];
+        if (f->key == *flow && now < f->bypass_until)
+        {
+            ++ac->n_skip_flow;
+            return false;
+        }
+    }
+
+    if (BLEN(buf) - payload >= COMP_SAMPLE_MIN
+        && comp_sample_random(BPTR(buf) + payload,
+                              min_int(BLEN(buf) - payload, COMP_SAMPLE_LEN)))
+    {
+        ++ac->n_skip_sample;
+        if (*flow)
+        {
+            comp_flow_bypass(ac, *flow);
+        }
+        return false;
+    }
+    return true;
+}
+
+void
+comp_adaptive_result(struct compress_context *compctx, const uint32_t flow,
+                     const int len, const int zlen, const uint64_t start)
+{
+    struct compress_adaptive *ac = &compctx->ac;
+
+    if (!(compctx->flags & COMP_F_ADAPTIVE))
+    {
+        return;
+    }
+    ac->compress_ns += perf_now() - start;
+    ++ac->n_compressed;
+    if (zlen >= len)
+    {
+        ++ac->n_no_gain;
+        if (flow)
+        {
+            comp_flow_bypass(ac, flow);
+        }
     }
 }
 
@@ -157,6 +339,7 @@ comp_generate_peer_info_string(const struct compress_options *opt, struct buffer
 #if defined(ENABLE_LZ4)
             buf_printf(out, "IV_LZ4=1\n");
             buf_printf(out, "IV_LZ4v2=1\n");
+            buf_printf(out, "IV_LZ4_STREAM=1\n");
 #endif
 #if defined(ENABLE_LZO)
             buf_printf(out, "IV_LZO=1\n");
@@ -50,9 +50,10 @@
  #define COMP_ALGV2_LZO     12
  #define COMP_ALGV2_SNAPPY   13
  */
+#define COMP_ALGV2_LZ4_STREAM 14
 
 /* Compression flags */
-#define COMP_F_ADAPTIVE             (1<<0) /* COMP_ALG_LZO only */
+#define COMP_F_ADAPTIVE             (1<<0) /* skip packets and flows which do not compress */
 #define COMP_F_ALLOW_COMPRESS       (1<<1) /* not only downlink is compressed but also uplink */
 #define COMP_F_SWAP                 (1<<2) /* initial command byte is swapped with last byte in buffer to preserve payload alignment */
 #define COMP_F_ADVERTISE_STUBS_ONLY (1<<3) /* tell server that we only support compression stubs */
@@ -83,6 +84,20 @@
 #define COMP_ALGV2_LZ4_BYTE             1
 #define COMP_ALGV2_LZO_BYTE             2
 #define COMP_ALGV2_SNAPPY_BYTE          3
+#define COMP_ALGV2_LZ4_STREAM_BYTE      4 /* followed by epoch/dictionary size and sequence bytes */
+#define COMP_ALGV2_LZ4_STREAM_RAW_BYTE  5 /* like COMP_ALGV2_LZ4_STREAM_BYTE, not compressed */
+
+/*
+ * lz4-stream dictionary size and the number of packets after which the
+ * compressor starts over with an empty dictionary, so that the
+ * decompressor can resync after a lost packet.  Over TCP the default is
+ * COMP_RESYNC_MAX, as packets are only lost before they are sent.
+ */
+#define COMP_DICT_MIN       1024
+#define COMP_DICT_MAX       65536
+#define COMP_DICT_DEFAULT   16384
+#define COMP_RESYNC_MAX     255
+#define COMP_RESYNC_DEFAULT 32
 
 /*
  * Compress worst case size expansion (for any algorithm)
@@ -98,6 +113,37 @@
  */
 #define COMPRESS_THRESHOLD 100
 
+/*
+ * Adaptive compression, shared by all algorithms.  Before a packet is
+ * compressed, the number of distinct byte values at the start of its
+ * payload is counted.  Encrypted or already compressed data has nearly
+ * as many distinct values as bytes sampled, and is sent uncompressed.
+ * The TCP/UDP flow of a packet that is skipped or does not get smaller
+ * is not compressed for COMP_FLOW_BYPASS_SEC.
+ */
+#define COMP_SAMPLE_LEN      64  /* payload bytes sampled */
+#define COMP_SAMPLE_MIN      32  /* shorter payloads are not sampled */
+#define COMP_FLOWS           64  /* flows remembered per tunnel */
+#define COMP_FLOW_BYPASS_SEC 30
+
+struct compress_flow
+{
+    uint32_t key;
+    time_t bypass_until;
+};
+
+struct compress_adaptive
+{
+    struct compress_flow flows[COMP_FLOWS];
+
+    /* statistics */
+    counter_type n_compressed;      /* packets compressed */
+    counter_type n_no_gain;         /* packets which did not get smaller */
+    counter_type n_skip_sample;     /* packets skipped after sampling */
+    counter_type n_skip_flow;       /* packets of a bypassed flow */
+    counter_type compress_ns;       /* time spent compressing */
+};
+
 /* Forward declaration of compression context */
 struct compress_context;
 
@@ -116,6 +162,9 @@ struct compress_alg
     void (*decompress)(struct buffer *buf, struct buffer work,
                        struct compress_context *compctx,
                        const struct frame *frame);
+
+    /* bytes allocated for this context, NULL if none */
+    int (*workspace_bytes)(const struct compress_context *compctx);
 };
 
 /*
@@ -137,6 +186,8 @@ struct compress_options
 {
     int alg;
     unsigned int flags;
+    int dict_size;  /* lz4-stream, 0 for default */
+    int resync;     /* lz4-stream, 0 for default */
 };
 
 /*
@@ -160,18 +211,29 @@ struct compress_context
     unsigned int flags;
     struct compress_alg alg;
     union compress_workspace_union wu;
+    struct compress_adaptive ac;
+    bool reliable;                  /* transport does not lose packets */
+    int tunnel_type;                /* DEV_TYPE_x, to find the IP header */
 
     /* statistics */
     counter_type pre_decompress;
     counter_type post_decompress;
     counter_type pre_compress;
     counter_type post_compress;
+    counter_type desync_drops;      /* lz4-stream packets lost with dictionary */
 };
 
 extern const struct compress_alg comp_stub_alg;
 extern const struct compress_alg compv2_stub_alg;
 
-struct compress_context *comp_init(const struct compress_options *opt);
+/**
+ * @param reliable     the transport does not lose or reorder packets, so
+ *                     lz4-stream can resync less often
+ * @param tunnel_type  DEV_TYPE_TUN or DEV_TYPE_TAP, for adaptive
+ *                     compression to find the flow of a packet
+ */
+struct compress_context *comp_init(const struct compress_options *opt, bool reliable,
+                                   int tunnel_type);
 
 void comp_uninit(struct compress_context *compctx);
 
@@ -181,6 +243,31 @@ void comp_add_to_extra_buffer(struct frame *frame);
 
 void comp_print_stats(const struct compress_context *compctx, struct status_output *so);
 
+/**
+ * Return the number of bytes allocated for a compression context,
+ * including its workspace.
+ */
+int comp_memory_bytes(const struct compress_context *compctx);
+
+/**
+ * Decide whether a packet is worth compressing, if adaptive compression
+ * is enabled.
+ *
+ * @param flow  set to the flow key of the packet, to be passed
+ *              to comp_adaptive_result()
+ */
+bool comp_adaptive_test(struct compress_context *compctx, const struct buffer *buf,
+                        uint32_t *flow);
+
+/**
+ * Account for a compressed packet and bypass its flow if it did not get
+ * smaller.
+ *
+ * @param start  perf_now() before compressing
+ */
+void comp_adaptive_result(struct compress_context *compctx, const uint32_t flow,
+                          const int len, const int zlen, const uint64_t start);
+
 void comp_generate_peer_info_string(const struct compress_options *opt, struct buffer *out);
 
 void compv2_escape_data_ifneeded(struct buffer *buf);
@@ -165,7 +165,8 @@ const struct compress_alg compv2_stub_alg = {
     stub_compress_init,
     stub_compress_uninit,
     stubv2_compress,
-    stubv2_decompress
+    stubv2_decompress,
+    NULL
 };
 
 const struct compress_alg comp_stub_alg = {
@@ -173,6 +174,7 @@ const struct compress_alg comp_stub_alg = {
     stub_compress_init,
     stub_compress_uninit,
     stub_compress,
-    stub_decompress
+    stub_decompress,
+    NULL
 };
 #endif /* USE_STUB */
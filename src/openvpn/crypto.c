@@ -907,6 +907,27 @@ free_key_ctx_bi(struct key_ctx_bi *ctx)
     free_key_ctx(&ctx->decrypt);
 }
 
+static int
+key_ctx_memory_bytes(const struct key_ctx *ctx)
+{
+    int ret = 0;
+    if (ctx->cipher)
+    {
+        ret += cipher_ctx_memory_bytes(ctx->cipher);
+    }
+    if (ctx->hmac)
+    {
+        ret += hmac_ctx_memory_bytes(ctx->hmac);
+    }
+    return ret;
+}
+
+int
+key_ctx_bi_memory_bytes(const struct key_ctx_bi *ctx)
+{
+    return key_ctx_memory_bytes(&ctx->encrypt) + key_ctx_memory_bytes(&ctx->decrypt);
+}
+
 static bool
 key_is_zero(struct key *key, const struct key_type *kt)
 {
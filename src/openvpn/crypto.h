@@ -324,6 +324,9 @@ void init_key_ctx_bi(struct key_ctx_bi *ctx, const struct key2 *key2,
 
 void free_key_ctx_bi(struct key_ctx_bi *ctx);
 
+/* bytes held by the cipher and HMAC contexts of a key_ctx_bi */
+int key_ctx_bi_memory_bytes(const struct key_ctx_bi *ctx);
+
 
 /**************************************************************************/
 /** @name Functions for performing security operations on data channel packets
@@ -340,6 +340,15 @@ cipher_ctx_t *cipher_ctx_new(void);
  */
 void cipher_ctx_free(cipher_ctx_t *ctx);
 
+/**
+ * Return the number of bytes OpenVPN allocated for a cipher context.
+ * What the crypto library allocates for it is not known and not
+ * included.
+ *
+ * @param ctx           Cipher context. May not be NULL
+ */
+int cipher_ctx_memory_bytes(const cipher_ctx_t *ctx);
+
 /**
  * Initialise a cipher context, based on the given key and key type.
  *
@@ -616,6 +625,15 @@ hmac_ctx_t *hmac_ctx_new(void);
  */
 void hmac_ctx_free(hmac_ctx_t *ctx);
 
+/*
+ * Return the number of bytes OpenVPN allocated for an HMAC context.
+ * What the crypto library allocates for it is not known and not
+ * included.
+ *
+ * @param ctx           HMAC context. May not be NULL
+ */
+int hmac_ctx_memory_bytes(const hmac_ctx_t *ctx);
+
 /*
  * Initialises the given HMAC context, using the given digest
  * and key.
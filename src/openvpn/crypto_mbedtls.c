@@ -601,6 +601,13 @@ cipher_ctx_free(mbedtls_cipher_context_t *ctx)
     free(ctx);
 }
 
+/* the context of the cipher itself is allocated by mbed TLS */
+int
+cipher_ctx_memory_bytes(const mbedtls_cipher_context_t *ctx)
+{
+    return sizeof(*ctx);
+}
+
 void
 cipher_ctx_init(mbedtls_cipher_context_t *ctx, const uint8_t *key, int key_len,
                 const mbedtls_cipher_info_t *kt, const mbedtls_operation_t operation)
@@ -918,6 +925,13 @@ hmac_ctx_free(mbedtls_md_context_t *ctx)
     free(ctx);
 }
 
+/* the digest context and the padded keys are allocated by mbed TLS */
+int
+hmac_ctx_memory_bytes(const mbedtls_md_context_t *ctx)
+{
+    return sizeof(*ctx);
+}
+
 void
 hmac_ctx_init(mbedtls_md_context_t *ctx, const uint8_t *key, int key_len,
               const mbedtls_md_info_t *kt)
@@ -766,6 +766,13 @@ cipher_ctx_free(EVP_CIPHER_CTX *ctx)
     EVP_CIPHER_CTX_free(ctx);
 }
 
+/* OpenSSL allocates the context itself and does not tell its size */
+int
+cipher_ctx_memory_bytes(const EVP_CIPHER_CTX *ctx)
+{
+    return 0;
+}
+
 void
 cipher_ctx_init(EVP_CIPHER_CTX *ctx, const uint8_t *key, int key_len,
                 const EVP_CIPHER *kt, int enc)
@@ -1006,6 +1013,13 @@ hmac_ctx_free(HMAC_CTX *ctx)
     HMAC_CTX_free(ctx);
 }
 
+/* as for cipher_ctx_memory_bytes() */
+int
+hmac_ctx_memory_bytes(const HMAC_CTX *ctx)
+{
+    return 0;
+}
+
 void
 hmac_ctx_init(HMAC_CTX *ctx, const uint8_t *key, int key_len,
               const EVP_MD *kt)
@@ -33,6 +33,7 @@
 #include "syshead.h"
 
 #include "env_set.h"
+#include "integer.h"
 
 #include "run_command.h"
 
@@ -46,19 +47,88 @@
 
 /* General-purpose environmental variable set functions */
 
-static char *
-construct_name_value(const char *name, const char *value, struct gc_arena *gc)
+/* struct env_set storage */
+
+#define ENV_SET_MIN_BUF  256
+#define ENV_SET_MIN_VARS 16
+
+/*
+ * Allocate from the gc_arena of the set, or from the heap if the set
+ * owns its storage.  Storage of gc backed sets is never freed explicitly.
+ */
+static void *
+env_set_malloc(const struct env_set *es, const size_t size)
 {
-    struct buffer out;
+    return gc_malloc(size, false, es->gc);
+}
 
-    ASSERT(name);
-    if (!value)
+static void
+env_set_free(const struct env_set *es, void *p, const size_t size)
+{
+    if (!es->gc && p)
     {
-        value = "";
+        secure_memzero(p, size);
+        free(p);
+    }
+}
+
+/*
+ * Move the live strings into a new buffer of size bytes, dropping the
+ * garbage left behind by deleted strings.
+ */
+static void
+env_set_repack(struct env_set *es, const size_t size)
+{
+    char *buf = env_set_malloc(es, size);
+    size_t len = 0;
+
+    for (int i = 0; i < es->count; ++i)
+    {
+        const size_t n = strlen(es->envp[i]) + 1;
+        memcpy(buf + len, es->envp[i], n);
+        es->envp[i] = buf + len;
+        len += n;
+    }
+    env_set_free(es, es->buf, es->size);
+    es->buf = buf;
+    es->len = len;
+    es->size = size;
+    es->garbage = 0;
+}
+
+/*
+ * Make sure that bytes more bytes of strings and vars more strings fit
+ * into the set.  This may move the strings.
+ */
+static void
+env_set_reserve(struct env_set *es, const size_t bytes, const int vars)
+{
+    if (es->len + bytes > es->size)
+    {
+        const size_t needed = es->len - es->garbage + bytes;
+        size_t size = es->size;
+
+        if (needed * 2 > size)
+        {
+            size = max_uint(needed * 2, ENV_SET_MIN_BUF);
+        }
+        env_set_repack(es, size);
+    }
+
+    if (es->count + vars > es->max)
+    {
+        const int max = max_int((es->count + vars) * 2, ENV_SET_MIN_VARS);
+        char **envp = env_set_malloc(es, (max + 1) * sizeof(char *));
+
+        if (es->count)
+        {
+            memcpy(envp, es->envp, es->count * sizeof(char *));
+        }
+        envp[es->count] = NULL;
+        env_set_free(es, es->envp, (es->max + 1) * sizeof(char *));
+        es->envp = envp;
+        es->max = max;
     }
-    out = alloc_buf_gc(strlen(name) + strlen(value) + 2, gc);
-    buf_printf(&out, "%s=%s", name, value);
-    return BSTR(&out);
 }
 
 static bool
@@ -93,50 +163,40 @@ env_string_equal(const char *s1, const char *s2)
 }
 
 static bool
-remove_env_item(const char *str, const bool do_free, struct env_item **list)
+remove_env_item(struct env_set *es, const char *str)
 {
-    struct env_item *current, *prev;
-
     ASSERT(str);
-    ASSERT(list);
 
-    for (current = *list, prev = NULL; current != NULL; current = current->next)
+    for (int i = 0; i < es->count; ++i)
     {
-        if (env_string_equal(current->string, str))
+        char *current = es->envp[i];
+        if (env_string_equal(current, str))
         {
-            if (prev)
-            {
-                prev->next = current->next;
-            }
-            else
-            {
-                *list = current->next;
-            }
-            if (do_free)
-            {
-                secure_memzero(current->string, strlen(current->string));
-                free(current->string);
-                free(current);
-            }
+            const size_t n = strlen(current) + 1;
+
+            memmove(&es->envp[i], &es->envp[i + 1],
+                    (es->count - i) * sizeof(char *));
+            --es->count;
+            secure_memzero(current, n);
+            es->garbage += n;
             return true;
         }
-        prev = current;
     }
     return false;
 }
 
+/*
+ * Append the string at the end of buf, which the caller has already
+ * placed there, to the set.
+ */
 static void
-add_env_item(char *str, const bool do_alloc, struct env_item **list, struct gc_arena *gc)
+add_env_item(struct env_set *es, char *str)
 {
-    struct env_item *item;
-
-    ASSERT(str);
-    ASSERT(list);
+    ASSERT(str == es->buf + es->len);
 
-    ALLOC_OBJ_GC(item, struct env_item, gc);
-    item->string = do_alloc ? string_alloc(str, gc) : str;
-    item->next = *list;
-    *list = item;
+    es->len += strlen(str) + 1;
+    es->envp[es->count++] = str;
+    es->envp[es->count] = NULL;
 }
 
 /* struct env_set functions */
@@ -144,14 +204,20 @@ add_env_item(char *str, const bool do_alloc, struct env_item **list, struct gc_a
 static bool
 env_set_del_nolock(struct env_set *es, const char *str)
 {
-    return remove_env_item(str, es->gc == NULL, &es->list);
+    return remove_env_item(es, str);
 }
 
 static void
 env_set_add_nolock(struct env_set *es, const char *str)
 {
-    remove_env_item(str, es->gc == NULL, &es->list);
-    add_env_item((char *)str, true, &es->list, es->gc);
+    const size_t n = strlen(str) + 1;
+    char *dest;
+
+    remove_env_item(es, str);
+    env_set_reserve(es, n, 1);
+    dest = es->buf + es->len;
+    memcpy(dest, str, n);
+    add_env_item(es, dest);
 }
 
 struct env_set *
@@ -159,7 +225,6 @@ env_set_create(struct gc_arena *gc)
 {
     struct env_set *es;
     ALLOC_OBJ_CLEAR_GC(es, struct env_set, gc);
-    es->list = NULL;
     es->gc = gc;
     return es;
 }
@@ -169,14 +234,8 @@ env_set_destroy(struct env_set *es)
 {
     if (es && es->gc == NULL)
     {
-        struct env_item *e = es->list;
-        while (e)
-        {
-            struct env_item *next = e->next;
-            free(e->string);
-            free(e);
-            e = next;
-        }
+        env_set_free(es, es->buf, es->size);
+        env_set_free(es, es->envp, (es->max + 1) * sizeof(char *));
         free(es);
     }
 }
@@ -202,12 +261,14 @@ env_set_add(struct env_set *es, const char *str)
 const char *
 env_set_get(const struct env_set *es, const char *name)
 {
-    const struct env_item *item = es->list;
-    while (item && !env_string_equal(item->string, name))
+    for (int i = 0; i < es->count; ++i)
     {
-        item = item->next;
+        if (env_string_equal(es->envp[i], name))
+        {
+            return es->envp[i];
+        }
     }
-    return item ? item->string : NULL;
+    return NULL;
 }
 
 void
@@ -215,22 +276,14 @@ env_set_print(int msglevel, const struct env_set *es)
 {
     if (check_debug_level(msglevel))
     {
-        const struct env_item *e;
-        int i;
-
         if (es)
         {
-            e = es->list;
-            i = 0;
-
-            while (e)
+            for (int i = 0; i < es->count; ++i)
             {
-                if (env_safe_to_print(e->string))
+                if (env_safe_to_print(es->envp[i]))
                 {
-                    msg(msglevel, "ENV [%d] '%s'", i, e->string);
+                    msg(msglevel, "ENV [%d] '%s'", i, es->envp[i]);
                 }
-                ++i;
-                e = e->next;
             }
         }
     }
@@ -239,17 +292,15 @@ env_set_print(int msglevel, const struct env_set *es)
 void
 env_set_inherit(struct env_set *es, const struct env_set *src)
 {
-    const struct env_item *e;
-
     ASSERT(es);
 
-    if (src)
+    if (src && src != es)
     {
-        e = src->list;
-        while (e)
+        /* make room for everything at once */
+        env_set_reserve(es, src->len - src->garbage, src->count);
+        for (int i = 0; i < src->count; ++i)
         {
-            env_set_add_nolock(es, e->string);
-            e = e->next;
+            env_set_add_nolock(es, src->envp[i]);
         }
     }
 }
@@ -344,35 +395,39 @@ setenv_str_ex(struct env_set *es,
               const unsigned int value_exclude,
               const char value_replace)
 {
-    struct gc_arena gc = gc_new();
-    const char *name_tmp;
-    const char *val_tmp = NULL;
+    const size_t name_len = strlen(name);
+    char *str;
 
-    ASSERT(name && strlen(name) > 1);
+    ASSERT(name && name_len > 1);
+    ASSERT(es);
 
-    name_tmp = string_mod_const(name, name_include, name_exclude, name_replace, &gc);
+    /*
+     * Assemble "name=value" right behind the last string of the set,
+     * where it stays if it is added.  string_mod() never makes a string
+     * longer, so the reserved space is sufficient.
+     */
+    env_set_reserve(es, name_len + (value ? strlen(value) : 0) + 2, 1);
+    str = es->buf + es->len;
+    memcpy(str, name, name_len + 1);
+    string_mod(str, name_include, name_exclude, name_replace);
 
     if (value)
     {
-        val_tmp = string_mod_const(value, value_include, value_exclude, value_replace, &gc);
-    }
-
-    ASSERT(es);
+        char *val = str + strlen(str);
+        *val++ = '=';
+        strcpy(val, value);
+        string_mod(val, value_include, value_exclude, value_replace);
 
-    if (val_tmp)
-    {
-        const char *str = construct_name_value(name_tmp, val_tmp, &gc);
-        env_set_add(es, str);
+        remove_env_item(es, str);
+        add_env_item(es, str);
 #if DEBUG_VERBOSE_SETENV
         msg(M_INFO, "SETENV_ES '%s'", str);
 #endif
     }
     else
     {
-        env_set_del(es, name_tmp);
+        env_set_del(es, str);
     }
-
-    gc_free(&gc);
 }
 
 /*
@@ -425,31 +480,37 @@ make_env_array(const struct env_set *es,
                struct gc_arena *gc)
 {
     char **ret = NULL;
-    struct env_item *e = NULL;
-    int i = 0, n = 0;
+    int i = 0;
 
-    /* figure length of es */
-    if (es)
+    if (es && es->envp)
     {
-        for (e = es->list; e != NULL; e = e->next)
+        bool filter = false;
+
+        if (check_allowed)
+        {
+            for (i = 0; i < es->count && !filter; ++i)
+            {
+                filter = !env_allowed(es->envp[i]);
+            }
+        }
+        if (!filter)
         {
-            ++n;
+            return (const char **)es->envp;
         }
     }
 
     /* alloc return array */
-    ALLOC_ARRAY_CLEAR_GC(ret, char *, n+1, gc);
+    ALLOC_ARRAY_CLEAR_GC(ret, char *, (es ? es->count : 0) + 1, gc);
 
     /* fill return array */
+    i = 0;
     if (es)
     {
-        i = 0;
-        for (e = es->list; e != NULL; e = e->next)
+        for (int j = 0; j < es->count; ++j)
         {
-            if (!check_allowed || env_allowed(e->string))
+            if (env_allowed(es->envp[j]))
             {
-                ASSERT(i < n);
-                ret[i++] = e->string;
+                ret[i++] = es->envp[j];
             }
         }
     }
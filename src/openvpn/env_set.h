@@ -32,16 +32,27 @@
 
 /*
  * Handle environmental variable lists
+ *
+ * The "name=value" strings of a set are kept back to back in a single
+ * buffer, and envp is a NULL terminated array pointing to them.  Deleted
+ * or replaced strings are only reclaimed when the buffer runs full, so
+ * an env_set that is updated over and over again, like the one of a
+ * client instance, settles on a fixed amount of memory and no longer
+ * allocates per variable.
+ *
+ * Pointers into envp and the strings are only valid until the set is
+ * modified.
  */
 
-struct env_item {
-    char *string;
-    struct env_item *next;
-};
-
 struct env_set {
-    struct gc_arena *gc;
-    struct env_item *list;
+    struct gc_arena *gc;    /* if NULL, the storage is owned by the set */
+    char **envp;            /* NULL terminated view of the strings */
+    int count;              /* number of strings in envp */
+    int max;                /* capacity of envp, not counting the NULL */
+    char *buf;              /* the strings */
+    size_t len;             /* bytes used in buf */
+    size_t size;            /* bytes allocated for buf */
+    size_t garbage;         /* bytes of deleted strings in buf */
 };
 
 /* set/delete environmental variable */
@@ -116,6 +127,12 @@ env_safe_to_print(const char *str)
 /* returns true if environmental variable may be passed to an external program */
 bool env_allowed(const char *str);
 
+/**
+ * Return a NULL terminated array of the strings in \c es.  If no
+ * strings need to be filtered out, this is the envp view of \c es
+ * itself, without any copying, which must not be modified and is only
+ * valid until \c es is modified.
+ */
 const char **make_env_array(const struct env_set *es,
                             const bool check_allowed,
                             struct gc_arena *gc);
@@ -42,6 +42,7 @@
 #include "integer.h"
 #include "ps.h"
 #include "mstats.h"
+#include "evlog.h"
 
 
 #if SYSLOG_CAPABILITY
@@ -741,6 +742,10 @@ openvpn_exit(const int status)
         mstats_close();
 #endif
 
+#ifdef ENABLE_EVENT_LOG
+        evlog_close();
+#endif
+
 #ifdef ABORT_ON_ERROR
         if (status == OPENVPN_EXIT_STATUS_ERROR)
         {
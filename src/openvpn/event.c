@@ -41,6 +41,8 @@
 
 #include "memdbg.h"
 
+struct event_loop_stats *event_loop_stats = NULL; /* GLOBAL */
+
 /*
  * Some OSes will prefer select() over poll()
  * when both are available.
@@ -1196,3 +1198,38 @@ event_set_init(int *maxevents, unsigned int flags)
         return event_set_init_scalable(maxevents, flags);
     }
 }
+
+int
+event_wait_timed(struct event_set *es, const struct timeval *tv,
+                 struct event_set_return *out, int outlen)
+{
+    struct event_loop_stats *s = event_loop_stats;
+    const uint64_t start = perf_now();
+    int ret;
+
+    if (s->last_return)
+    {
+        s->last_busy_ns = start - s->last_return;
+        s->busy_ns += s->last_busy_ns;
+    }
+
+    ret = (*es->func.wait)(es, tv, out, outlen);
+
+    s->last_return = perf_now();
+    s->wait_ns += s->last_return - start;
+    ++s->waits;
+    s->last_events = max_int(ret, 0);
+    if (ret > 0)
+    {
+        s->events += ret;
+        if (ret == outlen)
+        {
+            ++s->saturated;
+        }
+    }
+    else if (ret == 0)
+    {
+        ++s->timeouts;
+    }
+    return ret;
+}
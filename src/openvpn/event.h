@@ -27,6 +27,7 @@
 #include "win32.h"
 #include "sig.h"
 #include "perf.h"
+#include "common.h"
 
 /*
  * rwflags passed to event_ctl and returned by
@@ -72,6 +73,8 @@
 #define MANAGEMENT_WRITE    (1 << (MANAGEMENT_SHIFT + WRITE_SHIFT))
 #define FILE_SHIFT          8
 #define FILE_CLOSED         (1 << (FILE_SHIFT + READ_SHIFT))
+#define SCRIPT_SHIFT        10
+#define SCRIPT_DONE         (1 << (SCRIPT_SHIFT + READ_SHIFT))
 
 /*
  * Initialization flags passed to event_set_init
@@ -123,6 +126,30 @@ struct event_set
     struct event_set_functions func;
 };
 
+/*
+ * Event loop telemetry.  While event_loop_stats is set, event_wait()
+ * accounts the time spent waiting and between waits, and the events
+ * returned.  The server points it at its multi_context.
+ */
+struct event_loop_stats
+{
+    counter_type waits;
+    counter_type timeouts;      /* waits that returned no event */
+    counter_type saturated;     /* waits that filled the return array,
+                                 * so more events may be pending */
+    counter_type events;        /* events returned */
+    uint64_t wait_ns;           /* time spent waiting */
+    uint64_t busy_ns;           /* time spent between waits */
+    uint64_t last_return;       /* when the last wait returned, 0 if none */
+    uint64_t last_busy_ns;      /* time between the last two waits */
+    int last_events;            /* events returned by the last wait */
+};
+
+extern struct event_loop_stats *event_loop_stats; /* GLOBAL */
+
+int event_wait_timed(struct event_set *es, const struct timeval *tv,
+                     struct event_set_return *out, int outlen);
+
 /*
  * maxevents on input:  desired max number of event_t descriptors
  *                      simultaneously set with event_ctl
@@ -164,7 +191,14 @@ event_wait(struct event_set *es, const struct timeval *tv, struct event_set_retu
 {
     int ret;
     perf_push(PERF_IO_WAIT);
-    ret = (*es->func.wait)(es, tv, out, outlen);
+    if (event_loop_stats)
+    {
+        ret = event_wait_timed(es, tv, out, outlen);
+    }
+    else
+    {
+        ret = (*es->func.wait)(es, tv, out, outlen);
+    }
     perf_pop();
     return ret;
 }
@@ -0,0 +1,166 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Structured event log in a memory-mapped ring, see evlog.h
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#if defined(ENABLE_EVENT_LOG)
+
+#include <sys/mman.h>
+
+#include "error.h"
+#include "evlog.h"
+#include "platform.h"
+
+#include "memdbg.h"
+
+volatile struct evlog_header *evlog = NULL; /* GLOBAL */
+static volatile struct evlog_record *evlog_records = NULL; /* GLOBAL */
+static uint64_t evlog_mask;
+static size_t evlog_size;
+static char evlog_fn[128];
+
+static_assert(sizeof(struct evlog_header) == 64,
+              "struct evlog_header must be 64 bytes");
+static_assert(sizeof(struct evlog_record) == 64,
+              "struct evlog_record must be 64 bytes");
+
+void
+evlog_open(const char *fn, const int n_records)
+{
+    struct evlog_header h;
+    uint32_t n = 1;
+    void *data;
+    int fd;
+
+    if (evlog) /* already called? */
+    {
+        return;
+    }
+
+    if (strlen(fn) >= sizeof(evlog_fn))
+    {
+        msg(M_FATAL, "evlog_open: filename too long");
+    }
+
+    while (n < n_records)
+    {
+        n <<= 1;
+    }
+
+    fd = open(fn, O_CREAT | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+    {
+        msg(M_ERR, "evlog_open: cannot open: %s", fn);
+        return;
+    }
+
+    CLEAR(h);
+    h.magic = EVLOG_MAGIC;
+    h.version = EVLOG_VERSION;
+    h.record_size = sizeof(struct evlog_record);
+    h.n_records = n;
+    h.pid = platform_getpid();
+    h.state = EVLOG_ACTIVE;
+    evlog_size = sizeof(h) + (size_t)n * sizeof(struct evlog_record);
+    if (write(fd, &h, sizeof(h)) != sizeof(h) || ftruncate(fd, evlog_size))
+    {
+        msg(M_ERR, "evlog_open: write error: %s", fn);
+        close(fd);
+        return;
+    }
+
+    data = mmap(NULL, evlog_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        msg(M_ERR, "evlog_open: mmap error: %s", fn);
+        close(fd);
+        return;
+    }
+    if (close(fd))
+    {
+        msg(M_ERR, "evlog_open: close error: %s", fn);
+    }
+
+    strcpy(evlog_fn, fn);
+    evlog = (struct evlog_header *)data;
+    evlog_records = (struct evlog_record *)((uint8_t *)data + sizeof(h));
+    evlog_mask = n - 1;
+
+    msg(M_INFO, "event log ring of %u records will be written to %s", n, fn);
+}
+
+void
+evlog_close(void)
+{
+    if (evlog)
+    {
+        evlog->state = EVLOG_EXPIRED;
+        if (munmap((void *)evlog, evlog_size))
+        {
+            msg(M_WARN | M_ERRNO, "evlog_close: munmap error");
+        }
+        platform_unlink(evlog_fn);
+        evlog = NULL;
+        evlog_records = NULL;
+    }
+}
+
+void
+evlog_write(const unsigned int flags, const uint16_t event,
+            const uint64_t cid, const uint32_t peer_id,
+            const uint64_t a0, const uint64_t a1,
+            const uint64_t a2, const uint64_t a3)
+{
+    const uint64_t n = evlog->head + 1;
+    volatile struct evlog_record *r = &evlog_records[(n - 1) & evlog_mask];
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    r->seq = 0;
+    __sync_synchronize();
+    r->timestamp = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    r->event = event;
+    r->level = flags & M_DEBUG_LEVEL;
+    r->peer_id = peer_id;
+    r->cid = cid;
+    r->args[0] = a0;
+    r->args[1] = a1;
+    r->args[2] = a2;
+    r->args[3] = a3;
+    __sync_synchronize();
+    r->seq = n;
+    evlog->head = n;
+}
+
+#endif /* if defined(ENABLE_EVENT_LOG) */
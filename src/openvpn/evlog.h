@@ -0,0 +1,133 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Structured event log in a memory-mapped ring
+ *
+ * With --event-log, events such as client connects and packet drops are
+ * recorded as fixed-size binary records in a ring that lives in a
+ * memory-mapped file.  Recording an event does not format anything and
+ * never blocks; formatting and writing the events to a file, syslog or
+ * as JSON is left to a separate reader process, for example
+ * contrib/evlog/evlog-read.py.
+ *
+ * The file starts with a struct evlog_header, followed by n_records
+ * records of struct evlog_record.  n_records is a power of two.  Records
+ * are numbered from 1 and record n is stored in slot (n - 1) % n_records;
+ * head is the number of the last record written.  While a slot is being
+ * written its seq is 0, afterwards it is the record number.  A reader
+ * copies a slot and uses the copy only if seq was the expected record
+ * number before and after copying it.  If a reader falls behind by more
+ * than n_records, the records it missed are lost.
+ */
+
+#if !defined(OPENVPN_EVLOG_H) && defined(ENABLE_EVENT_LOG)
+#define OPENVPN_EVLOG_H
+
+#include "basic.h"
+
+#define EVLOG_MAGIC   0x4c45564f  /* "OVEL" in little endian */
+#define EVLOG_VERSION 1
+
+#define EVLOG_DEFAULT_RECORDS 65536
+
+/* no client id, e.g. OpenVPN was built without management support */
+#define EVLOG_NO_CID UINT64_MAX
+
+/* event ids, the meaning of the arguments is given for each event */
+#define EVLOG_CLIENT_CREATE      1 /* address family, address (2), port */
+#define EVLOG_CLIENT_ESTABLISHED 2 /* handshake time in usec, IPv4 VPN address */
+#define EVLOG_CLIENT_AUTH_FAILED 3
+#define EVLOG_CLIENT_HANDSHAKE_FAILED 4
+#define EVLOG_CLIENT_CLOSE       5 /* bytes in, bytes out */
+#define EVLOG_DROP_DECRYPT       6 /* packet length */
+#define EVLOG_DROP_BAD_SOURCE    7 /* packet length */
+#define EVLOG_DROP_OUTPUT_SATURATION 8
+#define EVLOG_DROP_TUN_QUEUE_FULL 9 /* packet length */
+#define EVLOG_DROP_POLICER       10 /* packet length */
+
+/* this struct is mapped to the start of the file, in host byte order */
+struct evlog_header {
+    uint32_t magic;              /* EVLOG_MAGIC */
+    uint32_t version;            /* EVLOG_VERSION */
+    uint32_t record_size;        /* sizeof(struct evlog_record) */
+    uint32_t n_records;
+    uint64_t head;               /* number of the last record written */
+    uint32_t pid;
+
+#define EVLOG_ACTIVE  1
+#define EVLOG_EXPIRED 2
+    uint32_t state;
+    uint8_t reserved[32];        /* zero, for future extensions */
+};
+
+struct evlog_record {
+    uint64_t seq;                /* record number, 0 while being written */
+    uint64_t timestamp;          /* nanoseconds since the epoch */
+    uint16_t event;              /* EVLOG_* event id */
+    uint8_t level;               /* --verb level of the matching log message */
+    uint8_t reserved;
+    uint32_t peer_id;            /* MAX_PEER_ID if the client has none */
+    uint64_t cid;                /* management client id or EVLOG_NO_CID */
+    uint64_t args[4];            /* event specific, 0 if unused */
+};
+
+extern volatile struct evlog_header *evlog; /* GLOBAL */
+
+/**
+ * Create the memory-mapped ring.
+ *
+ * @param fn         file name
+ * @param n_records  number of records, rounded up to a power of two
+ */
+void evlog_open(const char *fn, const int n_records);
+
+void evlog_close(void);
+
+void evlog_write(const unsigned int flags, const uint16_t event,
+                 const uint64_t cid, const uint32_t peer_id,
+                 const uint64_t a0, const uint64_t a1,
+                 const uint64_t a2, const uint64_t a3);
+
+/**
+ * Record an event if --event-log is active.
+ *
+ * @param flags    the msg() flags of the matching log message, the
+ *                 debug level is taken from them
+ * @param event    EVLOG_* event id
+ * @param cid      management client id or EVLOG_NO_CID
+ * @param peer_id  peer-id of the client
+ */
+static inline void
+evlog_event(const unsigned int flags, const uint16_t event,
+            const uint64_t cid, const uint32_t peer_id,
+            const uint64_t a0, const uint64_t a1,
+            const uint64_t a2, const uint64_t a3)
+{
+    if (evlog)
+    {
+        evlog_write(flags, event, cid, peer_id, a0, a1, a2, a3);
+    }
+}
+
+#endif /* if !defined(OPENVPN_EVLOG_H) && defined(ENABLE_EVENT_LOG) */
@@ -42,6 +42,7 @@
 #include "dhcp.h"
 #include "common.h"
 #include "ssl_verify.h"
+#include "run_command.h"
 
 #include "memdbg.h"
 
@@ -49,6 +50,7 @@
 
 counter_type link_read_bytes_global;  /* GLOBAL */
 counter_type link_write_bytes_global; /* GLOBAL */
+counter_type link_read_drops_global;  /* GLOBAL */
 
 /* show event wait debugging info */
 
@@ -141,6 +143,17 @@ context_reschedule_sec(struct context *c, int sec)
     }
 }
 
+/*
+ * A client instance of the server.  The server runs the --inactive and
+ * --ping timers of those by themselves, see process_keepalive_timers(),
+ * and lets their TLS state machine sleep while there is nothing to do.
+ */
+static inline bool
+context_is_instance(const struct context *c)
+{
+    return c->mode == CM_CHILD_UDP || c->mode == CM_CHILD_TCP;
+}
+
 /*
  * In TLS mode, let TLS level respond to any control-channel
  * packets which were received, or prepare any packets for
@@ -181,7 +194,16 @@ check_tls(struct context *c)
         interval_future_trigger(&c->c2.tmp_int, wakeup);
     }
 
-    interval_schedule_wakeup(&c->c2.tmp_int, &wakeup);
+    if (context_is_instance(c) && tls_multi_settled(c->c2.tls_multi))
+    {
+        /* no need to poll, packets and the deadlines reported to
+         * interval_future_trigger() bring us back here */
+        interval_earliest_wakeup(&wakeup, c->c2.tmp_int.future_trigger, now);
+    }
+    else
+    {
+        interval_schedule_wakeup(&c->c2.tmp_int, &wakeup);
+    }
 
     if (wakeup)
     {
@@ -648,23 +670,26 @@ process_coarse_timers(struct context *c)
         check_add_routes(c);
     }
 
-    /* possibly exit due to --inactive */
-    if (c->options.inactivity_timeout
-        && event_timeout_trigger(&c->c2.inactivity_interval, &c->c2.timeval, ETT_DEFAULT))
+    if (!context_is_instance(c))
     {
-        check_inactivity_timeout(c);
-    }
+        /* possibly exit due to --inactive */
+        if (c->options.inactivity_timeout
+            && event_timeout_trigger(&c->c2.inactivity_interval, &c->c2.timeval, ETT_DEFAULT))
+        {
+            check_inactivity_timeout(c);
+        }
 
-    if (c->sig->signal_received)
-    {
-        return;
-    }
+        if (c->sig->signal_received)
+        {
+            return;
+        }
 
-    /* restart if ping not received */
-    check_ping_restart(c);
-    if (c->sig->signal_received)
-    {
-        return;
+        /* restart if ping not received */
+        check_ping_restart(c);
+        if (c->sig->signal_received)
+        {
+            return;
+        }
     }
 
     if (c->c2.tls_multi)
@@ -694,6 +719,9 @@ process_coarse_timers(struct context *c)
     /* Should we send an MTU load test? */
     check_send_occ_load_test(c);
 
+    /* Should we send a path MTU probe? */
+    check_send_occ_mtu_probe(c);
+
     /* Should we send an OCC_EXIT message to remote? */
     if (c->c2.explicit_exit_notification_time_wait)
     {
@@ -701,7 +729,38 @@ process_coarse_timers(struct context *c)
     }
 
     /* Should we ping the remote? */
-    check_ping_send(c);
+    if (!context_is_instance(c))
+    {
+        check_ping_send(c);
+    }
+}
+
+interval_t
+process_keepalive_timers(struct context *c)
+{
+    const struct timeval save = c->c2.timeval;
+    interval_t ret;
+
+    c->c2.timeval.tv_sec = BIG_TIMEOUT;
+    c->c2.timeval.tv_usec = 0;
+
+    if (c->options.inactivity_timeout
+        && event_timeout_trigger(&c->c2.inactivity_interval, &c->c2.timeval, ETT_DEFAULT))
+    {
+        check_inactivity_timeout(c);
+    }
+    if (!c->sig->signal_received)
+    {
+        check_ping_restart(c);
+    }
+    if (!c->sig->signal_received)
+    {
+        check_ping_send(c);
+    }
+
+    ret = (interval_t) c->c2.timeval.tv_sec;
+    c->c2.timeval = save;
+    return ret;
 }
 
 static void
@@ -862,9 +921,12 @@ process_incoming_link_part1(struct context *c, struct link_socket_info *lsi, boo
     struct gc_arena gc = gc_new();
     bool decrypt_status = false;
 
+    pktrace_capture(c->c2.pktrace, PKTRACE_LINK_IN, &c->c2.buf);
+
     if (c->c2.buf.len > 0)
     {
         c->c2.link_read_bytes += c->c2.buf.len;
+        ++c->c2.link_read_packets;
         link_read_bytes_global += c->c2.buf.len;
 #ifdef ENABLE_MEMSTATS
         if (mmap_stats)
@@ -977,8 +1039,15 @@ process_incoming_link_part1(struct context *c, struct link_socket_info *lsi, boo
         }
 
         /* authenticate and decrypt the incoming packet */
+        const int encrypted_len = BLEN(&c->c2.buf);
         decrypt_status = openvpn_decrypt(&c->c2.buf, c->c2.buffers->decrypt_buf,
                                          co, &c->c2.frame, ad_start);
+        if (!decrypt_status)
+        {
+            ++c->c2.link_read_drops;
+            ++link_read_drops_global;
+            context_evlog(c, D_CRYPT_ERRORS, EVLOG_DROP_DECRYPT, encrypted_len, 0, 0, 0);
+        }
 
         if (!decrypt_status && link_socket_connection_oriented(c->c2.link_socket))
         {
@@ -1065,6 +1134,8 @@ process_incoming_link_part2(struct context *c, struct link_socket_info *lsi, con
             process_received_occ_msg(c);
         }
 
+        pktrace_capture(c->c2.pktrace, PKTRACE_TUN_OUT, &c->c2.buf);
+
         buffer_turnover(orig_buf, &c->c2.to_tun, &c->c2.buf, &c->c2.buffers->read_link_buf);
 
         /* to_tun defined + unopened tuntap can cause deadlock */
@@ -1302,6 +1373,7 @@ process_incoming_tun(struct context *c)
     }
     if (c->c2.buf.len > 0)
     {
+        pktrace_capture(c->c2.pktrace, PKTRACE_TUN_IN, &c->c2.buf);
         encrypt_sign(c, true);
     }
     else
@@ -1478,7 +1550,8 @@ process_ip_header(struct context *c, unsigned int flags, struct buffer *buf)
     {
         /*
          * The --passtos and --mssfix options require
-         * us to examine the IPv4 header.
+         * us to examine the IPv4 header.  The headers are parsed
+         * once and the result shared by all of the stages below.
          */
 
         if (flags & (PIP_MSSFIX
@@ -1488,9 +1561,13 @@ process_ip_header(struct context *c, unsigned int flags, struct buffer *buf)
                      | PIPV4_CLIENT_NAT
                      ))
         {
+            struct packet_info pi;
             struct buffer ipbuf = *buf;
-            if (is_ipv4(TUNNEL_TYPE(c->c1.tuntap), &ipbuf))
+
+            packet_info_parse(&pi, TUNNEL_TYPE(c->c1.tuntap), buf);
+            if (pi.ip_ver == 4)
             {
+                ASSERT(buf_advance(&ipbuf, pi.ip_offset));
 #if PASSTOS_CAPABILITY
                 /* extract TOS from IP header */
                 if (flags & PIPV4_PASSTOS)
@@ -1502,17 +1579,18 @@ process_ip_header(struct context *c, unsigned int flags, struct buffer *buf)
                 /* possibly alter the TCP MSS */
                 if (flags & PIP_MSSFIX)
                 {
-                    mss_fixup_ipv4(&ipbuf, MTU_TO_MSS(TUN_MTU_SIZE_DYNAMIC(&c->c2.frame)));
+                    mss_fixup(buf, &pi, MTU_TO_MSS(TUN_MTU_SIZE_DYNAMIC(&c->c2.frame)));
                 }
 
                 /* possibly do NAT on packet */
                 if ((flags & PIPV4_CLIENT_NAT) && c->options.client_nat)
                 {
                     const int direction = (flags & PIP_OUTGOING) ? CN_INCOMING : CN_OUTGOING;
-                    client_nat_transform(c->options.client_nat, &ipbuf, direction);
+                    client_nat_transform(c->options.client_nat, buf, &pi, direction);
                 }
                 /* possibly extract a DHCP router message */
-                if (flags & PIPV4_EXTRACT_DHCP_ROUTER)
+                if ((flags & PIPV4_EXTRACT_DHCP_ROUTER)
+                    && pi.l4_proto == OPENVPN_IPPROTO_UDP)
                 {
                     const in_addr_t dhcp_router = dhcp_extract_router_msg(&ipbuf);
                     if (dhcp_router)
@@ -1521,13 +1599,12 @@ process_ip_header(struct context *c, unsigned int flags, struct buffer *buf)
                     }
                 }
             }
-            else if (is_ipv6(TUNNEL_TYPE(c->c1.tuntap), &ipbuf))
+            else if (pi.ip_ver == 6)
             {
                 /* possibly alter the TCP MSS */
                 if (flags & PIP_MSSFIX)
                 {
-                    mss_fixup_ipv6(&ipbuf,
-                                   MTU_TO_MSS(TUN_MTU_SIZE_DYNAMIC(&c->c2.frame)));
+                    mss_fixup(buf, &pi, MTU_TO_MSS(TUN_MTU_SIZE_DYNAMIC(&c->c2.frame)));
                 }
                 if (!(flags & PIP_OUTGOING) && (flags
                                                 &(PIPV6_IMCP_NOHOST_CLIENT | PIPV6_IMCP_NOHOST_SERVER)))
@@ -1543,6 +1620,47 @@ process_ip_header(struct context *c, unsigned int flags, struct buffer *buf)
     }
 }
 
+#ifdef ENABLE_DEBUG
+/*
+ * In gremlin-test mode, possibly hold back a copy of the datagram
+ * in to_link, to be sent after the next one.
+ */
+static bool
+gremlin_hold(struct context *c)
+{
+    if (!reorder_gremlin(c->options.gremlin)
+        || !proto_is_dgram(c->c2.link_socket->info.proto)
+        || c->c2.link_socket->socks_proxy
+        || BLEN(&c->c2.gremlin_held))
+    {
+        return false;
+    }
+
+    if (!c->c2.gremlin_held.data)
+    {
+        c->c2.gremlin_held = alloc_buf(BUF_SIZE(&c->c2.frame));
+    }
+    if (!buf_copy(&c->c2.gremlin_held, &c->c2.to_link))
+    {
+        buf_reset_len(&c->c2.gremlin_held);
+        return false;
+    }
+    c->c2.gremlin_held_addr = *c->c2.to_link_addr;
+    return true;
+}
+
+static void
+gremlin_release(struct context *c)
+{
+    if (BLEN(&c->c2.gremlin_held))
+    {
+        link_socket_write(c->c2.link_socket, &c->c2.gremlin_held,
+                          &c->c2.gremlin_held_addr);
+        buf_reset_len(&c->c2.gremlin_held);
+    }
+}
+#endif /* ifdef ENABLE_DEBUG */
+
 /*
  * Input: c->c2.to_link
  */
@@ -1605,27 +1723,69 @@ process_outgoing_link(struct context *c)
                 print_link_socket_actual(c->c2.to_link_addr, &gc),
                 PROTO_DUMP(&c->c2.to_link, &gc));
 
+            pktrace_capture(c->c2.pktrace, PKTRACE_LINK_OUT, &c->c2.to_link);
+
             /* Packet send complexified by possible Socks5 usage */
             {
                 struct link_socket_actual *to_addr = c->c2.to_link_addr;
                 int size_delta = 0;
+#ifdef ENABLE_DEBUG
+                bool held = false;
+#endif
 
                 /* If Socks5 over UDP, prepend header */
                 socks_preprocess_outgoing_link(c, &to_addr, &size_delta);
 
-                /* Send packet */
-                size = link_socket_write(c->c2.link_socket,
-                                         &c->c2.to_link,
-                                         to_addr);
+                /* Send packet, an MTU probe with the don't-fragment bit */
+                if (unlikely(c->c2.plpmtud.probe_df))
+                {
+                    const sa_family_t af = to_addr->dest.addr.sa.sa_family;
+                    const int df = set_mtu_probe_df(c->c2.link_socket->sd, af, -1);
+                    size = link_socket_write(c->c2.link_socket,
+                                             &c->c2.to_link,
+                                             to_addr);
+                    if (size < 0 && openvpn_errno() == EMSGSIZE)
+                    {
+                        /* larger than the local MTU, the probe is lost */
+                        dmsg(D_MTU_DEBUG, "MTU probe of %d bytes too large to send",
+                             BLEN(&c->c2.to_link));
+                        size = 0;
+                    }
+                    if (df >= 0)
+                    {
+                        set_mtu_probe_df(c->c2.link_socket->sd, af, df);
+                    }
+                }
+#ifdef ENABLE_DEBUG
+                /* In gremlin-test mode, we may send it after the next one */
+                else if (c->options.gremlin && (held = gremlin_hold(c)))
+                {
+                    size = BLEN(&c->c2.to_link);
+                }
+#endif
+                else
+                {
+                    size = link_socket_write(c->c2.link_socket,
+                                             &c->c2.to_link,
+                                             to_addr);
+                }
 
                 /* Undo effect of prepend */
                 link_socket_write_post_size_adjust(&size, size_delta, &c->c2.to_link);
+
+#ifdef ENABLE_DEBUG
+                if (c->options.gremlin && !held && size > 0)
+                {
+                    gremlin_release(c);
+                }
+#endif
             }
 
             if (size > 0)
             {
                 c->c2.max_send_size_local = max_int(size, c->c2.max_send_size_local);
                 c->c2.link_write_bytes += size;
+                ++c->c2.link_write_packets;
                 link_write_bytes_global += size;
 #ifdef ENABLE_MEMSTATS
                 if (mmap_stats)
@@ -1686,6 +1846,7 @@ process_outgoing_link(struct context *c)
     }
 
     buf_reset(&c->c2.to_link);
+    c->c2.plpmtud.probe_df = false;
 
     perf_pop();
     gc_free(&gc);
@@ -1879,6 +2040,9 @@ io_wait_dowork(struct context *c, const unsigned int flags)
 #ifdef ENABLE_ASYNC_PUSH
     static int file_shift = FILE_SHIFT;
 #endif
+#ifndef _WIN32
+    static int script_shift = SCRIPT_SHIFT;
+#endif
 
     /*
      * Decide what kind of events we want to wait for.
@@ -2002,6 +2166,15 @@ io_wait_dowork(struct context *c, const unsigned int flags)
     }
 #endif
 
+#ifndef _WIN32
+    /* wake up when an asynchronously executed script has finished */
+    if (c->options.mode == MODE_SERVER && openvpn_execve_async_event_fd() >= 0)
+    {
+        event_ctl(c->c2.event_set, openvpn_execve_async_event_fd(), EVENT_READ,
+                  (void *)&script_shift);
+    }
+#endif
+
     /*
      * Possible scenarios:
      *  (1) tcp/udp port has data available to read
@@ -2032,7 +2205,11 @@ io_wait_dowork(struct context *c, const unsigned int flags)
              */
             status = event_wait(c->c2.event_set, &c->c2.timeval, esr, SIZE(esr));
 
-            check_status(status, "event_wait", NULL, NULL);
+            /* a signal interrupting the wait is not an error */
+            if (status >= 0 || openvpn_errno() != EINTR)
+            {
+                check_status(status, "event_wait", NULL, NULL);
+            }
 
             if (status > 0)
             {
@@ -50,6 +50,7 @@
 #include "openvpn.h"
 #include "occ.h"
 #include "ping.h"
+#include "evlog.h"
 
 #define IOW_TO_TUN          (1<<0)
 #define IOW_TO_LINK         (1<<1)
@@ -68,10 +69,23 @@ extern counter_type link_read_bytes_global;
 
 extern counter_type link_write_bytes_global;
 
+extern counter_type link_read_drops_global;
+
 void io_wait_dowork(struct context *c, const unsigned int flags);
 
 void pre_select(struct context *c);
 
+/**
+ * Run the \c --inactive and \c --ping timers of a client instance of
+ * the server, which \c pre_select() leaves out for those.
+ *
+ * @param c            - The context structure of the client instance.
+ *
+ * @return The number of seconds until the timers need to run again,
+ *     or \c BIG_TIMEOUT if none of them is enabled.
+ */
+interval_t process_keepalive_timers(struct context *c);
+
 void process_io(struct context *c);
 
 /**********************************************************************/
@@ -424,4 +438,28 @@ connection_established(struct context *c)
     }
 }
 
+/**
+ * Record an event of the peer of \c c in the --event-log ring.
+ *
+ * @param flags  msg() flags of the matching log message
+ * @param event  EVLOG_* event id
+ */
+static inline void
+context_evlog(const struct context *c, const unsigned int flags, const uint16_t event,
+              const uint64_t a0, const uint64_t a1, const uint64_t a2, const uint64_t a3)
+{
+#ifdef ENABLE_EVENT_LOG
+    if (evlog)
+    {
+        uint64_t cid = EVLOG_NO_CID;
+#ifdef ENABLE_MANAGEMENT
+        cid = c->c2.mda_context.cid;
+#endif
+        evlog_write(flags, event, cid,
+                    c->c2.tls_multi ? c->c2.tls_multi->peer_id : MAX_PEER_ID,
+                    a0, a1, a2, a3);
+    }
+#endif
+}
+
 #endif /* FORWARD_H */
@@ -39,52 +39,199 @@
 
 #define FRAG_ERR(s) { errmsg = s; goto error; }
 
+/*
+ * Idle reassembly structures, shared by all tunnels.  Their buffers
+ * are kept so that a packet burst does not cost a malloc per packet.
+ */
+static struct fragment *frag_pool;   /* GLOBAL */
+static int frag_pool_len;            /* GLOBAL */
+static int frag_masters;             /* GLOBAL */
+
+static struct fragment *
+fragment_pool_get(int buf_size)
+{
+    struct fragment *frag = frag_pool;
+    if (frag)
+    {
+        frag_pool = frag->next;
+        --frag_pool_len;
+        if (frag->buf.capacity < buf_size)
+        {
+            free_buf(&frag->buf);
+            frag->buf = alloc_buf(buf_size);
+        }
+    }
+    else
+    {
+        ALLOC_OBJ_CLEAR(frag, struct fragment);
+        frag->buf = alloc_buf(buf_size);
+    }
+    return frag;
+}
+
+static void
+fragment_pool_put(struct fragment *frag)
+{
+    if (frag_pool_len < FRAG_POOL_MAX)
+    {
+        frag->prev = NULL;
+        frag->next = frag_pool;
+        frag_pool = frag;
+        ++frag_pool_len;
+    }
+    else
+    {
+        free_buf(&frag->buf);
+        free(frag);
+    }
+}
+
+static void
+fragment_pool_drain(void)
+{
+    while (frag_pool)
+    {
+        struct fragment *frag = frag_pool;
+        frag_pool = frag->next;
+        free_buf(&frag->buf);
+        free(frag);
+    }
+    frag_pool_len = 0;
+}
+
+/* move an entry to the tail of the expiry list */
+static void
+fragment_list_touch(struct fragment_list *list, struct fragment *frag)
+{
+    if (list->tail == frag)
+    {
+        return;
+    }
+    if (frag->prev)
+    {
+        frag->prev->next = frag->next;
+    }
+    else if (list->head == frag)
+    {
+        list->head = frag->next;
+    }
+    if (frag->next)
+    {
+        frag->next->prev = frag->prev;
+    }
+    frag->prev = list->tail;
+    frag->next = NULL;
+    if (list->tail)
+    {
+        list->tail->next = frag;
+    }
+    else
+    {
+        list->head = frag;
+    }
+    list->tail = frag;
+}
+
+/* unlink an entry from the index and the expiry list */
+static struct fragment *
+fragment_list_remove(struct fragment_list *list, struct fragment *frag)
+{
+    if (frag->prev)
+    {
+        frag->prev->next = frag->next;
+    }
+    else
+    {
+        list->head = frag->next;
+    }
+    if (frag->next)
+    {
+        frag->next->prev = frag->prev;
+    }
+    else
+    {
+        list->tail = frag->prev;
+    }
+    list->index[frag->seq_id] = NULL;
+    --list->n;
+    return frag;
+}
+
 static void
-fragment_list_buf_init(struct fragment_list *list, const struct frame *frame)
+fragment_list_release(struct fragment_list *list, int seq_id)
 {
-    int i;
-    for (i = 0; i < N_FRAG_BUF; ++i)
+    struct fragment *frag = list->index[seq_id];
+    if (frag)
     {
-        list->fragments[i].buf = alloc_buf(BUF_SIZE(frame));
+        fragment_pool_put(fragment_list_remove(list, frag));
     }
 }
 
 static void
-fragment_list_buf_free(struct fragment_list *list)
+fragment_list_free(struct fragment_list *list)
 {
-    int i;
-    for (i = 0; i < N_FRAG_BUF; ++i)
+    while (list->head)
     {
-        free_buf(&list->fragments[i].buf);
+        fragment_pool_put(fragment_list_remove(list, list->head));
     }
+    if (list->done)
+    {
+        fragment_pool_put(list->done);
+        list->done = NULL;
+    }
+    free(list->index);
+    list->index = NULL;
 }
 
 /*
- * Given a sequence ID number, get a fragment buffer.  Use a sliding window,
- * similar to packet_id code.
+ * Given a sequence ID number, get a fragment structure, taking it from
+ * the pool if this is the first fragment of the packet.  Use a sliding
+ * window, similar to packet_id code.
  */
 static struct fragment *
-fragment_list_get_buf(struct fragment_list *list, int seq_id)
+fragment_list_get_buf(struct fragment_list *list, int seq_id, int buf_size)
 {
+    struct fragment *frag;
     int diff;
-    if (abs(diff = modulo_subtract(seq_id, list->seq_id, N_SEQ_ID)) >= N_FRAG_BUF)
+
+    if (!list->index)
+    {
+        ALLOC_ARRAY_CLEAR(list->index, struct fragment *, N_SEQ_ID);
+        list->seq_id = seq_id;
+    }
+
+    if (abs(diff = modulo_subtract(seq_id, list->seq_id, N_SEQ_ID)) >= FRAG_WINDOW)
+    {
+        while (list->head)
+        {
+            fragment_pool_put(fragment_list_remove(list, list->head));
+        }
+        list->seq_id = seq_id;
+    }
+    else if (diff > 0)
     {
+        /* release the IDs which slide out of the window */
+        const int out = list->seq_id - FRAG_WINDOW + N_SEQ_ID;
         int i;
-        for (i = 0; i < N_FRAG_BUF; ++i)
+        for (i = 1; i <= diff && list->n; ++i)
         {
-            list->fragments[i].defined = false;
+            fragment_list_release(list, (out + i) & (N_SEQ_ID - 1));
         }
-        list->index = 0;
         list->seq_id = seq_id;
-        diff = 0;
     }
-    while (diff > 0)
+
+    frag = list->index[seq_id];
+    if (!frag)
     {
-        list->fragments[list->index = modulo_add(list->index, 1, N_FRAG_BUF)].defined = false;
-        list->seq_id = modulo_add(list->seq_id, 1, N_SEQ_ID);
-        --diff;
+        frag = fragment_pool_get(buf_size);
+        frag->seq_id = seq_id;
+        frag->max_frag_size = -1;
+        frag->prev = frag->next = NULL;
+        list->index[seq_id] = frag;
+        ++list->n;
     }
-    return &list->fragments[modulo_add(list->index, diff, N_FRAG_BUF)];
+    fragment_list_touch(list, frag);
+    return frag;
 }
 
 struct fragment_master *
@@ -111,24 +258,50 @@ fragment_init(struct frame *frame)
 
     event_timeout_init(&ret->wakeup, FRAG_WAKEUP_INTERVAL, now);
 
+    ++frag_masters;
+
     return ret;
 }
 
 void
 fragment_free(struct fragment_master *f)
 {
-    fragment_list_buf_free(&f->incoming);
+    fragment_list_free(&f->incoming);
     free_buf(&f->outgoing);
     free_buf(&f->outgoing_return);
     free(f);
+
+    if (--frag_masters == 0)
+    {
+        fragment_pool_drain();
+    }
+}
+
+int
+fragment_memory_bytes(const struct fragment_master *f)
+{
+    const struct fragment *frag;
+    int ret = sizeof(*f) + f->outgoing.capacity + f->outgoing_return.capacity;
+
+    if (f->incoming.index)
+    {
+        ret += N_SEQ_ID * sizeof(*f->incoming.index);
+    }
+    for (frag = f->incoming.head; frag; frag = frag->next)
+    {
+        ret += sizeof(*frag) + frag->buf.capacity;
+    }
+    if (f->incoming.done)
+    {
+        ret += sizeof(*f->incoming.done) + f->incoming.done->buf.capacity;
+    }
+    return ret;
 }
 
 void
 fragment_frame_init(struct fragment_master *f, const struct frame *frame)
 {
-    fragment_list_buf_init(&f->incoming, frame);
-    f->outgoing = alloc_buf(BUF_SIZE(frame));
-    f->outgoing_return = alloc_buf(BUF_SIZE(frame));
+    f->buf_size = BUF_SIZE(frame);
 }
 
 /*
@@ -145,6 +318,13 @@ fragment_incoming(struct fragment_master *f, struct buffer *buf,
     fragment_header_type flags = 0;
     int frag_type = 0;
 
+    /* the last packet we completed has been processed by now */
+    if (f->incoming.done)
+    {
+        fragment_pool_put(f->incoming.done);
+        f->incoming.done = NULL;
+    }
+
     if (buf->len > 0)
     {
         /* get flags from packet head */
@@ -190,7 +370,7 @@ fragment_incoming(struct fragment_master *f, struct buffer *buf,
                               : buf->len);
 
             /* get the appropriate fragment buffer based on received seq_id */
-            struct fragment *frag = fragment_list_get_buf(&f->incoming, seq_id);
+            struct fragment *frag = fragment_list_get_buf(&f->incoming, seq_id, f->buf_size);
 
             dmsg(D_FRAG_DEBUG,
                  "FRAG_IN len=%d type=%d seq_id=%d frag_id=%d size=%d flags="
@@ -209,9 +389,8 @@ fragment_incoming(struct fragment_master *f, struct buffer *buf,
             }
 
             /* is this the first fragment for our sequence number? */
-            if (!frag->defined || frag->max_frag_size != size)
+            if (frag->max_frag_size != size)
             {
-                frag->defined = true;
                 frag->max_frag_size = size;
                 frag->map = 0;
                 ASSERT(buf_init(&frag->buf, FRAME_HEADROOM_ADJ(frame, FRAME_HEADROOM_MARKER_FRAGMENT)));
@@ -232,7 +411,7 @@ fragment_incoming(struct fragment_master *f, struct buffer *buf,
             /* received full datagram? */
             if ((frag->map & FRAG_MAP_MASK) == FRAG_MAP_MASK)
             {
-                frag->defined = false;
+                f->incoming.done = fragment_list_remove(&f->incoming, frag);
                 *buf = frag->buf;
             }
             else
@@ -345,6 +524,11 @@ fragment_outgoing(struct fragment_master *f, struct buffer *buf,
             {
                 FRAG_ERR("too many fragments would be required to send datagram");
             }
+            if (!f->outgoing.data)
+            {
+                f->outgoing = alloc_buf(f->buf_size);
+                f->outgoing_return = alloc_buf(f->buf_size);
+            }
             ASSERT(buf_init(&f->outgoing, FRAME_HEADROOM(frame)));
             ASSERT(buf_copy(&f->outgoing, buf));
             f->outgoing_seq_id = modulo_add(f->outgoing_seq_id, 1, N_SEQ_ID);
@@ -417,15 +601,13 @@ fragment_ready_to_send(struct fragment_master *f, struct buffer *buf,
 static void
 fragment_ttl_reap(struct fragment_master *f)
 {
-    int i;
-    for (i = 0; i < N_FRAG_BUF; ++i)
+    struct fragment_list *list = &f->incoming;
+
+    /* the expiry list is ordered by timestamp, oldest first */
+    while (list->head && list->head->timestamp + FRAG_TTL_SEC <= now)
     {
-        struct fragment *frag = &f->incoming.fragments[i];
-        if (frag->defined && frag->timestamp + FRAG_TTL_SEC <= now)
-        {
-            msg(D_FRAG_ERRORS, "FRAG TTL expired i=%d", i);
-            frag->defined = false;
-        }
+        msg(D_FRAG_ERRORS, "FRAG TTL expired seq_id=%d", list->head->seq_id);
+        fragment_pool_put(fragment_list_remove(list, list->head));
     }
 }
 
@@ -46,10 +46,18 @@
 #include "error.h"
 
 
-#define N_FRAG_BUF                   25
-/**< Number of packet buffers for
- *   reassembling incoming fragmented
- *   packets. */
+#define FRAG_WINDOW                  128
+/**< Number of consecutive fragmentation
+ *   sequence IDs, ending at the highest
+ *   one received, for which incoming
+ *   packets can be reassembled
+ *   concurrently.  Must be at most half of
+ *   \c N_SEQ_ID. */
+
+#define FRAG_POOL_MAX                1024
+/**< Maximum number of idle reassembly
+ *   buffers kept in the process-wide pool
+ *   for reuse. */
 
 #define FRAG_TTL_SEC                 10
 /**< Time-to-live in seconds for a %fragment. */
@@ -61,10 +69,14 @@
 /**************************************************************************/
 /**
  * Structure for reassembling one incoming fragmented packet.
+ *
+ * These structures are taken from a process-wide pool when the first
+ * %fragment of a packet arrives, and returned to it when the packet is
+ * complete or has expired.
  */
 struct fragment {
-    bool defined;               /**< Whether reassembly is currently
-                                 *   taking place in this structure. */
+    int seq_id;                 /**< Fragmentation sequence ID of the
+                                 *   packet being reassembled. */
 
     int max_frag_size;          /**< Maximum size of each %fragment. */
 
@@ -83,35 +95,42 @@ struct fragment {
 
     time_t timestamp;           /**< Timestamp for time-to-live purposes. */
 
+    struct fragment *prev;      /**< Previous entry in the expiry list. */
+    struct fragment *next;      /**< Next entry in the expiry list, or in
+                                 *   the pool of idle structures. */
+
     struct buffer buf;          /**< Buffer in which received datagrams
                                  *   are reassembled. */
 };
 
 
 /**
- * List of fragment structures for reassembling multiple incoming packets
+ * Index of the fragment structures reassembling incoming packets
  * concurrently.
  */
 struct fragment_list {
-    int seq_id;                 /**< Highest fragmentation sequence ID of
-                                 *   the packets currently being
-                                 *   reassembled. */
-    int index;                  /**< Index of the packet being reassembled
-                                 *   with the highest fragmentation
-                                 *   sequence ID into the \c
-                                 *   fragment_list.fragments array. */
-
-/** Array of reassembly structures, each can contain one whole packet.
- *
- *  The fragmentation sequence IDs of the packets being reassembled in
- *  this array are linearly increasing. \c
- *  fragment_list.fragments[fragment_list.index] has an ID of \c
- *  fragment_list.seq_id.  This means that one of these \c fragment_list
- *  structures can at any one time contain at most packets with the
- *  fragmentation sequence IDs in the range \c fragment_list.seq_id \c -
- *  \c N_FRAG_BUF \c + \c 1 to \c fragment_list.seq_id, inclusive.
+    int seq_id;                 /**< Highest fragmentation sequence ID
+                                 *   received so far. */
+
+/** Reassembly structures indexed by fragmentation sequence ID.
+ *
+ *  Only entries for the packets currently being reassembled are set,
+ *  and they all have IDs in the range \c fragment_list.seq_id \c -
+ *  \c FRAG_WINDOW \c + \c 1 to \c fragment_list.seq_id, inclusive.
+ *  The array itself is allocated when the first fragmented packet is
+ *  received.
  */
-    struct fragment fragments[N_FRAG_BUF];
+    struct fragment **index;
+
+    struct fragment *head;      /**< Entry updated least recently, which
+                                 *   is the first one to expire. */
+    struct fragment *tail;      /**< Entry updated most recently. */
+    int n;                      /**< Number of entries in use. */
+
+    struct fragment *done;      /**< Entry whose buffer holds the packet
+                                 *   completed last, returned to the pool
+                                 *   on the next call of \c
+                                 *   fragment_incoming(). */
 };
 
 
@@ -128,10 +147,10 @@ struct fragment_list {
  * sent can be retrieved by successive calls to \c
  * fragment_ready_to_send().
  *
- * The received packets currently being reassembled are stored in the \c
- * fragment_master.incoming array of \c fragment structures.  The \c
- * fragment_incoming() function adds newly received parts into this array
- * and returns the whole packets once reassembly is complete.
+ * The received packets currently being reassembled are stored in \c
+ * fragment structures indexed by \c fragment_master.incoming.  The \c
+ * fragment_incoming() function adds newly received parts into them and
+ * returns the whole packets once reassembly is complete.
  */
 struct fragment_master {
     struct event_timeout wakeup; /**< Timeout structure used by the main
@@ -169,6 +188,8 @@ struct fragment_master {
     int outgoing_frag_id;       /**< The fragment ID of the next part to
                                  *   be sent.  Must have a value between 0
                                  *   and \c MAX_FRAGS-1. */
+    int buf_size;               /**< Size of the packet buffers, which
+                                 *   are allocated when first needed. */
     struct buffer outgoing;     /**< Buffer containing the remaining parts
                                  *   of the fragmented packet being sent. */
     struct buffer outgoing_return;
@@ -177,7 +198,7 @@ struct fragment_master {
      *   part to send. */
 
     struct fragment_list incoming;
-    /**< List of structures for reassembling
+    /**< Index of structures for reassembling
      *   incoming packets. */
 };
 
@@ -274,10 +295,11 @@ struct fragment_master *fragment_init(struct frame *frame);
 
 
 /**
- * Allocate internal packet buffers for a \c fragment_master structure.
+ * Set the size of the internal packet buffers of a \c fragment_master
+ * structure.  The buffers themselves are allocated when first needed.
  *
  * @param f            - The \c fragment_master structure for which to
- *                       allocate the internal buffers.
+ *                       size the internal buffers.
  * @param frame        - The packet geometry parameters for this VPN
  *                       tunnel, used to determine how much memory to
  *                       allocate for each packet buffer.
@@ -287,11 +309,22 @@ void fragment_frame_init(struct fragment_master *f, const struct frame *frame);
 
 /**
  * Free a \c fragment_master structure and its internal packet buffers.
+ * Reassembly buffers go back to the pool, which is emptied once the last
+ * \c fragment_master structure has been freed.
  *
  * @param f            - The \c fragment_master structure to free.
  */
 void fragment_free(struct fragment_master *f);
 
+
+/**
+ * Return the number of bytes allocated for a \c fragment_master
+ * structure, its packet buffers and the reassembly buffers it holds.
+ *
+ * @param f            - The \c fragment_master structure to inspect.
+ */
+int fragment_memory_bytes(const struct fragment_master *f);
+
 /** @} name Functions for initialization and cleanup *//*******************/
 
 
@@ -452,9 +485,9 @@ void fragment_wakeup(struct fragment_master *f, struct frame *frame);
 /**
  * Perform housekeeping of a \c fragment_master structure.
  *
- * Housekeeping includes scanning incoming packet reassembly buffers for
- * packets which have not yet been reassembled completely but are already
- * older than their time-to-live.
+ * Housekeeping includes releasing the reassembly buffers of packets
+ * which have not yet been reassembled completely but are already older
+ * than their time-to-live.
  *
  * @param f            - The \c fragment_master structure for this VPN
  *                       tunnel.
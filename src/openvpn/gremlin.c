@@ -63,6 +63,11 @@ static const int drop_freq[] = { 500, 100, 50 };
  */
 static const int corrupt_freq[] = { 500, 100, 50 };
 
+/*
+ * Probability that we will reorder a packet is 1 / n
+ */
+static const int reorder_freq[] = { 500, 100, 20 };
+
 /*
  * When network goes up, it will be up for between
  * UP_LOW and UP_HIGH seconds.
@@ -179,6 +184,22 @@ ask_gremlin(int flags)
     return up;
 }
 
+/*
+ * Return true if we should send a packet after the next one.
+ */
+bool
+reorder_gremlin(int flags)
+{
+    const int reorder_level = GREMLIN_REORDER_LEVEL(flags);
+
+    if (reorder_level && flip(reorder_freq[reorder_level-1]))
+    {
+        dmsg(D_GREMLIN_VERBOSE, "GREMLIN: Packet reorder");
+        return true;
+    }
+    return false;
+}
+
 /*
  * Possibly corrupt a packet.
  */
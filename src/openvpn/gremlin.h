@@ -47,6 +47,11 @@
 #define GREMLIN_DROP_SHIFT               (9)
 #define GREMLIN_DROP_MASK                (0x03)
 
+/* 2048:1/500 4096:1/100 6144:1/20, datagrams sent after the next one */
+
+#define GREMLIN_REORDER_SHIFT            (11)
+#define GREMLIN_REORDER_MASK             (0x03)
+
 /* extract gremlin parms */
 
 #define GREMLIN_CONNECTION_FLOOD_LEVEL(x) (((x)>>GREMLIN_CONNECTION_FLOOD_SHIFT) & GREMLIN_CONNECTION_FLOOD_MASK)
@@ -54,6 +59,7 @@
 #define GREMLIN_CORRUPT_LEVEL(x)          (((x)>>GREMLIN_CORRUPT_SHIFT)          & GREMLIN_CORRUPT_MASK)
 #define GREMLIN_UP_DOWN_LEVEL(x)          (((x)>>GREMLIN_UP_DOWN_SHIFT)          & GREMLIN_UP_DOWN_MASK)
 #define GREMLIN_DROP_LEVEL(x)             (((x)>>GREMLIN_DROP_SHIFT)             & GREMLIN_DROP_MASK)
+#define GREMLIN_REORDER_LEVEL(x)          (((x)>>GREMLIN_REORDER_SHIFT)          & GREMLIN_REORDER_MASK)
 
 #include "buffer.h"
 
@@ -67,6 +73,12 @@ bool ask_gremlin(int flags);
 
 void corrupt_gremlin(struct buffer *buf, int flags);
 
+/*
+ * Return true if an outgoing datagram should be held back
+ * and sent after the next one.
+ */
+bool reorder_gremlin(int flags);
+
 struct packet_flood_parms get_packet_flood_parms(int level);
 
 #endif /* ifdef ENABLE_DEBUG */
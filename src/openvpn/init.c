@@ -48,6 +48,8 @@
 #include "lladdr.h"
 #include "ping.h"
 #include "mstats.h"
+#include "evlog.h"
+#include "perf.h"
 #include "ssl_verify.h"
 #include "ssl_ncp.h"
 #include "tls_crypt.h"
@@ -963,7 +965,7 @@ init_static(void)
 #ifdef MSTATS_TEST
     {
         int i;
-        mstats_open("/dev/shm/mstats.dat");
+        mstats_open("/dev/shm/mstats.dat", 0);
         for (i = 0; i < 30; ++i)
         {
             mmap_stats->n_clients += 1;
@@ -1273,7 +1275,15 @@ do_uid_gid_chroot(struct context *c, bool no_delay)
 #ifdef ENABLE_MEMSTATS
         if (c->first_time && c->options.memstats_fn)
         {
-            mstats_open(c->options.memstats_fn);
+            mstats_open(c->options.memstats_fn,
+                        c->options.mode == MODE_SERVER ? c->options.max_clients : 0);
+        }
+#endif
+
+#ifdef ENABLE_EVENT_LOG
+        if (c->first_time && c->options.event_log_fn)
+        {
+            evlog_open(c->options.event_log_fn, c->options.event_log_records);
         }
 #endif
 
@@ -1424,6 +1434,12 @@ do_init_timers(struct context *c, bool deferred)
             event_timeout_init(&c->c2.occ_mtu_load_test_interval, OCC_MTU_LOAD_INTERVAL_SECONDS, now);
         }
 
+        if (c->options.mtu_probe && proto_is_dgram(c->options.ce.proto))
+        {
+            plpmtud_init(&c->c2.plpmtud, PLPMTUD_BASE, EXPANDED_SIZE(&c->c2.frame),
+                         EXTRA_FRAME(&c->c2.frame), c->options.mtu_probe);
+        }
+
         /* initialize packet_id persistence timer */
         if (c->options.packet_id_file)
         {
@@ -2277,7 +2293,9 @@ do_deferred_options(struct context *c, const unsigned int found)
     {
         msg(D_PUSH, "OPTIONS IMPORT: compression parms modified");
         comp_uninit(c->c2.comp_context);
-        c->c2.comp_context = comp_init(&c->options.comp);
+        c->c2.comp_context = comp_init(&c->options.comp,
+                                       !proto_is_udp(c->options.ce.proto),
+                                       dev_type_enum(c->options.dev, c->options.dev_type));
     }
 #endif
 
@@ -3427,6 +3445,12 @@ do_init_first_time(struct context *c)
 
         /* should we change scheduling priority? */
         platform_nice(c->options.nice);
+
+        /* enable latency profiling */
+        if (c->options.perf_sample)
+        {
+            perf_set_sample(c->options.perf_sample);
+        }
     }
 }
 
@@ -3442,6 +3466,9 @@ do_close_free_buf(struct context *c)
         c->c2.buffers = NULL;
         c->c2.buffers_owned = false;
     }
+#ifdef ENABLE_DEBUG
+    free_buf(&c->c2.gremlin_held);
+#endif
 }
 
 /*
@@ -4179,7 +4206,8 @@ init_instance(struct context *c, const struct env_set *env, const unsigned int f
     /* initialize compression library. */
     if (comp_enabled(&options->comp) && (c->mode == CM_P2P || child))
     {
-        c->c2.comp_context = comp_init(&options->comp);
+        c->c2.comp_context = comp_init(&options->comp, !proto_is_udp(options->ce.proto),
+                                       dev_type_enum(options->dev, options->dev_type));
     }
 #endif
 
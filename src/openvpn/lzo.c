@@ -38,9 +38,17 @@
 #include "comp.h"
 #include "error.h"
 #include "otime.h"
+#include "perf.h"
 
 #include "memdbg.h"
 
+/*
+ * The compressor only uses its working memory during a call, so all
+ * tunnels share one buffer instead of keeping one each.
+ */
+static lzo_voidp lzo_wmem;      /* GLOBAL */
+static int lzo_wmem_users;      /* GLOBAL */
+
 /**
  * Perform adaptive compression housekeeping.
  *
@@ -104,24 +112,33 @@ lzo_compress_init(struct compress_context *compctx)
     ASSERT(!(compctx->flags & COMP_F_SWAP));
     compctx->wu.lzo.wmem_size = LZO_WORKSPACE;
 
-    int lzo_status = lzo_init();
-    if (lzo_status != LZO_E_OK)
+    if (!lzo_wmem_users++)
     {
-        msg(M_FATAL, "Cannot initialize LZO compression library (lzo_init() returns %d)", lzo_status);
+        int lzo_status = lzo_init();
+        if (lzo_status != LZO_E_OK)
+        {
+            msg(M_FATAL, "Cannot initialize LZO compression library (lzo_init() returns %d)", lzo_status);
+        }
+        lzo_wmem = (lzo_voidp) lzo_malloc(LZO_WORKSPACE);
+        check_malloc_return(lzo_wmem);
     }
-    compctx->wu.lzo.wmem = (lzo_voidp) lzo_malloc(compctx->wu.lzo.wmem_size);
-    check_malloc_return(compctx->wu.lzo.wmem);
+    compctx->wu.lzo.wmem = lzo_wmem;
 }
 
 static void
 lzo_compress_uninit(struct compress_context *compctx)
 {
-    lzo_free(compctx->wu.lzo.wmem);
     compctx->wu.lzo.wmem = NULL;
+    if (!--lzo_wmem_users)
+    {
+        lzo_free(lzo_wmem);
+        lzo_wmem = NULL;
+    }
 }
 
 static inline bool
-lzo_compression_enabled(struct compress_context *compctx)
+lzo_compression_enabled(struct compress_context *compctx,
+                        const struct buffer *buf, uint32_t *flow)
 {
     if (!(compctx->flags & COMP_F_ALLOW_COMPRESS))
     {
@@ -131,7 +148,8 @@ lzo_compression_enabled(struct compress_context *compctx)
     {
         if (compctx->flags & COMP_F_ADAPTIVE)
         {
-            return lzo_adaptive_compress_test(&compctx->wu.lzo.ac);
+            return lzo_adaptive_compress_test(&compctx->wu.lzo.ac)
+                   && comp_adaptive_test(compctx, buf, flow);
         }
         else
         {
@@ -148,6 +166,7 @@ lzo_compress(struct buffer *buf, struct buffer work,
     lzo_uint zlen = 0;
     int err;
     bool compressed = false;
+    uint32_t flow = 0;
 
     if (buf->len <= 0)
     {
@@ -158,9 +177,10 @@ lzo_compress(struct buffer *buf, struct buffer work,
      * In order to attempt compression, length must be at least COMPRESS_THRESHOLD,
      * and our adaptive level must give the OK.
      */
-    if (buf->len >= COMPRESS_THRESHOLD && lzo_compression_enabled(compctx))
+    if (buf->len >= COMPRESS_THRESHOLD && lzo_compression_enabled(compctx, buf, &flow))
     {
         const size_t ps = PAYLOAD_SIZE(frame);
+        const uint64_t start = perf_now();
         ASSERT(buf_init(&work, FRAME_HEADROOM(frame)));
         ASSERT(buf_safe(&work, ps + COMP_EXTRA_BUFFER(ps)));
 
@@ -191,6 +211,7 @@ lzo_compress(struct buffer *buf, struct buffer work,
         if (compctx->flags & COMP_F_ADAPTIVE)
         {
             lzo_adaptive_compress_data(&compctx->wu.lzo.ac, buf->len, work.len);
+            comp_adaptive_result(compctx, flow, buf->len, work.len, start);
         }
     }
 
@@ -263,6 +284,7 @@ const struct compress_alg lzo_alg = {
     lzo_compress_init,
     lzo_compress_uninit,
     lzo_compress,
-    lzo_decompress
+    lzo_decompress,
+    NULL
 };
 #endif /* ENABLE_LZO */
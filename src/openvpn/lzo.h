@@ -111,7 +111,8 @@ struct lzo_adaptive_compress {
  *
  * This structure contains compression module state, such as whether
  * compression is enabled and the status of the adaptive compression
- * routines.  It also contains an allocated working buffer.
+ * routines.  It also points to the working buffer, which is shared by
+ * all VPN tunnels.
  *
  * One of these compression workspace structures is maintained for each
  * VPN tunnel.
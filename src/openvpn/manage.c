@@ -39,9 +39,11 @@
 #include "otime.h"
 #include "integer.h"
 #include "misc.h"
+#include "perf.h"
 #include "ssl.h"
 #include "common.h"
 #include "manage.h"
+#include "pktrace.h"
 
 #include "memdbg.h"
 
@@ -83,30 +85,41 @@ man_help(void)
     msg(M_CLIENT, "                         release current hold and start tunnel.");
     msg(M_CLIENT, "kill cn                : Kill the client instance(s) having common name cn.");
     msg(M_CLIENT, "kill IP:port           : Kill the client instance connecting from IP:port.");
+    msg(M_CLIENT, "kill-batch             : Kill the clients given as cn or IP:port, one per line (MULTILINE)");
     msg(M_CLIENT, "load-stats             : Show global server load stats.");
     msg(M_CLIENT, "log [on|off] [N|all]   : Turn on/off realtime log display");
     msg(M_CLIENT, "                         + show last N lines or 'all' for entire history.");
+    msg(M_CLIENT, "metrics                : Show server metrics in OpenMetrics text format.");
     msg(M_CLIENT, "mute [n]               : Set log mute level to n, or show level if n is absent.");
     msg(M_CLIENT, "needok type action     : Enter confirmation for NEED-OK request of 'type',");
     msg(M_CLIENT, "                         where action = 'ok' or 'cancel'.");
     msg(M_CLIENT, "needstr type action    : Enter confirmation for NEED-STR request of 'type',");
     msg(M_CLIENT, "                         where action is reply string.");
     msg(M_CLIENT, "net                    : (Windows only) Show network info and routing table.");
+    msg(M_CLIENT, "notify-filter [t ...|all] : Only send notifications of types t, or all types.");
     msg(M_CLIENT, "password type p        : Enter password p for a queried OpenVPN password.");
+    msg(M_CLIENT, "perf [on [n]|off|reset] : Show stage latency histograms, enable profiling");
+    msg(M_CLIENT, "                         of 1 in n event loops, disable it or clear histograms.");
     msg(M_CLIENT, "remote type [host port] : Override remote directive, type=ACCEPT|MOD|SKIP.");
     msg(M_CLIENT, "proxy type [host port flags] : Enter dynamic proxy server info.");
     msg(M_CLIENT, "pid                    : Show process ID of the current OpenVPN process.");
+    msg(M_CLIENT, "protocol [binary]      : Show protocol or switch to framed binary protocol.");
 #ifdef ENABLE_PKCS11
     msg(M_CLIENT, "pkcs11-id-count        : Get number of available PKCS#11 identities.");
     msg(M_CLIENT, "pkcs11-id-get index    : Get PKCS#11 identity at index.");
 #endif
     msg(M_CLIENT, "client-auth CID KID    : Authenticate client-id/key-id CID/KID (MULTILINE)");
     msg(M_CLIENT, "client-auth-nt CID KID : Authenticate client-id/key-id CID/KID");
+    msg(M_CLIENT, "client-auth-nt-batch   : Authenticate the clients given as CID KID, one per line (MULTILINE)");
     msg(M_CLIENT, "client-deny CID KID R [CR] : Deny auth client-id/key-id CID/KID with log reason");
     msg(M_CLIENT, "                             text R and optional client reason text CR");
     msg(M_CLIENT, "client-pending-auth CID MSG : Instruct OpenVPN to send AUTH_PENDING and INFO_PRE msg"
         "                          to the client and wait for a final client-auth/client-deny");
     msg(M_CLIENT, "client-kill CID [M]    : Kill client instance CID with message M (def=RESTART)");
+    msg(M_CLIENT, "client-kill-batch      : Kill the clients given as CID [M], one per line (MULTILINE)");
+    msg(M_CLIENT, "client-trace CID on [n] : Record the last n packets of client CID (def=%d)",
+        PKTRACE_DEFAULT_PACKETS);
+    msg(M_CLIENT, "client-trace CID off|dump : Stop tracing or write the trace to a pcapng file");
     msg(M_CLIENT, "env-filter [level]     : Set env-var filter level");
 #ifdef MANAGEMENT_PF
     msg(M_CLIENT, "client-pf CID          : Define packet filter for client CID (MULTILINE)");
@@ -122,6 +135,7 @@ man_help(void)
     msg(M_CLIENT, "state [on|off] [N|all] : Like log, but show state history.");
     msg(M_CLIENT, "status [n]             : Show current daemon status info using format #n.");
     msg(M_CLIENT, "test n                 : Produce n lines of output for testing/debugging.");
+    msg(M_CLIENT, "top-clients [n]        : Show the n clients with the highest traffic rates (def=10).");
     msg(M_CLIENT, "username type u        : Enter username u for a queried OpenVPN username.");
     msg(M_CLIENT, "verb [n]               : Set log verbosity level to n, or show if n is absent.");
     msg(M_CLIENT, "version [n]            : Set client's version to n or show current version of daemon.");
@@ -249,12 +263,95 @@ man_output_list_push_finalize(struct management *man)
     }
 }
 
+/*
+ * Binary management protocol.
+ *
+ * After "protocol binary" succeeded, both directions of the connection
+ * carry frames of
+ *
+ *   uint32 length of the rest of the frame
+ *   uint8  type (MAN_FRAME_*)
+ *   uint32 request id
+ *   payload
+ *
+ * with all integers in network byte order.  A MAN_FRAME_COMMAND payload
+ * holds one or more command lines as they would be sent in text mode.
+ * Its reply, the text the commands would have produced, is returned as
+ * a single MAN_FRAME_REPLY with the same request id, so that requests
+ * can be pipelined.  Real-time notifications are sent as MAN_FRAME_NOTIFY
+ * and the per-client bytecount updates of the server are batched into
+ * MAN_FRAME_BYTECOUNT frames of MAN_BYTECOUNT_RECORD_SIZE records.
+ */
+#define MAN_FRAME_COMMAND   1
+#define MAN_FRAME_REPLY     2
+#define MAN_FRAME_NOTIFY    3
+#define MAN_FRAME_BYTECOUNT 4
+
+#define MAN_FRAME_HEADER_SIZE 9
+#define MAN_FRAME_MAX_SIZE    65536 /* largest frame accepted from a client */
+
+/* uint64 cid, uint64 bytes in and uint64 bytes out since the last record */
+#define MAN_BYTECOUNT_RECORD_SIZE 24
+#define MAN_BYTECOUNT_BATCH_SIZE  (MAN_BYTECOUNT_RECORD_SIZE * 512)
+
+static void
+man_frame_push(struct management *man, const uint8_t type, const uint32_t id,
+               const uint8_t *payload, const int len)
+{
+    struct gc_arena gc = gc_new();
+    struct buffer buf = alloc_buf_gc(MAN_FRAME_HEADER_SIZE + len, &gc);
+
+    buf_write_u32(&buf, len + MAN_FRAME_HEADER_SIZE - 4);
+    buf_write_u8(&buf, type);
+    buf_write_u32(&buf, id);
+    buf_write(&buf, payload, len);
+    buffer_list_push_data(man->connection.out, BPTR(&buf), BLEN(&buf));
+    gc_free(&gc);
+}
+
+/*
+ * Check a line of output against the notification filter set with
+ * the "notify-filter" command.  Only notifications are filtered.
+ */
+static bool
+man_notify_filter_match(const struct management *man, const char *str)
+{
+    const char *filter = man->connection.notify_filter;
+    if (filter && str[0] == '>')
+    {
+        char type[64];
+        int i;
+
+        for (i = 0; str[i + 1] && str[i + 1] != ':' && i < sizeof(type) - 3; ++i)
+        {
+            type[i + 1] = str[i + 1];
+        }
+        type[0] = ',';
+        type[i + 1] = ',';
+        type[i + 2] = '\0';
+        return strstr(filter, type) != NULL;
+    }
+    return true;
+}
+
 static void
 man_output_list_push_str(struct management *man, const char *str)
 {
-    if (management_connected(man) && str)
+    if (management_connected(man) && str && man_notify_filter_match(man, str))
     {
-        buffer_list_push(man->connection.out, str);
+        struct man_connection *mc = &man->connection;
+        if (!mc->binary)
+        {
+            buffer_list_push(mc->out, str);
+        }
+        else if (mc->binary_reply && str[0] != '>')
+        {
+            buffer_list_push(mc->binary_reply, str);
+        }
+        else
+        {
+            man_frame_push(man, MAN_FRAME_NOTIFY, 0, (const uint8_t *) str, strlen(str));
+        }
     }
 }
 
@@ -458,6 +555,75 @@ man_status(struct management *man, const int version, struct status_output *so)
     }
 }
 
+static void
+man_metrics(struct management *man, struct status_output *so)
+{
+    if (man->persist.callback.metrics)
+    {
+        (*man->persist.callback.metrics)(man->persist.callback.arg, so);
+    }
+    else
+    {
+        msg(M_CLIENT, "ERROR: The 'metrics' command is not supported by the current daemon mode");
+    }
+}
+
+static void
+man_top_clients(struct management *man, const char *n_str, struct status_output *so)
+{
+    const int n = n_str ? atoi(n_str) : 10;
+
+    if (!man->persist.callback.top_clients)
+    {
+        msg(M_CLIENT, "ERROR: The 'top-clients' command is not supported by the current daemon mode");
+    }
+    else if (n < 1 || n > MANAGEMENT_TOP_CLIENTS_MAX)
+    {
+        msg(M_CLIENT, "ERROR: top-clients count must be between 1 and %d", MANAGEMENT_TOP_CLIENTS_MAX);
+    }
+    else
+    {
+        (*man->persist.callback.top_clients)(man->persist.callback.arg, n, so);
+    }
+}
+
+static void
+man_perf(const char *cmd, const char *arg, struct status_output *so)
+{
+    if (!cmd)
+    {
+        perf_print_histograms(so);
+        msg(M_CLIENT, "END");
+    }
+    else if (streq(cmd, "on"))
+    {
+        const int sample = arg ? atoi(arg) : 1;
+        if (sample > 0)
+        {
+            perf_set_sample(sample);
+            msg(M_CLIENT, "SUCCESS: profiling 1 in %d event loop iterations", sample);
+        }
+        else
+        {
+            msg(M_CLIENT, "ERROR: bad sample rate: %s", arg);
+        }
+    }
+    else if (streq(cmd, "off"))
+    {
+        perf_set_sample(0);
+        msg(M_CLIENT, "SUCCESS: profiling disabled");
+    }
+    else if (streq(cmd, "reset"))
+    {
+        perf_reset();
+        msg(M_CLIENT, "SUCCESS: latency histograms cleared");
+    }
+    else
+    {
+        msg(M_CLIENT, "ERROR: unknown perf command: %s", cmd);
+    }
+}
+
 static void
 man_bytecount(struct management *man, const int update_seconds)
 {
@@ -472,6 +638,50 @@ man_bytecount(struct management *man, const int update_seconds)
     msg(M_CLIENT, "SUCCESS: bytecount interval changed");
 }
 
+static void
+man_bytecount_batch_flush(struct management *man)
+{
+    struct buffer *batch = &man->connection.bytecount_batch;
+    if (BLEN(batch))
+    {
+        man_frame_push(man, MAN_FRAME_BYTECOUNT, 0, BPTR(batch), BLEN(batch));
+        buf_reset_len(batch);
+        man_output_list_push_finalize(man);
+    }
+}
+
+/*
+ * In binary mode the bytecount updates of all clients are collected
+ * and sent as one frame when the batch is full or a second old.
+ */
+static void
+man_bytecount_batch_add(struct management *man, const unsigned long cid,
+                        const counter_type bytes_in, const counter_type bytes_out)
+{
+    struct buffer *batch = &man->connection.bytecount_batch;
+
+    if (!man_notify_filter_match(man, ">BYTECOUNT_CLI:"))
+    {
+        return;
+    }
+    if (man->connection.bytecount_batch_time != now)
+    {
+        man_bytecount_batch_flush(man);
+        man->connection.bytecount_batch_time = now;
+    }
+    buf_write_u32(batch, (uint32_t)((uint64_t)cid >> 32));
+    buf_write_u32(batch, (uint32_t)cid);
+    buf_write_u32(batch, (uint32_t)((uint64_t)bytes_in >> 32));
+    buf_write_u32(batch, (uint32_t)bytes_in);
+    buf_write_u32(batch, (uint32_t)((uint64_t)bytes_out >> 32));
+    buf_write_u32(batch, (uint32_t)bytes_out);
+
+    if (buf_forward_capacity(batch) < MAN_BYTECOUNT_RECORD_SIZE)
+    {
+        man_bytecount_batch_flush(man);
+    }
+}
+
 void
 man_bytecount_output_client(struct management *man)
 {
@@ -490,13 +700,24 @@ man_bytecount_output_server(struct management *man,
                             const counter_type *bytes_out_total,
                             struct man_def_auth_context *mdac)
 {
-    char in[32];
-    char out[32];
-    /* do in a roundabout way to work around possible mingw or mingw-glibc bug */
-    openvpn_snprintf(in, sizeof(in), counter_format, *bytes_in_total);
-    openvpn_snprintf(out, sizeof(out), counter_format, *bytes_out_total);
-    msg(M_CLIENT, ">BYTECOUNT_CLI:%lu,%s,%s", mdac->cid, in, out);
+    if (man->connection.binary)
+    {
+        man_bytecount_batch_add(man, mdac->cid,
+                                *bytes_in_total - mdac->bytecount_last_in,
+                                *bytes_out_total - mdac->bytecount_last_out);
+    }
+    else
+    {
+        char in[32];
+        char out[32];
+        /* do in a roundabout way to work around possible mingw or mingw-glibc bug */
+        openvpn_snprintf(in, sizeof(in), counter_format, *bytes_in_total);
+        openvpn_snprintf(out, sizeof(out), counter_format, *bytes_out_total);
+        msg(M_CLIENT, ">BYTECOUNT_CLI:%lu,%s,%s", mdac->cid, in, out);
+    }
     mdac->bytecount_last_update = now;
+    mdac->bytecount_last_in = *bytes_in_total;
+    mdac->bytecount_last_out = *bytes_out_total;
 }
 
 static void
@@ -886,6 +1107,125 @@ in_extra_reset(struct man_connection *mc, const int mode)
     }
 }
 
+/*
+ * Batch forms of kill, client-kill and client-auth-nt.  Each line of the
+ * multi-line input holds the arguments of one single command.  Instead of
+ * one reply per line a single summary line is returned once END is seen.
+ */
+
+static void
+man_kill_batch(struct management *man)
+{
+    int n_entries = 0, n_killed = 0, n_not_found = 0, n_invalid = 0;
+
+    for (struct buffer_entry *e = man->connection.in_extra->head; e; e = e->next)
+    {
+        const char *victim = BSTR(&e->buf);
+        struct buffer buf;
+        char p1[128];
+        char p2[128];
+        int n = -1;
+
+        ++n_entries;
+        buf_set_read(&buf, (const uint8_t *) victim, strlen(victim) + 1);
+        buf_parse(&buf, ':', p1, sizeof(p1));
+        buf_parse(&buf, ':', p2, sizeof(p2));
+
+        if (strlen(p1) && strlen(p2))
+        {
+            bool status;
+            const in_addr_t addr = getaddr(GETADDR_HOST_ORDER, p1, 0, &status, NULL);
+            const int port = atoi(p2);
+            if (status && port > 0 && port < 65536)
+            {
+                n = (*man->persist.callback.kill_by_addr)(man->persist.callback.arg, addr, port);
+            }
+        }
+        else if (strlen(p1))
+        {
+            n = (*man->persist.callback.kill_by_cn)(man->persist.callback.arg, p1);
+        }
+
+        if (n < 0)
+        {
+            ++n_invalid;
+        }
+        else if (n == 0)
+        {
+            ++n_not_found;
+        }
+        n_killed += max_int(n, 0);
+    }
+
+    msg(M_CLIENT, "SUCCESS: kill-batch entries=%d killed=%d not_found=%d invalid=%d",
+        n_entries, n_killed, n_not_found, n_invalid);
+}
+
+static void
+man_client_kill_batch(struct management *man)
+{
+    struct gc_arena gc = gc_new();
+    int n_entries = 0, n_killed = 0, n_failed = 0, n_invalid = 0;
+
+    for (struct buffer_entry *e = man->connection.in_extra->head; e; e = e->next)
+    {
+        char *p[3];
+        unsigned long cid;
+
+        CLEAR(p);
+        ++n_entries;
+        if (!parse_line(BSTR(&e->buf), p, SIZE(p), "client-kill-batch", 0, D_MANAGEMENT_DEBUG, &gc)
+            || sscanf(p[0], "%lu", &cid) != 1)
+        {
+            ++n_invalid;
+        }
+        else if ((*man->persist.callback.kill_by_cid)(man->persist.callback.arg, cid, p[1]))
+        {
+            ++n_killed;
+        }
+        else
+        {
+            ++n_failed;
+        }
+    }
+
+    msg(M_CLIENT, "SUCCESS: client-kill-batch entries=%d killed=%d failed=%d invalid=%d",
+        n_entries, n_killed, n_failed, n_invalid);
+    gc_free(&gc);
+}
+
+static void
+man_client_auth_batch(struct management *man)
+{
+    int n_entries = 0, n_authenticated = 0, n_failed = 0, n_invalid = 0;
+
+    for (struct buffer_entry *e = man->connection.in_extra->head; e; e = e->next)
+    {
+        unsigned long cid;
+        unsigned int kid;
+
+        ++n_entries;
+        if (sscanf(BSTR(&e->buf), "%lu %u", &cid, &kid) != 2)
+        {
+            ++n_invalid;
+        }
+        /* same as client-auth-nt, which passes an empty config */
+        else if ((*man->persist.callback.client_auth)(man->persist.callback.arg,
+                                                      cid, kid, true, NULL, NULL,
+                                                      buffer_list_new(0)))
+        {
+            ++n_authenticated;
+        }
+        else
+        {
+            ++n_failed;
+        }
+    }
+
+    msg(M_CLIENT, "SUCCESS: client-auth-nt-batch entries=%d authenticated=%d failed=%d invalid=%d",
+        n_entries, n_authenticated, n_failed, n_invalid);
+}
+
 static void
 in_extra_dispatch(struct management *man)
 {
@@ -943,6 +1283,18 @@ in_extra_dispatch(struct management *man)
             break;
 
 #endif /* ifdef MANAGEMENT_PF */
+        case IEC_KILL_BATCH:
+            man_kill_batch(man);
+            break;
+
+        case IEC_CLIENT_KILL_BATCH:
+            man_client_kill_batch(man);
+            break;
+
+        case IEC_CLIENT_AUTH_BATCH:
+            man_client_auth_batch(man);
+            break;
+
         case IEC_PK_SIGN:
             man->connection.ext_key_state = EKS_READY;
             buffer_list_free(man->connection.ext_key_input);
@@ -1104,6 +1456,143 @@ man_client_kill(struct management *man, const char *cid_str, const char *kill_ms
     }
 }
 
+/*
+ * Export the trace of a client as pcapng file.  A trace can be tens of
+ * megabytes, so it is written to a file rather than sent through the
+ * management connection, and the client is told its name.
+ */
+static void
+man_client_trace_dump(struct management *man, const unsigned long cid)
+{
+    struct gc_arena gc = gc_new();
+    const char *filename;
+
+    filename = (*man->persist.callback.client_trace_dump)(man->persist.callback.arg, cid, &gc);
+    if (filename)
+    {
+        msg(M_CLIENT, "SUCCESS: client-trace dump file=%s", filename);
+    }
+    else
+    {
+        msg(M_CLIENT, "ERROR: client-trace dump failed for client %lu", cid);
+    }
+    gc_free(&gc);
+}
+
+static void
+man_client_trace(struct management *man, const char *cid_str, const char *action, const char *n_str)
+{
+    unsigned long cid = 0;
+
+    if (!man->persist.callback.client_trace)
+    {
+        msg(M_CLIENT, "ERROR: The client-trace command is not supported by the current daemon mode");
+    }
+    else if (parse_cid(cid_str, &cid))
+    {
+        int n = -1;
+
+        if (streq(action, "on"))
+        {
+            n = n_str ? atoi(n_str) : PKTRACE_DEFAULT_PACKETS;
+            if (n < 1 || n > PKTRACE_MAX_PACKETS)
+            {
+                msg(M_CLIENT, "ERROR: client-trace packet count must be between 1 and %d",
+                    PKTRACE_MAX_PACKETS);
+                return;
+            }
+        }
+        else if (streq(action, "off"))
+        {
+            n = 0;
+        }
+        else if (streq(action, "dump"))
+        {
+            man_client_trace_dump(man, cid);
+            return;
+        }
+        else
+        {
+            msg(M_CLIENT, "ERROR: client-trace action must be on, off or dump");
+            return;
+        }
+
+        if ((*man->persist.callback.client_trace)(man->persist.callback.arg, cid, n))
+        {
+            msg(M_CLIENT, "SUCCESS: client-trace %s for client %lu", n ? "enabled" : "disabled", cid);
+        }
+        else
+        {
+            msg(M_CLIENT, "ERROR: client-trace command failed");
+        }
+    }
+}
+
+static void
+man_batch(struct management *man, const int cmd, const bool supported, const char *name)
+{
+    if (supported)
+    {
+        man->connection.in_extra_cmd = cmd;
+        in_extra_reset(&man->connection, IER_NEW);
+    }
+    else
+    {
+        msg(M_CLIENT, "ERROR: The '%s' command is not supported by the current daemon mode", name);
+    }
+}
+
+static void
+man_notify_filter(struct management *man, const char **p, const int nparms)
+{
+    struct man_connection *mc = &man->connection;
+
+    if (nparms > 1)
+    {
+        free(mc->notify_filter);
+        mc->notify_filter = NULL;
+        if (!streq(p[1], "all"))
+        {
+            struct buffer buf = alloc_buf(MAX_PARMS * 64 + 2);
+            buf_printf(&buf, ",");
+            for (int i = 1; i < nparms; ++i)
+            {
+                buf_printf(&buf, "%s,", p[i]);
+            }
+            mc->notify_filter = string_alloc(BSTR(&buf), NULL);
+            free_buf(&buf);
+        }
+    }
+    msg(M_CLIENT, "SUCCESS: notify-filter=%s",
+        mc->notify_filter ? mc->notify_filter : "all");
+}
+
+static void
+man_protocol(struct management *man, const char *name)
+{
+    struct man_connection *mc = &man->connection;
+
+    if (!name)
+    {
+        msg(M_CLIENT, "SUCCESS: protocol=%s", mc->binary ? "binary" : "text");
+    }
+    else if (streq(name, "binary"))
+    {
+        /* when switching, this is the last text sent */
+        msg(M_CLIENT, "SUCCESS: protocol=binary");
+        if (!mc->binary_in.data)
+        {
+            mc->binary_in = alloc_buf(MAN_FRAME_MAX_SIZE + 4);
+            mc->bytecount_batch = alloc_buf(MAN_BYTECOUNT_BATCH_SIZE);
+        }
+        mc->binary = true;
+    }
+    else
+    {
+        msg(M_CLIENT, "ERROR: protocol must be 'binary', switching back is not supported");
+    }
+}
+
 static void
 man_client_n_clients(struct management *man)
 {
@@ -1369,6 +1858,18 @@ man_dispatch_command(struct management *man, struct status_output *so, const cha
         }
         man_status(man, version, so);
     }
+    else if (streq(p[0], "metrics"))
+    {
+        man_metrics(man, so);
+    }
+    else if (streq(p[0], "top-clients"))
+    {
+        man_top_clients(man, p[1], so);
+    }
+    else if (streq(p[0], "perf"))
+    {
+        man_perf(p[1], p[1] ? p[2] : NULL, so);
+    }
     else if (streq(p[0], "kill"))
     {
         if (man_need(man, p, 1, 0))
@@ -1376,6 +1877,20 @@ man_dispatch_command(struct management *man, struct status_output *so, const cha
             man_kill(man, p[1]);
         }
     }
+    else if (streq(p[0], "notify-filter"))
+    {
+        man_notify_filter(man, p, nparms);
+    }
+    else if (streq(p[0], "protocol"))
+    {
+        man_protocol(man, p[1]);
+    }
+    else if (streq(p[0], "kill-batch"))
+    {
+        man_batch(man, IEC_KILL_BATCH,
+                  man->persist.callback.kill_by_cn && man->persist.callback.kill_by_addr,
+                  p[0]);
+    }
     else if (streq(p[0], "verb"))
     {
         if (p[1])
@@ -1539,6 +2054,17 @@ man_dispatch_command(struct management *man, struct status_output *so, const cha
             man_client_kill(man, p[1], p[2]);
         }
     }
+    else if (streq(p[0], "client-trace"))
+    {
+        if (man_need(man, p, 2, MN_AT_LEAST))
+        {
+            man_client_trace(man, p[1], p[2], p[3]);
+        }
+    }
+    else if (streq(p[0], "client-kill-batch"))
+    {
+        man_batch(man, IEC_CLIENT_KILL_BATCH, man->persist.callback.kill_by_cid != NULL, p[0]);
+    }
     else if (streq(p[0], "client-deny"))
     {
         if (man_need(man, p, 3, MN_AT_LEAST))
@@ -1553,6 +2079,10 @@ man_dispatch_command(struct management *man, struct status_output *so, const cha
             man_client_auth(man, p[1], p[2], false);
         }
     }
+    else if (streq(p[0], "client-auth-nt-batch"))
+    {
+        man_batch(man, IEC_CLIENT_AUTH_BATCH, man->persist.callback.client_auth != NULL, p[0]);
+    }
     else if (streq(p[0], "client-auth"))
     {
         if (man_need(man, p, 2, 0))
@@ -1963,6 +2493,17 @@ done:
     gc_free(&gc);
 }
 
+static void
+man_protocol_reset(struct man_connection *mc)
+{
+    /* the buffers may be in use by man_read_binary(), keep them */
+    mc->binary = false;
+    buf_reset_len(&mc->binary_in);
+    buf_reset_len(&mc->bytecount_batch);
+    free(mc->notify_filter);
+    mc->notify_filter = NULL;
+}
+
 static void
 man_reset_client_socket(struct management *man, const bool exiting)
 {
@@ -1977,6 +2518,7 @@ man_reset_client_socket(struct management *man, const bool exiting)
         command_line_reset(man->connection.in);
         buffer_list_reset(man->connection.out);
         in_extra_reset(&man->connection, IER_RESET);
+        man_protocol_reset(&man->connection);
         msg(D_MANAGEMENT, "MANAGEMENT: Client disconnected");
     }
     if (!exiting)
@@ -2213,6 +2755,156 @@ managment_android_persisttun_action(struct management *man)
 
 #endif /* ifdef TARGET_ANDROID */
 
+static void
+man_process_line(struct management *man, const char *line)
+{
+    if (man->connection.in_extra)
+    {
+        if (!strcmp(line, "END"))
+        {
+            in_extra_dispatch(man);
+        }
+        else
+        {
+            buffer_list_push(man->connection.in_extra, line);
+        }
+    }
+    else
+    {
+        man_process_command(man, line);
+    }
+}
+
+/*
+ * Run the command lines of a MAN_FRAME_COMMAND frame and send
+ * everything they output, except notifications, as the reply.
+ */
+static void
+man_process_frame(struct management *man, const uint8_t type, const uint32_t id,
+                  const uint8_t *payload, const int len)
+{
+    struct man_connection *mc = &man->connection;
+    struct buffer *reply;
+    int i = 0;
+
+    if (type != MAN_FRAME_COMMAND)
+    {
+        const char *err = "ERROR: unknown frame type\r\n";
+        man_frame_push(man, MAN_FRAME_REPLY, id, (const uint8_t *) err, strlen(err));
+        return;
+    }
+
+    mc->binary_reply = buffer_list_new(0);
+    while (i < len && !mc->halt)
+    {
+        const char *line;
+        int j = i;
+
+        while (j < len && payload[j] != '\n')
+        {
+            ++j;
+        }
+        command_line_add(mc->in, payload + i, j - i);
+        command_line_add(mc->in, (const uint8_t *) "\n", 1);
+        if ((line = command_line_get(mc->in)))
+        {
+            man_process_line(man, line);
+        }
+        command_line_reset(mc->in);
+        i = j + 1;
+    }
+
+    buffer_list_aggregate(mc->binary_reply, INT_MAX);
+    reply = buffer_list_peek(mc->binary_reply);
+    if (!mc->binary)
+    {
+        /* the connection was reset */
+    }
+    else if (reply)
+    {
+        man_frame_push(man, MAN_FRAME_REPLY, id, BPTR(reply), BLEN(reply));
+    }
+    else
+    {
+        man_frame_push(man, MAN_FRAME_REPLY, id, (const uint8_t *) "", 0);
+    }
+    buffer_list_free(mc->binary_reply);
+    mc->binary_reply = NULL;
+}
+
+/*
+ * Process the complete frames in mc->binary_in and move a trailing
+ * partial frame to the start of the buffer.
+ */
+static void
+man_process_binary_input(struct management *man)
+{
+    struct man_connection *mc = &man->connection;
+    struct buffer *in = &mc->binary_in;
+
+    while (BLEN(in) >= MAN_FRAME_HEADER_SIZE && !mc->halt)
+    {
+        struct buffer frame = *in;
+        const uint32_t size = buf_read_u32(&frame, NULL);
+        const uint8_t type = buf_read_u8(&frame);
+        const uint32_t id = buf_read_u32(&frame, NULL);
+
+        if (size < MAN_FRAME_HEADER_SIZE - 4 || size > MAN_FRAME_MAX_SIZE)
+        {
+            msg(D_MANAGEMENT, "MANAGEMENT: Client sent a frame of bad size %u", size);
+            mc->halt = true;
+            break;
+        }
+        if (BLEN(in) < size + 4)
+        {
+            break;
+        }
+        man_process_frame(man, type, id, BPTR(&frame), size + 4 - MAN_FRAME_HEADER_SIZE);
+        buf_advance(in, size + 4);
+    }
+
+    /* move a partial frame to the start of the buffer */
+    memmove(in->data, BPTR(in), BLEN(in));
+    in->offset = 0;
+}
+
+static int
+man_read_binary(struct management *man)
+{
+    struct man_connection *mc = &man->connection;
+    struct buffer *in = &mc->binary_in;
+    int len;
+
+    len = recv(mc->sd_cli, BEND(in), buf_forward_capacity(in), MSG_NOSIGNAL);
+    if (len == 0)
+    {
+        man_reset_client_socket(man, false);
+    }
+    else if (len > 0)
+    {
+        buf_inc_len(in, len);
+        man_process_binary_input(man);
+
+        if (mc->halt)
+        {
+            man_reset_client_socket(man, false);
+            len = 0;
+        }
+        else
+        {
+            man_update_io_state(man);
+        }
+    }
+    else /* len < 0 */
+    {
+        if (man_io_error(man, "recv"))
+        {
+            man_reset_client_socket(man, false);
+        }
+    }
+    return len;
+}
+
 static int
 man_read(struct management *man)
 {
@@ -2222,6 +2914,11 @@ man_read(struct management *man)
     unsigned char buf[256];
     int len = 0;
 
+    if (man->connection.binary)
+    {
+        return man_read_binary(man);
+    }
+
 #ifdef TARGET_ANDROID
     int fd;
     len = man_recv_with_fd(man->connection.sd_cli, buf, sizeof(buf), MSG_NOSIGNAL, &fd);
@@ -2240,9 +2937,9 @@ man_read(struct management *man)
     else if (len > 0)
     {
         bool processed_command = false;
+        int pos = 0;
 
         ASSERT(len <= (int) sizeof(buf));
-        command_line_add(man->connection.in, buf, len);
 
         /*
          * Reset output object
@@ -2250,36 +2947,44 @@ man_read(struct management *man)
         buffer_list_reset(man->connection.out);
 
         /*
-         * process command line if complete
+         * process command line if complete, passing the input on one
+         * line at a time so that the raw bytes following a
+         * "protocol binary" command are not run through the line filter
          */
+        while (pos < len && !man->connection.binary && !man->connection.halt)
         {
+            const unsigned char *nl = memchr(buf + pos, '\n', len - pos);
+            const int n = nl ? (int) (nl - buf) + 1 - pos : len - pos;
             const char *line;
+
+            command_line_add(man->connection.in, buf + pos, n);
+            pos += n;
+
             while ((line = command_line_get(man->connection.in)))
             {
-                if (man->connection.in_extra)
-                {
-                    if (!strcmp(line, "END"))
-                    {
-                        in_extra_dispatch(man);
-                    }
-                    else
-                    {
-                        buffer_list_push(man->connection.in_extra, line);
-                    }
-                }
-                else
-                {
-                    man_process_command(man, (char *) line);
-                }
+                man_process_line(man, line);
                 if (man->connection.halt)
                 {
                     break;
                 }
                 command_line_next(man->connection.in);
                 processed_command = true;
+
+                /* anything after "protocol binary" is framed */
+                if (man->connection.binary)
+                {
+                    command_line_reset(man->connection.in);
+                    break;
+                }
             }
         }
 
+        if (man->connection.binary && pos < len && !man->connection.halt)
+        {
+            buf_write(&man->connection.binary_in, buf + pos, len - pos);
+            man_process_binary_input(man);
+        }
+
         /*
          * Reset output state to MS_CC_WAIT_(READ|WRITE)
          */
@@ -2310,7 +3015,8 @@ man_read(struct management *man)
 static int
 man_write(struct management *man)
 {
-    const int size_hint = 1024;
+    /* frames are written in larger chunks */
+    const int size_hint = man->connection.binary ? 16384 : 1024;
     int sent = 0;
     const struct buffer *buf;
 
@@ -2611,6 +3317,9 @@ man_connection_close(struct management *man)
 
     in_extra_reset(&man->connection, IER_RESET);
     buffer_list_free(mc->ext_key_input);
+    free_buf(&mc->binary_in);
+    free_buf(&mc->bytecount_batch);
+    free(mc->notify_filter);
     man_connection_clear(mc);
 }
 
@@ -2826,12 +3535,11 @@ man_output_env(const struct env_set *es, const bool tail, const int env_filter_l
 {
     if (es)
     {
-        struct env_item *e;
-        for (e = es->list; e != NULL; e = e->next)
+        for (int i = 0; i < es->count; ++i)
         {
-            if (e->string && (!env_filter_level || env_filter_match(e->string, env_filter_level)))
+            if (!env_filter_level || env_filter_match(es->envp[i], env_filter_level))
             {
-                msg(M_CLIENT, ">%s:ENV,%s", prefix, e->string);
+                msg(M_CLIENT, ">%s:ENV,%s", prefix, es->envp[i]);
             }
         }
     }
@@ -3099,6 +3807,11 @@ management_socket_set(struct management *man,
                       void *arg,
                       unsigned int *persistent)
 {
+    if (man->connection.binary && man->connection.bytecount_batch_time != now)
+    {
+        man_bytecount_batch_flush(man);
+    }
+
     if (man->connection.state != MS_INITIAL)
     {
         event_t ev = net_event_win32_get_event(&man->connection.ne32);
@@ -3188,6 +3901,11 @@ management_socket_set(struct management *man,
                       void *arg,
                       unsigned int *persistent)
 {
+    if (man->connection.binary && man->connection.bytecount_batch_time != now)
+    {
+        man_bytecount_batch_flush(man);
+    }
+
     switch (man->connection.state)
     {
         case MS_LISTEN:
@@ -36,6 +36,7 @@
 #define MANAGEMENT_LOG_HISTORY_INITIAL_SIZE   100
 #define MANAGEMENT_ECHO_BUFFER_SIZE           100
 #define MANAGEMENT_STATE_BUFFER_SIZE          100
+#define MANAGEMENT_TOP_CLIENTS_MAX           1000
 
 /*
  * Management-interface-based deferred authentication
@@ -51,6 +52,8 @@ struct man_def_auth_context {
     unsigned int mda_key_id_counter;
 
     time_t bytecount_last_update;
+    counter_type bytecount_last_in;   /* totals at the last update */
+    counter_type bytecount_last_out;
 };
 
 /*
@@ -157,6 +160,8 @@ struct management_callback
     unsigned int flags;
 
     void (*status) (void *arg, const int version, struct status_output *so);
+    void (*metrics) (void *arg, struct status_output *so);
+    void (*top_clients) (void *arg, const int n, struct status_output *so);
     void (*show_net) (void *arg, const int msglevel);
     int (*kill_by_cn) (void *arg, const char *common_name);
     int (*kill_by_addr) (void *arg, const in_addr_t addr, const int port);
@@ -176,6 +181,10 @@ struct management_callback
                                  const char *extra,
                                  unsigned int timeout);
     char *(*get_peer_info) (void *arg, const unsigned long cid);
+    bool (*client_trace) (void *arg, const unsigned long cid, const int n);
+    const char *(*client_trace_dump) (void *arg,
+                                      const unsigned long cid,
+                                      struct gc_arena *gc);
 #ifdef MANAGEMENT_PF
     bool (*client_pf)(void *arg,
                       const unsigned long cid,
@@ -282,6 +291,9 @@ struct man_connection {
 #define IEC_RSA_SIGN    3
 #define IEC_CERTIFICATE 4
 #define IEC_PK_SIGN     5
+#define IEC_KILL_BATCH        6
+#define IEC_CLIENT_KILL_BATCH 7
+#define IEC_CLIENT_AUTH_BATCH 8
     int in_extra_cmd;
     struct buffer_list *in_extra;
     unsigned long in_extra_cid;
@@ -303,6 +315,16 @@ struct man_connection {
     int bytecount_update_seconds;
     time_t bytecount_last_update;
 
+    /* notification types to send, ",TYPE,TYPE," or NULL for all */
+    char *notify_filter;
+
+    /* framed binary protocol, selected with "protocol binary" */
+    bool binary;
+    struct buffer binary_in;          /* partially received frames */
+    struct buffer_list *binary_reply; /* reply to the current request */
+    struct buffer bytecount_batch;    /* pending bytecount records */
+    time_t bytecount_batch_time;      /* when the first record was added */
+
     const char *up_query_type;
     int up_query_mode;
     struct user_pass up_query;
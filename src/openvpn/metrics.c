@@ -0,0 +1,109 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include "error.h"
+#include "metrics.h"
+
+#include "memdbg.h"
+
+void
+metrics_histogram_init(struct metrics_histogram *h,
+                       const double *bounds, const int n_bounds)
+{
+    ASSERT(n_bounds <= METRICS_HISTOGRAM_MAX_BUCKETS);
+    CLEAR(*h);
+    h->bounds = bounds;
+    h->n_bounds = n_bounds;
+}
+
+void
+metrics_print_family(struct status_output *so, const char *name,
+                     const char *type, const char *help)
+{
+    status_printf(so, "# TYPE %s %s", name, type);
+    status_printf(so, "# HELP %s %s", name, help);
+}
+
+void
+metrics_print_histogram(struct status_output *so, const char *name,
+                        const char *labels,
+                        const struct metrics_histogram *h)
+{
+    const char *sep = labels ? "," : "";
+    counter_type cumulative = 0;
+
+    if (!labels)
+    {
+        labels = "";
+    }
+
+    for (int i = 0; i < h->n_bounds; ++i)
+    {
+        cumulative += h->buckets[i];
+        status_printf(so, "%s_bucket{%s%sle=\"%g\"} " counter_format,
+                      name, labels, sep, h->bounds[i], cumulative);
+    }
+    status_printf(so, "%s_bucket{%s%sle=\"+Inf\"} " counter_format,
+                  name, labels, sep, h->count);
+    status_printf(so, "%s_count%s%s%s " counter_format, name,
+                  *labels ? "{" : "", labels, *labels ? "}" : "", h->count);
+    status_printf(so, "%s_sum%s%s%s %.6f", name,
+                  *labels ? "{" : "", labels, *labels ? "}" : "", h->sum);
+}
+
+const char *
+metrics_label_value(const char *str, struct gc_arena *gc)
+{
+    struct buffer out = alloc_buf_gc(2 * strlen(str) + 1, gc);
+
+    for (; *str; ++str)
+    {
+        switch (*str)
+        {
+            case '\\':
+                buf_printf(&out, "\\\\");
+                break;
+
+            case '"':
+                buf_printf(&out, "\\\"");
+                break;
+
+            case '\n':
+                buf_printf(&out, "\\n");
+                break;
+
+            default:
+                buf_write_u8(&out, *str);
+        }
+    }
+    buf_null_terminate(&out);
+    return BSTR(&out);
+}
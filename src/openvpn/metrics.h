@@ -0,0 +1,91 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Helpers for printing metrics in the OpenMetrics text format, as
+ * used by the "metrics" management command.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "basic.h"
+#include "buffer.h"
+#include "status.h"
+
+#define METRICS_HISTOGRAM_MAX_BUCKETS 16
+
+/*
+ * A histogram with fixed bucket upper bounds.  The +Inf bucket is
+ * implicit.
+ */
+struct metrics_histogram
+{
+    const double *bounds;       /* ascending upper bounds */
+    int n_bounds;
+    counter_type buckets[METRICS_HISTOGRAM_MAX_BUCKETS + 1]; /* not cumulative */
+    counter_type count;
+    double sum;
+};
+
+void metrics_histogram_init(struct metrics_histogram *h,
+                            const double *bounds, const int n_bounds);
+
+static inline void
+metrics_histogram_observe(struct metrics_histogram *h, const double value)
+{
+    int i = 0;
+
+    while (i < h->n_bounds && value > h->bounds[i])
+    {
+        ++i;
+    }
+    ++h->buckets[i];
+    ++h->count;
+    h->sum += value;
+}
+
+/**
+ * Print the TYPE and HELP lines of a metric family.
+ *
+ * @param type  "counter", "gauge" or "histogram"
+ */
+void metrics_print_family(struct status_output *so, const char *name,
+                          const char *type, const char *help);
+
+/**
+ * Print the samples of a histogram family.
+ *
+ * @param labels  labels of the samples without braces, e.g.
+ *                "stage=\"tls\"", or NULL
+ */
+void metrics_print_histogram(struct status_output *so, const char *name,
+                             const char *labels,
+                             const struct metrics_histogram *h);
+
+/**
+ * Escape a string for use as a label value.
+ */
+const char *metrics_label_value(const char *str, struct gc_arena *gc);
+
+#endif /* ifndef METRICS_H */
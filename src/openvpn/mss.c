@@ -39,97 +39,31 @@
  */
 
 /*
- * IPv4 packet: find TCP header, check flags for "SYN"
- *              if yes, hand to mss_fixup_dowork()
+ * IPv4 or IPv6 packet classified by packet_info_parse(): if it is a
+ * whole TCP packet with "SYN", hand the TCP header to mss_fixup_dowork()
+ *
+ * An IPv6 packet could, theoretically, have a chain of multiple headers
+ * before the final header (TCP, UDP, ...).  In practice, "most typically
+ * used" extension headers (AH, routing, fragment, mobility) are very
+ * unlikely to be seen inside an OpenVPN tun, so packet_info_parse() only
+ * handles the case of "single next header = TCP".  The IPv6 header is
+ * 20 bytes longer than the IPv4 one, so is the MSS reduction.
  */
 void
-mss_fixup_ipv4(struct buffer *buf, int maxmss)
+mss_fixup(struct buffer *buf, const struct packet_info *pi, int maxmss)
 {
-    const struct openvpn_iphdr *pip;
-    int hlen;
-
-    if (BLEN(buf) < (int) sizeof(struct openvpn_iphdr))
-    {
-        return;
-    }
-
-    verify_align_4(buf);
-    pip = (struct openvpn_iphdr *) BPTR(buf);
-
-    hlen = OPENVPN_IPH_GET_LEN(pip->version_len);
-
-    if (pip->protocol == OPENVPN_IPPROTO_TCP
-        && ntohs(pip->tot_len) == BLEN(buf)
-        && (ntohs(pip->frag_off) & OPENVPN_IP_OFFMASK) == 0
-        && hlen <= BLEN(buf)
-        && BLEN(buf) - hlen
-        >= (int) sizeof(struct openvpn_tcphdr))
+    if (pi->l4_proto == OPENVPN_IPPROTO_TCP
+        && pi->whole
+        && (pi->tcp_flags & OPENVPN_TCPH_SYN_MASK))
     {
         struct buffer newbuf = *buf;
-        if (buf_advance(&newbuf, hlen))
+        if (buf_advance(&newbuf, pi->l4_offset))
         {
-            struct openvpn_tcphdr *tc = (struct openvpn_tcphdr *) BPTR(&newbuf);
-            if (tc->flags & OPENVPN_TCPH_SYN_MASK)
+            if (pi->ip_ver == 6)
             {
-                mss_fixup_dowork(&newbuf, (uint16_t) maxmss);
+                maxmss -= 20;
             }
-        }
-    }
-}
-
-/*
- * IPv6 packet: find TCP header, check flags for "SYN"
- *              if yes, hand to mss_fixup_dowork()
- *              (IPv6 header structure is sufficiently different from IPv4...)
- */
-void
-mss_fixup_ipv6(struct buffer *buf, int maxmss)
-{
-    const struct openvpn_ipv6hdr *pip6;
-    struct buffer newbuf;
-
-    if (BLEN(buf) < (int) sizeof(struct openvpn_ipv6hdr))
-    {
-        return;
-    }
-
-    verify_align_4(buf);
-    pip6 = (struct openvpn_ipv6hdr *) BPTR(buf);
-
-    /* do we have the full IPv6 packet?
-     * "payload_len" does not include IPv6 header (+40 bytes)
-     */
-    if (BLEN(buf) != (int) ntohs(pip6->payload_len)+40)
-    {
-        return;
-    }
-
-    /* follow header chain until we reach final header, then check for TCP
-     *
-     * An IPv6 packet could, theoretically, have a chain of multiple headers
-     * before the final header (TCP, UDP, ...), so we'd need to walk that
-     * chain (see RFC 2460 and RFC 6564 for details).
-     *
-     * In practice, "most typically used" extension headers (AH, routing,
-     * fragment, mobility) are very unlikely to be seen inside an OpenVPN
-     * tun, so for now, we only handle the case of "single next header = TCP"
-     */
-    if (pip6->nexthdr != OPENVPN_IPPROTO_TCP)
-    {
-        return;
-    }
-
-    /* skip IPv6 header (40 bytes),
-     * verify remainder is large enough to contain a full TCP header
-     */
-    newbuf = *buf;
-    if (buf_advance( &newbuf, 40 )
-        && BLEN(&newbuf) >= (int) sizeof(struct openvpn_tcphdr))
-    {
-        struct openvpn_tcphdr *tc = (struct openvpn_tcphdr *) BPTR(&newbuf);
-        if (tc->flags & OPENVPN_TCPH_SYN_MASK)
-        {
-            mss_fixup_dowork(&newbuf, (uint16_t) maxmss-20);
+            mss_fixup_dowork(&newbuf, (uint16_t) maxmss);
         }
     }
 }
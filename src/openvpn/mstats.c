@@ -35,6 +35,7 @@
 
 #if defined(ENABLE_MEMSTATS)
 
+#include <stddef.h>
 #include <sys/mman.h>
 
 #include "error.h"
@@ -44,15 +45,28 @@
 #include "memdbg.h"
 
 volatile struct mmap_stats *mmap_stats = NULL; /* GLOBAL */
+static volatile struct mstats_client *mmap_clients = NULL; /* GLOBAL */
+static size_t mmap_size;
+static int mmap_next_slot;
 static char mmap_fn[128];
 
+/* keep the 64 bit counters of consecutive slots aligned */
+static_assert(sizeof(struct mstats_client) % 8 == 0,
+              "struct mstats_client size must be a multiple of 8");
+
+#define MSTATS_CLIENTS_OFFSET 64
+
+static_assert(sizeof(struct mmap_stats) <= MSTATS_CLIENTS_OFFSET,
+              "struct mmap_stats overlaps the client slots");
+
 void
-mstats_open(const char *fn)
+mstats_open(const char *fn, const int n_client_slots)
 {
     void *data;
     ssize_t stat;
     int fd;
     struct mmap_stats ms;
+    size_t size = sizeof(struct mmap_stats);
 
     if (mmap_stats) /* already called? */
     {
@@ -74,11 +88,20 @@ mstats_open(const char *fn)
     }
 
     /* set the file to the correct size to contain a
-     * struct mmap_stats, and zero it */
+     * struct mmap_stats and the client slots, and zero it */
     CLEAR(ms);
     ms.state = MSTATS_ACTIVE;
+    ms.version = MSTATS_VERSION;
+    ms.client_size = sizeof(struct mstats_client);
+    if (n_client_slots > 0)
+    {
+        ms.n_client_slots = n_client_slots;
+        ms.clients_offset = MSTATS_CLIENTS_OFFSET;
+        size = MSTATS_CLIENTS_OFFSET
+               + (size_t)n_client_slots * sizeof(struct mstats_client);
+    }
     stat = write(fd, &ms, sizeof(ms));
-    if (stat != sizeof(ms))
+    if (stat != sizeof(ms) || ftruncate(fd, size))
     {
         msg(M_ERR, "mstats_open: write error: %s", fn);
         close(fd);
@@ -86,7 +109,7 @@ mstats_open(const char *fn)
     }
 
     /* mmap the file */
-    data = mmap(NULL, sizeof(struct mmap_stats), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    data = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
     if (data == MAP_FAILED)
     {
         msg(M_ERR, "mstats_open: write error: %s", fn);
@@ -105,6 +128,11 @@ mstats_open(const char *fn)
 
     /* save a global pointer to memory-mapped region */
     mmap_stats = (struct mmap_stats *)data;
+    mmap_size = size;
+    if (n_client_slots > 0)
+    {
+        mmap_clients = (struct mstats_client *)((uint8_t *)data + MSTATS_CLIENTS_OFFSET);
+    }
 
     msg(M_INFO, "memstats data will be written to %s", fn);
 }
@@ -115,13 +143,82 @@ mstats_close(void)
     if (mmap_stats)
     {
         mmap_stats->state = MSTATS_EXPIRED;
-        if (munmap((void *)mmap_stats, sizeof(struct mmap_stats)))
+        if (munmap((void *)mmap_stats, mmap_size))
         {
             msg(M_WARN | M_ERRNO, "mstats_close: munmap error");
         }
         platform_unlink(mmap_fn);
         mmap_stats = NULL;
+        mmap_clients = NULL;
     }
 }
 
+int
+mstats_client_alloc(const int hint)
+{
+    if (!mmap_clients)
+    {
+        return -1;
+    }
+
+    const int n = mmap_stats->n_client_slots;
+    int slot = -1;
+
+    if (hint >= 0 && hint < n && mmap_clients[hint].state == MSTATS_CLIENT_FREE)
+    {
+        slot = hint;
+    }
+    else
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            const int s = (mmap_next_slot + i) % n;
+            if (mmap_clients[s].state == MSTATS_CLIENT_FREE)
+            {
+                slot = s;
+                mmap_next_slot = (s + 1) % n;
+                break;
+            }
+        }
+    }
+
+    if (slot >= 0)
+    {
+        struct mstats_client mc;
+        CLEAR(mc);
+        mc.state = MSTATS_CLIENT_CONNECTING;
+        mstats_client_update(slot, &mc);
+    }
+    return slot;
+}
+
+void
+mstats_client_update(const int slot, const struct mstats_client *mc)
+{
+    if (!mmap_clients || slot < 0 || slot >= mmap_stats->n_client_slots)
+    {
+        return;
+    }
+
+    volatile struct mstats_client *dst = &mmap_clients[slot];
+    const uint32_t seq = dst->seq;
+    const size_t off = offsetof(struct mstats_client, state);
+
+    dst->seq = seq + 1;
+    __sync_synchronize();
+    memcpy((void *)((volatile uint8_t *)dst + off), (const uint8_t *)mc + off,
+           sizeof(*mc) - off);
+    __sync_synchronize();
+    dst->seq = seq + 2;
+}
+
+void
+mstats_client_free(const int slot)
+{
+    struct mstats_client mc;
+
+    CLEAR(mc);
+    mstats_client_update(slot, &mc);
+}
+
 #endif /* if defined(ENABLE_MEMSTATS) */
@@ -23,6 +23,21 @@
 
 /*
  * Maintain usage stats in a memory-mapped file
+ *
+ * The file starts with a struct mmap_stats.  Its first four fields have
+ * not changed since the file format was introduced, so old readers keep
+ * working.  Version 1 of the format appends a table of fixed-size
+ * struct mstats_client slots, one per client, that starts at
+ * clients_offset bytes from the beginning of the file.  In server mode
+ * there are --max-clients slots, and UDP clients use the slot matching
+ * their peer-id.
+ *
+ * A slot is written by OpenVPN while other processes may read it, so
+ * it is protected by a sequence counter: seq is odd while the slot is
+ * being written.  A reader copies the slot and uses the copy only if
+ * seq was even and unchanged before and after copying it; otherwise it
+ * retries.  The counters of a slot are refreshed at most once per
+ * second, and only while the client is active.
  */
 
 #if !defined(OPENVPN_MEMSTATS_H) && defined(ENABLE_MEMSTATS)
@@ -30,6 +45,8 @@
 
 #include "basic.h"
 
+#define MSTATS_VERSION 1
+
 /* this struct is mapped to the file */
 struct mmap_stats {
     counter_type link_read_bytes; /* counter_type can be assumed to be a uint64_t */
@@ -40,12 +57,73 @@ struct mmap_stats {
 #define MSTATS_ACTIVE  1
 #define MSTATS_EXPIRED 2
     int state;
+
+    /* added in version 1 */
+    uint32_t version;             /* MSTATS_VERSION */
+    uint32_t client_size;         /* sizeof(struct mstats_client) */
+    uint32_t n_client_slots;      /* number of struct mstats_client slots */
+    uint32_t clients_offset;      /* file offset of the first slot */
+};
+
+/* a per-client slot, integers are in host byte order and addresses in
+ * network byte order */
+struct mstats_client {
+    uint32_t seq;                 /* odd while the slot is being written */
+
+#define MSTATS_CLIENT_FREE       0
+#define MSTATS_CLIENT_CONNECTING 1  /* authentication not complete yet */
+#define MSTATS_CLIENT_ACTIVE     2
+    uint32_t state;
+
+    uint32_t peer_id;             /* MAX_PEER_ID if the client has none */
+    int32_t key_state;            /* S_* state of the primary key */
+    int32_t auth_state;           /* enum multi_status of the client */
+    uint32_t real_port;
+    uint32_t real_af;             /* AF_INET or AF_INET6, 0 if unknown */
+    uint8_t real_addr[16];        /* IPv4 addresses use the first 4 bytes */
+    uint8_t vaddr[4];             /* IPv4 VPN address, 0 if none */
+    uint8_t vaddr6[16];           /* IPv6 VPN address, :: if none */
+    char common_name[64];         /* NUL terminated, possibly truncated */
+    uint64_t connected_since;     /* time_t the client connected */
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t packets_in;
+    uint64_t packets_out;
+    uint64_t packets_dropped;     /* failed authentication or replay check */
+    uint8_t reserved[64];         /* zero, for future extensions */
 };
 
 extern volatile struct mmap_stats *mmap_stats; /* GLOBAL */
 
-void mstats_open(const char *fn);
+/**
+ * Create the memory-mapped file.
+ *
+ * @param fn              file name
+ * @param n_client_slots  number of per-client slots to allocate
+ */
+void mstats_open(const char *fn, const int n_client_slots);
 
 void mstats_close(void);
 
+/**
+ * Allocate a per-client slot.
+ *
+ * @param hint  slot to use if it is free, e.g. the peer-id of the client,
+ *              or -1
+ *
+ * @return the slot index, or -1 if all slots are in use
+ */
+int mstats_client_alloc(const int hint);
+
+/**
+ * Publish the contents of a per-client slot.  The seq field of \c mc
+ * is ignored.
+ */
+void mstats_client_update(const int slot, const struct mstats_client *mc);
+
+/**
+ * Release a slot obtained by mstats_client_alloc().
+ */
+void mstats_client_free(const int slot);
+
 #endif /* if !defined(OPENVPN_MEMSTATS_H) && defined(ENABLE_MEMSTATS) */
@@ -31,6 +31,7 @@
 
 #include "multi.h"
 #include "forward.h"
+#include "run_command.h"
 
 #include "memdbg.h"
 
@@ -61,6 +62,7 @@
 #define MTCP_SIG         ((void *)3) /* Only on Windows */
 #define MTCP_MANAGEMENT ((void *)4)
 #define MTCP_FILE_CLOSE_WRITE ((void *)5)
+#define MTCP_SCRIPT_DONE ((void *)6)
 
 #define MTCP_N           ((void *)16) /* upper bound on MTCP_x */
 
@@ -290,6 +292,14 @@ multi_tcp_wait(const struct context *c,
     event_ctl(mtcp->es, c->c2.inotify_fd, EVENT_READ, MTCP_FILE_CLOSE_WRITE);
 #endif
 
+#ifndef _WIN32
+    /* wake up when an asynchronously executed script has finished */
+    if (openvpn_execve_async_event_fd() >= 0)
+    {
+        event_ctl(mtcp->es, openvpn_execve_async_event_fd(), EVENT_READ, MTCP_SCRIPT_DONE);
+    }
+#endif
+
     status = event_wait(mtcp->es, &c->c2.timeval, mtcp->esr, mtcp->maxevents);
     update_time();
     mtcp->n_esr = 0;
@@ -747,6 +757,12 @@ multi_tcp_process_io(struct multi_context *m)
             {
                 multi_process_file_closed(m, MPP_PRE_SELECT | MPP_RECORD_TOUCH);
             }
+#endif
+#ifndef _WIN32
+            else if (e->arg == MTCP_SCRIPT_DONE)
+            {
+                multi_process_child_exited(m);
+            }
 #endif
         }
         if (IS_SIG(&m->top))
@@ -816,11 +832,15 @@ tunnel_server_tcp(struct context *top)
         /* wait on tun/socket list */
         multi_get_timeout(&multi, &multi.top.c2.timeval);
         status = multi_tcp_wait(&multi.top, multi.mtcp);
+        multi_loop_wakeup(&multi);
         MULTI_CHECK_SIG(&multi);
 
         /* check on status of coarse timers */
         multi_process_per_second_timers(&multi);
 
+        /* write some more of the --status file */
+        multi_process_status(&multi);
+
         /* timeout? */
         if (status > 0)
         {
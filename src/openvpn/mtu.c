@@ -226,6 +226,67 @@ translate_mtu_discover_type_name(const char *name)
     return -1;                  /* NOTREACHED */
 }
 
+int
+set_mtu_probe_df(socket_descriptor_t sd, sa_family_t proto_af, int df_type)
+{
+    int level, name, probe;
+    int prev = 0;
+    socklen_t len = sizeof(prev);
+
+    switch (proto_af)
+    {
+#if defined(IP_MTU_DISCOVER) && defined(IP_PMTUDISC_DO)
+        case AF_INET:
+            level = IPPROTO_IP;
+            name = IP_MTU_DISCOVER;
+#ifdef IP_PMTUDISC_PROBE
+            probe = IP_PMTUDISC_PROBE;
+#else
+            probe = IP_PMTUDISC_DO;
+#endif
+            break;
+
+#elif defined(IP_DONTFRAG)
+        case AF_INET:
+            level = IPPROTO_IP;
+            name = IP_DONTFRAG;
+            probe = 1;
+            break;
+
+#endif
+#if defined(IPV6_MTU_DISCOVER) && defined(IPV6_PMTUDISC_DO)
+        case AF_INET6:
+            level = IPPROTO_IPV6;
+            name = IPV6_MTU_DISCOVER;
+#ifdef IPV6_PMTUDISC_PROBE
+            probe = IPV6_PMTUDISC_PROBE;
+#else
+            probe = IPV6_PMTUDISC_DO;
+#endif
+            break;
+
+#elif defined(IPV6_DONTFRAG)
+        case AF_INET6:
+            level = IPPROTO_IPV6;
+            name = IPV6_DONTFRAG;
+            probe = 1;
+            break;
+
+#endif
+        default:
+            return -2;
+    }
+
+    if (getsockopt(sd, level, name, (void *) &prev, &len)
+        || setsockopt(sd, level, name, (void *) (df_type < 0 ? &probe : &df_type),
+                      sizeof(int)))
+    {
+        msg(D_LINK_ERRORS | M_ERRNO, "Error setting the don't-fragment bit for an MTU probe");
+        return -2;
+    }
+    return prev;
+}
+
 #if EXTENDED_SOCKET_ERROR_CAPABILITY
 
 struct probehdr
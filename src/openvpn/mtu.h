@@ -213,6 +213,14 @@ void set_mtu_discover_type(socket_descriptor_t sd, int mtu_type, sa_family_t pro
 
 int translate_mtu_discover_type_name(const char *name);
 
+/*
+ * Make the socket set the don't-fragment bit, without being limited
+ * by the path MTU the OS has cached, if df_type is -1, and otherwise
+ * set the value returned by the previous call.  Returns the previous
+ * value, or -2 if the OS does not support this.
+ */
+int set_mtu_probe_df(socket_descriptor_t sd, sa_family_t proto_af, int df_type);
+
 /*
  * frame_set_mtu_dynamic and flags
  */
@@ -192,6 +192,14 @@ multi_process_io_udp(struct multi_context *m)
     }
 #endif
 
+#ifndef _WIN32
+    /* collect asynchronously executed scripts */
+    if (status & SCRIPT_DONE)
+    {
+        multi_process_child_exited(m);
+    }
+#endif
+
     /* UDP port ready to accept write */
     if (status & SOCKET_WRITE)
     {
@@ -309,11 +317,15 @@ tunnel_server_udp(struct context *top)
         /* set up and do the io_wait() */
         multi_get_timeout(&multi, &multi.top.c2.timeval);
         io_wait(&multi.top, p2mp_iow_flags(&multi));
+        multi_loop_wakeup(&multi);
         MULTI_CHECK_SIG(&multi);
 
         /* check on status of coarse timers */
         multi_process_per_second_timers(&multi);
 
+        /* write some more of the --status file */
+        multi_process_status(&multi);
+
         /* timeout? */
         if (multi.top.c2.event_set_status == ES_TIMEOUT)
         {
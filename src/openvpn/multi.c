@@ -38,6 +38,8 @@
 #include "multi.h"
 #include "push.h"
 #include "run_command.h"
+#include "script_helper.h"
+#include "ccd_cache.h"
 #include "otime.h"
 #include "pf.h"
 #include "gremlin.h"
@@ -90,6 +92,123 @@ update_mstat_n_clients(const int n_clients)
 #endif
 }
 
+#ifdef ENABLE_MEMSTATS
+/*
+ * Publish the state of a client in its --memstats slot, allocating
+ * the slot on first use.
+ */
+static void
+multi_update_mstats_client(struct multi_instance *mi)
+{
+    const struct context *c = &mi->context;
+    const struct tls_multi *multi = c->c2.tls_multi;
+    struct mstats_client mc;
+
+    if (mi->mstats_slot < 0)
+    {
+        const uint32_t peer_id = multi->peer_id;
+        mi->mstats_slot = mstats_client_alloc(peer_id != MAX_PEER_ID ? (int)peer_id : -1);
+        if (mi->mstats_slot < 0)
+        {
+            return;
+        }
+    }
+
+    CLEAR(mc);
+    mc.state = multi->multi_state >= CAS_CONNECT_DONE ?
+               MSTATS_CLIENT_ACTIVE : MSTATS_CLIENT_CONNECTING;
+    mc.peer_id = multi->peer_id;
+    mc.key_state = get_primary_key(multi)->state;
+    mc.auth_state = multi->multi_state;
+
+    switch (mi->real.type & MR_ADDR_MASK)
+    {
+        case MR_ADDR_IPV4:
+            mc.real_af = AF_INET;
+            memcpy(mc.real_addr, &mi->real.v4.addr, sizeof(mi->real.v4.addr));
+            mc.real_port = ntohs(mi->real.v4.port);
+            break;
+
+        case MR_ADDR_IPV6:
+            mc.real_af = AF_INET6;
+            memcpy(mc.real_addr, &mi->real.v6.addr, sizeof(mi->real.v6.addr));
+            mc.real_port = ntohs(mi->real.v6.port);
+            break;
+    }
+
+    if (mi->reporting_addr)
+    {
+        const in_addr_t vaddr = htonl(mi->reporting_addr);
+        memcpy(mc.vaddr, &vaddr, sizeof(vaddr));
+    }
+    memcpy(mc.vaddr6, &mi->reporting_addr_ipv6, sizeof(mc.vaddr6));
+
+    strncpynt(mc.common_name, tls_common_name(multi, false),
+              sizeof(mc.common_name));
+    mc.connected_since = mi->created;
+    mc.bytes_in = c->c2.link_read_bytes;
+    mc.bytes_out = c->c2.link_write_bytes;
+    mc.packets_in = c->c2.link_read_packets;
+    mc.packets_out = c->c2.link_write_packets;
+    mc.packets_dropped = c->c2.link_read_drops;
+
+    mstats_client_update(mi->mstats_slot, &mc);
+}
+
+/*
+ * Called whenever an instance has been processed.  The slot is written
+ * at most once per second, later changes within the same second are
+ * published by multi_flush_mstats_clients().  Instances that see no
+ * activity cost nothing.
+ */
+static inline void
+multi_update_mstats(struct multi_context *m, struct multi_instance *mi)
+{
+    if (!mmap_stats || mi->mstats_stale || mi->halt)
+    {
+        return;
+    }
+    if (mi->mstats_updated != now)
+    {
+        mi->mstats_updated = now;
+        multi_update_mstats_client(mi);
+    }
+    else
+    {
+        mi->mstats_stale = true;
+        mi->mstats_next = m->mstats_stale;
+        m->mstats_stale = mi;
+        multi_instance_inc_refcount(mi);
+    }
+}
+
+/*
+ * Refresh the --memstats slots of the clients that changed after their
+ * slot was last written.
+ */
+static void
+multi_flush_mstats_clients(struct multi_context *m)
+{
+    struct multi_instance *mi = m->mstats_stale;
+
+    m->mstats_stale = NULL;
+    while (mi)
+    {
+        struct multi_instance *next = mi->mstats_next;
+
+        mi->mstats_stale = false;
+        mi->mstats_next = NULL;
+        if (!mi->halt)
+        {
+            mi->mstats_updated = now;
+            multi_update_mstats_client(mi);
+        }
+        multi_instance_dec_refcount(mi);
+        mi = next;
+    }
+}
+#endif /* ifdef ENABLE_MEMSTATS */
+
 static bool
 learn_address_script(const struct multi_context *m,
                      const struct multi_instance *mi,
@@ -199,6 +318,10 @@ multi_reap_range(const struct multi_context *m,
             learn_address_script(m, NULL, "delete", &r->addr);
             multi_route_del(r);
             hash_iterator_delete_element(&hi);
+            if (m->reaper)
+            {
+                ++m->reaper->reaped;
+            }
         }
     }
     hash_iterator_free(&hi);
@@ -219,6 +342,7 @@ multi_reap_new(int buckets_per_pass)
     mr->bucket_base = 0;
     mr->buckets_per_pass = buckets_per_pass;
     mr->last_call = now;
+    mr->reaped = 0;
     return mr;
 }
 
@@ -267,12 +391,244 @@ cid_compare_function(const void *key1, const void *key2)
     return *k1 == *k2;
 }
 
+/*
+ * Index of the instances by common name, so that the management interface
+ * can find the clients of a common name without walking all instances.
+ * Instances with the same common name are chained through cn_next.
+ */
+struct multi_cn_entry
+{
+    char *common_name;
+    struct multi_instance *first;
+};
+
+static uint32_t
+cn_hash_function(const void *key, uint32_t iv)
+{
+    const char *cn = (const char *) key;
+    return hash_func((const uint8_t *) cn, strlen(cn), iv);
+}
+
+static bool
+cn_compare_function(const void *key1, const void *key2)
+{
+    return streq((const char *) key1, (const char *) key2);
+}
+
+static void
+multi_cn_index_remove(struct multi_context *m, struct multi_instance *mi)
+{
+    struct multi_cn_entry *entry = mi->cn_entry;
+    if (entry)
+    {
+        struct multi_instance **pmi = &entry->first;
+        while (*pmi != mi)
+        {
+            ASSERT(*pmi);
+            pmi = &(*pmi)->cn_next;
+        }
+        *pmi = mi->cn_next;
+        mi->cn_next = NULL;
+        mi->cn_entry = NULL;
+
+        if (!entry->first)
+        {
+            ASSERT(hash_remove(m->cn_hash, entry->common_name));
+            free(entry->common_name);
+            free(entry);
+        }
+    }
+}
+
+/*
+ * Keep the instance indexed under its current common name.  The common
+ * name may change during the TLS handshake and authentication, until it
+ * is locked when the client connects.  From then on this is a no-op.
+ */
+static void
+multi_cn_index_update(struct multi_context *m, struct multi_instance *mi)
+{
+    if (mi->cn_locked)
+    {
+        return;
+    }
+
+    /* index as reported by the status output, "UNDEF" for no name */
+    const char *cn = tls_common_name(mi->context.c2.tls_multi, false);
+
+    mi->cn_locked = mi->context.c2.tls_multi->locked_cn != NULL;
+    if (mi->cn_entry && streq(mi->cn_entry->common_name, cn))
+    {
+        return;
+    }
+
+    multi_cn_index_remove(m, mi);
+
+    struct multi_cn_entry *entry = (struct multi_cn_entry *) hash_lookup(m->cn_hash, cn);
+    if (!entry)
+    {
+        ALLOC_OBJ_CLEAR(entry, struct multi_cn_entry);
+        entry->common_name = string_alloc(cn, NULL);
+        hash_add(m->cn_hash, entry->common_name, entry, false);
+    }
+    mi->cn_next = entry->first;
+    entry->first = mi;
+    mi->cn_entry = entry;
+}
+
+/*
+ * The top talkers heap orders the instances by total byte rate without
+ * revisiting instances whose rate decays because they went quiet.  The
+ * key of an instance is its rate at the last update multiplied by
+ * MULTI_RATE_DECAY^-(last - rate_landmark), so that keys compare like
+ * the rates decayed to a common time.  The landmark is moved forward
+ * every MULTI_RATE_LANDMARK_INTERVAL seconds to keep the keys finite.
+ */
+#define MULTI_RATE_DECAY 0.9048374180359595 /* exp(-1/10), 10 s time constant */
+#define MULTI_RATE_LANDMARK_INTERVAL 3600
+
+/* MULTI_RATE_DECAY^seconds */
+static double
+multi_rate_decay(time_t seconds)
+{
+    double base = MULTI_RATE_DECAY;
+    double ret = 1.0;
+
+    while (seconds > 0)
+    {
+        if (seconds & 1)
+        {
+            ret *= base;
+        }
+        base *= base;
+        seconds >>= 1;
+    }
+    return ret;
+}
+
+static void
+multi_rate_heap_swap(struct multi_context *m, const int i, const int j)
+{
+    struct multi_instance *tmp = m->rate_heap[i];
+
+    m->rate_heap[i] = m->rate_heap[j];
+    m->rate_heap[j] = tmp;
+    m->rate_heap[i]->rate.heap_index = i;
+    m->rate_heap[j]->rate.heap_index = j;
+}
+
+/* restore the heap order after the key at i changed */
+static void
+multi_rate_heap_fix(struct multi_context *m, int i)
+{
+    while (i > 0 && m->rate_heap[(i - 1) / 2]->rate.key < m->rate_heap[i]->rate.key)
+    {
+        multi_rate_heap_swap(m, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    while (true)
+    {
+        const int l = 2 * i + 1;
+        const int r = l + 1;
+        int max = i;
+
+        if (l < m->rate_heap_len && m->rate_heap[l]->rate.key > m->rate_heap[max]->rate.key)
+        {
+            max = l;
+        }
+        if (r < m->rate_heap_len && m->rate_heap[r]->rate.key > m->rate_heap[max]->rate.key)
+        {
+            max = r;
+        }
+        if (max == i)
+        {
+            break;
+        }
+        multi_rate_heap_swap(m, i, max);
+        i = max;
+    }
+}
+
+static void
+multi_rate_heap_add(struct multi_context *m, struct multi_instance *mi)
+{
+    if (m->rate_heap_len == m->rate_heap_size)
+    {
+        m->rate_heap_size = max_int(64, 2 * m->rate_heap_size);
+        m->rate_heap = realloc(m->rate_heap, m->rate_heap_size * sizeof(*m->rate_heap));
+        check_malloc_return(m->rate_heap);
+    }
+    mi->rate.key = 0;
+    mi->rate.heap_index = m->rate_heap_len;
+    m->rate_heap[m->rate_heap_len++] = mi;
+    multi_rate_heap_fix(m, mi->rate.heap_index);
+}
+
+static void
+multi_rate_heap_remove(struct multi_context *m, struct multi_instance *mi)
+{
+    const int i = mi->rate.heap_index;
+
+    if (i < 0)
+    {
+        return;
+    }
+    multi_rate_heap_swap(m, i, --m->rate_heap_len);
+    mi->rate.heap_index = -1;
+    if (i < m->rate_heap_len)
+    {
+        multi_rate_heap_fix(m, i);
+    }
+}
+
+void
+multi_rate_update_dowork(struct multi_context *m, struct multi_instance *mi)
+{
+    struct multi_rate *r = &mi->rate;
+    const struct context_2 *c2 = &mi->context.c2;
+    const time_t elapsed = now - r->last;
+
+    if (elapsed > 0)
+    {
+        /* spread the traffic since the last update evenly over the
+         * elapsed seconds */
+        const double f = multi_rate_decay(elapsed);
+        const double g = (1.0 - f) / elapsed;
+
+        r->bps_in = r->bps_in * f + (c2->link_read_bytes - r->bytes_in) * g;
+        r->bps_out = r->bps_out * f + (c2->link_write_bytes - r->bytes_out) * g;
+        r->pps_in = r->pps_in * f + (c2->link_read_packets - r->packets_in) * g;
+        r->pps_out = r->pps_out * f + (c2->link_write_packets - r->packets_out) * g;
+    }
+    r->bytes_in = c2->link_read_bytes;
+    r->bytes_out = c2->link_write_bytes;
+    r->packets_in = c2->link_read_packets;
+    r->packets_out = c2->link_write_packets;
+    r->last = now;
+
+    if (now - m->rate_landmark >= MULTI_RATE_LANDMARK_INTERVAL)
+    {
+        /* scaling all keys by the same factor keeps the heap order */
+        const double f = multi_rate_decay(now - m->rate_landmark);
+        for (int i = 0; i < m->rate_heap_len; ++i)
+        {
+            m->rate_heap[i]->rate.key *= f;
+        }
+        m->rate_landmark = now;
+    }
+    if (r->heap_index >= 0)
+    {
+        r->key = (r->bps_in + r->bps_out) / multi_rate_decay(now - m->rate_landmark);
+        multi_rate_heap_fix(m, r->heap_index);
+    }
+}
+
 #endif
 
-#ifdef ENABLE_ASYNC_PUSH
+#ifndef _WIN32
 static uint32_t
 /*
- * inotify watcher descriptors are used as hash value
+ * inotify watcher descriptors and pids are used as hash value
  */
 int_hash_function(const void *key, uint32_t iv)
 {
@@ -286,6 +642,19 @@ int_compare_function(const void *key1, const void *key2)
 }
 #endif
 
+/* bucket bounds of the handshake duration histogram, in seconds */
+static const double multi_handshake_seconds_bounds[] = {
+    0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30
+};
+
+/* bucket bounds of the event loop histograms */
+static const double multi_events_per_wakeup_bounds[] = {
+    0, 1, 2, 4, 8, 16, 32, 64, 128
+};
+static const double multi_wakeup_seconds_bounds[] = {
+    1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3, 1e-2, 0.1
+};
+
 /*
  * Main initialization function, init multi_context object.
  */
@@ -343,8 +712,23 @@ multi_init(struct multi_context *m, struct context *t, bool tcp_mode)
                             0,
                             cid_hash_function,
                             cid_compare_function);
+    m->cn_hash = hash_init(t->options.real_hash_size,
+                           get_random(),
+                           cn_hash_function,
+                           cn_compare_function);
+    m->rate_landmark = now;
 #endif
 
+    for (const struct policer_class *sc = t->options.policer_classes; sc; sc = sc->next)
+    {
+        struct multi_policer_class *msc;
+        ALLOC_OBJ_CLEAR(msc, struct multi_policer_class);
+        msc->name = sc->name;
+        token_bucket_init(&msc->tb, sc->rate, sc->burst);
+        msc->next = m->policer_classes;
+        m->policer_classes = msc;
+    }
+
 #ifdef ENABLE_ASYNC_PUSH
     /*
      * Mapping between inotify watch descriptors and
@@ -356,11 +740,54 @@ multi_init(struct multi_context *m, struct context *t, bool tcp_mode)
                                     int_compare_function);
 #endif
 
+#ifndef _WIN32
+    /*
+     * Mapping between asynchronously running
+     * auth scripts and multi_instances.
+     */
+    m->auth_jobs = hash_init(t->options.real_hash_size,
+                             get_random(),
+                             int_hash_function,
+                             int_compare_function);
+    openvpn_execve_async_init(t->options.script_async_max);
+    script_helper_init(t->options.script_helper_hooks, &t->options);
+#endif
+
+    /*
+     * Format the push options common to all clients once,
+     * instances inherit the result with their copy of the push list.
+     */
+    push_reply_cache_init(&t->options);
+
+    metrics_histogram_init(&m->metrics.handshake_seconds,
+                           multi_handshake_seconds_bounds,
+                           SIZE(multi_handshake_seconds_bounds));
+    metrics_histogram_init(&m->metrics.events_per_wakeup,
+                           multi_events_per_wakeup_bounds,
+                           SIZE(multi_events_per_wakeup_bounds));
+    metrics_histogram_init(&m->metrics.wakeup_seconds,
+                           multi_wakeup_seconds_bounds,
+                           SIZE(multi_wakeup_seconds_bounds));
+    m->metrics.window.start = now;
+    event_loop_stats = &m->metrics.loop;
+#ifdef ENABLE_MANAGEMENT
+    m->metrics.clients_gc = gc_new();
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+    if (t->options.ccd_cache)
+    {
+        m->ccd_cache = ccd_cache_new(t->options.client_config_dir,
+                                     t->options.ccd_cache_preload);
+    }
+#endif
+
     /*
      * This is our scheduler, for time-based wakeup
      * events.
      */
     m->schedule = schedule_init();
+    wheel_init(&m->wheel);
 
     /*
      * Limit frequency of incoming connections to control
@@ -638,6 +1065,8 @@ multi_close_instance(struct multi_context *m,
         {
             ASSERT(hash_remove(m->cid_hash, &mi->context.c2.mda_context.cid));
         }
+        multi_cn_index_remove(m, mi);
+        multi_rate_heap_remove(m, mi);
 #endif
 
 #ifdef ENABLE_ASYNC_PUSH
@@ -647,13 +1076,30 @@ multi_close_instance(struct multi_context *m,
             mi->inotify_watch = -1;
         }
 #endif
+#ifndef _WIN32
+        if (mi->auth_job)
+        {
+            hash_remove(m->auth_jobs, (void *) (unsigned long)mi->auth_job);
+            mi->auth_job = 0;
+        }
+#endif
 
         if (mi->context.c2.tls_multi->peer_id != MAX_PEER_ID)
         {
             m->instances[mi->context.c2.tls_multi->peer_id] = NULL;
         }
 
+#ifdef ENABLE_MEMSTATS
+        if (mi->mstats_slot >= 0)
+        {
+            mstats_client_free(mi->mstats_slot);
+            mi->mstats_slot = -1;
+        }
+#endif
+
         schedule_remove_entry(m->schedule, (struct schedule_entry *) mi);
+        wheel_remove(&m->wheel, &mi->wakeup_deadline.we);
+        wheel_remove(&m->wheel, &mi->keepalive_deadline.we);
 
         ifconfig_pool_release(m->ifconfig_pool, mi->vaddr_handle, false);
 
@@ -673,11 +1119,20 @@ multi_close_instance(struct multi_context *m,
 
 #ifdef ENABLE_MANAGEMENT
     set_cc_config(mi, NULL);
+    pktrace_free(mi->context.c2.pktrace);
+    mi->context.c2.pktrace = NULL;
 #endif
 
     if (mi->context.c2.tls_multi->multi_state >= CAS_CONNECT_DONE)
     {
         multi_client_disconnect_script(mi);
+        context_evlog(&mi->context, D_MULTI_LOW, EVLOG_CLIENT_CLOSE,
+                      mi->context.c2.link_read_bytes, mi->context.c2.link_write_bytes, 0, 0);
+    }
+    else if (!shutdown)
+    {
+        ++m->metrics.handshake_failures;
+        context_evlog(&mi->context, D_MULTI_LOW, EVLOG_CLIENT_HANDSHAKE_FAILED, 0, 0, 0, 0);
     }
 
     close_context(&mi->context, SIGTERM, CC_GC_FREE);
@@ -702,6 +1157,8 @@ multi_close_instance(struct multi_context *m,
 void
 multi_uninit(struct multi_context *m)
 {
+    event_loop_stats = NULL;
+
     if (m->hash)
     {
         struct hash_iterator hi;
@@ -717,21 +1174,62 @@ multi_uninit(struct multi_context *m)
         hash_iterator_free(&hi);
 
         multi_reap_all(m);
+#ifdef ENABLE_MEMSTATS
+        /* only drops the references, all instances are halted */
+        multi_flush_mstats_clients(m);
+#endif
 
         hash_free(m->hash);
         hash_free(m->vhash);
         hash_free(m->iter);
 #ifdef ENABLE_MANAGEMENT
         hash_free(m->cid_hash);
+
+        /* the instances themselves are gone already */
+        hash_iterator_init(m->cn_hash, &hi);
+        while ((he = hash_iterator_next(&hi)))
+        {
+            struct multi_cn_entry *entry = (struct multi_cn_entry *) he->value;
+            free(entry->common_name);
+            free(entry);
+        }
+        hash_iterator_free(&hi);
+        hash_free(m->cn_hash);
+        free(m->rate_heap);
+        m->rate_heap = NULL;
 #endif
         m->hash = NULL;
 
+        while (m->policer_classes)
+        {
+            struct multi_policer_class *next = m->policer_classes->next;
+            free(m->policer_classes);
+            m->policer_classes = next;
+        }
+
         free(m->instances);
 
 #ifdef ENABLE_ASYNC_PUSH
         hash_free(m->inotify_watchers);
         m->inotify_watchers = NULL;
 #endif
+#ifndef _WIN32
+        hash_free(m->auth_jobs);
+        m->auth_jobs = NULL;
+        script_helper_uninit();
+        openvpn_execve_async_uninit();
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+        ccd_cache_free(m->ccd_cache);
+        m->ccd_cache = NULL;
+#endif
+        free(m->status_job);
+        m->status_job = NULL;
+#ifdef ENABLE_MANAGEMENT
+        free(m->metrics.clients);
+        m->metrics.clients = NULL;
+        gc_free(&m->metrics.clients_gc);
+#endif
 
         schedule_free(m->schedule);
         mbuf_free(m->mbuf);
@@ -743,6 +1241,40 @@ multi_uninit(struct multi_context *m)
     }
 }
 
+#ifdef ENABLE_EVENT_LOG
+/*
+ * Record the creation of an instance with the real address of the
+ * client, as address family, address and port in host byte order.
+ */
+static void
+multi_evlog_create(const struct multi_instance *mi)
+{
+    uint64_t addr[2] = { 0, 0 };
+    uint64_t af = 0;
+    in_port_t port = 0;
+
+    switch (mi->real.type & MR_ADDR_MASK)
+    {
+        case MR_ADDR_IPV4:
+            af = AF_INET;
+            addr[0] = ntohl(mi->real.v4.addr);
+            port = mi->real.v4.port;
+            break;
+
+        case MR_ADDR_IPV6:
+            af = AF_INET6;
+            for (int i = 0; i < 16; ++i)
+            {
+                addr[i / 8] = (addr[i / 8] << 8) | mi->real.v6.addr.s6_addr[i];
+            }
+            port = mi->real.v6.port;
+            break;
+    }
+    context_evlog(&mi->context, D_MULTI_LOW, EVLOG_CLIENT_CREATE,
+                  af, addr[0], addr[1], ntohs(port));
+}
+#endif
+
 /*
  * Create a client instance object for a newly connected client.
  */
@@ -761,7 +1293,14 @@ multi_create_instance(struct multi_context *m, const struct mroute_addr *real)
     mi->gc = gc_new();
     multi_instance_inc_refcount(mi);
     mi->vaddr_handle = -1;
+#ifdef ENABLE_MANAGEMENT
+    mi->rate.heap_index = -1;
+#endif
+    mi->wakeup_deadline.mi = mi;
+    mi->keepalive_deadline.mi = mi;
+    mi->keepalive_deadline.keepalive = true;
     mi->created = now;
+    openvpn_gettimeofday(&mi->created_tv, NULL);
     mroute_addr_init(&mi->real);
 
     if (real)
@@ -807,12 +1346,20 @@ multi_create_instance(struct multi_context *m, const struct mroute_addr *real)
         mi->context.c2.mda_context.cid = m->cid_counter++;
     } while (!hash_add(m->cid_hash, &mi->context.c2.mda_context.cid, mi, false));
     mi->did_cid_hash = true;
+    mi->rate.last = now;
+    multi_rate_heap_add(m, mi);
 #endif
 
     mi->context.c2.push_request_received = false;
 #ifdef ENABLE_ASYNC_PUSH
     mi->inotify_watch = -1;
 #endif
+#ifdef ENABLE_MEMSTATS
+    mi->mstats_slot = -1;
+#endif
+#ifdef ENABLE_EVENT_LOG
+    multi_evlog_create(mi);
+#endif
 
     if (!multi_process_post(m, mi, MPP_PRE_SELECT))
     {
@@ -832,209 +1379,367 @@ err:
 }
 
 /*
- * Dump tables -- triggered by SIGUSR2.
- * If status file is defined, write to file.
- * If status file is NULL, write to syslog.
+ * State of a status dump, which can be written in several steps.
  */
-void
-multi_print_status(struct multi_context *m, struct status_output *so, const int version)
+struct multi_status_job
 {
-    if (m->hash)
-    {
-        struct gc_arena gc_top = gc_new();
-        struct hash_iterator hi;
-        const struct hash_element *he;
-
-        status_reset(so);
-
-        if (version == 1) /* WAS: m->status_file_version */
-        {
-            /*
-             * Status file version 1
-             */
-            status_printf(so, "OpenVPN CLIENT LIST");
-            status_printf(so, "Updated,%s", time_string(0, 0, false, &gc_top));
-            status_printf(so, "Common Name,Real Address,Bytes Received,Bytes Sent,Connected Since");
-            hash_iterator_init(m->hash, &hi);
-            while ((he = hash_iterator_next(&hi)))
-            {
-                struct gc_arena gc = gc_new();
-                const struct multi_instance *mi = (struct multi_instance *) he->value;
-
-                if (!mi->halt)
-                {
-                    status_printf(so, "%s,%s," counter_format "," counter_format ",%s",
-                                  tls_common_name(mi->context.c2.tls_multi, false),
-                                  mroute_addr_print(&mi->real, &gc),
-                                  mi->context.c2.link_read_bytes,
-                                  mi->context.c2.link_write_bytes,
-                                  time_string(mi->created, 0, false, &gc));
-                }
-                gc_free(&gc);
-            }
-            hash_iterator_free(&hi);
+    struct status_output *so;
+    int version;
 
-            status_printf(so, "ROUTING TABLE");
-            status_printf(so, "Virtual Address,Common Name,Real Address,Last Ref");
-            hash_iterator_init(m->vhash, &hi);
-            while ((he = hash_iterator_next(&hi)))
-            {
-                struct gc_arena gc = gc_new();
-                const struct multi_route *route = (struct multi_route *) he->value;
+#define MSJ_CLIENTS 0
+#define MSJ_ROUTES  1
+#ifdef PACKET_TRUNCATION_CHECK
+#define MSJ_ERRORS  2
+#define MSJ_DONE    3
+#else
+#define MSJ_DONE    2
+#endif
+    int phase;
+    int bucket;                 /* next hash bucket of the current phase */
+};
 
-                if (multi_route_defined(m, route))
-                {
-                    const struct multi_instance *mi = route->instance;
-                    const struct mroute_addr *ma = &route->addr;
-                    char flags[2] = {0, 0};
+static void
+multi_print_status_header(const struct multi_status_job *job)
+{
+    struct gc_arena gc = gc_new();
+    struct status_output *so = job->so;
 
-                    if (route->flags & MULTI_ROUTE_CACHE)
-                    {
-                        flags[0] = 'C';
-                    }
-                    status_printf(so, "%s%s,%s,%s,%s",
-                                  mroute_addr_print(ma, &gc),
-                                  flags,
-                                  tls_common_name(mi->context.c2.tls_multi, false),
-                                  mroute_addr_print(&mi->real, &gc),
-                                  time_string(route->last_reference, 0, false, &gc));
-                }
-                gc_free(&gc);
-            }
-            hash_iterator_free(&hi);
+    if (job->version == 1) /* WAS: m->status_file_version */
+    {
+        /*
+         * Status file version 1
+         */
+        status_printf(so, "OpenVPN CLIENT LIST");
+        status_printf(so, "Updated,%s", time_string(0, 0, false, &gc));
+        status_printf(so, "Common Name,Real Address,Bytes Received,Bytes Sent,Connected Since");
+    }
+    else if (job->version == 2 || job->version == 3)
+    {
+        const char sep = (job->version == 3) ? '\t' : ',';
 
-            status_printf(so, "GLOBAL STATS");
-            if (m->mbuf)
-            {
-                status_printf(so, "Max bcast/mcast queue length,%d",
-                              mbuf_maximum_queued(m->mbuf));
-            }
+        /*
+         * Status file version 2 and 3
+         */
+        status_printf(so, "TITLE%c%s", sep, title_string);
+        status_printf(so, "TIME%c%s%c%u", sep, time_string(now, 0, false, &gc), sep, (unsigned int)now);
+        status_printf(so, "HEADER%cCLIENT_LIST%cCommon Name%cReal Address%cVirtual Address%cVirtual IPv6 Address%cBytes Received%cBytes Sent%cConnected Since%cConnected Since (time_t)%cUsername%cClient ID%cPeer ID%cData Channel Cipher",
+                      sep, sep, sep, sep, sep, sep, sep, sep, sep, sep, sep, sep, sep);
+    }
+    else
+    {
+        status_printf(so, "ERROR: bad status format version number");
+    }
+    gc_free(&gc);
+}
 
-            status_printf(so, "END");
-        }
-        else if (version == 2 || version == 3)
-        {
-            const char sep = (version == 3) ? '\t' : ',';
+static void
+multi_print_status_client(const struct multi_status_job *job,
+                          const struct multi_instance *mi)
+{
+    struct gc_arena gc = gc_new();
+    struct status_output *so = job->so;
 
-            /*
-             * Status file version 2 and 3
-             */
-            status_printf(so, "TITLE%c%s", sep, title_string);
-            status_printf(so, "TIME%c%s%c%u", sep, time_string(now, 0, false, &gc_top), sep, (unsigned int)now);
-            status_printf(so, "HEADER%cCLIENT_LIST%cCommon Name%cReal Address%cVirtual Address%cVirtual IPv6 Address%cBytes Received%cBytes Sent%cConnected Since%cConnected Since (time_t)%cUsername%cClient ID%cPeer ID%cData Channel Cipher",
-                          sep, sep, sep, sep, sep, sep, sep, sep, sep, sep, sep, sep, sep);
-            hash_iterator_init(m->hash, &hi);
-            while ((he = hash_iterator_next(&hi)))
-            {
-                struct gc_arena gc = gc_new();
-                const struct multi_instance *mi = (struct multi_instance *) he->value;
+    if (mi->halt)
+    {
+        /* nothing to print */
+    }
+    else if (job->version == 1)
+    {
+        status_printf(so, "%s,%s," counter_format "," counter_format ",%s",
+                      tls_common_name(mi->context.c2.tls_multi, false),
+                      mroute_addr_print(&mi->real, &gc),
+                      mi->context.c2.link_read_bytes,
+                      mi->context.c2.link_write_bytes,
+                      time_string(mi->created, 0, false, &gc));
+    }
+    else if (job->version == 2 || job->version == 3)
+    {
+        const char sep = (job->version == 3) ? '\t' : ',';
 
-                if (!mi->halt)
-                {
-                    status_printf(so, "CLIENT_LIST%c%s%c%s%c%s%c%s%c" counter_format "%c" counter_format "%c%s%c%u%c%s%c"
+        status_printf(so, "CLIENT_LIST%c%s%c%s%c%s%c%s%c" counter_format "%c" counter_format "%c%s%c%u%c%s%c"
 #ifdef ENABLE_MANAGEMENT
-                                  "%lu"
+                      "%lu"
 #else
-                                  ""
-#endif
-                                  "%c%" PRIu32 "%c%s",
-                                  sep, tls_common_name(mi->context.c2.tls_multi, false),
-                                  sep, mroute_addr_print(&mi->real, &gc),
-                                  sep, print_in_addr_t(mi->reporting_addr, IA_EMPTY_IF_UNDEF, &gc),
-                                  sep, print_in6_addr(mi->reporting_addr_ipv6, IA_EMPTY_IF_UNDEF, &gc),
-                                  sep, mi->context.c2.link_read_bytes,
-                                  sep, mi->context.c2.link_write_bytes,
-                                  sep, time_string(mi->created, 0, false, &gc),
-                                  sep, (unsigned int)mi->created,
-                                  sep, tls_username(mi->context.c2.tls_multi, false),
+                      ""
+#endif
+                      "%c%" PRIu32 "%c%s",
+                      sep, tls_common_name(mi->context.c2.tls_multi, false),
+                      sep, mroute_addr_print(&mi->real, &gc),
+                      sep, print_in_addr_t(mi->reporting_addr, IA_EMPTY_IF_UNDEF, &gc),
+                      sep, print_in6_addr(mi->reporting_addr_ipv6, IA_EMPTY_IF_UNDEF, &gc),
+                      sep, mi->context.c2.link_read_bytes,
+                      sep, mi->context.c2.link_write_bytes,
+                      sep, time_string(mi->created, 0, false, &gc),
+                      sep, (unsigned int)mi->created,
+                      sep, tls_username(mi->context.c2.tls_multi, false),
 #ifdef ENABLE_MANAGEMENT
-                                  sep, mi->context.c2.mda_context.cid,
+                      sep, mi->context.c2.mda_context.cid,
 #else
-                                  sep,
+                      sep,
 #endif
-                                  sep, mi->context.c2.tls_multi ? mi->context.c2.tls_multi->peer_id : UINT32_MAX,
-                                  sep, translate_cipher_name_to_openvpn(mi->context.options.ciphername));
-                }
-                gc_free(&gc);
-            }
-            hash_iterator_free(&hi);
+                      sep, mi->context.c2.tls_multi ? mi->context.c2.tls_multi->peer_id : UINT32_MAX,
+                      sep, translate_cipher_name_to_openvpn(mi->context.options.ciphername));
+    }
+    gc_free(&gc);
+}
 
-            status_printf(so, "HEADER%cROUTING_TABLE%cVirtual Address%cCommon Name%cReal Address%cLast Ref%cLast Ref (time_t)",
-                          sep, sep, sep, sep, sep, sep);
-            hash_iterator_init(m->vhash, &hi);
-            while ((he = hash_iterator_next(&hi)))
-            {
-                struct gc_arena gc = gc_new();
-                const struct multi_route *route = (struct multi_route *) he->value;
+static void
+multi_print_status_routes_header(const struct multi_status_job *job)
+{
+    if (job->version == 1)
+    {
+        status_printf(job->so, "ROUTING TABLE");
+        status_printf(job->so, "Virtual Address,Common Name,Real Address,Last Ref");
+    }
+    else if (job->version == 2 || job->version == 3)
+    {
+        const char sep = (job->version == 3) ? '\t' : ',';
 
-                if (multi_route_defined(m, route))
-                {
-                    const struct multi_instance *mi = route->instance;
-                    const struct mroute_addr *ma = &route->addr;
-                    char flags[2] = {0, 0};
+        status_printf(job->so, "HEADER%cROUTING_TABLE%cVirtual Address%cCommon Name%cReal Address%cLast Ref%cLast Ref (time_t)",
+                      sep, sep, sep, sep, sep, sep);
+    }
+}
 
-                    if (route->flags & MULTI_ROUTE_CACHE)
-                    {
-                        flags[0] = 'C';
-                    }
-                    status_printf(so, "ROUTING_TABLE%c%s%s%c%s%c%s%c%s%c%u",
-                                  sep, mroute_addr_print(ma, &gc), flags,
-                                  sep, tls_common_name(mi->context.c2.tls_multi, false),
-                                  sep, mroute_addr_print(&mi->real, &gc),
-                                  sep, time_string(route->last_reference, 0, false, &gc),
-                                  sep, (unsigned int)route->last_reference);
-                }
-                gc_free(&gc);
-            }
-            hash_iterator_free(&hi);
+static void
+multi_print_status_route(const struct multi_context *m,
+                         const struct multi_status_job *job,
+                         const struct multi_route *route)
+{
+    struct gc_arena gc = gc_new();
 
-            if (m->mbuf)
-            {
-                status_printf(so, "GLOBAL_STATS%cMax bcast/mcast queue length%c%d",
-                              sep, sep, mbuf_maximum_queued(m->mbuf));
-            }
+    if (multi_route_defined(m, route)
+        && (job->version == 1 || job->version == 2 || job->version == 3))
+    {
+        const struct multi_instance *mi = route->instance;
+        const struct mroute_addr *ma = &route->addr;
+        char flags[2] = {0, 0};
 
-            status_printf(so, "END");
+        if (route->flags & MULTI_ROUTE_CACHE)
+        {
+            flags[0] = 'C';
+        }
+        if (job->version == 1)
+        {
+            status_printf(job->so, "%s%s,%s,%s,%s",
+                          mroute_addr_print(ma, &gc),
+                          flags,
+                          tls_common_name(mi->context.c2.tls_multi, false),
+                          mroute_addr_print(&mi->real, &gc),
+                          time_string(route->last_reference, 0, false, &gc));
         }
         else
         {
-            status_printf(so, "ERROR: bad status format version number");
+            const char sep = (job->version == 3) ? '\t' : ',';
+
+            status_printf(job->so, "ROUTING_TABLE%c%s%s%c%s%c%s%c%s%c%u",
+                          sep, mroute_addr_print(ma, &gc), flags,
+                          sep, tls_common_name(mi->context.c2.tls_multi, false),
+                          sep, mroute_addr_print(&mi->real, &gc),
+                          sep, time_string(route->last_reference, 0, false, &gc),
+                          sep, (unsigned int)route->last_reference);
+        }
+    }
+    gc_free(&gc);
+}
+
+/*
+ * Print the event loop averages of the last MULTI_LOOP_WINDOW seconds.
+ */
+static void
+multi_print_status_loop(const struct multi_context *m, struct status_output *so,
+                        const char *prefix, const char sep)
+{
+    const struct multi_loop_window *w = &m->metrics.window;
+
+    status_printf(so, "%sEvent loop duty cycle%c%.3f", prefix, sep, w->duty_cycle);
+    status_printf(so, "%sEvent loop wakeups/sec%c%.1f", prefix, sep, w->wakeups_per_second);
+    status_printf(so, "%sEvent loop events/wakeup%c%.2f", prefix, sep, w->events_per_wakeup);
+    status_printf(so, "%sEvent loop packets/wakeup%c%.2f", prefix, sep, w->packets_per_wakeup);
+    status_printf(so, "%sEvent loop saturated wakeups%c%.3f", prefix, sep, w->saturated_fraction);
+}
+
+static void
+multi_print_status_footer(const struct multi_context *m,
+                          const struct multi_status_job *job)
+{
+    if (job->version == 1)
+    {
+        status_printf(job->so, "GLOBAL STATS");
+        if (m->mbuf)
+        {
+            status_printf(job->so, "Max bcast/mcast queue length,%d",
+                          mbuf_maximum_queued(m->mbuf));
+        }
+        multi_print_status_loop(m, job->so, "", ',');
+
+        status_printf(job->so, "END");
+    }
+    else if (job->version == 2 || job->version == 3)
+    {
+        const char sep = (job->version == 3) ? '\t' : ',';
+        const char *prefix = (job->version == 3) ? "GLOBAL_STATS\t" : "GLOBAL_STATS,";
+
+        if (m->mbuf)
+        {
+            status_printf(job->so, "GLOBAL_STATS%cMax bcast/mcast queue length%c%d",
+                          sep, sep, mbuf_maximum_queued(m->mbuf));
         }
+        multi_print_status_loop(m, job->so, prefix, sep);
+
+        status_printf(job->so, "END");
+    }
 
 #ifdef PACKET_TRUNCATION_CHECK
+    status_printf(job->so, "HEADER,ERRORS,Common Name,TUN Read Trunc,TUN Write Trunc,Pre-encrypt Trunc,Post-decrypt Trunc");
+#endif
+
+#ifdef ENABLE_ASYNC_PUSH
+    if (m->inotify_watchers)
+    {
+        msg(D_MULTI_DEBUG, "inotify watchers count: %d\n", hash_n_elements(m->inotify_watchers));
+    }
+#endif
+}
+
+#ifdef PACKET_TRUNCATION_CHECK
+static void
+multi_print_status_errors(const struct multi_context *m,
+                          const struct multi_status_job *job,
+                          const struct multi_instance *mi)
+{
+    if (!mi->halt)
+    {
+        status_printf(job->so, "ERRORS,%s," counter_format "," counter_format "," counter_format "," counter_format,
+                      tls_common_name(mi->context.c2.tls_multi, false),
+                      m->top.c2.n_trunc_tun_read,
+                      mi->context.c2.n_trunc_tun_write,
+                      mi->context.c2.n_trunc_pre_encrypt,
+                      mi->context.c2.n_trunc_post_decrypt);
+    }
+}
+#endif /* ifdef PACKET_TRUNCATION_CHECK */
+
+/*
+ * Continue a status dump, printing at least one hash bucket and
+ * stopping once max_rows entries have been visited.
+ *
+ * Only the position in the hash tables is kept between calls, so
+ * instances and routes added or removed in the meantime may or may not
+ * show up in the dump.
+ *
+ * @return true if the dump is complete
+ */
+static bool
+multi_status_job_step(struct multi_context *m, struct multi_status_job *job,
+                      const int max_rows)
+{
+    int rows = 0;
+
+    while (job->phase != MSJ_DONE && rows < max_rows)
+    {
+        struct hash *hash = (job->phase == MSJ_ROUTES) ? m->vhash : m->hash;
+
+        if (job->bucket < hash_n_buckets(hash))
         {
-            status_printf(so, "HEADER,ERRORS,Common Name,TUN Read Trunc,TUN Write Trunc,Pre-encrypt Trunc,Post-decrypt Trunc");
-            hash_iterator_init(m->hash, &hi);
+            struct hash_iterator hi;
+            const struct hash_element *he;
+
+            hash_iterator_init_range(hash, &hi, job->bucket, job->bucket + 1);
             while ((he = hash_iterator_next(&hi)))
             {
-                struct gc_arena gc = gc_new();
-                const struct multi_instance *mi = (struct multi_instance *) he->value;
-
-                if (!mi->halt)
+                switch (job->phase)
                 {
-                    status_printf(so, "ERRORS,%s," counter_format "," counter_format "," counter_format "," counter_format,
-                                  tls_common_name(mi->context.c2.tls_multi, false),
-                                  m->top.c2.n_trunc_tun_read,
-                                  mi->context.c2.n_trunc_tun_write,
-                                  mi->context.c2.n_trunc_pre_encrypt,
-                                  mi->context.c2.n_trunc_post_decrypt);
+                    case MSJ_CLIENTS:
+                        multi_print_status_client(job, he->value);
+                        break;
+
+                    case MSJ_ROUTES:
+                        multi_print_status_route(m, job, he->value);
+                        break;
+
+#ifdef PACKET_TRUNCATION_CHECK
+                    case MSJ_ERRORS:
+                        multi_print_status_errors(m, job, he->value);
+                        break;
+#endif
                 }
-                gc_free(&gc);
+                ++rows;
             }
             hash_iterator_free(&hi);
+            ++job->bucket;
         }
-#endif /* ifdef PACKET_TRUNCATION_CHECK */
+        else
+        {
+            /* end of a table */
+            if (job->phase == MSJ_CLIENTS)
+            {
+                multi_print_status_routes_header(job);
+            }
+            else if (job->phase == MSJ_ROUTES)
+            {
+                multi_print_status_footer(m, job);
+            }
+            ++job->phase;
+            job->bucket = 0;
+        }
+    }
 
-        status_flush(so);
-        gc_free(&gc_top);
+    if (job->phase == MSJ_DONE)
+    {
+        status_flush(job->so);
+        return true;
     }
+    return false;
+}
 
-#ifdef ENABLE_ASYNC_PUSH
-    if (m->inotify_watchers)
+/*
+ * Dump tables -- triggered by SIGUSR2.
+ * If status file is defined, write to file.
+ * If status file is NULL, write to syslog.
+ */
+void
+multi_print_status(struct multi_context *m, struct status_output *so, const int version)
+{
+    if (m->hash)
     {
-        msg(D_MULTI_DEBUG, "inotify watchers count: %d\n", hash_n_elements(m->inotify_watchers));
+        struct multi_status_job job = { .so = so, .version = version };
+
+        status_reset(so);
+        multi_print_status_header(&job);
+        multi_status_job_step(m, &job, INT_MAX);
+    }
+}
+
+/*
+ * Start writing the --status file in the background, a few entries per
+ * event loop iteration, see multi_process_status().
+ */
+static void
+multi_status_job_start(struct multi_context *m, struct status_output *so)
+{
+    struct multi_status_job *job;
+
+    if (m->status_job || !m->hash)
+    {
+        return;
+    }
+
+    ALLOC_OBJ_CLEAR(job, struct multi_status_job);
+    job->so = so;
+    job->version = m->status_file_version;
+    status_begin_replace(so);
+    multi_print_status_header(job);
+    m->status_job = job;
+}
+
+void
+multi_process_status_dowork(struct multi_context *m)
+{
+    if (multi_status_job_step(m, m->status_job, MULTI_STATUS_ROWS_PER_STEP))
+    {
+        free(m->status_job);
+        m->status_job = NULL;
     }
-#endif
 }
 
 /*
@@ -2314,6 +3019,36 @@ multi_client_generate_tls_keys(struct context *c)
     return true;
 }
 
+/*
+ * Set up the --client-policer bucket of a client, after its
+ * --client-config-dir file and client-connect scripts were read.
+ */
+static void
+multi_policer_setup(struct multi_context *m, struct multi_instance *mi)
+{
+    const struct options *o = &mi->context.options;
+
+    mi->policer_parent = NULL;
+    if (o->client_policer_class)
+    {
+        struct multi_policer_class *msc;
+        for (msc = m->policer_classes; msc; msc = msc->next)
+        {
+            if (streq(msc->name, o->client_policer_class))
+            {
+                mi->policer_parent = &msc->tb;
+                break;
+            }
+        }
+        if (!mi->policer_parent)
+        {
+            msg(M_WARN, "MULTI: --client-policer class '%s' is not defined by --policer-class",
+                o->client_policer_class);
+        }
+    }
+    token_bucket_init(&mi->policer, o->client_policer, o->client_policer_burst);
+}
+
 static void
 multi_client_connect_late_setup(struct multi_context *m,
                                 struct multi_instance *mi,
@@ -2328,6 +3063,8 @@ multi_client_connect_late_setup(struct multi_context *m,
      */
     do_deferred_options(&mi->context, option_types_found);
 
+    multi_policer_setup(m, mi);
+
     /*
      * make sure we got ifconfig settings from somewhere
      */
@@ -2442,6 +3179,9 @@ multi_client_connect_early_setup(struct multi_context *m,
      */
     tls_lock_common_name(mi->context.c2.tls_multi);
     tls_lock_cert_hash_set(mi->context.c2.tls_multi);
+#ifdef ENABLE_MANAGEMENT
+    multi_cn_index_update(m, mi);
+#endif
 
     /* generate a msg() prefix for this client instance */
     generate_prefix(mi);
@@ -2515,36 +3255,63 @@ multi_client_connect_source_ccd(struct multi_context *m,
     {
         struct gc_arena gc = gc_new();
         const char *ccd_file = NULL;
+        const struct options_file *ccd_parsed = NULL;
 
-        const char *ccd_client =
-            platform_gen_path(mi->context.options.client_config_dir,
-                              tls_common_name(mi->context.c2.tls_multi, false),
-                              &gc);
-
-        const char *ccd_default =
-            platform_gen_path(mi->context.options.client_config_dir,
-                              CCD_DEFAULT, &gc);
-
-
-        /* try common-name file */
-        if (platform_test_file(ccd_client))
+#ifdef HAVE_SYS_INOTIFY_H
+        if (m->ccd_cache)
         {
-            ccd_file = ccd_client;
+            ccd_parsed = ccd_cache_get(m->ccd_cache,
+                                       tls_common_name(mi->context.c2.tls_multi, false));
+            if (!ccd_parsed)
+            {
+                ccd_parsed = ccd_cache_get(m->ccd_cache, CCD_DEFAULT);
+            }
         }
-        /* try default file */
-        else if (platform_test_file(ccd_default))
+        else
+#endif
         {
-            ccd_file = ccd_default;
+            const char *ccd_client =
+                platform_gen_path(mi->context.options.client_config_dir,
+                                  tls_common_name(mi->context.c2.tls_multi, false),
+                                  &gc);
+
+            const char *ccd_default =
+                platform_gen_path(mi->context.options.client_config_dir,
+                                  CCD_DEFAULT, &gc);
+
+
+            /* try common-name file */
+            if (platform_test_file(ccd_client))
+            {
+                ccd_file = ccd_client;
+            }
+            /* try default file */
+            else if (platform_test_file(ccd_default))
+            {
+                ccd_file = ccd_default;
+            }
         }
 
-        if (ccd_file)
+        if (ccd_file || ccd_parsed)
         {
-            options_server_import(&mi->context.options,
-                                  ccd_file,
-                                  D_IMPORT_ERRORS|M_OPTERR,
-                                  CLIENT_CONNECT_OPT_MASK,
-                                  option_types_found,
-                                  mi->context.c2.es);
+            if (ccd_parsed)
+            {
+                options_server_import_parsed(&mi->context.options,
+                                             ccd_parsed,
+                                             D_IMPORT_ERRORS|M_OPTERR,
+                                             CLIENT_CONNECT_OPT_MASK,
+                                             option_types_found,
+                                             mi->context.c2.es);
+            }
+            else
+            {
+                options_server_import(&mi->context.options,
+                                      ccd_file,
+                                      D_IMPORT_ERRORS|M_OPTERR,
+                                      CLIENT_CONNECT_OPT_MASK,
+                                      option_types_found,
+                                      mi->context.c2.es);
+            }
             /*
              * Select a virtual address from either --ifconfig-push in
              * --client-config-dir file or --ifconfig-pool.
@@ -2693,6 +3460,25 @@ multi_connection_established(struct multi_context *m, struct multi_instance *mi)
         mi->context.c2.tls_multi->multi_state = CAS_FAILED;
     }
 
+    if (mi->context.c2.tls_multi->multi_state == CAS_CONNECT_DONE)
+    {
+        struct timeval tv, delta;
+
+        openvpn_gettimeofday(&tv, NULL);
+        tv_delta(&delta, &mi->created_tv, &tv);
+        metrics_histogram_observe(&m->metrics.handshake_seconds,
+                                  delta.tv_sec + delta.tv_usec / 1000000.0);
+        ++m->metrics.connections;
+        context_evlog(&mi->context, D_MULTI_LOW, EVLOG_CLIENT_ESTABLISHED,
+                      (uint64_t)delta.tv_sec * 1000000 + delta.tv_usec,
+                      mi->reporting_addr, 0, 0);
+    }
+    else
+    {
+        ++m->metrics.auth_failures;
+        context_evlog(&mi->context, D_MULTI_LOW, EVLOG_CLIENT_AUTH_FAILED, 0, 0, 0, 0);
+    }
+
     /* increment number of current authenticated clients */
     ++m->n_clients;
     update_mstat_n_clients(m->n_clients);
@@ -2780,7 +3566,29 @@ multi_add_mbuf(struct multi_context *m,
     else
     {
         msg(D_MULTI_DROPPED, "MULTI: packet dropped due to output saturation (multi_add_mbuf)");
+        ++m->metrics.drops_output_saturation;
+        context_evlog(&mi->context, D_MULTI_DROPPED, EVLOG_DROP_OUTPUT_SATURATION, 0, 0, 0, 0);
+    }
+}
+
+/*
+ * Check a packet to a client against its --client-policer and
+ * --policer-class budgets, and account for it if it is dropped.
+ */
+static inline bool
+multi_policer_conform(struct multi_context *m,
+                      struct multi_instance *mi,
+                      const struct buffer *buf)
+{
+    if (likely(!mi->policer.rate && !mi->policer_parent)
+        || token_bucket_take(&mi->policer, mi->policer_parent, BLEN(buf)))
+    {
+        return true;
     }
+    msg(D_MULTI_DROPPED, "MULTI: packet dropped by client policer, len=%d", BLEN(buf));
+    ++m->metrics.drops_policer;
+    context_evlog(&mi->context, D_MULTI_DROPPED, EVLOG_DROP_POLICER, BLEN(buf), 0, 0, 0);
+    return false;
 }
 
 /*
@@ -2793,7 +3601,7 @@ multi_unicast(struct multi_context *m,
 {
     struct mbuf_buffer *mb;
 
-    if (BLEN(buf) > 0)
+    if (BLEN(buf) > 0 && multi_policer_conform(m, mi, buf))
     {
         mb = mbuf_alloc_buf(buf);
         mb->flags = MF_UNICAST;
@@ -2914,6 +3722,25 @@ multi_schedule_context_wakeup(struct multi_context *m, struct multi_instance *mi
     ASSERT(!openvpn_gettimeofday(&mi->wakeup, NULL));
     tv_add(&mi->wakeup, &mi->context.c2.timeval);
 
+    /*
+     * Wakeups a second or more away, such as renegotiation deadlines,
+     * go on the coarse wheel, rounded up to the next second.  The
+     * keepalive timers have their own deadline there, see
+     * multi_process_keepalive().
+     */
+    if (mi->context.c2.timeval.tv_sec >= 1)
+    {
+        if (IN_TREE(&mi->se))
+        {
+            schedule_remove_entry(m->schedule, (struct schedule_entry *) mi);
+        }
+        wheel_add(&m->wheel, &mi->wakeup_deadline.we,
+                  mi->wakeup.tv_sec + (mi->wakeup.tv_usec ? 1 : 0));
+        return;
+    }
+
+    wheel_remove(&m->wheel, &mi->wakeup_deadline.we);
+
     /* tell scheduler to wake us up at some point in the future */
     schedule_add_entry(m->schedule,
                        (struct schedule_entry *) mi,
@@ -2947,6 +3774,77 @@ add_inotify_file_watch(struct multi_context *m, struct multi_instance *mi,
 }
 #endif /* if defined(ENABLE_ASYNC_PUSH) */
 
+#ifndef _WIN32
+/*
+ * Remember the job id of an asynchronously started auth script,
+ * so that its completion can wake up the instance.
+ */
+static void
+multi_watch_auth_child(struct multi_context *m, struct multi_instance *mi)
+{
+    const struct key_state *ks = &mi->context.c2.tls_multi->session[TM_ACTIVE].key[KS_PRIMARY];
+    const unsigned int job = ks->script_auth.child_job;
+
+    if (job && job != mi->auth_job)
+    {
+        if (mi->auth_job)
+        {
+            hash_remove(m->auth_jobs, (void *) (unsigned long)mi->auth_job);
+        }
+        hash_add(m->auth_jobs, (void *) (unsigned long)job, mi, true);
+        mi->auth_job = job;
+    }
+}
+
+/*
+ * Called for every asynchronously started script that finished,
+ * schedules the instance it belongs to for immediate processing.
+ */
+static void
+multi_auth_child_exited(unsigned int job, void *arg)
+{
+    struct multi_context *m = (struct multi_context *) arg;
+    struct multi_instance *mi = hash_lookup(m->auth_jobs,
+                                            (void *) (unsigned long)job);
+
+    msg(D_MULTI_DEBUG, "MULTI: asynchronous script job %u finished", job);
+
+    if (mi)
+    {
+        hash_remove(m->auth_jobs, (void *) (unsigned long)job);
+        mi->auth_job = 0;
+        reschedule_multi_process(&mi->context);
+        multi_schedule_context_wakeup(m, mi);
+    }
+}
+
+void
+multi_process_child_exited(struct multi_context *m)
+{
+    openvpn_execve_async_reap(multi_auth_child_exited, m);
+}
+#endif /* ifndef _WIN32 */
+
+/*
+ * Run the --inactive and --ping timers of an instance, which
+ * pre_select() leaves to us, and put the next time they are
+ * due on the wheel.
+ */
+static void
+multi_process_keepalive(struct multi_context *m, struct multi_instance *mi)
+{
+    const interval_t wakeup = process_keepalive_timers(&mi->context);
+
+    if (wakeup < BIG_TIMEOUT)
+    {
+        wheel_add(&m->wheel, &mi->keepalive_deadline.we, now + wakeup);
+    }
+    else
+    {
+        wheel_remove(&m->wheel, &mi->keepalive_deadline.we);
+    }
+}
+
 /*
  * Figure instance-specific timers, convert
  * earliest to absolute time in mi->wakeup,
@@ -2959,6 +3857,10 @@ multi_process_post(struct multi_context *m, struct multi_instance *mi, const uns
 {
     bool ret = true;
 
+#ifdef ENABLE_MANAGEMENT
+    multi_rate_update(m, mi);
+#endif
+
     if (!IS_SIG(&mi->context) && ((flags & MPP_PRE_SELECT) || ((flags & MPP_CONDITIONAL_PRE_SELECT) && !ANY_OUT(&mi->context))))
     {
 #if defined(ENABLE_ASYNC_PUSH)
@@ -2974,6 +3876,24 @@ multi_process_post(struct multi_context *m, struct multi_instance *mi, const uns
         /* figure timeouts and fetch possible outgoing
          * to_link packets (such as ping or TLS control) */
         pre_select(&mi->context);
+        if (!IS_SIG(&mi->context))
+        {
+            multi_process_keepalive(m, mi);
+        }
+
+#ifndef _WIN32
+        if (mi->context.c2.tls_multi)
+        {
+            multi_watch_auth_child(m, mi);
+        }
+#endif
+#ifdef ENABLE_MANAGEMENT
+        /* the common name is only set while the client authenticates */
+        if (mi->context.c2.tls_multi && !mi->halt && !mi->cn_locked)
+        {
+            multi_cn_index_update(m, mi);
+        }
+#endif
 
 #if defined(ENABLE_ASYNC_PUSH)
         /*
@@ -3017,6 +3937,10 @@ multi_process_post(struct multi_context *m, struct multi_instance *mi, const uns
             multi_schedule_context_wakeup(m, mi);
         }
     }
+    else if (!IS_SIG(&mi->context) && (flags & MPP_KEEPALIVE))
+    {
+        multi_process_keepalive(m, mi);
+    }
 
     if (IS_SIG(&mi->context))
     {
@@ -3043,6 +3967,10 @@ multi_process_post(struct multi_context *m, struct multi_instance *mi, const uns
 #endif
     }
 
+#ifdef ENABLE_MEMSTATS
+    multi_update_mstats(m, mi);
+#endif
+
     if ((flags & MPP_RECORD_TOUCH) && m->mpp_touched)
     {
         *m->mpp_touched = mi;
@@ -3144,6 +4072,7 @@ multi_process_incoming_link(struct multi_context *m, struct multi_instance *inst
     {
         return true;
     }
+    ++m->metrics.loop_packets;
 
     if (!instance)
     {
@@ -3227,6 +4156,9 @@ multi_process_incoming_link(struct multi_context *m, struct multi_instance *inst
                     {
                         msg(D_MULTI_DROPPED, "MULTI: bad source address from client [%s], packet dropped",
                             mroute_addr_print(&src, &gc));
+                        ++m->metrics.drops_bad_source;
+                        context_evlog(c, D_MULTI_DROPPED, EVLOG_DROP_BAD_SOURCE,
+                                      BLEN(&c->c2.to_tun), 0, 0, 0);
                     }
                     c->c2.to_tun.len = 0;
                 }
@@ -3363,6 +4295,9 @@ multi_process_incoming_link(struct multi_context *m, struct multi_instance *inst
                     {
                         msg(D_MULTI_DROPPED, "MULTI: bad source address from client [%s], packet dropped",
                             mroute_addr_print(&src, &gc));
+                        ++m->metrics.drops_bad_source;
+                        context_evlog(c, D_MULTI_DROPPED, EVLOG_DROP_BAD_SOURCE,
+                                      BLEN(&c->c2.to_tun), 0, 0, 0);
                         c->c2.to_tun.len = 0;
                     }
                 }
@@ -3400,6 +4335,8 @@ multi_process_incoming_tun(struct multi_context *m, const unsigned int mpp_flags
         const int dev_type = TUNNEL_TYPE(m->top.c1.tuntap);
         int16_t vid = 0;
 
+        ++m->metrics.loop_packets;
+
 #ifdef ENABLE_PF
         struct mroute_addr esrc, *e1, *e2;
         if (dev_type == DEV_TYPE_TUN)
@@ -3484,7 +4421,11 @@ multi_process_incoming_tun(struct multi_context *m, const unsigned int mpp_flags
                     else
 #endif
                     {
-                        if (multi_output_queue_ready(m, m->pending))
+                        if (!multi_policer_conform(m, m->pending, &m->top.c2.buf))
+                        {
+                            buf_reset_len(&c->c2.buf);
+                        }
+                        else if (multi_output_queue_ready(m, m->pending))
                         {
                             /* transfer packet pointer from top-level context buffer to instance */
                             c->c2.buf = m->top.c2.buf;
@@ -3493,6 +4434,8 @@ multi_process_incoming_tun(struct multi_context *m, const unsigned int mpp_flags
                         {
                             /* drop packet */
                             msg(D_MULTI_DROPPED, "MULTI: packet dropped due to output saturation (multi_process_incoming_tun)");
+                            ++m->metrics.drops_output_saturation;
+                            context_evlog(c, D_MULTI_DROPPED, EVLOG_DROP_OUTPUT_SATURATION, 0, 0, 0, 0);
                             buf_reset_len(&c->c2.buf);
                         }
                     }
@@ -3569,8 +4512,17 @@ multi_process_timeout(struct multi_context *m, const unsigned int mpp_flags)
         }
         else
         {
+            unsigned int flags = mpp_flags;
+
+            /* only the keepalive timers are due, no need for pre_select() */
+            if (m->earliest_keepalive)
+            {
+                flags = (flags & ~MPP_PRE_SELECT) | MPP_KEEPALIVE;
+            }
+
+            ++m->metrics.loop_timers;
             set_prefix(m->earliest_wakeup);
-            ret = multi_process_post(m, m->earliest_wakeup, mpp_flags);
+            ret = multi_process_post(m, m->earliest_wakeup, flags);
             clear_prefix();
         }
         m->earliest_wakeup = NULL;
@@ -3592,6 +4544,9 @@ multi_process_drop_outgoing_tun(struct multi_context *m, const unsigned int mpp_
 
     msg(D_MULTI_ERRORS, "MULTI: Outgoing TUN queue full, dropped packet len=%d",
         mi->context.c2.to_tun.len);
+    ++m->metrics.drops_tun_queue_full;
+    context_evlog(&mi->context, D_MULTI_ERRORS, EVLOG_DROP_TUN_QUEUE_FULL,
+                  BLEN(&mi->context.c2.to_tun), 0, 0, 0);
 
     buf_reset(&mi->context.c2.to_tun);
 
@@ -3658,12 +4613,51 @@ stale_route_check_trigger(struct multi_context *m)
     return event_timeout_trigger(&m->stale_routes_check_et, &null, ETT_DEFAULT);
 }
 
+/*
+ * Compute the event loop averages of a window once it is complete.
+ */
+static void
+multi_loop_window_update(struct multi_context *m)
+{
+    struct multi_loop_window *w = &m->metrics.window;
+    const struct event_loop_stats *s = &m->metrics.loop;
+
+    if (now - w->start < MULTI_LOOP_WINDOW)
+    {
+        return;
+    }
+
+    const double wait = s->wait_ns - w->loop.wait_ns;
+    const double busy = s->busy_ns - w->loop.busy_ns;
+    const counter_type wakeups = s->waits - w->loop.waits;
+
+    w->duty_cycle = wait + busy > 0 ? busy / (wait + busy) : 0;
+    w->wakeups_per_second = (double)wakeups / (now - w->start);
+    if (wakeups)
+    {
+        w->events_per_wakeup = (double)(s->events - w->loop.events) / wakeups;
+        w->packets_per_wakeup = (double)(m->metrics.loop_packets - w->packets) / wakeups;
+        w->saturated_fraction = (double)(s->saturated - w->loop.saturated) / wakeups;
+    }
+    else
+    {
+        w->events_per_wakeup = w->packets_per_wakeup = w->saturated_fraction = 0;
+    }
+
+    w->start = now;
+    w->loop = *s;
+    w->packets = m->metrics.loop_packets;
+}
+
 /*
  * Process timers in the top-level context
  */
 void
 multi_process_per_second_timers_dowork(struct multi_context *m)
 {
+    /* update the event loop averages */
+    multi_loop_window_update(m);
+
     /* possibly reap instances/routes in vhash */
     multi_reap_process(m);
 
@@ -3672,13 +4666,26 @@ multi_process_per_second_timers_dowork(struct multi_context *m)
     {
         if (status_trigger(m->top.c1.status_output))
         {
-            multi_print_status(m, m->top.c1.status_output, m->status_file_version);
+            multi_status_job_start(m, m->top.c1.status_output);
         }
     }
 
     /* possibly flush ifconfig-pool file */
     multi_ifconfig_pool_persist(m, false);
 
+#ifdef ENABLE_MEMSTATS
+    /* refresh the --memstats slots that went stale during the last second */
+    multi_flush_mstats_clients(m);
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+    /* read some more --client-config-dir files into the cache */
+    if (m->ccd_cache)
+    {
+        ccd_cache_preload(m->ccd_cache, CCD_CACHE_PRELOAD_BATCH);
+    }
+#endif
+
 #ifdef ENABLE_DEBUG
     gremlin_flood_clients(m);
 #endif
@@ -3814,6 +4821,300 @@ management_callback_status(void *arg, const int version, struct status_output *s
     }
 }
 
+/* per-client values reported by the "metrics" command */
+struct multi_metrics_client
+{
+    const char *labels;
+    counter_type bytes_in;
+    counter_type bytes_out;
+    counter_type packets_in;
+    counter_type packets_out;
+    counter_type drops;
+    int tcp_deferred;
+    int path_mtu;
+    int mem_context;
+    int mem_control;
+    int mem_crypto;
+    int mem_fragment;
+    int mem_compress;
+#ifdef USE_COMP
+    counter_type comp_in;
+    counter_type comp_out;
+    counter_type comp_skipped;
+    double comp_seconds;
+#endif
+};
+
+/*
+ * Collect the per-client values, unless this has already been done
+ * during the current second.
+ */
+static void
+multi_metrics_update_clients(struct multi_context *m)
+{
+    struct multi_metrics *mm = &m->metrics;
+    struct hash_iterator hi;
+    struct hash_element *he;
+    const int n = hash_n_elements(m->hash);
+
+    if (mm->clients && mm->clients_updated == now)
+    {
+        return;
+    }
+
+    free(mm->clients);
+    gc_free(&mm->clients_gc);
+    ALLOC_ARRAY_CLEAR(mm->clients, struct multi_metrics_client, max_int(n, 1));
+    mm->n_clients = 0;
+    mm->clients_updated = now;
+
+    hash_iterator_init(m->hash, &hi);
+    while ((he = hash_iterator_next(&hi)) && mm->n_clients < n)
+    {
+        const struct multi_instance *mi = (struct multi_instance *) he->value;
+        const struct context *c = &mi->context;
+        struct multi_metrics_client *mc = &mm->clients[mm->n_clients];
+
+        if (mi->halt)
+        {
+            continue;
+        }
+
+        struct buffer labels = alloc_buf_gc(256, &mm->clients_gc);
+        buf_printf(&labels, "cid=\"%lu\",common_name=\"%s\"",
+                   c->c2.mda_context.cid,
+                   metrics_label_value(tls_common_name(c->c2.tls_multi, false),
+                                       &mm->clients_gc));
+        mc->labels = BSTR(&labels);
+        mc->bytes_in = c->c2.link_read_bytes;
+        mc->bytes_out = c->c2.link_write_bytes;
+        mc->packets_in = c->c2.link_read_packets;
+        mc->packets_out = c->c2.link_write_packets;
+        mc->drops = c->c2.link_read_drops;
+        if (mi->tcp_link_out_deferred)
+        {
+            mc->tcp_deferred = mbuf_len(mi->tcp_link_out_deferred);
+        }
+        mc->path_mtu = c->c2.plpmtud.pmtu;
+        mc->mem_context = sizeof(*mi);
+        if (c->c2.tls_multi)
+        {
+            mc->mem_context += tls_multi_state_bytes(c->c2.tls_multi);
+            mc->mem_control = tls_multi_buffer_bytes(c->c2.tls_multi);
+            mc->mem_crypto = tls_multi_crypto_bytes(c->c2.tls_multi);
+        }
+#ifdef ENABLE_FRAGMENT
+        if (c->c2.fragment)
+        {
+            mc->mem_fragment = fragment_memory_bytes(c->c2.fragment);
+        }
+#endif
+#ifdef USE_COMP
+        if (c->c2.comp_context)
+        {
+            const struct compress_context *cc = c->c2.comp_context;
+            mc->mem_compress = comp_memory_bytes(cc);
+            mc->comp_in = cc->pre_compress;
+            mc->comp_out = cc->post_compress;
+            mc->comp_skipped = cc->ac.n_skip_sample + cc->ac.n_skip_flow;
+            mc->comp_seconds = cc->ac.compress_ns / 1e9;
+        }
+#endif
+        ++mm->n_clients;
+    }
+    hash_iterator_free(&hi);
+}
+
+#define MULTI_METRICS_CLIENTS(name, type, help, field, format) \
+    do { \
+        metrics_print_family(so, name, type, help); \
+        for (int i = 0; i < mm->n_clients; ++i) \
+        { \
+            status_printf(so, "%s%s{%s} " format, name, \
+                          streq(type, "counter") ? "_total" : "", \
+                          mm->clients[i].labels, mm->clients[i].field); \
+        } \
+    } while (0)
+
+/*
+ * Print server metrics in the OpenMetrics text format.  Server-wide
+ * values are counters maintained as events happen, per-client values
+ * are collected at most once per second.
+ */
+static void
+management_callback_metrics(void *arg, struct status_output *so)
+{
+    struct multi_context *m = (struct multi_context *) arg;
+    struct multi_metrics *mm = &m->metrics;
+    int tcp_deferred = 0;
+
+    multi_metrics_update_clients(m);
+    for (int i = 0; i < mm->n_clients; ++i)
+    {
+        tcp_deferred += mm->clients[i].tcp_deferred;
+    }
+
+    metrics_print_family(so, "openvpn_clients", "gauge",
+                         "Number of authenticated clients.");
+    status_printf(so, "openvpn_clients %d", m->n_clients);
+
+    metrics_print_family(so, "openvpn_link_received_bytes", "counter",
+                         "Bytes received on the external network.");
+    status_printf(so, "openvpn_link_received_bytes_total " counter_format,
+                  link_read_bytes_global);
+    metrics_print_family(so, "openvpn_link_sent_bytes", "counter",
+                         "Bytes sent on the external network.");
+    status_printf(so, "openvpn_link_sent_bytes_total " counter_format,
+                  link_write_bytes_global);
+
+    metrics_print_family(so, "openvpn_connections", "counter",
+                         "Clients that completed authentication.");
+    status_printf(so, "openvpn_connections_total " counter_format,
+                  mm->connections);
+    metrics_print_family(so, "openvpn_auth_failures", "counter",
+                         "Clients rejected during client-connect.");
+    status_printf(so, "openvpn_auth_failures_total " counter_format,
+                  mm->auth_failures);
+    metrics_print_family(so, "openvpn_handshake_failures", "counter",
+                         "Clients closed before completing authentication.");
+    status_printf(so, "openvpn_handshake_failures_total " counter_format,
+                  mm->handshake_failures);
+
+    metrics_print_family(so, "openvpn_dropped_packets", "counter",
+                         "Packets dropped, by reason.");
+    status_printf(so, "openvpn_dropped_packets_total{reason=\"decrypt\"} " counter_format,
+                  link_read_drops_global);
+    status_printf(so, "openvpn_dropped_packets_total{reason=\"bad_source\"} " counter_format,
+                  mm->drops_bad_source);
+    status_printf(so, "openvpn_dropped_packets_total{reason=\"output_saturation\"} " counter_format,
+                  mm->drops_output_saturation);
+    status_printf(so, "openvpn_dropped_packets_total{reason=\"tun_queue_full\"} " counter_format,
+                  mm->drops_tun_queue_full);
+    status_printf(so, "openvpn_dropped_packets_total{reason=\"policer\"} " counter_format,
+                  mm->drops_policer);
+
+    metrics_print_family(so, "openvpn_mbuf_queued_packets", "gauge",
+                         "Packets in the client-to-client/broadcast queue.");
+    status_printf(so, "openvpn_mbuf_queued_packets %d",
+                  m->mbuf ? mbuf_len(m->mbuf) : 0);
+    metrics_print_family(so, "openvpn_mbuf_queued_packets_max", "gauge",
+                         "Maximum length reached by the client-to-client/broadcast queue.");
+    status_printf(so, "openvpn_mbuf_queued_packets_max %d",
+                  m->mbuf ? mbuf_maximum_queued(m->mbuf) : 0);
+    metrics_print_family(so, "openvpn_tcp_deferred_packets", "gauge",
+                         "Packets waiting to be written to TCP clients.");
+    status_printf(so, "openvpn_tcp_deferred_packets %d", tcp_deferred);
+
+    metrics_print_family(so, "openvpn_handshake_duration_seconds", "histogram",
+                         "Time from the first packet of a client until it is authenticated.");
+    metrics_print_histogram(so, "openvpn_handshake_duration_seconds", NULL,
+                            &mm->handshake_seconds);
+
+    metrics_print_family(so, "openvpn_event_loop_wakeups", "counter",
+                         "Returns from waiting for I/O events or timers.");
+    status_printf(so, "openvpn_event_loop_wakeups_total " counter_format,
+                  mm->loop.waits);
+    metrics_print_family(so, "openvpn_event_loop_timeouts", "counter",
+                         "Wakeups without I/O events.");
+    status_printf(so, "openvpn_event_loop_timeouts_total " counter_format,
+                  mm->loop.timeouts);
+    metrics_print_family(so, "openvpn_event_loop_saturated_wakeups", "counter",
+                         "Wakeups that returned as many I/O events as could be handled at once.");
+    status_printf(so, "openvpn_event_loop_saturated_wakeups_total " counter_format,
+                  mm->loop.saturated);
+    metrics_print_family(so, "openvpn_event_loop_events", "counter",
+                         "I/O events returned by wakeups.");
+    status_printf(so, "openvpn_event_loop_events_total " counter_format,
+                  mm->loop.events);
+    metrics_print_family(so, "openvpn_event_loop_wait_seconds", "counter",
+                         "Time spent waiting for I/O events or timers.");
+    status_printf(so, "openvpn_event_loop_wait_seconds_total %.6f",
+                  mm->loop.wait_ns / 1000000000.0);
+    metrics_print_family(so, "openvpn_event_loop_busy_seconds", "counter",
+                         "Time spent processing between waits.");
+    status_printf(so, "openvpn_event_loop_busy_seconds_total %.6f",
+                  mm->loop.busy_ns / 1000000000.0);
+    metrics_print_family(so, "openvpn_event_loop_work", "counter",
+                         "Work done by the event loop, by kind.");
+    status_printf(so, "openvpn_event_loop_work_total{kind=\"packets\"} " counter_format,
+                  mm->loop_packets);
+    status_printf(so, "openvpn_event_loop_work_total{kind=\"timers\"} " counter_format,
+                  mm->loop_timers);
+    status_printf(so, "openvpn_event_loop_work_total{kind=\"reaps\"} " counter_format,
+                  m->reaper ? m->reaper->reaped : 0);
+    metrics_print_family(so, "openvpn_event_loop_duty_cycle", "gauge",
+                         "Fraction of the last 10 seconds spent processing rather than waiting.");
+    status_printf(so, "openvpn_event_loop_duty_cycle %.3f", mm->window.duty_cycle);
+    metrics_print_family(so, "openvpn_event_loop_events_per_wakeup", "histogram",
+                         "I/O events returned per wakeup.");
+    metrics_print_histogram(so, "openvpn_event_loop_events_per_wakeup", NULL,
+                            &mm->events_per_wakeup);
+    metrics_print_family(so, "openvpn_event_loop_wakeup_duration_seconds", "histogram",
+                         "Time spent processing per wakeup.");
+    metrics_print_histogram(so, "openvpn_event_loop_wakeup_duration_seconds", NULL,
+                            &mm->wakeup_seconds);
+
+    MULTI_METRICS_CLIENTS("openvpn_client_received_bytes", "counter",
+                          "Bytes received from a client.",
+                          bytes_in, counter_format);
+    MULTI_METRICS_CLIENTS("openvpn_client_sent_bytes", "counter",
+                          "Bytes sent to a client.",
+                          bytes_out, counter_format);
+    MULTI_METRICS_CLIENTS("openvpn_client_received_packets", "counter",
+                          "Packets received from a client.",
+                          packets_in, counter_format);
+    MULTI_METRICS_CLIENTS("openvpn_client_sent_packets", "counter",
+                          "Packets sent to a client.",
+                          packets_out, counter_format);
+    MULTI_METRICS_CLIENTS("openvpn_client_dropped_packets", "counter",
+                          "Packets from a client that failed authentication or replay checks.",
+                          drops, counter_format);
+    MULTI_METRICS_CLIENTS("openvpn_client_tcp_deferred_packets", "gauge",
+                          "Packets waiting to be written to a TCP client.",
+                          tcp_deferred, "%d");
+    MULTI_METRICS_CLIENTS("openvpn_client_path_mtu_bytes", "gauge",
+                          "Largest packet found to reach a client by --mtu-probe, 0 if unknown.",
+                          path_mtu, "%d");
+
+    metrics_print_family(so, "openvpn_client_memory_bytes", "gauge",
+                         "Memory allocated by OpenVPN for a client, by part.");
+    for (int i = 0; i < mm->n_clients; ++i)
+    {
+        const struct multi_metrics_client *mc = &mm->clients[i];
+
+        status_printf(so, "openvpn_client_memory_bytes{%s,part=\"context\"} %d",
+                      mc->labels, mc->mem_context);
+        status_printf(so, "openvpn_client_memory_bytes{%s,part=\"control_channel\"} %d",
+                      mc->labels, mc->mem_control);
+        status_printf(so, "openvpn_client_memory_bytes{%s,part=\"crypto\"} %d",
+                      mc->labels, mc->mem_crypto);
+        status_printf(so, "openvpn_client_memory_bytes{%s,part=\"fragment\"} %d",
+                      mc->labels, mc->mem_fragment);
+        status_printf(so, "openvpn_client_memory_bytes{%s,part=\"compress\"} %d",
+                      mc->labels, mc->mem_compress);
+    }
+
+#ifdef USE_COMP
+    MULTI_METRICS_CLIENTS("openvpn_client_compress_input_bytes", "counter",
+                          "Bytes of packets to a client passed to the compressor.",
+                          comp_in, counter_format);
+    MULTI_METRICS_CLIENTS("openvpn_client_compress_output_bytes", "counter",
+                          "Bytes of packets to a client returned by the compressor.",
+                          comp_out, counter_format);
+    MULTI_METRICS_CLIENTS("openvpn_client_compress_skipped_packets", "counter",
+                          "Packets to a client sent uncompressed by adaptive compression.",
+                          comp_skipped, counter_format);
+    MULTI_METRICS_CLIENTS("openvpn_client_compress_cpu_seconds", "counter",
+                          "Time spent compressing packets to a client, with adaptive compression.",
+                          comp_seconds, "%.6f");
+#endif
+
+    status_printf(so, "# EOF");
+    status_printf(so, "END");
+}
+
+#undef MULTI_METRICS_CLIENTS
+
 static int
 management_callback_n_clients(void *arg)
 {
@@ -3825,25 +5126,40 @@ static int
 management_callback_kill_by_cn(void *arg, const char *del_cn)
 {
     struct multi_context *m = (struct multi_context *) arg;
-    struct hash_iterator hi;
-    struct hash_element *he;
+    struct gc_arena gc = gc_new();
+    struct multi_cn_entry *entry;
     int count = 0;
 
-    hash_iterator_init(m->iter, &hi);
-    while ((he = hash_iterator_next(&hi)))
+    entry = (struct multi_cn_entry *) hash_lookup(m->cn_hash, del_cn);
+    if (entry)
     {
-        struct multi_instance *mi = (struct multi_instance *) he->value;
-        if (!mi->halt)
+        struct multi_instance **victims;
+        struct multi_instance *mi;
+        int n = 0;
+
+        /* closing an instance unlinks it, so collect the victims first */
+        for (mi = entry->first; mi; mi = mi->cn_next)
+        {
+            ++n;
+        }
+        ALLOC_ARRAY_GC(victims, struct multi_instance *, n, &gc);
+        n = 0;
+        for (mi = entry->first; mi; mi = mi->cn_next)
         {
-            const char *cn = tls_common_name(mi->context.c2.tls_multi, false);
-            if (cn && !strcmp(cn, del_cn))
+            victims[n++] = mi;
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            mi = victims[i];
+            if (!mi->halt)
             {
                 multi_signal_instance(m, mi, SIGTERM);
                 ++count;
             }
         }
     }
-    hash_iterator_free(&hi);
+    gc_free(&gc);
     return count;
 }
 
@@ -3851,8 +5167,6 @@ static int
 management_callback_kill_by_addr(void *arg, const in_addr_t addr, const int port)
 {
     struct multi_context *m = (struct multi_context *) arg;
-    struct hash_iterator hi;
-    struct hash_element *he;
     struct openvpn_sockaddr saddr;
     struct mroute_addr maddr;
     int count = 0;
@@ -3863,17 +5177,13 @@ management_callback_kill_by_addr(void *arg, const in_addr_t addr, const int port
     saddr.addr.in4.sin_port = htons(port);
     if (mroute_extract_openvpn_sockaddr(&maddr, &saddr, true))
     {
-        hash_iterator_init(m->iter, &hi);
-        while ((he = hash_iterator_next(&hi)))
+        /* m->hash is keyed by the real address of the clients */
+        struct multi_instance *mi = (struct multi_instance *) hash_lookup(m->hash, &maddr);
+        if (mi && !mi->halt)
         {
-            struct multi_instance *mi = (struct multi_instance *) he->value;
-            if (!mi->halt && mroute_addr_equal(&maddr, &mi->real))
-            {
-                multi_signal_instance(m, mi, SIGTERM);
-                ++count;
-            }
+            multi_signal_instance(m, mi, SIGTERM);
+            ++count;
         }
-        hash_iterator_free(&hi);
     }
     return count;
 }
@@ -3999,6 +5309,134 @@ management_get_peer_info(void *arg, const unsigned long cid)
     return ret;
 }
 
+/*
+ * Print the n instances with the highest byte rates.  The heap is
+ * walked with a second, small heap of candidate positions: the best
+ * candidate is printed and replaced by its two children, so only
+ * O(n log n) work is done regardless of the number of instances.
+ */
+static void
+management_callback_top_clients(void *arg, const int n, struct status_output *so)
+{
+    struct multi_context *m = (struct multi_context *) arg;
+    struct gc_arena gc = gc_new();
+    int *cand;
+    int n_cand = 0;
+
+    ALLOC_ARRAY_GC(cand, int, n + 2, &gc);
+    if (m->rate_heap_len > 0)
+    {
+        cand[n_cand++] = 0;
+    }
+
+    status_printf(so, "HEADER,TOP_CLIENT,Rank,Common Name,Real Address,Client ID,"
+                  "Bytes Received/s,Bytes Sent/s,Packets Received/s,Packets Sent/s");
+    for (int rank = 1; rank <= n && n_cand > 0; ++rank)
+    {
+        /* pop the best candidate */
+        const int best = cand[0];
+        cand[0] = cand[--n_cand];
+        for (int i = 0; ; )
+        {
+            const int l = 2 * i + 1;
+            int max = i;
+            for (int c = l; c <= l + 1 && c < n_cand; ++c)
+            {
+                if (m->rate_heap[cand[c]]->rate.key > m->rate_heap[cand[max]]->rate.key)
+                {
+                    max = c;
+                }
+            }
+            if (max == i)
+            {
+                break;
+            }
+            const int tmp = cand[i];
+            cand[i] = cand[max];
+            cand[max] = tmp;
+            i = max;
+        }
+
+        /* push its children */
+        for (int c = 2 * best + 1; c <= 2 * best + 2 && c < m->rate_heap_len; ++c)
+        {
+            int i = n_cand++;
+            cand[i] = c;
+            while (i > 0 && m->rate_heap[cand[(i - 1) / 2]]->rate.key < m->rate_heap[cand[i]]->rate.key)
+            {
+                const int tmp = cand[i];
+                cand[i] = cand[(i - 1) / 2];
+                cand[(i - 1) / 2] = tmp;
+                i = (i - 1) / 2;
+            }
+        }
+
+        const struct multi_instance *mi = m->rate_heap[best];
+        const struct multi_rate *r = &mi->rate;
+        const double f = multi_rate_decay(now - r->last);
+        status_printf(so, "TOP_CLIENT,%d,%s,%s,%lu,%.0f,%.0f,%.1f,%.1f",
+                      rank,
+                      tls_common_name(mi->context.c2.tls_multi, false),
+                      mroute_addr_print(&mi->real, &gc),
+                      mi->context.c2.mda_context.cid,
+                      r->bps_in * f, r->bps_out * f,
+                      r->pps_in * f, r->pps_out * f);
+    }
+    status_printf(so, "END");
+    gc_free(&gc);
+}
+
+static bool
+management_client_trace(void *arg, const unsigned long cid, const int n)
+{
+    struct multi_context *m = (struct multi_context *) arg;
+    struct multi_instance *mi = lookup_by_cid(m, cid);
+
+    if (!mi)
+    {
+        return false;
+    }
+    pktrace_free(mi->context.c2.pktrace);
+    mi->context.c2.pktrace = NULL;
+    if (n > 0)
+    {
+        const bool tap = TUNNEL_TYPE(mi->context.c1.tuntap) == DEV_TYPE_TAP;
+        mi->context.c2.pktrace = pktrace_new(n, tap);
+    }
+    return true;
+}
+
+/*
+ * Write the trace of a client as pcapng file to --tmp-dir and return the
+ * file name, or NULL if the client is not traced or the file cannot be
+ * written.
+ */
+static const char *
+management_client_trace_dump(void *arg, const unsigned long cid, struct gc_arena *gc)
+{
+    struct multi_context *m = (struct multi_context *) arg;
+    struct multi_instance *mi = lookup_by_cid(m, cid);
+    const char *filename;
+    struct buffer pcap;
+
+    if (!mi || !mi->context.c2.pktrace)
+    {
+        return NULL;
+    }
+    filename = platform_create_temp_file(m->top.options.tmp_dir, "trace", gc);
+    if (!filename)
+    {
+        return NULL;
+    }
+    pcap = pktrace_pcapng(mi->context.c2.pktrace, gc);
+    if (!buffer_write_file(filename, &pcap))
+    {
+        platform_unlink(filename);
+        return NULL;
+    }
+    return filename;
+}
+
 #endif /* ifdef ENABLE_MANAGEMENT */
 
 #ifdef MANAGEMENT_PF
@@ -4037,10 +5475,14 @@ init_management_callback_multi(struct multi_context *m)
         cb.kill_by_addr = management_callback_kill_by_addr;
         cb.delete_event = management_delete_event;
         cb.n_clients = management_callback_n_clients;
+        cb.metrics = management_callback_metrics;
         cb.kill_by_cid = management_kill_by_cid;
         cb.client_auth = management_client_auth;
         cb.client_pending_auth = management_client_pending_auth;
         cb.get_peer_info = management_get_peer_info;
+        cb.client_trace = management_client_trace;
+        cb.top_clients = management_callback_top_clients;
+        cb.client_trace_dump = management_client_trace_dump;
 #ifdef MANAGEMENT_PF
         cb.client_pf = management_client_pf;
 #endif
@@ -34,11 +34,13 @@
 #include "mbuf.h"
 #include "list.h"
 #include "schedule.h"
+#include "wheel.h"
 #include "pool.h"
 #include "mudp.h"
 #include "mtcp.h"
 #include "perf.h"
 #include "vlan.h"
+#include "metrics.h"
 
 #define MULTI_PREFIX_MAX_LENGTH 256
 
@@ -52,6 +54,7 @@ struct multi_reap
     int bucket_base;
     int buckets_per_pass;
     time_t last_call;
+    counter_type reaped;        /* routes removed */
 };
 
 
@@ -87,6 +90,41 @@ struct client_connect_defer_state
     char *config_file;
 };
 
+#ifdef ENABLE_MANAGEMENT
+/*
+ * Traffic rates of a client, as exponentially weighted moving averages
+ * in units per second.  They are updated from the link counters of the
+ * client at most once per second, so the forwarding path only compares
+ * a timestamp.
+ */
+struct multi_rate
+{
+    time_t last;                /* time of the last update */
+    counter_type bytes_in;      /* counters at the last update */
+    counter_type bytes_out;
+    counter_type packets_in;
+    counter_type packets_out;
+    double bps_in;              /* rates at the last update */
+    double bps_out;
+    double pps_in;
+    double pps_out;
+    double key;                 /* top talkers heap key */
+    int heap_index;             /* position in the heap, -1 if none */
+};
+#endif
+
+/*
+ * A deadline of an instance on the wheel of its multi_context: the next
+ * wakeup for pre_select(), if it is a second or more away, or the next
+ * time its keepalive timers need to run, see process_keepalive_timers().
+ */
+struct multi_deadline
+{
+    struct wheel_entry we;     /* must be the first element of the structure */
+    struct multi_instance *mi;
+    bool keepalive;
+};
+
 /**
  * Server-mode state structure for one single VPN tunnel.
  *
@@ -99,6 +137,8 @@ struct client_connect_defer_state
  */
 struct multi_instance {
     struct schedule_entry se;  /* this must be the first element of the structure */
+    struct multi_deadline wakeup_deadline;  /* used instead of se for wakeups >= 1 second away */
+    struct multi_deadline keepalive_deadline;
     struct gc_arena gc;
     bool halt;
     int refcount;
@@ -107,6 +147,7 @@ struct multi_instance {
                                  *   was created.  This parameter is set
                                  *   by the \c multi_create_instance()
                                  *   function. */
+    struct timeval created_tv;  /* precise creation time, for metrics */
     struct timeval wakeup;     /* absolute time */
     struct mroute_addr real;    /**< External network address of the
                                  *   remote peer. */
@@ -126,7 +167,13 @@ struct multi_instance {
 #ifdef ENABLE_MANAGEMENT
     bool did_cid_hash;
     struct buffer_list *cc_config;
+    struct multi_cn_entry *cn_entry; /* common name index entry */
+    struct multi_instance *cn_next;  /* next instance with same common name */
+    bool cn_locked;                  /* indexed under the locked common name */
+    struct multi_rate rate;
 #endif
+    struct token_bucket policer;         /* --client-policer */
+    struct token_bucket *policer_parent; /* bucket of its --policer-class */
     bool did_iroutes;
     int n_clients_delta; /* added to multi_context.n_clients when instance is closed */
 
@@ -136,8 +183,71 @@ struct multi_instance {
 #ifdef ENABLE_ASYNC_PUSH
     int inotify_watch; /* watch descriptor for acf */
 #endif
+#ifndef _WIN32
+    unsigned int auth_job; /* asynchronously running auth script */
+#endif
+#ifdef ENABLE_MEMSTATS
+    int mstats_slot; /* --memstats client slot, -1 if none */
+    time_t mstats_updated; /* when the slot was last written */
+    struct multi_instance *mstats_next; /* in multi_context.mstats_stale */
+    bool mstats_stale; /* changed since mstats_updated */
+#endif
+};
+
+
+/*
+ * A --policer-class, its bucket is the parent of the buckets of its clients.
+ */
+struct multi_policer_class
+{
+    const char *name;
+    struct token_bucket tb;
+    struct multi_policer_class *next;
 };
 
+/*
+ * Server-wide counters reported by the "metrics" management command.
+ */
+struct multi_metrics
+{
+    counter_type connections;        /* clients that completed authentication */
+    counter_type auth_failures;      /* clients rejected by client-connect */
+    counter_type handshake_failures; /* clients closed before authentication */
+    counter_type drops_bad_source;
+    counter_type drops_output_saturation;
+    counter_type drops_tun_queue_full;
+    counter_type drops_policer;
+    struct metrics_histogram handshake_seconds;
+
+    /* event loop telemetry */
+    struct event_loop_stats loop;
+    counter_type loop_packets;       /* packets read from the link or tun */
+    counter_type loop_timers;        /* instances woken up by their timer */
+    counter_type loop_waits_seen;    /* waits accounted in the histograms */
+    struct metrics_histogram events_per_wakeup;
+    struct metrics_histogram wakeup_seconds; /* processing time per wakeup */
+
+    /* event loop averages over the last complete MULTI_LOOP_WINDOW */
+    struct multi_loop_window
+    {
+        time_t start;               /* of the current window */
+        struct event_loop_stats loop; /* values at the start */
+        counter_type packets;
+        double duty_cycle;          /* fraction of time not waiting */
+        double wakeups_per_second;
+        double events_per_wakeup;
+        double packets_per_wakeup;
+        double saturated_fraction;  /* of the wakeups */
+    } window;
+
+#ifdef ENABLE_MANAGEMENT
+    /* per-client values, collected at most once per second */
+    struct multi_metrics_client *clients;
+    int n_clients;
+    time_t clients_updated;
+    struct gc_arena clients_gc;
+#endif
+};
 
 /**
  * Main OpenVPN server state structure.
@@ -161,6 +271,9 @@ struct multi_context {
                                  *   address of the remote peer, optimized
                                  *   for iteration. */
     struct schedule *schedule;
+    struct wheel wheel;         /**< Deadlines of the instances a
+                                 *   second or more away, see
+                                 *   \c multi_deadline. */
     struct mbuf_set *mbuf;      /**< Set of buffers for passing data
                                  *   channel packets between VPN tunnel
                                  *   instances. */
@@ -180,10 +293,25 @@ struct multi_context {
 #ifdef ENABLE_MANAGEMENT
     struct hash *cid_hash;
     unsigned long cid_counter;
+    struct hash *cn_hash;       /* common name -> struct multi_cn_entry */
+
+    /* instances as a max-heap ordered by byte rate */
+    struct multi_instance **rate_heap;
+    int rate_heap_len;
+    int rate_heap_size;
+    time_t rate_landmark;       /* reference time of the heap keys */
+#endif
+
+    struct multi_policer_class *policer_classes;
+
+#ifdef ENABLE_MEMSTATS
+    /* instances whose --memstats slot is out of date */
+    struct multi_instance *mstats_stale;
 #endif
 
     struct multi_instance *pending;
     struct multi_instance *earliest_wakeup;
+    bool earliest_keepalive;    /* only its keepalive timers are due */
     struct multi_instance **mpp_touched;
     struct context_buffers *context_buffers;
     time_t per_second_trigger;
@@ -201,6 +329,16 @@ struct multi_context {
     struct hash *inotify_watchers;
 #endif
 
+#ifndef _WIN32
+    /* mapping between asynchronous auth script jobs and multi_instances */
+    struct hash *auth_jobs;
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+    struct ccd_cache *ccd_cache; /* parsed --client-config-dir files */
+#endif
+    struct multi_status_job *status_job; /* --status file being written */
+    struct multi_metrics metrics;
+
     struct deferred_signal_schedule_entry deferred_shutdown_signal;
 };
 
@@ -281,6 +419,7 @@ void multi_process_float(struct multi_context *m, struct multi_instance *mi);
 #define MPP_CONDITIONAL_PRE_SELECT (1<<1)
 #define MPP_CLOSE_ON_SIGNAL        (1<<2)
 #define MPP_RECORD_TOUCH           (1<<3)
+#define MPP_KEEPALIVE              (1<<4)  /* run only the keepalive timers */
 
 
 /**************************************************************************/
@@ -382,6 +521,17 @@ void multi_process_file_closed(struct multi_context *m, const unsigned int mpp_f
 
 #endif
 
+#ifndef _WIN32
+/**
+ * Collects asynchronously started auth scripts that have exited and
+ * schedules the instances waiting for them to be processed.
+ *
+ * @param m multi_context
+ */
+void multi_process_child_exited(struct multi_context *m);
+
+#endif
+
 /*
  * Return true if our output queue is not full
  */
@@ -570,6 +720,50 @@ multi_reap_process(const struct multi_context *m)
     }
 }
 
+/*
+ * Length of the window over which the event loop averages in the
+ * --status file and the "metrics" command are computed, in seconds.
+ */
+#define MULTI_LOOP_WINDOW 10
+
+/*
+ * Account the wait that the event loop just returned from.  io_wait()
+ * does not wait when it has pending writes.
+ */
+static inline void
+multi_loop_wakeup(struct multi_context *m)
+{
+    const struct event_loop_stats *s = &m->metrics.loop;
+
+    if (s->waits == m->metrics.loop_waits_seen)
+    {
+        return;
+    }
+    m->metrics.loop_waits_seen = s->waits;
+    metrics_histogram_observe(&m->metrics.events_per_wakeup, s->last_events);
+    if (s->last_busy_ns)
+    {
+        metrics_histogram_observe(&m->metrics.wakeup_seconds,
+                                  s->last_busy_ns / 1000000000.0);
+    }
+}
+
+#ifdef ENABLE_MANAGEMENT
+void multi_rate_update_dowork(struct multi_context *m, struct multi_instance *mi);
+
+/*
+ * Fold the traffic of a client into its rates, once per second.
+ */
+static inline void
+multi_rate_update(struct multi_context *m, struct multi_instance *mi)
+{
+    if (mi->rate.last != now)
+    {
+        multi_rate_update_dowork(m, mi);
+    }
+}
+#endif
+
 static inline void
 multi_process_per_second_timers(struct multi_context *m)
 {
@@ -580,11 +774,32 @@ multi_process_per_second_timers(struct multi_context *m)
     }
 }
 
+/*
+ * Number of clients or routes written to the --status file
+ * per event loop iteration.
+ */
+#define MULTI_STATUS_ROWS_PER_STEP 32
+
+void multi_process_status_dowork(struct multi_context *m);
+
+/*
+ * Continue writing the --status file, if a dump is in progress.
+ */
+static inline void
+multi_process_status(struct multi_context *m)
+{
+    if (m->status_job)
+    {
+        multi_process_status_dowork(m);
+    }
+}
+
 /*
  * Compute earliest timeout expiry from the set of
  * all instances.  Output:
  *
  * m->earliest_wakeup : instance needing the earliest service.
+ * m->earliest_keepalive : if only its keepalive timers need it.
  * dest               : earliest timeout as a delta in relation
  *                      to current time.
  */
@@ -592,8 +807,22 @@ static inline void
 multi_get_timeout(struct multi_context *m, struct timeval *dest)
 {
     struct timeval tv, current;
+    struct multi_deadline *d;
+    time_t next;
+
+    /* an instance whose coarse deadline has passed comes first */
+    d = (struct multi_deadline *) wheel_expired(&m->wheel, now);
+    if (d)
+    {
+        m->earliest_wakeup = d->mi;
+        m->earliest_keepalive = d->keepalive;
+        dest->tv_sec = 0;
+        dest->tv_usec = 0;
+        return;
+    }
 
     CLEAR(tv);
+    m->earliest_keepalive = false;
     m->earliest_wakeup = (struct multi_instance *) schedule_get_earliest_wakeup(m->schedule, &tv);
     if (m->earliest_wakeup)
     {
@@ -611,6 +840,30 @@ multi_get_timeout(struct multi_context *m, struct timeval *dest)
         dest->tv_sec = REAP_MAX_WAKEUP;
         dest->tv_usec = 0;
     }
+
+    /* wake up at the start of the next second with a deadline */
+    next = wheel_next(&m->wheel);
+    if (next && next - now <= dest->tv_sec)
+    {
+        struct timeval delta;
+
+        ASSERT(!openvpn_gettimeofday(&current, NULL));
+        tv.tv_sec = next;
+        tv.tv_usec = 0;
+        tv_delta(&delta, &current, &tv);
+        if (tv_lt(&delta, dest))
+        {
+            m->earliest_wakeup = NULL;
+            *dest = delta;
+        }
+    }
+
+    /* do not sleep while the --status file is being written */
+    if (m->status_job)
+    {
+        dest->tv_sec = 0;
+        dest->tv_usec = 0;
+    }
 }
 
 
@@ -212,10 +212,63 @@ check_send_occ_load_test_dowork(struct context *c)
     }
 }
 
+/*
+ * A path MTU search has ended: lower --mssfix and --fragment to its
+ * result, or go back to the configured values if the peer did not
+ * answer.
+ */
+static void
+occ_mtu_probe_done(struct context *c)
+{
+    const struct plpmtud *p = &c->c2.plpmtud;
+
+    if (p->state == PLPMTUD_COMPLETE)
+    {
+        msg(D_MTU_INFO, "Path MTU discovery: packets of %d bytes reach the peer", p->pmtu);
+    }
+    else
+    {
+        msg(M_INFO, "NOTE: peer does not answer MTU probes, it may be running an "
+            "older version of " PACKAGE_NAME " -- keeping the configured MTU");
+    }
+
+    if (c->options.ce.mssfix)
+    {
+        frame_set_mtu_dynamic(&c->c2.frame,
+                              p->pmtu ? min_int(p->pmtu, c->options.ce.mssfix) : c->options.ce.mssfix,
+                              0);
+    }
+#ifdef ENABLE_FRAGMENT
+    if (c->c2.fragment)
+    {
+        frame_set_mtu_dynamic(&c->c2.frame_fragment,
+                              p->pmtu ? min_int(p->pmtu, c->options.ce.fragment) : c->options.ce.fragment,
+                              0);
+    }
+#endif
+}
+
+void
+check_send_occ_mtu_probe_dowork(struct context *c)
+{
+    if (connection_established(c))
+    {
+        if (plpmtud_timeout(&c->c2.plpmtud))
+        {
+            occ_mtu_probe_done(c);
+        }
+        if (plpmtud_probing(&c->c2.plpmtud))
+        {
+            c->c2.occ_op = OCC_MTU_PROBE;
+        }
+    }
+}
+
 void
 check_send_occ_msg_dowork(struct context *c)
 {
     bool doit = false;
+    bool probe = false;
 
     c->c2.buf = c->c2.buffers->aux_buf;
     ASSERT(buf_init(&c->c2.buf, FRAME_HEADROOM(&c->c2.frame)));
@@ -325,6 +378,52 @@ check_send_occ_msg_dowork(struct context *c)
         }
         break;
 
+        case OCC_MTU_PROBE:
+        {
+            const struct plpmtud *p = &c->c2.plpmtud;
+            int need_to_add;
+
+            if (!buf_write_u8(&c->c2.buf, OCC_MTU_PROBE))
+            {
+                break;
+            }
+            if (!buf_write_u16(&c->c2.buf, p->probe_id))
+            {
+                break;
+            }
+            need_to_add = min_int(p->probe_size, EXPANDED_SIZE(&c->c2.frame))
+                          - p->overhead
+                          - BLEN(&c->c2.buf);
+            if (need_to_add > 0)
+            {
+                /* random padding, so that compression cannot shrink it */
+                uint8_t *pad = buf_write_alloc(&c->c2.buf, need_to_add);
+                if (!pad)
+                {
+                    break;
+                }
+                prng_bytes(pad, need_to_add);
+            }
+            dmsg(D_PACKET_CONTENT, "SENT OCC_MTU_PROBE id=%u size=%d",
+                 p->probe_id, p->probe_size);
+            doit = true;
+            probe = true;
+        }
+        break;
+
+        case OCC_MTU_PROBE_ACK:
+            if (!buf_write_u8(&c->c2.buf, OCC_MTU_PROBE_ACK))
+            {
+                break;
+            }
+            if (!buf_write_u16(&c->c2.buf, c->c2.plpmtud.ack_id))
+            {
+                break;
+            }
+            dmsg(D_PACKET_CONTENT, "SENT OCC_MTU_PROBE_ACK id=%d", c->c2.plpmtud.ack_id);
+            doit = true;
+            break;
+
         case OCC_EXIT:
             if (!buf_write_u8(&c->c2.buf, OCC_EXIT))
             {
@@ -335,7 +434,31 @@ check_send_occ_msg_dowork(struct context *c)
             break;
     }
 
-    if (doit)
+    if (doit && probe)
+    {
+        /*
+         * A probe is sent whole with the don't-fragment bit set, so
+         * --fragment must not split it.
+         */
+        const int payload = BLEN(&c->c2.buf);
+#ifdef ENABLE_FRAGMENT
+        const int frag_mtu = c->c2.frame_fragment.link_mtu_dynamic;
+        c->c2.frame_fragment.link_mtu_dynamic = EXPANDED_SIZE(&c->c2.frame_fragment);
+#endif
+        encrypt_sign(c, true);
+#ifdef ENABLE_FRAGMENT
+        c->c2.frame_fragment.link_mtu_dynamic = frag_mtu;
+#endif
+        if (c->c2.to_link.len > 0)
+        {
+            c->c2.plpmtud.probe_df = true;
+            if (plpmtud_probe_sent(&c->c2.plpmtud, payload, BLEN(&c->c2.to_link)))
+            {
+                occ_mtu_probe_done(c);
+            }
+        }
+    }
+    else if (doit)
     {
         /*
          * We will treat the packet like any other outgoing packet,
@@ -414,6 +537,39 @@ process_received_occ_msg(struct context *c)
             event_timeout_clear(&c->c2.occ_mtu_load_test_interval);
             break;
 
+        case OCC_MTU_PROBE:
+            c->c2.plpmtud.ack_id = buf_read_u16(&c->c2.buf);
+            dmsg(D_PACKET_CONTENT, "RECEIVED OCC_MTU_PROBE id=%d", c->c2.plpmtud.ack_id);
+            if (c->c2.plpmtud.ack_id >= 0)
+            {
+                c->c2.occ_op = OCC_MTU_PROBE_ACK;
+            }
+            break;
+
+        case OCC_MTU_PROBE_ACK:
+        {
+            struct plpmtud *p = &c->c2.plpmtud;
+            const uint16_t probe_id = p->probe_id;
+            const int id = buf_read_u16(&c->c2.buf);
+
+            dmsg(D_PACKET_CONTENT, "RECEIVED OCC_MTU_PROBE_ACK id=%d", id);
+            if (id < 0)
+            {
+                break;
+            }
+            if (plpmtud_probe_acked(p, (uint16_t)id))
+            {
+                occ_mtu_probe_done(c);
+            }
+            else if (p->probe_id != probe_id && plpmtud_probing(p))
+            {
+                /* probe the next size right away */
+                c->c2.occ_op = OCC_MTU_PROBE;
+                event_timeout_reset(&p->timer);
+            }
+        }
+        break;
+
         case OCC_EXIT:
             dmsg(D_PACKET_CONTENT, "RECEIVED OCC_EXIT");
             c->sig->signal_received = SIGTERM;
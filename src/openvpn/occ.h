@@ -66,6 +66,12 @@
  */
 #define OCC_EXIT               6
 
+/*
+ * Path MTU discovery, see plpmtud.h.
+ */
+#define OCC_MTU_PROBE          7        /* Padded probe, ack it */
+#define OCC_MTU_PROBE_ACK      8        /* Probe received */
+
 /*
  * Used to conduct a load test command sequence
  * of UDP connection for empirical MTU measurement.
@@ -94,6 +100,8 @@ void check_send_occ_load_test_dowork(struct context *c);
 
 void check_send_occ_msg_dowork(struct context *c);
 
+void check_send_occ_mtu_probe_dowork(struct context *c);
+
 /*
  * Inline functions
  */
@@ -134,6 +142,21 @@ check_send_occ_load_test(struct context *c)
     }
 }
 
+/*
+ * Should we send a path MTU probe?
+ */
+static inline void
+check_send_occ_mtu_probe(struct context *c)
+{
+    if (event_timeout_defined(&c->c2.plpmtud.timer)
+        && event_timeout_trigger(&c->c2.plpmtud.timer,
+                                 &c->c2.timeval,
+                                 (!TO_LINK_DEF(c) && c->c2.occ_op < 0) ? ETT_DEFAULT : 0))
+    {
+        check_send_occ_mtu_probe_dowork(c);
+    }
+}
+
 /*
  * Should we send an OCC message?
  */
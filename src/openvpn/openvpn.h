@@ -35,6 +35,7 @@
 #include "interval.h"
 #include "status.h"
 #include "fragment.h"
+#include "plpmtud.h"
 #include "shaper.h"
 #include "route.h"
 #include "proxy.h"
@@ -46,6 +47,7 @@
 #include "pool.h"
 #include "plugin.h"
 #include "manage.h"
+#include "pktrace.h"
 
 /*
  * Our global key schedules, packaged thusly
@@ -270,6 +272,9 @@ struct context_2
     counter_type link_read_bytes;
     counter_type link_read_bytes_auth;
     counter_type link_write_bytes;
+    counter_type link_read_packets;
+    counter_type link_write_packets;
+    counter_type link_read_drops; /* failed authentication or replay check */
 #ifdef PACKET_TRUNCATION_CHECK
     counter_type n_trunc_tun_read;
     counter_type n_trunc_tun_write;
@@ -314,6 +319,9 @@ struct context_2
     struct event_timeout occ_mtu_load_test_interval;
     int occ_mtu_load_n_tries;
 
+    /* --mtu-probe path MTU discovery, and acks for the peer's probes */
+    struct plpmtud plpmtud;
+
     /*
      * TLS-mode crypto objects.
      */
@@ -445,6 +453,15 @@ struct context_2
     struct man_def_auth_context mda_context;
 #endif
 
+    /* packet trace enabled by the management interface, or NULL */
+    struct pktrace *pktrace;
+
+#ifdef ENABLE_DEBUG
+    /* datagram held back by --gremlin, sent after the next one */
+    struct buffer gremlin_held;
+    struct link_socket_actual gremlin_held_addr;
+#endif
+
 #ifdef ENABLE_ASYNC_PUSH
     int inotify_fd; /* descriptor for monitoring file changes */
 #endif
@@ -40,8 +40,10 @@
 
 #include "buffer.h"
 #include "error.h"
+#include "evlog.h"
 #include "common.h"
 #include "run_command.h"
+#include "script_helper.h"
 #include "shaper.h"
 #include "crypto.h"
 #include "ssl.h"
@@ -278,6 +280,9 @@ static const char usage_message[] =
     "                  'maybe' -- Use per-route hints\n"
     "                  'yes'   -- Always DF (Don't Fragment)\n"
     "--mtu-test      : Empirically measure and report MTU.\n"
+    "--mtu-probe [n] : Discover the path MTU to the peer with padded probes and\n"
+    "                  lower --mssfix and --fragment to it.  Repeat every n\n"
+    "                  seconds (default=600).  Ignored over TCP.\n"
 #ifdef ENABLE_FRAGMENT
     "--fragment max  : Enable internal datagram fragmentation so that no UDP\n"
     "                  datagrams are sent which are larger than max bytes.\n"
@@ -297,6 +302,10 @@ static const char usage_message[] =
     "--txqueuelen n  : Set the tun/tap TX queue length to n (Linux only).\n"
 #ifdef ENABLE_MEMSTATS
     "--memstats file : Write live usage stats to memory mapped binary file.\n"
+#endif
+#ifdef ENABLE_EVENT_LOG
+    "--event-log file [n] : Record events in a memory mapped ring of n records\n"
+    "                  (default=65536).\n"
 #endif
     "--mlock         : Disable Paging -- ensures key material and tunnel\n"
     "                  data will never be written to disk.\n"
@@ -330,6 +339,8 @@ static const char usage_message[] =
     "--machine-readable-output : Always log timestamp, message flags to stdout/stderr.\n"
     "--writepid file : Write main process ID to file.\n"
     "--nice n        : Change process priority (>0 = lower, <0 = higher).\n"
+    "--perf-sample n : Record latency histograms of processing stages for one\n"
+    "                  out of every n event loop iterations (default=0, off).\n"
     "--echo [parms ...] : Echo parameters to log output.\n"
     "--verb n        : Set output verbosity to n (default=%d):\n"
     "                  (Level 3 is recommended if you want a good summary\n"
@@ -353,6 +364,13 @@ static const char usage_message[] =
 #if defined(USE_COMP)
     "--compress alg  : Use compression algorithm alg\n"
     "--allow-compression: Specify whether compression should be allowed\n"
+#if defined(ENABLE_LZ4)
+    "--compress-dict n : Keep n bytes of history per direction for\n"
+    "                  --compress lz4-stream (default=16384).\n"
+    "--compress-resync n : With --compress lz4-stream, start over with an\n"
+    "                  empty dictionary every n packets (default=32 over UDP,\n"
+    "                  255 over TCP, max=255).\n"
+#endif
 #if defined(ENABLE_LZO)
     "--comp-lzo      : Use LZO compression -- may add up to 1 byte per\n"
     "                  packet for incompressible data.\n"
@@ -442,6 +460,12 @@ static const char usage_message[] =
     "                  run command cmd to verify.  If method='via-env', pass\n"
     "                  user/pass via environment, if method='via-file', pass\n"
     "                  user/pass via temporary file.\n"
+    "--script-async n : Run --auth-user-pass-verify scripts without blocking the\n"
+    "                  server, with up to n scripts running at the same time.\n"
+    "--script-helper hook : Run the script of hook as persistent helper instead of\n"
+    "                  forking it for every event.  hook is auth-user-pass-verify,\n"
+    "                  client-connect, client-disconnect, learn-address or\n"
+    "                  tls-verify.\n"
     "--auth-gen-token  [lifetime] Generate a random authentication token which is pushed\n"
     "                  to each client, replacing the password.  Useful when\n"
     "                  OTP based two-factor auth mechanisms are in use and\n"
@@ -460,6 +484,8 @@ static const char usage_message[] =
     "--client-disconnect cmd : Run command cmd on client disconnection.\n"
     "--client-config-dir dir : Directory for custom client config files.\n"
     "--ccd-exclusive : Refuse connection unless custom client config is found.\n"
+    "--ccd-cache [preload] : Keep parsed --client-config-dir files in memory,\n"
+    "                  optionally reading all of them at startup.\n"
     "--tmp-dir dir   : Temporary directory, used for --client-connect return file and plugin communication.\n"
     "--hash-size r v : Set the size of the real address hash table to r and the\n"
     "                  virtual address table to v.\n"
@@ -471,6 +497,11 @@ static const char usage_message[] =
     "--connect-freq n s : Allow a maximum of n new connections per s seconds.\n"
     "--max-clients n : Allow a maximum of n simultaneously connected clients.\n"
     "--max-routes-per-client n : Allow a maximum of n internal routes per client.\n"
+    "--client-policer n [burst [class]] : Police traffic to each client to n\n"
+    "                  bytes per second, allowing bursts of burst bytes, and\n"
+    "                  drop the excess.  The traffic of all clients in class\n"
+    "                  shares its budget.\n"
+    "--policer-class name n [burst] : Define a class for --client-policer.\n"
     "--stale-routes-check n [t] : Remove routes with a last activity timestamp\n"
     "                             older than n seconds. Run this check every t\n"
     "                             seconds (defaults to n).\n"
@@ -801,6 +832,9 @@ init_options(struct options *o, const bool init_gc)
     o->ce.local_port = o->ce.remote_port = OPENVPN_PORT;
     o->verbosity = 1;
     o->status_file_update_freq = 60;
+#ifdef ENABLE_EVENT_LOG
+    o->event_log_records = EVLOG_DEFAULT_RECORDS;
+#endif
     o->status_file_version = 1;
     o->ce.bind_local = true;
     o->ce.tun_mtu = TUN_MTU_DEFAULT;
@@ -1334,6 +1368,8 @@ show_p2mp_parms(const struct options *o)
     SHOW_STR(client_disconnect_script);
     SHOW_STR(client_config_dir);
     SHOW_BOOL(ccd_exclusive);
+    SHOW_BOOL(ccd_cache);
+    SHOW_BOOL(ccd_cache_preload);
     SHOW_STR(tmp_dir);
     SHOW_BOOL(push_ifconfig_defined);
     msg(D_SHOW_PARMS, "  push_ifconfig_local = %s", print_in_addr_t(o->push_ifconfig_local, 0, &gc));
@@ -1347,8 +1383,13 @@ show_p2mp_parms(const struct options *o)
     SHOW_INT(cf_per);
     SHOW_INT(max_clients);
     SHOW_INT(max_routes_per_client);
+    SHOW_INT(client_policer);
+    SHOW_INT(client_policer_burst);
+    SHOW_STR(client_policer_class);
     SHOW_STR(auth_user_pass_verify_script);
     SHOW_BOOL(auth_user_pass_verify_script_via_file);
+    SHOW_INT(script_async_max);
+    SHOW_UNSIGNED(script_helper_hooks);
     SHOW_BOOL(auth_token_generate);
     SHOW_INT(auth_token_lifetime);
     SHOW_STR_INLINE(auth_token_secret_file);
@@ -1611,6 +1652,7 @@ show_settings(const struct options *o)
 
     SHOW_INT(shaper);
     SHOW_INT(mtu_test);
+    SHOW_INT(mtu_probe);
 
     SHOW_BOOL(mlock);
 
@@ -1652,6 +1694,7 @@ show_settings(const struct options *o)
     SHOW_BOOL(suppress_timestamps);
     SHOW_BOOL(machine_readable_output);
     SHOW_INT(nice);
+    SHOW_INT(perf_sample);
     SHOW_INT(verbosity);
     SHOW_INT(mute);
 #ifdef ENABLE_DEBUG
@@ -1660,6 +1703,10 @@ show_settings(const struct options *o)
     SHOW_STR(status_file);
     SHOW_INT(status_file_version);
     SHOW_INT(status_file_update_freq);
+#ifdef ENABLE_EVENT_LOG
+    SHOW_STR(event_log_fn);
+    SHOW_INT(event_log_records);
+#endif
 
     SHOW_BOOL(occ);
     SHOW_INT(rcvbuf);
@@ -1674,6 +1721,8 @@ show_settings(const struct options *o)
 #ifdef USE_COMP
     SHOW_INT(comp.alg);
     SHOW_INT(comp.flags);
+    SHOW_INT(comp.dict_size);
+    SHOW_INT(comp.resync);
 #endif
 
     SHOW_STR(route_script);
@@ -2430,6 +2479,10 @@ options_postprocess_verify_ce(const struct options *options,
         {
             msg(M_USAGE, "--ccd-exclusive must be used with --client-config-dir");
         }
+        if (options->ccd_cache && !options->client_config_dir)
+        {
+            msg(M_USAGE, "--ccd-cache must be used with --client-config-dir");
+        }
         if (options->auth_token_generate && !options->renegotiate_seconds)
         {
             msg(M_USAGE, "--auth-gen-token needs a non-infinite "
@@ -2501,9 +2554,10 @@ options_postprocess_verify_ce(const struct options *options,
         {
             msg(M_USAGE, "--client-disconnect requires --mode server");
         }
-        if (options->client_config_dir || options->ccd_exclusive)
+        if (options->client_config_dir || options->ccd_exclusive
+            || options->ccd_cache)
         {
-            msg(M_USAGE, "--client-config-dir/--ccd-exclusive requires --mode server");
+            msg(M_USAGE, "--client-config-dir/--ccd-exclusive/--ccd-cache requires --mode server");
         }
         if (options->enable_c2c)
         {
@@ -2543,6 +2597,14 @@ options_postprocess_verify_ce(const struct options *options,
         {
             msg(M_USAGE, "--auth-user-pass-verify requires --mode server");
         }
+        if (options->script_async_max)
+        {
+            msg(M_USAGE, "--script-async requires --mode server");
+        }
+        if (options->script_helper_hooks)
+        {
+            msg(M_USAGE, "--script-helper requires --mode server");
+        }
         if (options->auth_token_generate)
         {
             msg(M_USAGE, "--auth-gen-token requires --mode server");
@@ -2563,6 +2625,11 @@ options_postprocess_verify_ce(const struct options *options,
         {
             msg(M_USAGE, "--vlan-tagging requires --mode server");
         }
+
+        if (options->client_policer || options->policer_classes)
+        {
+            msg(M_USAGE, "--client-policer/--policer-class requires --mode server");
+        }
     }
 
     /*
@@ -4822,6 +4889,69 @@ add_option(struct options *options,
            unsigned int *option_types_found,
            struct env_set *es);
 
+/*
+ * Tokenize the option lines read from fp and pass each of them to
+ * handle(), together with its line number and the number of lines
+ * consumed by an inline file following it.
+ */
+static void
+read_config_lines(FILE *fp, const char *file, const int msglevel,
+                  struct gc_arena *gc,
+                  void (*handle)(char *p[], int line_num, int lines_inline, void *arg),
+                  void *arg)
+{
+    char line[OPTION_LINE_SIZE+1];
+    char *p[MAX_PARMS+1];
+    int line_num = 0;
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        int offset = 0;
+        CLEAR(p);
+        ++line_num;
+        if (strlen(line) == OPTION_LINE_SIZE)
+        {
+            msg(msglevel, "In %s:%d: Maximum option line length (%d) exceeded, line starts with %s",
+                file, line_num, OPTION_LINE_SIZE, line);
+        }
+
+        /* Ignore UTF-8 BOM at start of stream */
+        if (line_num == 1 && strncmp(line, "\xEF\xBB\xBF", 3) == 0)
+        {
+            offset = 3;
+        }
+        if (parse_line(line + offset, p, SIZE(p)-1, file, line_num, msglevel, gc))
+        {
+            bypass_doubledash(&p[0]);
+            int lines_inline = check_inline_file_via_fp(fp, p, gc);
+            (*handle)(p, line_num, lines_inline, arg);
+            line_num += lines_inline;
+        }
+    }
+    secure_memzero(line, sizeof(line));
+    CLEAR(p);
+}
+
+struct read_config_file_args
+{
+    struct options *options;
+    const char *file;
+    int level;
+    int msglevel;
+    unsigned int permission_mask;
+    unsigned int *option_types_found;
+    struct env_set *es;
+};
+
+static void
+read_config_file_line(char *p[], int line_num, int lines_inline, void *arg)
+{
+    const struct read_config_file_args *a = arg;
+
+    add_option(a->options, p, lines_inline, a->file, line_num, a->level,
+               a->msglevel, a->permission_mask, a->option_types_found, a->es);
+}
+
 static void
 read_config_file(struct options *options,
                  const char *file,
@@ -4835,9 +4965,6 @@ read_config_file(struct options *options,
 {
     const int max_recursive_levels = 10;
     FILE *fp;
-    int line_num;
-    char line[OPTION_LINE_SIZE+1];
-    char *p[MAX_PARMS+1];
 
     ++level;
     if (level <= max_recursive_levels)
@@ -4852,33 +4979,18 @@ read_config_file(struct options *options,
         }
         if (fp)
         {
-            line_num = 0;
-            while (fgets(line, sizeof(line), fp))
-            {
-                int offset = 0;
-                CLEAR(p);
-                ++line_num;
-                if (strlen(line) == OPTION_LINE_SIZE)
-                {
-                    msg(msglevel, "In %s:%d: Maximum option line length (%d) exceeded, line starts with %s",
-                        file, line_num, OPTION_LINE_SIZE, line);
-                }
-
-                /* Ignore UTF-8 BOM at start of stream */
-                if (line_num == 1 && strncmp(line, "\xEF\xBB\xBF", 3) == 0)
-                {
-                    offset = 3;
-                }
-                if (parse_line(line + offset, p, SIZE(p)-1, file, line_num, msglevel, &options->gc))
-                {
-                    bypass_doubledash(&p[0]);
-                    int lines_inline = check_inline_file_via_fp(fp, p, &options->gc);
-                    add_option(options, p, lines_inline, file, line_num, level,
-                               msglevel, permission_mask, option_types_found,
-                               es);
-                    line_num += lines_inline;
-                }
-            }
+            struct read_config_file_args args = {
+                .options = options,
+                .file = file,
+                .level = level,
+                .msglevel = msglevel,
+                .permission_mask = permission_mask,
+                .option_types_found = option_types_found,
+                .es = es,
+            };
+
+            read_config_lines(fp, file, msglevel, &options->gc,
+                              read_config_file_line, &args);
             if (fp != stdin)
             {
                 fclose(fp);
@@ -4893,8 +5005,6 @@ read_config_file(struct options *options,
     {
         msg(msglevel, "In %s:%d: Maximum recursive include levels exceeded in include attempt of file %s -- probably you have a configuration file that tries to include itself.", top_file, top_line, file);
     }
-    secure_memzero(line, sizeof(line));
-    CLEAR(p);
 }
 
 static void
@@ -5088,6 +5198,87 @@ options_server_import(struct options *o,
                      es);
 }
 
+struct options_file_line
+{
+    struct options_file_line *next;
+    char *p[MAX_PARMS+1];
+    int line_num;
+    int lines_inline;
+};
+
+struct options_file
+{
+    const char *file;
+    struct options_file_line *head;
+};
+
+struct options_file_parse_args
+{
+    struct options_file_line **tail;
+    struct gc_arena *gc;
+};
+
+static void
+options_file_parse_line(char *p[], int line_num, int lines_inline, void *arg)
+{
+    struct options_file_parse_args *a = arg;
+    struct options_file_line *l;
+
+    ALLOC_OBJ_CLEAR_GC(l, struct options_file_line, a->gc);
+    l->lines_inline = lines_inline;
+    l->line_num = line_num;
+    memcpy(l->p, p, sizeof(l->p));
+    *a->tail = l;
+    a->tail = &l->next;
+}
+
+struct options_file *
+options_file_parse(const char *file, int msglevel, struct gc_arena *gc)
+{
+    struct options_file_parse_args args;
+    struct options_file *f = NULL;
+    FILE *fp;
+
+    fp = platform_fopen(file, "r");
+    if (!fp)
+    {
+        return NULL;
+    }
+
+    ALLOC_OBJ_CLEAR_GC(f, struct options_file, gc);
+    f->file = string_alloc(file, gc);
+    args.tail = &f->head;
+    args.gc = gc;
+
+    read_config_lines(fp, file, msglevel, gc, options_file_parse_line, &args);
+    fclose(fp);
+    return f;
+}
+
+void
+options_server_import_parsed(struct options *o,
+                             const struct options_file *f,
+                             int msglevel,
+                             unsigned int permission_mask,
+                             unsigned int *option_types_found,
+                             struct env_set *es)
+{
+    msg(D_PUSH, "OPTIONS IMPORT: applying client specific options from: %s", f->file);
+    for (const struct options_file_line *l = f->head; l; l = l->next)
+    {
+        char *p[MAX_PARMS+1];
+
+        /* the options keep pointers to their parameters */
+        CLEAR(p);
+        for (int i = 0; l->p[i]; ++i)
+        {
+            p[i] = string_alloc(l->p[i], &o->gc);
+        }
+        add_option(o, p, l->lines_inline, f->file, l->line_num, 1, msglevel,
+                   permission_mask, option_types_found, es);
+    }
+}
+
 void
 options_string_import(struct options *options,
                       const char *config,
@@ -5984,6 +6175,23 @@ add_option(struct options *options,
         VERIFY_PERMISSION(OPT_P_GENERAL);
         options->memstats_fn = p[1];
     }
+#endif
+#ifdef ENABLE_EVENT_LOG
+    else if (streq(p[0], "event-log") && p[1] && !p[3])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+        options->event_log_fn = p[1];
+        if (p[2])
+        {
+            int n = positive_atoi(p[2]);
+            if (n < 1 || n > (1 << 24))
+            {
+                msg(msglevel, "--event-log ring size must be between 1 and %d", 1 << 24);
+                goto err;
+            }
+            options->event_log_records = n;
+        }
+    }
 #endif
     else if (streq(p[0], "mlock") && !p[1])
     {
@@ -6107,11 +6315,31 @@ add_option(struct options *options,
         VERIFY_PERMISSION(OPT_P_GENERAL);
         options->mtu_test = true;
     }
+    else if (streq(p[0], "mtu-probe") && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+        options->mtu_probe = PLPMTUD_DEFAULT_INTERVAL;
+        if (p[1])
+        {
+            options->mtu_probe = positive_atoi(p[1]);
+            if (options->mtu_probe < PLPMTUD_PROBE_INTERVAL * PLPMTUD_MAX_PROBES)
+            {
+                msg(msglevel, "--mtu-probe interval must be at least %d seconds",
+                    PLPMTUD_PROBE_INTERVAL * PLPMTUD_MAX_PROBES);
+                goto err;
+            }
+        }
+    }
     else if (streq(p[0], "nice") && p[1] && !p[2])
     {
         VERIFY_PERMISSION(OPT_P_NICE);
         options->nice = atoi(p[1]);
     }
+    else if (streq(p[0], "perf-sample") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+        options->perf_sample = positive_atoi(p[1]);
+    }
     else if (streq(p[0], "rcvbuf") && p[1] && !p[2])
     {
         VERIFY_PERMISSION(OPT_P_SOCKBUF);
@@ -6974,6 +7202,70 @@ add_option(struct options *options,
         }
         options->max_clients = max_clients;
     }
+    else if (streq(p[0], "client-policer") && p[1] && !p[4])
+    {
+        int rate, burst = 0;
+
+        VERIFY_PERMISSION(OPT_P_GENERAL|OPT_P_INSTANCE);
+        rate = atoi(p[1]);
+        if (rate && (rate < SHAPER_MIN || rate > SHAPER_MAX))
+        {
+            msg(msglevel, "Bad --client-policer rate, must be 0 or between %d and %d",
+                SHAPER_MIN, SHAPER_MAX);
+            goto err;
+        }
+        if (p[2])
+        {
+            burst = atoi(p[2]);
+            if (burst < TOKEN_BUCKET_MIN_BURST || burst > SHAPER_MAX)
+            {
+                msg(msglevel, "Bad --client-policer burst, must be between %d and %d",
+                    TOKEN_BUCKET_MIN_BURST, SHAPER_MAX);
+                goto err;
+            }
+        }
+        options->client_policer = rate;
+        options->client_policer_burst = burst;
+        options->client_policer_class = p[3];
+    }
+    else if (streq(p[0], "policer-class") && p[1] && p[2] && !p[4])
+    {
+        struct policer_class *sc;
+        int rate, burst = 0;
+
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+        rate = atoi(p[2]);
+        if (rate < SHAPER_MIN || rate > SHAPER_MAX)
+        {
+            msg(msglevel, "Bad --policer-class rate, must be between %d and %d",
+                SHAPER_MIN, SHAPER_MAX);
+            goto err;
+        }
+        if (p[3])
+        {
+            burst = atoi(p[3]);
+            if (burst < TOKEN_BUCKET_MIN_BURST || burst > SHAPER_MAX)
+            {
+                msg(msglevel, "Bad --policer-class burst, must be between %d and %d",
+                    TOKEN_BUCKET_MIN_BURST, SHAPER_MAX);
+                goto err;
+            }
+        }
+        for (sc = options->policer_classes; sc; sc = sc->next)
+        {
+            if (streq(sc->name, p[1]))
+            {
+                msg(msglevel, "--policer-class %s is defined twice", p[1]);
+                goto err;
+            }
+        }
+        ALLOC_OBJ_GC(sc, struct policer_class, &options->gc);
+        sc->name = p[1];
+        sc->rate = rate;
+        sc->burst = burst;
+        sc->next = options->policer_classes;
+        options->policer_classes = sc;
+    }
     else if (streq(p[0], "max-routes-per-client") && p[1] && !p[2])
     {
         VERIFY_PERMISSION(OPT_P_INHERIT);
@@ -7055,6 +7347,32 @@ add_option(struct options *options,
                         &options->auth_user_pass_verify_script,
                         p[1], "auth-user-pass-verify", true);
     }
+    else if (streq(p[0], "script-async") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#ifndef _WIN32
+        options->script_async_max = positive_atoi(p[1]);
+#else
+        msg(msglevel, "--script-async not supported on this OS");
+        goto err;
+#endif
+    }
+    else if (streq(p[0], "script-helper") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#ifndef _WIN32
+        const unsigned int hook = script_helper_hook_flag(p[1]);
+        if (!hook)
+        {
+            msg(msglevel, "--script-helper: unsupported hook '%s'", p[1]);
+            goto err;
+        }
+        options->script_helper_hooks |= hook;
+#else
+        msg(msglevel, "--script-helper not supported on this OS");
+        goto err;
+#endif
+    }
     else if (streq(p[0], "auth-gen-token") && !p[3])
     {
         VERIFY_PERMISSION(OPT_P_GENERAL);
@@ -7125,6 +7443,22 @@ add_option(struct options *options,
         VERIFY_PERMISSION(OPT_P_GENERAL);
         options->ccd_exclusive = true;
     }
+    else if (streq(p[0], "ccd-cache") && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#ifdef HAVE_SYS_INOTIFY_H
+        if (p[1] && !streq(p[1], "preload"))
+        {
+            msg(msglevel, "--ccd-cache: unknown parameter '%s'", p[1]);
+            goto err;
+        }
+        options->ccd_cache = true;
+        options->ccd_cache_preload = (p[1] != NULL);
+#else
+        msg(msglevel, "--ccd-cache not supported on this OS");
+        goto err;
+#endif
+    }
     else if (streq(p[0], "bcast-buffers") && p[1] && !p[2])
     {
         int n_bcast_buf;
@@ -7786,6 +8120,36 @@ add_option(struct options *options,
         show_compression_warning(&options->comp);
 #endif /* if defined(ENABLE_LZO) */
     }
+#if defined(ENABLE_LZ4)
+    else if (streq(p[0], "compress-dict") && p[1] && !p[2])
+    {
+        int dict_size;
+
+        VERIFY_PERMISSION(OPT_P_COMP);
+        dict_size = positive_atoi(p[1]);
+        if (dict_size < COMP_DICT_MIN || dict_size > COMP_DICT_MAX
+            || (dict_size & (dict_size - 1)))
+        {
+            msg(msglevel, "--compress-dict must be a power of 2 between %d and %d",
+                COMP_DICT_MIN, COMP_DICT_MAX);
+            goto err;
+        }
+        options->comp.dict_size = dict_size;
+    }
+    else if (streq(p[0], "compress-resync") && p[1] && !p[2])
+    {
+        int resync;
+
+        VERIFY_PERMISSION(OPT_P_COMP);
+        resync = positive_atoi(p[1]);
+        if (resync < 1 || resync > COMP_RESYNC_MAX)
+        {
+            msg(msglevel, "--compress-resync must be between 1 and %d", COMP_RESYNC_MAX);
+            goto err;
+        }
+        options->comp.resync = resync;
+    }
+#endif
     else if (streq(p[0], "comp-noadapt") && !p[1])
     {
         /*
@@ -7834,11 +8198,17 @@ add_option(struct options *options,
             else if (streq(p[1], "lz4"))
             {
                 options->comp.alg = COMP_ALG_LZ4;
-                options->comp.flags |= COMP_F_SWAP;
+                options->comp.flags |= (COMP_F_SWAP|COMP_F_ADAPTIVE);
             }
             else if (streq(p[1], "lz4-v2"))
             {
                 options->comp.alg = COMP_ALGV2_LZ4;
+                options->comp.flags |= COMP_F_ADAPTIVE;
+            }
+            else if (streq(p[1], "lz4-stream"))
+            {
+                options->comp.alg = COMP_ALGV2_LZ4_STREAM;
+                options->comp.flags |= COMP_F_ADAPTIVE;
             }
 #endif
             else
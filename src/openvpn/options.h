@@ -210,6 +210,15 @@ struct verify_hash_list
 };
 
 /* Command line options */
+/* a --policer-class, shared by all clients that name it */
+struct policer_class
+{
+    const char *name;
+    int rate;
+    int burst;
+    struct policer_class *next;
+};
+
 struct options
 {
     struct gc_arena gc;
@@ -279,11 +288,17 @@ struct options
     int proto_force;
 
     bool mtu_test;
+    int mtu_probe;              /* seconds between --mtu-probe searches, 0 = off */
 
 #ifdef ENABLE_MEMSTATS
     char *memstats_fn;
 #endif
 
+#ifdef ENABLE_EVENT_LOG
+    const char *event_log_fn;
+    int event_log_records;
+#endif
+
     bool mlock;
 
     int keepalive_ping;         /* a proxy for ping/ping-restart */
@@ -339,6 +354,7 @@ struct options
     bool suppress_timestamps;
     bool machine_readable_output;
     int nice;
+    int perf_sample;            /* profile one of this many event loops */
     int verbosity;
     int mute;
 
@@ -451,6 +467,8 @@ struct options
     const char *learn_address_script;
     const char *client_config_dir;
     bool ccd_exclusive;
+    bool ccd_cache;
+    bool ccd_cache_preload;
     bool disable;
     int n_bcast_buf;
     int tcp_queue_limit;
@@ -475,11 +493,17 @@ struct options
     int cf_per;
     int max_clients;
     int max_routes_per_client;
+    int client_policer;          /* bytes per second, 0 if unlimited */
+    int client_policer_burst;
+    const char *client_policer_class;
+    struct policer_class *policer_classes;
     int stale_routes_check_interval;
     int stale_routes_ageing_time;
 
     const char *auth_user_pass_verify_script;
     bool auth_user_pass_verify_script_via_file;
+    int script_async_max;
+    unsigned int script_helper_hooks; /* SH_* flags */
     bool auth_token_generate;
     bool auth_token_gen_secret_file;
     bool auth_token_call_auth;
@@ -811,6 +835,35 @@ void options_server_import(struct options *o,
                            unsigned int *option_types_found,
                            struct env_set *es);
 
+/**
+ * An options file split into lines of parameters by options_file_parse()
+ */
+struct options_file;
+
+/**
+ * Read and tokenize an options file once, so that it can be applied by
+ * options_server_import_parsed() any number of times.
+ *
+ * @param file      the file to read
+ * @param msglevel  message level for parse errors
+ * @param gc        arena the result is allocated from
+ *
+ * @return the parsed file, or NULL if it could not be opened
+ */
+struct options_file *options_file_parse(const char *file, int msglevel,
+                                        struct gc_arena *gc);
+
+/**
+ * Like options_server_import(), but with a file parsed by
+ * options_file_parse().
+ */
+void options_server_import_parsed(struct options *o,
+                                  const struct options_file *f,
+                                  int msglevel,
+                                  unsigned int permission_mask,
+                                  unsigned int *option_types_found,
+                                  struct env_set *es);
+
 void pre_pull_default(struct options *o);
 
 void rol_check_alloc(struct options *options);
@@ -212,6 +212,13 @@ void packet_id_init(struct packet_id *p, int seq_backtrack, int time_backtrack,
 
 void packet_id_free(struct packet_id *p);
 
+/* bytes allocated for the replay window of p */
+static inline int
+packet_id_memory_bytes(const struct packet_id *p)
+{
+    return p->rec.seq_list ? p->rec.seq_list->x_sizeof : 0;
+}
+
 /* should we accept an incoming packet id ? */
 bool packet_id_test(struct packet_id_rec *p,
                     const struct packet_id_net *pin);
@@ -31,13 +31,15 @@
 
 #include "perf.h"
 
-#ifdef ENABLE_PERFORMANCE_METRICS
-
 #include "error.h"
+#include "metrics.h"
 #include "otime.h"
+#include "status.h"
 
 #include "memdbg.h"
 
+bool perf_enabled = false; /* GLOBAL */
+
 static const char *metric_names[] = {
     "PERF_BIO_READ_PLAINTEXT",
     "PERF_BIO_WRITE_PLAINTEXT",
@@ -61,6 +63,12 @@ static const char *metric_names[] = {
     "PERF_PROC_OUT_TUN_MTCP"
 };
 
+/* latency histogram bucket bounds, in seconds */
+static const double perf_bounds[] = {
+    1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4,
+    1e-3, 2.5e-3, 5e-3, 1e-2, 1e-1, 1
+};
+
 struct perf
 {
 #define PS_INITIAL            0
@@ -68,67 +76,54 @@ struct perf
 #define PS_METER_INTERRUPTED  2
     int state;
 
-    struct timeval start;
-    double sofar;
-    double sum;
-    double max;
-    double count;
+    uint64_t start;             /* nanoseconds */
+    uint64_t sofar;
+    uint64_t max;
+    struct metrics_histogram hist;
 };
 
 struct perf_set
 {
+    int sample;                 /* profile one of this many outermost stages */
+    int countdown;              /* outermost stages until the next sample */
+    int skip_depth;             /* nesting depth of stages not profiled */
     int stack_len;
     int stack[STACK_N];
     struct perf perf[PERF_N];
 };
 
-static struct perf_set perf_set;
+static struct perf_set perf_set; /* GLOBAL */
 
-static void perf_print_state(int lev);
-
-static inline int
-get_stack_index(int sdelta)
+/*
+ * Forget the stages being timed.  Used when profiling is enabled, as
+ * stages may have been entered while it was off, and if the stack is
+ * found to be inconsistent.
+ */
+static void
+perf_clear_stack(void)
 {
-    const int sindex = perf_set.stack_len + sdelta;
-    if (sindex >= 0 && sindex < STACK_N)
+    for (int i = 0; i < PERF_N; ++i)
     {
-        return sindex;
-    }
-    else
-    {
-        return -1;
+        perf_set.perf[i].state = PS_INITIAL;
     }
+    perf_set.stack_len = 0;
+    perf_set.skip_depth = 0;
 }
 
-static int
-get_perf_index(int sdelta)
+static void
+perf_stack_error(const char *what)
 {
-    const int sindex = get_stack_index(sdelta);
-    if (sindex >= 0)
-    {
-        const int pindex = perf_set.stack[sindex];
-        if (pindex >= 0 && pindex < PERF_N)
-        {
-            return pindex;
-        }
-        else
-        {
-            return -1;
-        }
-    }
-    else
-    {
-        return -1;
-    }
+    msg(D_LOW, "PERF: %s, resetting profiler stack", what);
+    perf_clear_stack();
 }
 
 static struct perf *
 get_perf(int sdelta)
 {
-    const int pindex = get_perf_index(sdelta);
-    if (pindex >= 0)
+    const int sindex = perf_set.stack_len + sdelta;
+    if (sindex >= 0 && sindex < perf_set.stack_len)
     {
-        return &perf_set.perf[pindex];
+        return &perf_set.perf[perf_set.stack[sindex]];
     }
     else
     {
@@ -137,185 +132,169 @@ get_perf(int sdelta)
 }
 
 static void
-push_perf_index(int pindex)
+perf_stop(struct perf *p, const uint64_t t)
 {
-    const int sindex = get_stack_index(0);
-    const int newlen = get_stack_index(1);
-    if (sindex >= 0 && newlen >= 0
-        && pindex >= 0 && pindex < PERF_N)
-    {
-        int i;
-        for (i = 0; i < sindex; ++i)
-        {
-            if (perf_set.stack[i] == pindex)
-            {
-                perf_print_state(M_INFO);
-                msg(M_FATAL, "PERF: push_perf_index %s failed",
-                    metric_names [pindex]);
-            }
-        }
+    const uint64_t sofar = p->sofar + (t - p->start);
 
-        perf_set.stack[sindex] = pindex;
-        perf_set.stack_len = newlen;
-    }
-    else
+    metrics_histogram_observe(&p->hist, sofar / 1000000000.0);
+    if (sofar > p->max)
     {
-        msg(M_FATAL, "PERF: push_perf_index: stack push error");
+        p->max = sofar;
     }
+    p->state = PS_INITIAL;
 }
 
-static void
-pop_perf_index(void)
+void
+perf_push_dowork(int type)
 {
-    const int newlen = get_stack_index(-1);
-    if (newlen >= 0)
+    struct perf *prev;
+    struct perf *cur;
+    uint64_t t;
+
+    ASSERT(type >= 0 && type < PERF_N);
+
+    /* decide at the outermost stage whether to profile */
+    if (perf_set.skip_depth > 0
+        || (perf_set.stack_len == 0 && --perf_set.countdown > 0))
     {
-        perf_set.stack_len = newlen;
+        ++perf_set.skip_depth;
+        return;
     }
-    else
+    if (perf_set.stack_len == 0)
     {
-        msg(M_FATAL, "PERF: pop_perf_index: stack pop error");
+        perf_set.countdown = perf_set.sample;
     }
-}
 
-static void
-state_must_be(const struct perf *p, const int wanted)
-{
-    if (p->state != wanted)
+    cur = &perf_set.perf[type];
+    if (perf_set.stack_len >= STACK_N || cur->state != PS_INITIAL)
     {
-        msg(M_FATAL, "PERF: bad state actual=%d wanted=%d",
-            p->state,
-            wanted);
+        perf_stack_error("bad push");
+        return;
     }
-}
 
-static void
-update_sofar(struct perf *p)
-{
-    struct timeval current;
-    ASSERT(!gettimeofday(&current, NULL));
-    p->sofar += (double) tv_subtract(&current, &p->start, 600) / 1000000.0;
-    tv_clear(&p->start);
-}
-
-static void
-perf_start(struct perf *p)
-{
-    state_must_be(p, PS_INITIAL);
-    ASSERT(!gettimeofday(&p->start, NULL));
-    p->sofar = 0.0;
-    p->state = PS_METER_RUNNING;
-}
-
-static void
-perf_stop(struct perf *p)
-{
-    state_must_be(p, PS_METER_RUNNING);
-    update_sofar(p);
-    p->sum += p->sofar;
-    if (p->sofar > p->max)
+    t = perf_now();
+    prev = get_perf(-1);
+    if (prev)
     {
-        p->max = p->sofar;
+        /* interrupt */
+        prev->sofar += t - prev->start;
+        prev->state = PS_METER_INTERRUPTED;
     }
-    p->count += 1.0;
-    p->sofar = 0.0;
-    p->state = PS_INITIAL;
-}
-
-static void
-perf_interrupt(struct perf *p)
-{
-    state_must_be(p, PS_METER_RUNNING);
-    update_sofar(p);
-    p->state = PS_METER_INTERRUPTED;
-}
-
-static void
-perf_resume(struct perf *p)
-{
-    state_must_be(p, PS_METER_INTERRUPTED);
-    ASSERT(!gettimeofday(&p->start, NULL));
-    p->state = PS_METER_RUNNING;
+    perf_set.stack[perf_set.stack_len++] = type;
+    cur->start = t;
+    cur->sofar = 0;
+    cur->state = PS_METER_RUNNING;
 }
 
 void
-perf_push(int type)
+perf_pop_dowork(void)
 {
     struct perf *prev;
     struct perf *cur;
+    uint64_t t;
 
-    ASSERT(SIZE(metric_names) == PERF_N);
-    push_perf_index(type);
+    if (perf_set.skip_depth > 0)
+    {
+        --perf_set.skip_depth;
+        return;
+    }
 
-    prev = get_perf(-2);
+    /* stages entered while profiling was off are not on the stack */
     cur = get_perf(-1);
+    if (!cur)
+    {
+        return;
+    }
+    if (cur->state != PS_METER_RUNNING)
+    {
+        perf_stack_error("bad pop");
+        return;
+    }
 
-    ASSERT(cur);
+    t = perf_now();
+    perf_stop(cur, t);
+    --perf_set.stack_len;
 
+    prev = get_perf(-1);
     if (prev)
     {
-        perf_interrupt(prev);
+        /* resume */
+        prev->start = t;
+        prev->state = PS_METER_RUNNING;
     }
-    perf_start(cur);
 }
 
 void
-perf_pop(void)
+perf_set_sample(const int sample)
 {
-    struct perf *prev;
-    struct perf *cur;
-
-    prev = get_perf(-2);
-    cur = get_perf(-1);
-
-    ASSERT(cur);
-    perf_stop(cur);
-
-    if (prev)
+    if (sample > 0)
     {
-        perf_resume(prev);
+        if (!perf_set.perf[0].hist.bounds)
+        {
+            perf_reset();
+        }
+        perf_clear_stack();
+        perf_set.sample = sample;
+        perf_set.countdown = 1;
+        perf_enabled = true;
+    }
+    else
+    {
+        perf_enabled = false;
     }
-
-    pop_perf_index();
 }
 
 void
-perf_output_results(void)
+perf_reset(void)
 {
-    int i;
-    msg(M_INFO, "LATENCY PROFILE (mean and max are in milliseconds)");
-    for (i = 0; i < PERF_N; ++i)
+    for (int i = 0; i < PERF_N; ++i)
     {
         struct perf *p = &perf_set.perf[i];
-        if (p->count > 0.0)
+        metrics_histogram_init(&p->hist, perf_bounds, SIZE(perf_bounds));
+        p->max = 0;
+    }
+}
+
+void
+perf_print_histograms(struct status_output *so)
+{
+    struct gc_arena gc = gc_new();
+
+    ASSERT(SIZE(metric_names) == PERF_N);
+    metrics_print_family(so, "openvpn_stage_duration_seconds", "histogram",
+                         "Time spent in a processing stage, excluding nested stages.");
+    for (int i = 0; i < PERF_N; ++i)
+    {
+        const struct perf *p = &perf_set.perf[i];
+        if (p->hist.count > 0)
         {
-            const double mean = p->sum / p->count;
-            msg(M_INFO, "%s n=%.0f mean=%.3f max=%.3f", metric_names[i], p->count, mean*1000.0, p->max*1000.0);
+            struct buffer labels = alloc_buf_gc(64, &gc);
+            buf_printf(&labels, "stage=\"%s\"", metric_names[i] + 5);
+            metrics_print_histogram(so, "openvpn_stage_duration_seconds",
+                                    BSTR(&labels), &p->hist);
         }
     }
+    status_printf(so, "# EOF");
+    gc_free(&gc);
 }
 
-static void
-perf_print_state(int lev)
+void
+perf_output_results(void)
 {
-    struct gc_arena gc = gc_new();
     int i;
-    msg(lev, "PERF STATE");
-    msg(lev, "Stack:");
-    for (i = 0; i < perf_set.stack_len; ++i)
+    if (!perf_set.sample)
     {
-        const int j = perf_set.stack[i];
-        const struct perf *p = &perf_set.perf[j];
-        msg(lev, "[%d] %s state=%d start=%s sofar=%f sum=%f max=%f count=%f",
-            i,
-            metric_names[j],
-            p->state,
-            tv_string(&p->start, &gc),
-            p->sofar,
-            p->sum,
-            p->max,
-            p->count);
+        return;
+    }
+    msg(M_INFO, "LATENCY PROFILE (mean and max are in milliseconds)");
+    for (i = 0; i < PERF_N; ++i)
+    {
+        const struct perf *p = &perf_set.perf[i];
+        if (p->hist.count > 0)
+        {
+            const double mean = p->hist.sum / p->hist.count;
+            msg(M_INFO, "%s n=" counter_format " mean=%.3f max=%.3f", metric_names[i],
+                p->hist.count, mean*1000.0, p->max/1000000.0);
+        }
     }
-    gc_free(&gc);
 }
-#endif /* ifdef ENABLE_PERFORMANCE_METRICS */
@@ -22,15 +22,20 @@
  */
 
 /*
- * The interval_ routines are designed to optimize the calling of a routine
- * (normally tls_multi_process()) which can be called less frequently
- * between triggers.
+ * Latency profiling of the stages of packet processing.
+ *
+ * Code brackets a stage with perf_push() and perf_pop().  When enabled,
+ * one out of every n outermost stages (normally the event loop) is
+ * timed together with all stages nested in it.  The time spent in a
+ * stage, excluding the time spent in nested stages, is added to a
+ * latency histogram of that stage.  When disabled, perf_push() and
+ * perf_pop() only test a flag.
  */
 
 #ifndef PERF_H
 #define PERF_H
 
-/*#define ENABLE_PERFORMANCE_METRICS*/
+#include "basic.h"
 
 /*
  * Metrics
@@ -57,36 +62,73 @@
 #define PERF_PROC_OUT_TUN_MTCP      19
 #define PERF_N                      20
 
-#ifdef ENABLE_PERFORMANCE_METRICS
-
-#include "basic.h"
-
 /*
  * Stack size
  */
 #define STACK_N               64
 
-void perf_push(int type);
+extern bool perf_enabled; /* GLOBAL */
 
-void perf_pop(void);
+/**
+ * Return a monotonic timestamp in nanoseconds.
+ */
+static inline uint64_t
+perf_now(void)
+{
+#if defined(CLOCK_MONOTONIC) && !defined(_WIN32)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000000 + (uint64_t)tv.tv_usec * 1000;
+#endif
+}
 
-void perf_output_results(void);
+void perf_push_dowork(int type);
 
-#else  /* ifdef ENABLE_PERFORMANCE_METRICS */
+void perf_pop_dowork(void);
 
 static inline void
 perf_push(int type)
 {
+    if (perf_enabled)
+    {
+        perf_push_dowork(type);
+    }
 }
+
 static inline void
 perf_pop(void)
 {
+    if (perf_enabled)
+    {
+        perf_pop_dowork();
+    }
 }
-static inline void
-perf_output_results(void)
-{
-}
 
-#endif /* ifdef ENABLE_PERFORMANCE_METRICS */
+/**
+ * Enable profiling of one out of every \c sample outermost stages, or
+ * disable it if \c sample is 0.  The histograms are kept.
+ */
+void perf_set_sample(const int sample);
+
+/**
+ * Clear the histograms.
+ */
+void perf_reset(void);
+
+struct status_output;
+
+/**
+ * Print the histograms in the OpenMetrics text format.
+ */
+void perf_print_histograms(struct status_output *so);
+
+/**
+ * Log a summary of the histograms.
+ */
+void perf_output_results(void);
 
 #endif /* ifndef PERF_H */
@@ -0,0 +1,181 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include "otime.h"
+#include "pktrace.h"
+
+#include "memdbg.h"
+
+/* pcapng block types, see draft-ietf-opsawg-pcapng */
+#define PCAPNG_SHB 0x0A0D0D0A
+#define PCAPNG_IDB 0x00000001
+#define PCAPNG_EPB 0x00000006
+
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+
+#define PCAPNG_OPT_ENDOFOPT 0
+#define PCAPNG_OPT_IF_NAME  2
+#define PCAPNG_OPT_EPB_FLAGS 2
+
+#define PCAPNG_EPB_INBOUND  1
+#define PCAPNG_EPB_OUTBOUND 2
+
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW      101
+#define LINKTYPE_USER0    147
+
+#define PAD4(n) (((n) + 3) & ~3)
+
+struct pktrace *
+pktrace_new(const int n, const bool tap)
+{
+    struct pktrace *pt;
+
+    ASSERT(n > 0 && n <= PKTRACE_MAX_PACKETS);
+    ALLOC_OBJ_CLEAR(pt, struct pktrace);
+    pt->tap = tap;
+    pt->n = n;
+    ALLOC_ARRAY_CLEAR(pt->packets, struct pktrace_packet, n);
+    ALLOC_ARRAY(pt->data, uint8_t, n * PKTRACE_SNAPLEN);
+    return pt;
+}
+
+void
+pktrace_free(struct pktrace *pt)
+{
+    if (pt)
+    {
+        free(pt->packets);
+        free(pt->data);
+        free(pt);
+    }
+}
+
+void
+pktrace_add(struct pktrace *pt, const int point, const struct buffer *buf)
+{
+    const int i = (int)(pt->count++ % pt->n);
+    struct pktrace_packet *p = &pt->packets[i];
+
+    openvpn_gettimeofday(&p->tv, NULL);
+    p->point = point;
+    p->len = BLEN(buf);
+    p->caplen = min_int(p->len, PKTRACE_SNAPLEN);
+    memcpy(pt->data + i * PKTRACE_SNAPLEN, BPTR(buf), p->caplen);
+}
+
+/* pcapng is written in host byte order, readers detect it from the SHB */
+static void
+pcapng_u16(struct buffer *buf, const uint16_t v)
+{
+    ASSERT(buf_write(buf, &v, sizeof(v)));
+}
+
+static void
+pcapng_u32(struct buffer *buf, const uint32_t v)
+{
+    ASSERT(buf_write(buf, &v, sizeof(v)));
+}
+
+static void
+pcapng_idb(struct buffer *buf, const uint16_t linktype, const char *name)
+{
+    const int namelen = strlen(name);
+    const uint32_t len = 20 + 4 + PAD4(namelen) + 4;
+    const uint8_t zero[4] = { 0 };
+
+    pcapng_u32(buf, PCAPNG_IDB);
+    pcapng_u32(buf, len);
+    pcapng_u16(buf, linktype);
+    pcapng_u16(buf, 0);
+    pcapng_u32(buf, PKTRACE_SNAPLEN);
+    pcapng_u16(buf, PCAPNG_OPT_IF_NAME);
+    pcapng_u16(buf, namelen);
+    ASSERT(buf_write(buf, name, namelen));
+    ASSERT(buf_write(buf, zero, PAD4(namelen) - namelen));
+    pcapng_u32(buf, PCAPNG_OPT_ENDOFOPT);
+    pcapng_u32(buf, len);
+}
+
+struct buffer
+pktrace_pcapng(const struct pktrace *pt, struct gc_arena *gc)
+{
+    const uint64_t first = pt->count > pt->n ? pt->count - pt->n : 0;
+    const uint8_t zero[4] = { 0 };
+    int size = 28 + 2 * 36;
+    struct buffer buf;
+
+    for (uint64_t c = first; c < pt->count; ++c)
+    {
+        size += 32 + PAD4(pt->packets[c % pt->n].caplen) + 12;
+    }
+    buf = alloc_buf_gc(size, gc);
+
+    /* section header */
+    pcapng_u32(&buf, PCAPNG_SHB);
+    pcapng_u32(&buf, 28);
+    pcapng_u32(&buf, PCAPNG_BYTE_ORDER_MAGIC);
+    pcapng_u16(&buf, 1);
+    pcapng_u16(&buf, 0);
+    pcapng_u32(&buf, 0xffffffff); /* section length unknown */
+    pcapng_u32(&buf, 0xffffffff);
+    pcapng_u32(&buf, 28);
+
+    pcapng_idb(&buf, LINKTYPE_USER0, "link");
+    pcapng_idb(&buf, pt->tap ? LINKTYPE_ETHERNET : LINKTYPE_RAW, "tun");
+
+    for (uint64_t c = first; c < pt->count; ++c)
+    {
+        const int i = (int)(c % pt->n);
+        const struct pktrace_packet *p = &pt->packets[i];
+        const uint32_t len = 32 + PAD4(p->caplen) + 12;
+        const uint64_t ts = (uint64_t)p->tv.tv_sec * 1000000 + p->tv.tv_usec;
+        const bool link = p->point == PKTRACE_LINK_IN || p->point == PKTRACE_LINK_OUT;
+        const bool in = p->point == PKTRACE_LINK_IN || p->point == PKTRACE_TUN_IN;
+
+        pcapng_u32(&buf, PCAPNG_EPB);
+        pcapng_u32(&buf, len);
+        pcapng_u32(&buf, link ? 0 : 1);
+        pcapng_u32(&buf, (uint32_t)(ts >> 32));
+        pcapng_u32(&buf, (uint32_t)ts);
+        pcapng_u32(&buf, p->caplen);
+        pcapng_u32(&buf, p->len);
+        ASSERT(buf_write(&buf, pt->data + i * PKTRACE_SNAPLEN, p->caplen));
+        ASSERT(buf_write(&buf, zero, PAD4(p->caplen) - p->caplen));
+        pcapng_u16(&buf, PCAPNG_OPT_EPB_FLAGS);
+        pcapng_u16(&buf, 4);
+        pcapng_u32(&buf, in ? PCAPNG_EPB_INBOUND : PCAPNG_EPB_OUTBOUND);
+        pcapng_u32(&buf, PCAPNG_OPT_ENDOFOPT);
+        pcapng_u32(&buf, len);
+    }
+
+    return buf;
+}
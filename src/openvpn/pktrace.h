@@ -0,0 +1,103 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Per-client packet tracing.
+ *
+ * A trace is a bounded ring of the most recent packets of one client,
+ * enabled through the management interface.  Packets are captured on the
+ * link side, as they are sent and received over the TCP/UDP socket, and
+ * on the tun side, after decryption and before encryption.  The ring can
+ * be exported as pcapng with two interfaces:
+ *
+ *   0 "link"  LINKTYPE_USER0, the OpenVPN packet without IP/UDP header
+ *   1 "tun"   LINKTYPE_RAW or LINKTYPE_ETHERNET, depending on --dev-type
+ *
+ * Tracing costs a single branch per packet when it is disabled.
+ */
+
+#ifndef PKTRACE_H
+#define PKTRACE_H
+
+#include "buffer.h"
+
+#define PKTRACE_DEFAULT_PACKETS 1024
+#define PKTRACE_MAX_PACKETS     16384
+#define PKTRACE_SNAPLEN         1600  /* longer packets are truncated */
+
+/* capture points */
+#define PKTRACE_LINK_IN   0
+#define PKTRACE_LINK_OUT  1
+#define PKTRACE_TUN_IN    2 /* read from tun, to be encrypted */
+#define PKTRACE_TUN_OUT   3 /* decrypted, to be written to tun */
+
+struct pktrace_packet
+{
+    struct timeval tv;
+    int point;       /* PKTRACE_* */
+    int len;         /* original length */
+    int caplen;      /* captured length, at most PKTRACE_SNAPLEN */
+};
+
+struct pktrace
+{
+    bool tap;
+    int n;                          /* ring size in packets */
+    uint64_t count;                 /* packets captured so far */
+    struct pktrace_packet *packets;
+    uint8_t *data;                  /* n * PKTRACE_SNAPLEN bytes */
+};
+
+/**
+ * Allocate a trace ring of \c n packets.
+ *
+ * @param tap  tun side packets are ethernet frames
+ */
+struct pktrace *pktrace_new(const int n, const bool tap);
+
+void pktrace_free(struct pktrace *pt);
+
+/**
+ * Record the packet in \c buf, overwriting the oldest packet if the
+ * ring is full.
+ */
+void pktrace_add(struct pktrace *pt, const int point, const struct buffer *buf);
+
+/**
+ * Return the packets in the ring, oldest first, as pcapng file.
+ */
+struct buffer pktrace_pcapng(const struct pktrace *pt, struct gc_arena *gc);
+
+/**
+ * Capture a packet if tracing is enabled for its client.
+ */
+static inline void
+pktrace_capture(struct pktrace *pt, const int point, const struct buffer *buf)
+{
+    if (unlikely(pt != NULL) && buf->len > 0)
+    {
+        pktrace_add(pt, point, buf);
+    }
+}
+
+#endif /* PKTRACE_H */
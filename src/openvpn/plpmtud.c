@@ -0,0 +1,145 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include "plpmtud.h"
+#include "crypto.h"
+#include "integer.h"
+
+#include "memdbg.h"
+
+static void
+plpmtud_start(struct plpmtud *p)
+{
+    p->state = PLPMTUD_BASE_SIZE;
+    p->lo = 0;
+    p->hi = p->max + 1;
+    p->probe_size = p->base;
+    p->n_probes = 0;
+    ++p->probe_id;
+    event_timeout_init(&p->timer, PLPMTUD_PROBE_INTERVAL, now);
+}
+
+static void
+plpmtud_end(struct plpmtud *p, int state)
+{
+    p->state = state;
+    p->pmtu = (state == PLPMTUD_COMPLETE) ? p->lo : 0;
+    event_timeout_init(&p->timer, p->interval, now);
+}
+
+/* pick the next size to probe after lo or hi changed */
+static bool
+plpmtud_next(struct plpmtud *p)
+{
+    if (p->lo >= p->max || p->hi - p->lo <= PLPMTUD_STEP)
+    {
+        plpmtud_end(p, PLPMTUD_COMPLETE);
+        return true;
+    }
+
+    /* most paths carry the full size, so try that before bisecting */
+    p->probe_size = (p->hi > p->max) ? p->max : p->lo + (p->hi - p->lo) / 2;
+    p->n_probes = 0;
+    ++p->probe_id;
+    return false;
+}
+
+void
+plpmtud_init(struct plpmtud *p, int base, int max, int overhead, int interval)
+{
+    CLEAR(*p);
+    p->max = max;
+    p->base = min_int(base, max);
+    p->overhead = overhead;
+    p->interval = interval;
+    p->ack_id = -1;
+    p->probe_id = (uint16_t)get_random();
+    plpmtud_start(p);
+}
+
+bool
+plpmtud_timeout(struct plpmtud *p)
+{
+    switch (p->state)
+    {
+        case PLPMTUD_BASE_SIZE:
+            if (p->n_probes >= PLPMTUD_MAX_PROBES)
+            {
+                plpmtud_end(p, PLPMTUD_ERROR);
+                return true;
+            }
+            break;
+
+        case PLPMTUD_SEARCHING:
+            if (p->n_probes >= PLPMTUD_MAX_PROBES)
+            {
+                p->hi = min_int(p->hi, p->probe_sent);
+                return plpmtud_next(p);
+            }
+            break;
+
+        case PLPMTUD_COMPLETE:
+        case PLPMTUD_ERROR:
+            plpmtud_start(p);
+            break;
+    }
+    return false;
+}
+
+bool
+plpmtud_probe_sent(struct plpmtud *p, int payload, int sent)
+{
+    p->overhead = sent - payload;
+    p->probe_sent = sent;
+    ++p->n_probes;
+
+    /* the padding cannot be made any finer */
+    if (p->state == PLPMTUD_SEARCHING && sent <= p->lo)
+    {
+        plpmtud_end(p, PLPMTUD_COMPLETE);
+        return true;
+    }
+    return false;
+}
+
+bool
+plpmtud_probe_acked(struct plpmtud *p, uint16_t id)
+{
+    if ((p->state != PLPMTUD_BASE_SIZE && p->state != PLPMTUD_SEARCHING)
+        || id != p->probe_id || !p->n_probes)
+    {
+        return false;
+    }
+
+    p->lo = max_int(p->lo, p->probe_sent);
+    p->state = PLPMTUD_SEARCHING;
+    return plpmtud_next(p);
+}
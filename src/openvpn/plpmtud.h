@@ -0,0 +1,127 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Datagram packetization layer path MTU discovery, after RFC 8899.
+ *
+ * Each side searches for the largest packet it can send to its peer.
+ * Probes are OCC_MTU_PROBE messages padded to the size under test and
+ * sent with the don't-fragment bit set, so that a probe larger than the
+ * path MTU is lost instead of being fragmented by IP.  The peer answers
+ * every probe it receives with an OCC_MTU_PROBE_ACK.
+ *
+ * A search first confirms PLPMTUD_BASE bytes, which any IPv4 path must
+ * carry; a peer which does not answer is left alone.  It then tries the
+ * configured link MTU and, if that is lost, bisects down to PLPMTUD_STEP
+ * bytes.  The result lowers
+ * --mssfix and the --fragment size of the tunnel, and the search is
+ * repeated periodically so that the result follows the path.
+ *
+ * This file holds the search itself; sending and receiving the probes
+ * is done in occ.c.
+ */
+
+#ifndef PLPMTUD_H
+#define PLPMTUD_H
+
+#include "interval.h"
+
+#define PLPMTUD_BASE             548  /* IPv4 minimum MTU less IP and UDP header */
+#define PLPMTUD_STEP             16   /* precision of the search, in bytes */
+#define PLPMTUD_PROBE_INTERVAL   2    /* seconds to wait for an ack */
+#define PLPMTUD_MAX_PROBES       3    /* lost probes before a size fails */
+#define PLPMTUD_DEFAULT_INTERVAL 600  /* seconds between searches */
+
+/* states */
+#define PLPMTUD_DISABLED  0
+#define PLPMTUD_BASE_SIZE 1           /* confirming that the peer answers */
+#define PLPMTUD_SEARCHING 2
+#define PLPMTUD_COMPLETE  3           /* pmtu is valid */
+#define PLPMTUD_ERROR     4           /* the peer did not answer */
+
+struct plpmtud
+{
+    int state;
+    int base;                   /* size probed first */
+    int max;                    /* size probed second, the link MTU */
+    int lo;                     /* largest size acked in this search */
+    int hi;                     /* smallest size lost, or max + 1 */
+
+    int probe_size;             /* size aimed at by the current probe */
+    int probe_sent;             /* actual size of the last probe sent */
+    int n_probes;               /* probes sent at probe_size */
+    uint16_t probe_id;
+    int overhead;               /* link bytes added to the probe payload */
+    bool probe_df;              /* to_link holds a probe, send it with DF */
+
+    int pmtu;                   /* result of the last search, 0 if none */
+    int interval;               /* seconds between searches */
+    struct event_timeout timer;
+
+    int ack_id;                 /* probe to acknowledge, or -1 */
+};
+
+/**
+ * Prepare a search for the largest packet between \c base and \c max
+ * bytes, to be repeated every \c interval seconds.  \c overhead is a
+ * first guess of the bytes added to the probe payload on the link.
+ */
+void plpmtud_init(struct plpmtud *p, int base, int max, int overhead,
+                  int interval);
+
+/**
+ * Called when the timer expires.  Fails the current probe size after
+ * PLPMTUD_MAX_PROBES, or starts a new search.
+ *
+ * @return true if a search has ended, in which case \c state is either
+ *         \c PLPMTUD_COMPLETE or \c PLPMTUD_ERROR.
+ */
+bool plpmtud_timeout(struct plpmtud *p);
+
+/**
+ * Record that a probe has been sent: \c payload bytes were padded up to
+ * \c sent bytes on the link.
+ *
+ * @return true if the search has ended because the probe was no larger
+ *         than a size already acked.
+ */
+bool plpmtud_probe_sent(struct plpmtud *p, int payload, int sent);
+
+/**
+ * Process an ack for probe \c id.
+ *
+ * @return true if a search has ended.
+ */
+bool plpmtud_probe_acked(struct plpmtud *p, uint16_t id);
+
+/**
+ * Whether a probe should be sent now.
+ */
+static inline bool
+plpmtud_probing(const struct plpmtud *p)
+{
+    return (p->state == PLPMTUD_BASE_SIZE || p->state == PLPMTUD_SEARCHING)
+           && p->n_probes < PLPMTUD_MAX_PROBES;
+}
+
+#endif /* ifndef PLPMTUD_H */
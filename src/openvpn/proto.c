@@ -35,13 +35,14 @@
 #include "memdbg.h"
 
 /*
- * If raw tunnel packet is IPv<X>, return true and increment
- * buffer offset to start of IP header.
+ * Return the offset of the IP header in a raw tunnel packet and set
+ * *ip_ver to the IP version, or return -1 if the packet is not IP.
  */
-static bool
-is_ipv_X(int tunnel_type, struct buffer *buf, int ip_ver)
+static int
+ip_header_offset(int tunnel_type, const struct buffer *buf, int *ip_ver)
 {
     int offset;
+    int ver = 0;
     uint16_t proto;
     const struct openvpn_iphdr *ih;
 
@@ -50,7 +51,7 @@ is_ipv_X(int tunnel_type, struct buffer *buf, int ip_ver)
     {
         if (BLEN(buf) < sizeof(struct openvpn_iphdr))
         {
-            return false;
+            return -1;
         }
         offset = 0;
     }
@@ -60,7 +61,7 @@ is_ipv_X(int tunnel_type, struct buffer *buf, int ip_ver)
         if (BLEN(buf) < (sizeof(struct openvpn_ethhdr)
                          + sizeof(struct openvpn_iphdr)))
         {
-            return false;
+            return -1;
         }
         eh = (const struct openvpn_ethhdr *)BPTR(buf);
 
@@ -74,10 +75,10 @@ is_ipv_X(int tunnel_type, struct buffer *buf, int ip_ver)
         if (proto == htons(OPENVPN_ETH_P_8021Q))
         {
             const struct openvpn_8021qhdr *evh;
-            if (BLEN(buf) < (sizeof(struct openvpn_ethhdr)
+            if (BLEN(buf) < (sizeof(struct openvpn_8021qhdr)
                              + sizeof(struct openvpn_iphdr)))
             {
-                return false;
+                return -1;
             }
 
             evh = (const struct openvpn_8021qhdr *)BPTR(buf);
@@ -86,20 +87,46 @@ is_ipv_X(int tunnel_type, struct buffer *buf, int ip_ver)
             offset = sizeof(struct openvpn_8021qhdr);
         }
 
-        if (ntohs(proto) != (ip_ver == 6 ? OPENVPN_ETH_P_IPV6 : OPENVPN_ETH_P_IPV4))
+        if (ntohs(proto) == OPENVPN_ETH_P_IPV4)
+        {
+            ver = 4;
+        }
+        else if (ntohs(proto) == OPENVPN_ETH_P_IPV6)
+        {
+            ver = 6;
+        }
+        else
         {
-            return false;
+            return -1;
         }
     }
     else
     {
-        return false;
+        return -1;
     }
 
     ih = (const struct openvpn_iphdr *)(BPTR(buf) + offset);
 
     /* IP version is stored in the same bits for IPv4 or IPv6 header */
-    if (OPENVPN_IPH_GET_VER(ih->version_len) == ip_ver)
+    *ip_ver = OPENVPN_IPH_GET_VER(ih->version_len);
+    if (ver && *ip_ver != ver)
+    {
+        return -1;
+    }
+    return offset;
+}
+
+/*
+ * If raw tunnel packet is IPv<X>, return true and increment
+ * buffer offset to start of IP header.
+ */
+static bool
+is_ipv_X(int tunnel_type, struct buffer *buf, int ip_ver)
+{
+    int ver;
+    const int offset = ip_header_offset(tunnel_type, buf, &ver);
+
+    if (offset >= 0 && ver == ip_ver)
     {
         return buf_advance(buf, offset);
     }
@@ -120,47 +147,122 @@ is_ipv6(int tunnel_type, struct buffer *buf)
     return is_ipv_X( tunnel_type, buf, 6 );
 }
 
-
-uint16_t
-ip_checksum(const sa_family_t af, const uint8_t *payload, const int len_payload,
-            const uint8_t *src_addr, const uint8_t *dest_addr, const int proto)
+void
+packet_info_parse(struct packet_info *pi, int tunnel_type,
+                  const struct buffer *buf)
 {
-    uint32_t sum = 0;
-    int addr_len = (af == AF_INET) ? 4 : 16;
+    int ver;
+    const int offset = ip_header_offset(tunnel_type, buf, &ver);
+    const int len = BLEN(buf) - offset;
 
-    /*
-     * make 16 bit words out of every two adjacent 8 bit words and  */
-    /* calculate the sum of all 16 bit words
-     */
-    for (int i = 0; i < len_payload; i += 2)
+    CLEAR(*pi);
+    if (offset < 0)
     {
-        sum +=  (uint16_t)(((payload[i] << 8) & 0xFF00)
-                           +((i + 1 < len_payload) ? (payload[i + 1] & 0xFF) : 0));
+        return;
+    }
 
+    if (ver == 4)
+    {
+        const struct openvpn_iphdr *pip =
+            (const struct openvpn_iphdr *) (BPTR(buf) + offset);
+        const int hlen = OPENVPN_IPH_GET_LEN(pip->version_len);
+
+        pi->ip_ver = 4;
+        pi->ip_offset = offset;
+        pi->whole = ntohs(pip->tot_len) == len;
+        pi->l4_proto = pip->protocol;
+        if ((ntohs(pip->frag_off) & OPENVPN_IP_OFFMASK) == 0
+            && hlen >= (int) sizeof(struct openvpn_iphdr) && hlen <= len)
+        {
+            pi->l4_offset = offset + hlen;
+            pi->l4_len = len - hlen;
+        }
     }
+    else if (ver == 6)
+    {
+        pi->ip_ver = 6;
+        pi->ip_offset = offset;
+        if (len >= (int) sizeof(struct openvpn_ipv6hdr))
+        {
+            const struct openvpn_ipv6hdr *pip6 =
+                (const struct openvpn_ipv6hdr *) (BPTR(buf) + offset);
 
-    /*
-     * add the pseudo header which contains the IP source and destination
-     * addresses
-     */
-    for (int i = 0; i < addr_len; i += 2)
+            pi->whole = ntohs(pip6->payload_len) + (int) sizeof(struct openvpn_ipv6hdr) == len;
+            pi->l4_proto = pip6->nexthdr;
+            pi->l4_offset = offset + sizeof(struct openvpn_ipv6hdr);
+            pi->l4_len = len - sizeof(struct openvpn_ipv6hdr);
+        }
+    }
+    else
     {
-        sum += (uint16_t)((src_addr[i] << 8) & 0xFF00) + (src_addr[i + 1] & 0xFF);
+        return;
+    }
 
+    if (pi->l4_proto == OPENVPN_IPPROTO_TCP && pi->l4_offset
+        && pi->l4_len >= (int) sizeof(struct openvpn_tcphdr))
+    {
+        const struct openvpn_tcphdr *tc =
+            (const struct openvpn_tcphdr *) (BPTR(buf) + pi->l4_offset);
+        pi->tcp_flags = tc->flags;
     }
-    for (int i = 0; i < addr_len; i += 2)
+}
+
+/*
+ * Add len bytes to a one's complement sum, 32 bits at a time.  Summing
+ * in host byte order gives the byte swapped sum on little endian hosts,
+ * which is corrected after folding (RFC 1071, section 2).
+ */
+static uint64_t
+checksum_add(uint64_t sum, const uint8_t *data, int len)
+{
+    uint32_t w32;
+    uint16_t w16;
+
+    while (len >= 4)
+    {
+        memcpy(&w32, data, sizeof(w32));
+        sum += w32;
+        data += 4;
+        len -= 4;
+    }
+    if (len >= 2)
+    {
+        memcpy(&w16, data, sizeof(w16));
+        sum += w16;
+        data += 2;
+        len -= 2;
+    }
+    if (len)
     {
-        sum += (uint16_t)((dest_addr[i] << 8) & 0xFF00) + (dest_addr[i + 1] & 0xFF);
+        /* pad the odd byte with zero */
+        const uint8_t last[2] = { *data, 0 };
+        memcpy(&w16, last, sizeof(w16));
+        sum += w16;
     }
+    return sum;
+}
 
-    /* the length of the payload */
-    sum += (uint16_t)len_payload;
+uint16_t
+ip_checksum(const sa_family_t af, const uint8_t *payload, const int len_payload,
+            const uint8_t *src_addr, const uint8_t *dest_addr, const int proto)
+{
+    uint64_t sum;
+    int addr_len = (af == AF_INET) ? 4 : 16;
+
+    sum = checksum_add(0, payload, len_payload);
 
-    /* The next header or proto field*/
-    sum += (uint16_t)proto;
+    /*
+     * add the pseudo header which contains the IP source and destination
+     * addresses, the length of the payload and the next header or proto
+     * field
+     */
+    sum = checksum_add(sum, src_addr, addr_len);
+    sum = checksum_add(sum, dest_addr, addr_len);
+    sum += htons((uint16_t)len_payload);
+    sum += htons((uint16_t)proto);
 
     /*
-     * keep only the last 16 bits of the 32 bit calculated sum and add
+     * keep only the last 16 bits of the calculated sum and add
      * the carries
      */
     while (sum >> 16)
@@ -169,7 +271,7 @@ ip_checksum(const sa_family_t af, const uint8_t *payload, const int len_payload,
     }
 
     /* Take the one's complement of sum */
-    return ((uint16_t) ~sum);
+    return (uint16_t) ~ntohs((uint16_t)sum);
 }
 
 #ifdef PACKET_TRUNCATION_CHECK
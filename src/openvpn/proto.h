@@ -306,6 +306,29 @@ bool is_ipv4(int tunnel_type, struct buffer *buf);
 
 bool is_ipv6(int tunnel_type, struct buffer *buf);
 
+/*
+ * Layer 3 and 4 summary of a raw tunnel packet, so that the stages
+ * which look at the headers of a packet parse them only once.
+ */
+struct packet_info
+{
+    int ip_ver;         /* 4 or 6, 0 if the packet is not IP */
+    int ip_offset;      /* offset of the IP header */
+    bool whole;         /* the IP length matches the buffer length */
+    int l4_proto;       /* IPv4 protocol or IPv6 next header */
+    int l4_offset;      /* offset of the L4 header, 0 if not present */
+    int l4_len;         /* bytes from the L4 header to the end */
+    uint8_t tcp_flags;  /* if l4_proto is TCP and its header is complete */
+};
+
+/**
+ * Classify a raw tunnel packet.  The L4 header is only located in
+ * unfragmented or first fragment IPv4 packets, and in IPv6 packets
+ * without extension headers.
+ */
+void packet_info_parse(struct packet_info *pi, int tunnel_type,
+                       const struct buffer *buf);
+
 /**
  *  Calculates an IP or IPv6 checksum with a pseudo header as required by
  *  TCP, UDP and ICMPv6
@@ -609,10 +609,47 @@ prepare_push_reply(struct context *c, struct gc_arena *gc,
     return true;
 }
 
+/*
+ * Preformatted common part of the PUSH_REPLY, see push_reply_cache_init()
+ */
+struct push_reply_cache
+{
+    struct push_list msgs;  /* complete messages, ending in push-continuation 2 */
+    const char *tail;       /* the last message, still open for more options */
+    bool multi_push;
+};
+
+/*
+ * Append a complete message to the push reply cache
+ */
+static void
+push_reply_cache_add(struct push_reply_cache *cache, const char *str,
+                     struct gc_arena *gc)
+{
+    struct push_entry *e;
+    ALLOC_OBJ_CLEAR_GC(e, struct push_entry, gc);
+    e->enable = true;
+    e->option = string_alloc(str, gc);
+    if (cache->msgs.tail)
+    {
+        cache->msgs.tail->next = e;
+    }
+    else
+    {
+        cache->msgs.head = e;
+    }
+    cache->msgs.tail = e;
+}
+
+/*
+ * Pack the enabled options of push_list into buf.  Whenever buf is full
+ * it is sent to the client, or if cache is not NULL, stored in the cache.
+ */
 static bool
 send_push_options(struct context *c, struct buffer *buf,
                   struct push_list *push_list, int safe_cap,
-                  bool *push_sent, bool *multi_push)
+                  bool *push_sent, bool *multi_push,
+                  struct push_reply_cache *cache, struct gc_arena *gc)
 {
     struct push_entry *e = push_list->head;
 
@@ -625,17 +662,22 @@ send_push_options(struct context *c, struct buffer *buf,
             if (BLEN(buf) + l >= safe_cap)
             {
                 buf_printf(buf, ",push-continuation 2");
+                if (cache)
+                {
+                    push_reply_cache_add(cache, BSTR(buf), gc);
+                }
+                else
                 {
                     const bool status = send_control_channel_string(c, BSTR(buf), D_PUSH);
                     if (!status)
                     {
                         return false;
                     }
-                    *push_sent = true;
-                    *multi_push = true;
-                    buf_reset_len(buf);
-                    buf_printf(buf, "%s", push_reply_cmd);
                 }
+                *push_sent = true;
+                *multi_push = true;
+                buf_reset_len(buf);
+                buf_printf(buf, "%s", push_reply_cmd);
             }
             if (BLEN(buf) + l >= safe_cap)
             {
@@ -649,6 +691,37 @@ send_push_options(struct context *c, struct buffer *buf,
     return true;
 }
 
+/* extra space for possible trailing ifconfig and push-continuation */
+#define PUSH_REPLY_EXTRA 84
+
+void
+push_reply_cache_init(struct options *o)
+{
+    struct gc_arena gc = gc_new();
+    struct buffer buf = alloc_buf_gc(PUSH_BUNDLE_SIZE, &gc);
+    const int safe_cap = BCAP(&buf) - PUSH_REPLY_EXTRA;
+    struct push_reply_cache *cache;
+    bool push_sent = false;
+
+    o->push_list.cache = NULL;
+    if (!o->push_list.head)
+    {
+        goto done;
+    }
+
+    ALLOC_OBJ_CLEAR_GC(cache, struct push_reply_cache, &o->gc);
+    buf_printf(&buf, "%s", push_reply_cmd);
+    if (send_push_options(NULL, &buf, &o->push_list, safe_cap, &push_sent,
+                          &cache->multi_push, cache, &o->gc))
+    {
+        cache->tail = string_alloc(BSTR(&buf), &o->gc);
+        o->push_list.cache = cache;
+    }
+
+done:
+    gc_free(&gc);
+}
+
 void
 send_push_reply_auth_token(struct tls_multi *multi)
 {
@@ -674,22 +747,39 @@ send_push_reply(struct context *c, struct push_list *per_client_push_list)
     struct gc_arena gc = gc_new();
     struct buffer buf = alloc_buf_gc(PUSH_BUNDLE_SIZE, &gc);
     bool multi_push = false;
-    const int extra = 84; /* extra space for possible trailing ifconfig and push-continuation */
-    const int safe_cap = BCAP(&buf) - extra;
+    const int safe_cap = BCAP(&buf) - PUSH_REPLY_EXTRA;
     bool push_sent = false;
+    const struct push_reply_cache *cache = c->options.push_list.cache;
 
-    buf_printf(&buf, "%s", push_reply_cmd);
-
-    /* send options which are common to all clients */
-    if (!send_push_options(c, &buf, &c->options.push_list, safe_cap,
-                           &push_sent, &multi_push))
+    if (cache)
     {
-        goto fail;
+        /* options which are common to all clients are preformatted */
+        for (const struct push_entry *e = cache->msgs.head; e; e = e->next)
+        {
+            if (!send_control_channel_string(c, e->option, D_PUSH))
+            {
+                goto fail;
+            }
+            push_sent = true;
+        }
+        multi_push = cache->multi_push;
+        buf_printf(&buf, "%s", cache->tail);
+    }
+    else
+    {
+        buf_printf(&buf, "%s", push_reply_cmd);
+
+        /* send options which are common to all clients */
+        if (!send_push_options(c, &buf, &c->options.push_list, safe_cap,
+                               &push_sent, &multi_push, NULL, NULL))
+        {
+            goto fail;
+        }
     }
 
     /* send client-specific options */
     if (!send_push_options(c, &buf, per_client_push_list, safe_cap,
-                           &push_sent, &multi_push))
+                           &push_sent, &multi_push, NULL, NULL))
     {
         goto fail;
     }
@@ -747,6 +837,7 @@ push_option_ex(struct gc_arena *gc, struct push_list *push_list,
         ALLOC_OBJ_CLEAR_GC(e, struct push_entry, gc);
         e->enable = true;
         e->option = opt;
+        push_list->cache = NULL;
         if (push_list->head)
         {
             ASSERT(push_list->tail);
@@ -774,6 +865,7 @@ clone_push_list(struct options *o)
     if (o->push_list.head)
     {
         const struct push_entry *e = o->push_list.head;
+        const struct push_reply_cache *cache = o->push_list.cache;
         push_reset(o);
         while (e)
         {
@@ -781,6 +873,8 @@ clone_push_list(struct options *o)
                            string_alloc(e->option, &o->gc), true, M_FATAL);
             e = e->next;
         }
+        /* the copy is identical, so the formatted reply still applies */
+        o->push_list.cache = cache;
     }
 }
 
@@ -847,6 +941,7 @@ push_remove_option(struct options *o, const char *p)
             {
                 msg(D_PUSH_DEBUG, "PUSH_REMOVE removing: '%s'", e->option);
                 e->enable = false;
+                o->push_list.cache = NULL;
             }
 
             e = e->next;
@@ -1050,6 +1145,7 @@ remove_iroutes_from_push_route_list(struct options *o)
                 e->enable = enable;
                 if (!enable)
                 {
+                    o->push_list.cache = NULL;
                     msg(D_PUSH, "REMOVE PUSH ROUTE: '%s'", e->option);
                 }
             }
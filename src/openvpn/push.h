@@ -57,6 +57,15 @@ void incoming_push_message(struct context *c, const struct buffer *buffer);
 
 void clone_push_list(struct options *o);
 
+/**
+ * Format the push list of \c o into PUSH_REPLY messages once, so that
+ * send_push_reply() only has to add the client specific options for
+ * clients whose push list has not been changed by --client-config-dir
+ * or --client-connect.  The cache is allocated from the gc of \c o and
+ * is shared by all copies of the push list made by clone_push_list().
+ */
+void push_reply_cache_init(struct options *o);
+
 void push_option(struct options *o, const char *opt, int msglevel);
 
 void push_options(struct options *o, char **p, int msglevel,
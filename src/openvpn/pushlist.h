@@ -32,9 +32,13 @@ struct push_entry {
     const char *option;
 };
 
+struct push_reply_cache;
+
 struct push_list {
     struct push_entry *head;
     struct push_entry *tail;
+    /* preformatted PUSH_REPLY for this list, dropped on modification */
+    const struct push_reply_cache *cache;
 };
 
 #endif /* if !defined(PUSHLIST_H) */
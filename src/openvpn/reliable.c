@@ -308,19 +308,12 @@ done:
 void
 reliable_init(struct reliable *rel, int buf_size, int offset, int array_size, bool hold)
 {
-    int i;
-
     CLEAR(*rel);
     ASSERT(array_size > 0 && array_size <= RELIABLE_CAPACITY);
     rel->hold = hold;
     rel->size = array_size;
+    rel->buf_size = buf_size;
     rel->offset = offset;
-    for (i = 0; i < rel->size; ++i)
-    {
-        struct reliable_entry *e = &rel->array[i];
-        e->buf = alloc_buf(buf_size);
-        ASSERT(buf_init(&e->buf, offset));
-    }
 }
 
 void
@@ -339,6 +332,31 @@ reliable_free(struct reliable *rel)
     free(rel);
 }
 
+void
+reliable_release_buffers(struct reliable *rel)
+{
+    int i;
+    for (i = 0; i < rel->size; ++i)
+    {
+        struct reliable_entry *e = &rel->array[i];
+        if (!e->active)
+        {
+            free_buf(&e->buf);
+        }
+    }
+}
+
+int
+reliable_buffer_bytes(const struct reliable *rel)
+{
+    int i, ret = 0;
+    for (i = 0; i < rel->size; ++i)
+    {
+        ret += rel->array[i].buf.capacity;
+    }
+    return ret;
+}
+
 /* no active buffers? */
 bool
 reliable_empty(const struct reliable *rel)
@@ -490,6 +508,10 @@ reliable_get_buf(struct reliable *rel)
         struct reliable_entry *e = &rel->array[i];
         if (!e->active)
         {
+            if (!e->buf.data)
+            {
+                e->buf = alloc_buf(rel->buf_size);
+            }
             ASSERT(buf_init(&e->buf, rel->offset));
             return &e->buf;
         }
@@ -92,6 +92,7 @@ struct reliable
     int size;
     interval_t initial_timeout;
     packet_id_type packet_id;
+    int buf_size;
     int offset;
     bool hold; /* don't xmit until reliable_schedule_now is called */
     struct reliable_entry array[RELIABLE_CAPACITY];
@@ -189,7 +190,7 @@ bool reliable_ack_write(struct reliable_ack *ack,
  *
  * @param rel The reliable structure to initialize.
  * @param buf_size The size of the buffers in which packets will be
- *     stored.
+ *     stored.  A buffer is allocated when its entry is first used.
  * @param offset The size of reserved space at the beginning of the
  *     buffers to allow efficient header prepending.
  * @param array_size The number of packets that this reliable
@@ -207,6 +208,22 @@ void reliable_init(struct reliable *rel, int buf_size, int offset, int array_siz
  */
 void reliable_free(struct reliable *rel);
 
+/**
+ * Free the buffers of all entries which are not in use.  They are
+ * allocated again when needed.
+ *
+ * @param rel The reliable structure to trim.
+ */
+void reliable_release_buffers(struct reliable *rel);
+
+/**
+ * Return the number of bytes allocated for the packet buffers of a
+ * reliable structure.
+ *
+ * @param rel The reliable structure to inspect.
+ */
+int reliable_buffer_bytes(const struct reliable *rel);
+
 /* add to extra_frame the maximum number of bytes we will need for reliable_ack_write */
 void reliable_ack_adjust_frame_parameters(struct frame *frame, int max);
 
@@ -37,6 +37,8 @@
 #include "memdbg.h"
 
 #include "run_command.h"
+#include "script_helper.h"
+#include "fdmisc.h"
 
 /* contains an SSEC_x value defined in platform.h */
 static int script_security_level = SSEC_BUILT_IN; /* GLOBAL */
@@ -189,13 +191,13 @@ openvpn_execve(const struct argv *a, const struct env_set *es, const unsigned in
 #endif /* ifndef _WIN32 */
 
 /*
- * Wrapper around openvpn_execve
+ * Translate the status returned by openvpn_execve() into the return value
+ * of openvpn_execve_check(), logging error_message on failure.
  */
-int
-openvpn_execve_check(const struct argv *a, const struct env_set *es, const unsigned int flags, const char *error_message)
+static int
+execve_status_check(const int stat, const unsigned int flags, const char *error_message)
 {
     struct gc_arena gc = gc_new();
-    const int stat = openvpn_execve(a, es, flags);
     int ret = false;
 
     if (flags & S_EXITCODE)
@@ -223,6 +225,429 @@ done:
     return ret;
 }
 
+/*
+ * Wrapper around openvpn_execve
+ */
+int
+openvpn_execve_check(const struct argv *a, const struct env_set *es, const unsigned int flags, const char *error_message)
+{
+    return execve_status_check(openvpn_execve(a, es, flags), flags,
+                               error_message);
+}
+
+#ifndef _WIN32
+/*
+ * Table of programs started by openvpn_execve_async() that have not been
+ * collected by openvpn_execve_async_check() yet.  A slot with id 0 is free.
+ * A job is either a forked child or a request sent to a script helper.
+ */
+struct execve_async_job
+{
+    unsigned int id;
+    pid_t pid;
+    struct script_helper *helper;
+    int stat;
+    bool exited;
+    bool notified;
+    bool abandoned;
+};
+
+static struct execve_async_job *async_jobs = NULL; /* GLOBAL */
+static int async_jobs_max = 0;                     /* GLOBAL */
+static unsigned int async_job_id = 0;              /* GLOBAL */
+static int async_job_pipe[2] = { -1, -1 };         /* GLOBAL */
+
+/*
+ * Make the read end of async_job_pipe readable, so that the event loop
+ * wakes up and calls openvpn_execve_async_reap().  Safe to call from a
+ * signal handler.
+ */
+static void
+async_job_wakeup(void)
+{
+    const int saved_errno = errno;
+
+    if (async_job_pipe[1] >= 0
+        && write(async_job_pipe[1], "", 1) < 0)
+    {
+        /* pipe full, the event loop will wake up anyway */
+    }
+    errno = saved_errno;
+}
+
+/*
+ * Called on SIGCHLD and on SIGIO from a script helper
+ */
+static void
+async_job_handler(const int signum)
+{
+    async_job_wakeup();
+}
+
+/*
+ * Empty async_job_pipe, returns true if anything was in it
+ */
+static bool
+async_job_drain(void)
+{
+    char buf[64];
+    bool ret = false;
+
+    while (read(async_job_pipe[0], buf, sizeof(buf)) > 0)
+    {
+        ret = true;
+    }
+    return ret;
+}
+
+static unsigned int
+execve_async_next_id(void)
+{
+    if (++async_job_id == 0)
+    {
+        ++async_job_id;
+    }
+    return async_job_id;
+}
+
+/*
+ * Translate the exit code returned by a script helper into a status
+ * as returned by waitpid()
+ */
+static int
+script_helper_stat(const int exit_code)
+{
+#ifdef W_EXITCODE
+    return W_EXITCODE(exit_code & 0xff, 0);
+#else
+    return (exit_code & 0xff) << 8;
+#endif
+}
+
+void
+openvpn_execve_async_init(int max_jobs)
+{
+    openvpn_execve_async_uninit();
+    if (max_jobs > 0)
+    {
+        if (pipe(async_job_pipe) < 0)
+        {
+            msg(M_WARN | M_ERRNO, "openvpn_execve_async: cannot create pipe, scripts run synchronously");
+            async_job_pipe[0] = async_job_pipe[1] = -1;
+            return;
+        }
+        for (int i = 0; i < 2; ++i)
+        {
+            set_nonblock(async_job_pipe[i]);
+            set_cloexec(async_job_pipe[i]);
+        }
+        ALLOC_ARRAY_CLEAR(async_jobs, struct execve_async_job, max_jobs);
+        async_jobs_max = max_jobs;
+        signal(SIGCHLD, async_job_handler);
+        signal(SIGIO, async_job_handler);
+    }
+}
+
+void
+openvpn_execve_async_uninit(void)
+{
+    if (async_jobs)
+    {
+        signal(SIGCHLD, SIG_DFL);
+        signal(SIGIO, SIG_IGN);
+        free(async_jobs);
+        async_jobs = NULL;
+        async_jobs_max = 0;
+        close(async_job_pipe[0]);
+        close(async_job_pipe[1]);
+        async_job_pipe[0] = async_job_pipe[1] = -1;
+    }
+}
+
+int
+openvpn_execve_async_event_fd(void)
+{
+    return async_job_pipe[0];
+}
+
+static struct execve_async_job *
+execve_async_find(const unsigned int id)
+{
+    for (int i = 0; i < async_jobs_max; ++i)
+    {
+        if (async_jobs[i].id == id)
+        {
+            return &async_jobs[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Record the result of a job
+ */
+static void
+execve_async_complete(const unsigned int id, const int stat)
+{
+    struct execve_async_job *job = execve_async_find(id);
+
+    if (!job || job->exited)
+    {
+        msg(D_SCRIPT, "openvpn_execve_async: ignoring result for unknown job %u",
+            id);
+        return;
+    }
+    job->stat = stat;
+    job->exited = true;
+    if (job->abandoned)
+    {
+        CLEAR(*job);
+    }
+    async_job_wakeup();
+}
+
+/*
+ * Fail all jobs that are waiting for a helper that went away
+ */
+static void
+execve_async_helper_gone(const struct script_helper *sh)
+{
+    for (int i = 0; i < async_jobs_max; ++i)
+    {
+        struct execve_async_job *job = &async_jobs[i];
+        if (job->id && job->helper == sh && !job->exited)
+        {
+            execve_async_complete(job->id, OPENVPN_EXECVE_ERROR);
+        }
+    }
+}
+
+/*
+ * Read all responses a helper has available without blocking
+ */
+static void
+execve_async_drain(struct script_helper *sh)
+{
+    uint32_t id;
+    int exit_code;
+    int ret;
+
+    while ((ret = script_helper_recv(sh, false, &id, &exit_code)) > 0)
+    {
+        execve_async_complete(id, script_helper_stat(exit_code));
+    }
+    if (ret < 0)
+    {
+        execve_async_helper_gone(sh);
+    }
+}
+
+/*
+ * Collect the result of job without blocking, returns true if the
+ * job has finished.
+ */
+static bool
+execve_async_wait(struct execve_async_job *job)
+{
+    if (!job->exited && job->helper)
+    {
+        execve_async_drain(job->helper);
+    }
+    else if (!job->exited)
+    {
+        const pid_t ret = waitpid(job->pid, &job->stat, WNOHANG);
+        if (ret == job->pid)
+        {
+            job->exited = true;
+        }
+        else if (ret < 0 && errno != EINTR)
+        {
+            /* the child is gone, we will not learn how it ended */
+            job->stat = OPENVPN_EXECVE_ERROR;
+            job->exited = true;
+        }
+    }
+    return job->exited;
+}
+
+unsigned int
+openvpn_execve_async(const struct argv *a, const struct env_set *es,
+                     const unsigned int flags, const char *hook)
+{
+    struct gc_arena gc = gc_new();
+    unsigned int ret = 0;
+    struct execve_async_job *job = NULL;
+
+    if (!a || !a->argv[0])
+    {
+        msg(M_FATAL, "openvpn_execve_async: called with empty argv");
+    }
+
+#if defined(ENABLE_FEATURE_EXECVE)
+    if (async_jobs)
+    {
+        job = execve_async_find(0);
+    }
+    if (job && !openvpn_execve_allowed(flags))
+    {
+        /* let openvpn_execve() take care of the warning */
+        job = NULL;
+    }
+    if (job)
+    {
+        struct script_helper *sh = script_helper_get(hook);
+        const unsigned int id = execve_async_next_id();
+
+        if (sh)
+        {
+            if (script_helper_send(sh, id, a, es, true))
+            {
+                CLEAR(*job);
+                job->id = id;
+                job->helper = sh;
+                ret = id;
+            }
+        }
+        else
+        {
+            char *const *envp = (char *const *)make_env_array(es, true, &gc);
+            const pid_t pid = fork();
+
+            if (pid == (pid_t)0) /* child side */
+            {
+                execve(a->argv[0], a->argv, envp);
+                exit(OPENVPN_EXECVE_FAILURE);
+            }
+            else if (pid < (pid_t)0) /* fork failed */
+            {
+                msg(M_WARN | M_ERRNO, "openvpn_execve_async: unable to fork");
+            }
+            else /* parent side */
+            {
+                CLEAR(*job);
+                job->id = id;
+                job->pid = pid;
+                ret = id;
+            }
+        }
+    }
+#endif /* if defined(ENABLE_FEATURE_EXECVE) */
+
+    gc_free(&gc);
+    return ret;
+}
+
+bool
+openvpn_execve_async_check(const unsigned int id, const unsigned int flags,
+                           const char *error_message, int *ret)
+{
+    struct execve_async_job *job = execve_async_find(id);
+
+    if (!job)
+    {
+        /* should not happen, but do not leave the caller waiting forever */
+        *ret = execve_status_check(OPENVPN_EXECVE_ERROR, flags, error_message);
+        return true;
+    }
+    if (!execve_async_wait(job))
+    {
+        return false;
+    }
+    *ret = execve_status_check(job->stat, flags, error_message);
+    CLEAR(*job);
+    return true;
+}
+
+void
+openvpn_execve_async_abandon(const unsigned int id)
+{
+    struct execve_async_job *job = execve_async_find(id);
+
+    if (job)
+    {
+        if (execve_async_wait(job))
+        {
+            CLEAR(*job);
+        }
+        else
+        {
+            job->abandoned = true;
+        }
+    }
+}
+
+void
+openvpn_execve_async_reap(void (*done)(unsigned int id, void *arg), void *arg)
+{
+    if (!async_jobs || !async_job_drain())
+    {
+        return;
+    }
+
+    for (int i = 0; i < async_jobs_max; ++i)
+    {
+        struct execve_async_job *job = &async_jobs[i];
+        if (job->id && execve_async_wait(job) && job->id && !job->notified)
+        {
+            job->notified = true;
+            if (done)
+            {
+                (*done)(job->id, arg);
+            }
+        }
+    }
+}
+
+/*
+ * Run a script through its helper and wait for the result.  Results of
+ * asynchronous requests to the same helper arriving in the meantime are
+ * recorded for openvpn_execve_async_check().
+ */
+static int
+script_helper_execve(struct script_helper *sh, const struct argv *a,
+                     const struct env_set *es, const unsigned int flags)
+{
+    const unsigned int id = execve_async_next_id();
+    uint32_t rid;
+    int exit_code;
+
+    if (!openvpn_execve_allowed(flags))
+    {
+        return openvpn_execve(a, es, flags);
+    }
+    if (!script_helper_send(sh, id, a, es, false))
+    {
+        return OPENVPN_EXECVE_ERROR;
+    }
+    while (script_helper_recv(sh, true, &rid, &exit_code) > 0)
+    {
+        if (rid == id)
+        {
+            return script_helper_stat(exit_code);
+        }
+        execve_async_complete(rid, script_helper_stat(exit_code));
+    }
+    execve_async_helper_gone(sh);
+    return OPENVPN_EXECVE_ERROR;
+}
+#endif /* ifndef _WIN32 */
+
+int
+openvpn_execve_script(const struct argv *a, const struct env_set *es,
+                      const unsigned int flags, const char *hook,
+                      const char *error_message)
+{
+#ifndef _WIN32
+    struct script_helper *sh = script_helper_get(hook);
+    if (sh)
+    {
+        return execve_status_check(script_helper_execve(sh, a, es, flags),
+                                   flags, error_message);
+    }
+#endif
+    return openvpn_execve_check(a, es, flags, error_message);
+}
+
 /*
  * Run execve() inside a fork(), duping stdout.  Designed to replicate the semantics of popen() but
  * in a safer way that doesn't require the invocation of a shell or the risks
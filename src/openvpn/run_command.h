@@ -36,6 +36,7 @@
 #define OPENVPN_EXECVE_ERROR       -1 /* generic error while forking to run an external program */
 #define OPENVPN_EXECVE_NOT_ALLOWED -2 /* external program not run due to script security */
 #define OPENVPN_EXECVE_FAILURE    127 /* exit code passed back from child when execve fails */
+#define OPENVPN_EXECVE_BUSY        -3 /* no free slot for asynchronous execution */
 
 int script_security(void);
 
@@ -56,6 +57,83 @@ bool openvpn_execve_allowed(const unsigned int flags);
 int openvpn_execve_check(const struct argv *a, const struct env_set *es,
                           const unsigned int flags, const char *error_message);
 
+#ifndef _WIN32
+/**
+ * Set up the table of asynchronously executed programs.
+ *
+ * @param max_jobs  Maximum number of programs that may run concurrently,
+ *                  0 disables asynchronous execution.
+ */
+void openvpn_execve_async_init(int max_jobs);
+
+void openvpn_execve_async_uninit(void);
+
+/**
+ * Return a descriptor that becomes readable when an asynchronously
+ * started program may have finished, or -1 if asynchronous execution is
+ * disabled.  The event loop waits on it and calls
+ * openvpn_execve_async_reap() when it fires.
+ */
+int openvpn_execve_async_event_fd(void);
+
+/**
+ * Start a program like openvpn_execve() does, but return right after the
+ * fork() instead of waiting for the child to exit.  If a script helper is
+ * enabled for \c hook, the request is passed to the helper instead.
+ *
+ * @param hook  hook description as passed to openvpn_run_script()
+ *
+ * @return a job id, or 0 if asynchronous execution is disabled, all
+ *         slots are in use, the program is not allowed to run or could
+ *         not be started.  The caller is expected to fall back to
+ *         synchronous execution in this case.
+ */
+unsigned int openvpn_execve_async(const struct argv *a, const struct env_set *es,
+                                  const unsigned int flags, const char *hook);
+
+/**
+ * Check if an asynchronously started program has exited.  Once this
+ * returns true the slot of the program is released and \c job must not
+ * be used anymore.
+ *
+ * @param job            job id returned by openvpn_execve_async()
+ * @param flags          S_* flags, interpreted as by openvpn_execve_check()
+ * @param error_message  message to log if the program failed, may be NULL
+ * @param ret            set to the value openvpn_execve_check() would
+ *                       have returned
+ *
+ * @return true if the program has exited, false if it is still running
+ */
+bool openvpn_execve_async_check(const unsigned int job, const unsigned int flags,
+                                const char *error_message, int *ret);
+
+/**
+ * Forget about an asynchronously started program whose result is no
+ * longer of interest.  The child is still reaped when it exits.
+ */
+void openvpn_execve_async_abandon(const unsigned int job);
+
+/**
+ * Reap all asynchronously started programs that have exited since the
+ * last call and empty the descriptor returned by
+ * openvpn_execve_async_event_fd().  This is cheap if that descriptor was
+ * not readable.
+ *
+ * @param done  called for each job that finished and is not abandoned
+ * @param arg   passed through to \c done
+ */
+void openvpn_execve_async_reap(void (*done)(unsigned int job, void *arg), void *arg);
+
+#endif /* ifndef _WIN32 */
+
+/**
+ * Like openvpn_execve_check(), but pass the request to the script helper
+ * of \c hook if one is enabled.
+ */
+int openvpn_execve_script(const struct argv *a, const struct env_set *es,
+                          const unsigned int flags, const char *hook,
+                          const char *error_message);
+
 /**
  * Will run a script and return the exit code of the script if between
  * 0 and 255, -1 otherwise
@@ -68,7 +146,7 @@ openvpn_run_script(const struct argv *a, const struct env_set *es,
 
     openvpn_snprintf(msg, sizeof(msg),
                      "WARNING: Failed running command (%s)", hook);
-    return openvpn_execve_check(a, es, flags | S_SCRIPT, msg);
+    return openvpn_execve_script(a, es, flags | S_SCRIPT, hook, msg);
 }
 
 #endif /* ifndef RUN_COMMAND_H */
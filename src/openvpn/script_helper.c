@@ -0,0 +1,460 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#ifndef _WIN32
+
+#include "buffer.h"
+#include "error.h"
+#include "fdmisc.h"
+#include "options.h"
+#include "run_command.h"
+#include "script_helper.h"
+
+#include "memdbg.h"
+
+/* size of the fixed part of a response */
+#define SCRIPT_HELPER_RESPONSE_SIZE 12
+
+/* how long the event loop may be held up by a helper that does not read
+ * its requests or does not exit */
+#define SCRIPT_HELPER_TIMEOUT_MS 1000
+
+/* PATH given to the helper if OpenVPN runs without one */
+#define SCRIPT_HELPER_DEFAULT_PATH "/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin"
+
+struct script_helper
+{
+    const unsigned int hook;    /* SH_* flag */
+    const char *name;           /* hook option name */
+    const char *cmd;            /* command the helper is started with */
+    pid_t pid;
+    int fd;                     /* our end of the socket, -1 if not running */
+    bool async;                 /* SIGIO requested on fd */
+
+    /* partially received response */
+    uint8_t rbuf[SCRIPT_HELPER_RESPONSE_SIZE];
+    int rlen;
+    uint32_t skip;              /* bytes of extra response data to discard */
+};
+
+static struct script_helper script_helpers[] = { /* GLOBAL */
+    { .hook = SH_AUTH_USER_PASS_VERIFY, .name = "auth-user-pass-verify", .fd = -1 },
+    { .hook = SH_CLIENT_CONNECT, .name = "client-connect", .fd = -1 },
+    { .hook = SH_CLIENT_DISCONNECT, .name = "client-disconnect", .fd = -1 },
+    { .hook = SH_LEARN_ADDRESS, .name = "learn-address", .fd = -1 },
+    { .hook = SH_TLS_VERIFY, .name = "tls-verify", .fd = -1 },
+};
+
+unsigned int
+script_helper_hook_flag(const char *name)
+{
+    for (int i = 0; i < SIZE(script_helpers); ++i)
+    {
+        if (streq(script_helpers[i].name, name))
+        {
+            return script_helpers[i].hook;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Wait at most timeout milliseconds for fd to become ready for events,
+ * a negative timeout waits forever.
+ */
+static bool
+script_helper_poll(struct script_helper *sh, const short events, const int timeout)
+{
+    struct pollfd pfd = { .fd = sh->fd, .events = events };
+    int n;
+
+    while ((n = poll(&pfd, 1, timeout)) < 0 && errno == EINTR)
+    {
+    }
+    return n > 0;
+}
+
+static void
+script_helper_stop(struct script_helper *sh)
+{
+    if (sh->fd >= 0)
+    {
+        close(sh->fd);
+        sh->fd = -1;
+    }
+    if (sh->pid > 0)
+    {
+        int status;
+        pid_t ret = 0;
+
+        /* give the helper a moment to exit by itself, then kill it */
+        kill(sh->pid, SIGTERM);
+        for (int i = 0; i < SCRIPT_HELPER_TIMEOUT_MS / 10; ++i)
+        {
+            if ((ret = waitpid(sh->pid, &status, WNOHANG)) != 0)
+            {
+                break;
+            }
+            platform_sleep_milliseconds(10);
+        }
+        if (ret == 0)
+        {
+            msg(M_WARN, "--%s helper (pid %d) did not exit, killing it",
+                sh->name, (int)sh->pid);
+            kill(sh->pid, SIGKILL);
+            waitpid(sh->pid, &status, 0);
+        }
+        msg(M_INFO, "--%s helper (pid %d) stopped", sh->name, (int)sh->pid);
+        sh->pid = 0;
+    }
+    sh->async = false;
+    sh->rlen = 0;
+    sh->skip = 0;
+}
+
+void
+script_helper_init(const unsigned int hooks, const struct options *o)
+{
+    script_helper_uninit();
+
+    for (int i = 0; i < SIZE(script_helpers); ++i)
+    {
+        struct script_helper *sh = &script_helpers[i];
+        const char *cmd = NULL;
+
+        if (!(hooks & sh->hook))
+        {
+            continue;
+        }
+        switch (sh->hook)
+        {
+            case SH_AUTH_USER_PASS_VERIFY:
+                cmd = o->auth_user_pass_verify_script;
+                break;
+
+            case SH_CLIENT_CONNECT:
+                cmd = o->client_connect_script;
+                break;
+
+            case SH_CLIENT_DISCONNECT:
+                cmd = o->client_disconnect_script;
+                break;
+
+            case SH_LEARN_ADDRESS:
+                cmd = o->learn_address_script;
+                break;
+
+            case SH_TLS_VERIFY:
+                cmd = o->tls_verify;
+                break;
+        }
+        if (!cmd)
+        {
+            msg(M_WARN, "WARNING: --script-helper %s ignored, no --%s "
+                "script configured", sh->name, sh->name);
+            continue;
+        }
+        sh->cmd = cmd;
+    }
+}
+
+void
+script_helper_uninit(void)
+{
+    for (int i = 0; i < SIZE(script_helpers); ++i)
+    {
+        script_helper_stop(&script_helpers[i]);
+        script_helpers[i].cmd = NULL;
+    }
+}
+
+struct script_helper *
+script_helper_get(const char *hook)
+{
+    if (!hook || strncmp(hook, "--", 2))
+    {
+        return NULL;
+    }
+    hook += 2;
+
+    for (int i = 0; i < SIZE(script_helpers); ++i)
+    {
+        struct script_helper *sh = &script_helpers[i];
+        const size_t len = strlen(sh->name);
+
+        /* hooks may carry a suffix, e.g. "--tls-verify script" */
+        if (sh->cmd && !strncmp(hook, sh->name, len)
+            && (hook[len] == '\0' || hook[len] == ' '))
+        {
+            return sh;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Fork the helper with a socket as stdin and stdout.  The helper lives
+ * longer than any single event, so it only gets PATH in its environment,
+ * everything else is passed with each request.
+ */
+static bool
+script_helper_start(struct script_helper *sh)
+{
+    struct gc_arena gc = gc_new();
+    struct argv argv = argv_new();
+    struct buffer path = alloc_buf_gc(256, &gc);
+    const char *envp[2];
+    bool ret = false;
+    int sv[2];
+
+    buf_printf(&path, "PATH=%s", getenv("PATH") ? getenv("PATH")
+               : SCRIPT_HELPER_DEFAULT_PATH);
+    envp[0] = BSTR(&path);
+    envp[1] = NULL;
+
+    argv_parse_cmd(&argv, sh->cmd);
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    {
+        msg(M_WARN | M_ERRNO, "--%s helper: socketpair failed", sh->name);
+        goto done;
+    }
+
+    const pid_t pid = fork();
+    if (pid == (pid_t)0) /* child side */
+    {
+        close(sv[0]);
+        dup2(sv[1], 0);
+        dup2(sv[1], 1);
+        if (sv[1] > 1)
+        {
+            close(sv[1]);
+        }
+        execve(argv.argv[0], argv.argv, (char *const *)envp);
+        exit(OPENVPN_EXECVE_FAILURE);
+    }
+    close(sv[1]);
+    if (pid < (pid_t)0)
+    {
+        msg(M_WARN | M_ERRNO, "--%s helper: unable to fork", sh->name);
+        close(sv[0]);
+        goto done;
+    }
+
+    set_nonblock(sv[0]);
+    set_cloexec(sv[0]);
+    sh->fd = sv[0];
+    sh->pid = pid;
+    msg(M_INFO, "--%s helper %s started (pid %d)", sh->name, argv.argv[0],
+        (int)pid);
+    ret = true;
+
+done:
+    argv_free(&argv);
+    gc_free(&gc);
+    return ret;
+}
+
+/*
+ * Write a request.  A helper that does not read it within
+ * SCRIPT_HELPER_TIMEOUT_MS is considered stuck.
+ */
+static bool
+script_helper_write(struct script_helper *sh, const struct buffer *buf)
+{
+    const uint8_t *data = BPTR(buf);
+    int len = BLEN(buf);
+
+    while (len > 0)
+    {
+        const ssize_t n = write(sh->fd, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK)
+                && script_helper_poll(sh, POLLOUT, SCRIPT_HELPER_TIMEOUT_MS))
+            {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool
+script_helper_send(struct script_helper *sh, const uint32_t id,
+                   const struct argv *a, const struct env_set *es,
+                   const bool async)
+{
+    struct gc_arena gc = gc_new();
+    const char **envp;
+    size_t size = 8;
+    int envc = 0;
+    bool ret = false;
+
+    if (sh->fd < 0 && !script_helper_start(sh))
+    {
+        goto done;
+    }
+
+    if (async && !sh->async)
+    {
+        /* make the event loop wake up when a response arrives */
+        if (fcntl(sh->fd, F_SETOWN, getpid()) < 0
+            || fcntl(sh->fd, F_SETFL, fcntl(sh->fd, F_GETFL) | O_ASYNC) < 0)
+        {
+            msg(M_WARN | M_ERRNO, "--%s helper: cannot enable SIGIO", sh->name);
+        }
+        sh->async = true;
+    }
+
+    envp = make_env_array(es, true, &gc);
+    for (size_t i = 0; i < a->argc; ++i)
+    {
+        size += strlen(a->argv[i]) + 1;
+    }
+    for (envc = 0; envp[envc]; ++envc)
+    {
+        size += strlen(envp[envc]) + 1;
+    }
+    if (a->argc > UINT16_MAX || envc > UINT16_MAX || size > INT_MAX - 4)
+    {
+        msg(M_WARN, "--%s helper: request too large", sh->name);
+        goto done;
+    }
+
+    struct buffer buf = alloc_buf_gc(size + 4, &gc);
+    buf_write_u32(&buf, size);
+    buf_write_u32(&buf, id);
+    buf_write_u16(&buf, a->argc);
+    buf_write_u16(&buf, envc);
+    for (size_t i = 0; i < a->argc; ++i)
+    {
+        buf_write(&buf, a->argv[i], strlen(a->argv[i]) + 1);
+    }
+    for (int i = 0; i < envc; ++i)
+    {
+        buf_write(&buf, envp[i], strlen(envp[i]) + 1);
+    }
+
+    if (!script_helper_write(sh, &buf))
+    {
+        msg(M_WARN | M_ERRNO, "--%s helper: write failed", sh->name);
+        script_helper_stop(sh);
+        goto done;
+    }
+    ret = true;
+
+done:
+    gc_free(&gc);
+    return ret;
+}
+
+int
+script_helper_recv(struct script_helper *sh, const bool wait,
+                   uint32_t *id, int *exit_code)
+{
+    const int flags = MSG_DONTWAIT;
+
+    while (sh->fd >= 0)
+    {
+        uint8_t discard[256];
+        ssize_t n;
+
+        if (sh->skip)
+        {
+            n = recv(sh->fd, discard, min_uint(sh->skip, sizeof(discard)), flags);
+        }
+        else
+        {
+            n = recv(sh->fd, sh->rbuf + sh->rlen,
+                     SCRIPT_HELPER_RESPONSE_SIZE - sh->rlen, flags);
+        }
+
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            if (!wait)
+            {
+                return 0;
+            }
+            /* like a synchronously run script, wait as long as it takes */
+            script_helper_poll(sh, POLLIN, -1);
+            continue;
+        }
+        if (n <= 0)
+        {
+            msg(M_WARN | (n < 0 ? M_ERRNO : 0), "--%s helper went away",
+                sh->name);
+            break;
+        }
+
+        if (sh->skip)
+        {
+            sh->skip -= n;
+            continue;
+        }
+        sh->rlen += n;
+        if (sh->rlen == SCRIPT_HELPER_RESPONSE_SIZE)
+        {
+            struct buffer buf;
+            bool good = true;
+            uint32_t len;
+
+            buf_set_read(&buf, sh->rbuf, sizeof(sh->rbuf));
+            len = buf_read_u32(&buf, &good);
+            *id = buf_read_u32(&buf, &good);
+            *exit_code = (int)buf_read_u32(&buf, &good);
+            sh->rlen = 0;
+            if (!good || len < SCRIPT_HELPER_RESPONSE_SIZE - 4)
+            {
+                msg(M_WARN, "--%s helper: malformed response", sh->name);
+                break;
+            }
+            sh->skip = len - (SCRIPT_HELPER_RESPONSE_SIZE - 4);
+            return 1;
+        }
+    }
+
+    script_helper_stop(sh);
+    return -1;
+}
+
+#endif /* ifndef _WIN32 */
@@ -0,0 +1,125 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Persistent script helpers.
+ *
+ * Instead of forking a new process for every event, the script of a hook
+ * can be started once and then be fed one request per event over a unix
+ * stream socket connected to its stdin and stdout.  All integers are in
+ * network byte order.
+ *
+ * Request:  uint32 length of the rest of the record
+ *           uint32 request id
+ *           uint16 argc
+ *           uint16 number of environment strings
+ *           argc NUL terminated argv strings
+ *           NUL terminated "name=value" environment strings
+ *
+ * Response: uint32 length of the rest of the record (at least 8)
+ *           uint32 request id
+ *           uint32 exit code, with the meaning the exit code of the
+ *                  script would have
+ *
+ * Responses may be sent in any order, additional response data is
+ * ignored.
+ */
+
+#ifndef SCRIPT_HELPER_H
+#define SCRIPT_HELPER_H
+
+#ifndef _WIN32
+
+#include "argv.h"
+#include "env_set.h"
+
+/* hooks that may be run by a persistent helper */
+#define SH_AUTH_USER_PASS_VERIFY (1<<0)
+#define SH_CLIENT_CONNECT        (1<<1)
+#define SH_CLIENT_DISCONNECT     (1<<2)
+#define SH_LEARN_ADDRESS         (1<<3)
+#define SH_TLS_VERIFY            (1<<4)
+
+struct script_helper;
+
+/**
+ * Map a hook name as used by --script-helper to its SH_* flag.
+ *
+ * @return the flag, or 0 if the hook cannot be run by a helper
+ */
+unsigned int script_helper_hook_flag(const char *name);
+
+struct options;
+
+/**
+ * Enable persistent helpers for the hooks in \c hooks, using the
+ * commands configured for these hooks in \c o.  Helpers are started on
+ * their first use.
+ */
+void script_helper_init(const unsigned int hooks, const struct options *o);
+
+/**
+ * Stop all helpers.
+ */
+void script_helper_uninit(void);
+
+/**
+ * Find the helper for a hook.
+ *
+ * @param hook  hook description as passed to openvpn_run_script(),
+ *              e.g. "--learn-address"
+ *
+ * @return the helper, or NULL if no helper is enabled for \c hook
+ */
+struct script_helper *script_helper_get(const char *hook);
+
+/**
+ * Send a request to a helper, starting the helper if it is not running.
+ * argv[0] is the program started as helper.
+ *
+ * @param async  if true, arrange for SIGIO to be raised when a response
+ *               is available
+ *
+ * @return true if the request was sent
+ */
+bool script_helper_send(struct script_helper *sh, const uint32_t id,
+                        const struct argv *a, const struct env_set *es,
+                        const bool async);
+
+/**
+ * Receive one response from a helper.
+ *
+ * @param wait       block until a response is available
+ * @param id         set to the request id of the response
+ * @param exit_code  set to the exit code of the response
+ *
+ * @return 1 if a response was received, 0 if none is available yet and
+ *         -1 if the helper went away.  Requests pending on a helper
+ *         that went away will never be answered.
+ */
+int script_helper_recv(struct script_helper *sh, const bool wait,
+                       uint32_t *id, int *exit_code);
+
+#endif /* ifndef _WIN32 */
+
+#endif /* ifndef SCRIPT_HELPER_H */
@@ -29,6 +29,7 @@
 
 #include "syshead.h"
 #include "shaper.h"
+#include "perf.h"
 #include "memdbg.h"
 
 /*
@@ -86,6 +87,75 @@ shaper_reset_wakeup(struct shaper *s)
     CLEAR(s->wakeup);
 }
 
+static inline uint64_t
+token_bucket_now(void)
+{
+    return perf_now() / 1000;
+}
+
+void
+token_bucket_init(struct token_bucket *tb, int bytes_per_second, int burst)
+{
+    if (!burst)
+    {
+        burst = max_int(bytes_per_second, TOKEN_BUCKET_DEFAULT_BURST);
+    }
+    tb->rate = bytes_per_second;
+    tb->burst = (uint64_t)burst * 1000000;
+    tb->tokens = tb->burst;
+    tb->last = token_bucket_now();
+}
+
+static void
+token_bucket_refill(struct token_bucket *tb, const uint64_t t)
+{
+    if (t > tb->last)
+    {
+        /* a full refill takes at most 1000 seconds at SHAPER_MIN */
+        uint64_t elapsed = t - tb->last;
+        if (elapsed > 1000000000)
+        {
+            elapsed = 1000000000;
+        }
+        tb->tokens += tb->rate * elapsed;
+        if (tb->tokens > tb->burst)
+        {
+            tb->tokens = tb->burst;
+        }
+    }
+    tb->last = t;
+}
+
+bool
+token_bucket_take(struct token_bucket *tb, struct token_bucket *parent,
+                  int nbytes)
+{
+    const uint64_t need = (uint64_t)nbytes * 1000000;
+    const uint64_t t = token_bucket_now();
+
+    if (tb->rate)
+    {
+        token_bucket_refill(tb, t);
+    }
+    if (parent)
+    {
+        token_bucket_refill(parent, t);
+    }
+    if ((tb->rate && tb->tokens < need) || (parent && parent->tokens < need))
+    {
+        return false;
+    }
+    if (tb->rate)
+    {
+        tb->tokens -= need;
+    }
+    if (parent)
+    {
+        parent->tokens -= need;
+    }
+    return true;
+}
+
 void
 shaper_msg(struct shaper *s)
 {
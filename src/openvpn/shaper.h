@@ -154,6 +154,40 @@ shaper_wrote_bytes(struct shaper *s, int nbytes)
     }
 }
 
+/*
+ * A token bucket, used to police the traffic to a client in server mode.
+ * Tokens are bytes scaled by 1000000, so that the refill for the
+ * microseconds since the last packet needs no division.  A bucket is
+ * refilled when a packet is checked against it, no timer is involved.
+ * The refill uses the monotonic clock, so that a step of the wall clock
+ * neither fills nor starves the bucket.
+ */
+struct token_bucket
+{
+    uint64_t rate;              /* bytes per second, 0 if unlimited */
+    uint64_t burst;             /* capacity, in scaled tokens */
+    uint64_t tokens;            /* scaled tokens */
+    uint64_t last;              /* time of the last refill, in microseconds */
+};
+
+#define TOKEN_BUCKET_MIN_BURST     3000  /* bytes, two full-sized packets */
+#define TOKEN_BUCKET_DEFAULT_BURST 65536 /* bytes, at least a TCP window */
+
+/*
+ * Start with a full bucket.  If burst is 0, the bucket holds a second of
+ * traffic, but at least TOKEN_BUCKET_DEFAULT_BURST bytes, so that TCP in
+ * the tunnel can keep a window in flight at the policed rate.
+ */
+void token_bucket_init(struct token_bucket *tb, int bytes_per_second, int burst);
+
+/*
+ * Take nbytes tokens from the bucket and from its parent, if any.
+ * Returns false and takes nothing if either holds too few tokens.
+ * A bucket with a rate of 0 never runs out of tokens.
+ */
+bool token_bucket_take(struct token_bucket *tb, struct token_bucket *parent,
+                       int nbytes);
+
 #if 0
 /*
  * Increase/Decrease bandwidth by a percentage.
@@ -906,6 +906,56 @@ is_hard_reset_method2(int op)
 /** @name Functions for initialization and cleanup of key_state structures
  *  @{ */
 
+/*
+ * The control channel buffers of a key_state are only needed while
+ * control packets are exchanged.  They are allocated when a handshake is
+ * processed or a control packet has to be sent or received, and
+ * released by key_state_release_buffers() once the key state has
+ * settled, so that idle clients do not hold them.
+ */
+static inline bool
+key_state_has_buffers(const struct key_state *ks)
+{
+    return ks->plaintext_read_buf.data != NULL;
+}
+
+static void
+key_state_alloc_buffers(struct key_state *ks, const struct frame *frame)
+{
+    if (!key_state_has_buffers(ks))
+    {
+        ks->plaintext_read_buf = alloc_buf(TLS_CHANNEL_BUF_SIZE);
+        ks->plaintext_write_buf = alloc_buf(TLS_CHANNEL_BUF_SIZE);
+        ks->ack_write_buf = alloc_buf(BUF_SIZE(frame));
+    }
+}
+
+/*
+ * Release the control channel buffers if nothing is in flight.  The
+ * caller must make sure that to_link does not point into ack_write_buf.
+ */
+static void
+key_state_release_buffers(struct key_state *ks)
+{
+    if (key_state_has_buffers(ks)
+        && ks->state >= S_ACTIVE
+        && reliable_empty(ks->send_reliable)
+        && reliable_empty(ks->rec_reliable)
+        && reliable_ack_empty(ks->rec_ack)
+        && !BLEN(&ks->plaintext_read_buf)
+        && !BLEN(&ks->plaintext_write_buf)
+        && !ks->paybuf)
+    {
+        free_buf(&ks->plaintext_read_buf);
+        free_buf(&ks->plaintext_write_buf);
+        free_buf(&ks->ack_write_buf);
+        reliable_release_buffers(ks->send_reliable);
+        reliable_release_buffers(ks->rec_reliable);
+        key_state_ssl_release_buffers(&ks->ks_ssl);
+        dmsg(D_TLS_DEBUG, "TLS: released control channel buffers");
+    }
+}
+
 /**
  * Initialize a \c key_state structure.
  * @ingroup control_processor
@@ -963,9 +1013,6 @@ key_state_init(struct tls_session *session, struct key_state *ks)
     ALLOC_OBJ_CLEAR(ks->rec_ack, struct reliable_ack);
 
     /* allocate buffers */
-    ks->plaintext_read_buf = alloc_buf(TLS_CHANNEL_BUF_SIZE);
-    ks->plaintext_write_buf = alloc_buf(TLS_CHANNEL_BUF_SIZE);
-    ks->ack_write_buf = alloc_buf(BUF_SIZE(&session->opt->frame));
     reliable_init(ks->send_reliable, BUF_SIZE(&session->opt->frame),
                   FRAME_HEADROOM(&session->opt->frame), TLS_RELIABLE_N_SEND_BUFFERS,
                   ks->key_id ? false : session->opt->xmit_hold);
@@ -1362,6 +1409,93 @@ tls_multi_free(struct tls_multi *multi, bool clear)
     free(multi);
 }
 
+/*
+ * Add up the control channel buffers held by the sessions and key
+ * states of a tls_multi structure.
+ */
+int
+tls_multi_buffer_bytes(const struct tls_multi *multi)
+{
+    int ret = 0;
+
+    for (int i = 0; i < TM_SIZE; ++i)
+    {
+        const struct tls_session *session = &multi->session[i];
+
+        ret += session->tls_wrap.work.capacity
+               + session->tls_wrap.tls_crypt_v2_metadata.capacity;
+
+        for (int j = 0; j < KS_SIZE; ++j)
+        {
+            const struct key_state *ks = &session->key[j];
+
+            if (ks->state == S_UNDEF)
+            {
+                continue;
+            }
+            ret += ks->plaintext_read_buf.capacity
+                   + ks->plaintext_write_buf.capacity
+                   + ks->ack_write_buf.capacity
+                   + reliable_buffer_bytes(ks->send_reliable)
+                   + reliable_buffer_bytes(ks->rec_reliable);
+        }
+    }
+    return ret;
+}
+
+int
+tls_multi_state_bytes(const struct tls_multi *multi)
+{
+    int ret = sizeof(*multi);
+
+    for (int i = 0; i < TM_SIZE; ++i)
+    {
+        for (int j = 0; j < KS_SIZE; ++j)
+        {
+            const struct key_state *ks = &multi->session[i].key[j];
+
+            if (ks->state == S_UNDEF)
+            {
+                continue;
+            }
+            ret += 2 * sizeof(struct reliable)
+                   + sizeof(struct reliable_ack)
+                   + sizeof(struct key_source2);
+        }
+    }
+    return ret;
+}
+
+int
+tls_multi_crypto_bytes(const struct tls_multi *multi)
+{
+    int ret = 0;
+
+    for (int i = 0; i < TM_SIZE; ++i)
+    {
+        const struct tls_session *session = &multi->session[i];
+
+        ret += packet_id_memory_bytes(&session->tls_wrap.opt.packet_id);
+        if (session->tls_wrap.cleanup_key_ctx)
+        {
+            ret += key_ctx_bi_memory_bytes(&session->tls_wrap.opt.key_ctx_bi);
+        }
+
+        for (int j = 0; j < KS_SIZE; ++j)
+        {
+            const struct key_state *ks = &session->key[j];
+
+            if (ks->state == S_UNDEF)
+            {
+                continue;
+            }
+            ret += key_ctx_bi_memory_bytes(&ks->crypto_options.key_ctx_bi)
+                   + packet_id_memory_bytes(&ks->crypto_options.packet_id);
+        }
+    }
+    return ret;
+}
+
 
 /*
  * Move a packet authentication HMAC + related fields to or from the front
@@ -2220,20 +2354,18 @@ push_peer_info(struct buffer *buf, struct tls_session *session)
         }
 
         /* push env vars that begin with UV_, IV_PLAT_VER and IV_GUI_VER */
-        for (struct env_item *e = es->list; e != NULL; e = e->next)
+        for (int i = 0; i < es->count; ++i)
         {
-            if (e->string)
+            const char *str = es->envp[i];
+            if ((((strncmp(str, "UV_", 3)==0
+                   || strncmp(str, "IV_PLAT_VER=", sizeof("IV_PLAT_VER=")-1)==0)
+                  && session->opt->push_peer_info_detail >= 2)
+                 || (strncmp(str,"IV_GUI_VER=",sizeof("IV_GUI_VER=")-1)==0)
+                 || (strncmp(str,"IV_SSO=",sizeof("IV_SSO=")-1)==0)
+                 )
+                && buf_safe(&out, strlen(str)+1))
             {
-                if ((((strncmp(e->string, "UV_", 3)==0
-                       || strncmp(e->string, "IV_PLAT_VER=", sizeof("IV_PLAT_VER=")-1)==0)
-                      && session->opt->push_peer_info_detail >= 2)
-                     || (strncmp(e->string,"IV_GUI_VER=",sizeof("IV_GUI_VER=")-1)==0)
-                     || (strncmp(e->string,"IV_SSO=",sizeof("IV_SSO=")-1)==0)
-                     )
-                    && buf_safe(&out, strlen(e->string)+1))
-                {
-                    buf_printf(&out, "%s\n", e->string);
-                }
+                buf_printf(&out, "%s\n", str);
             }
         }
 
@@ -2696,6 +2828,11 @@ tls_process(struct tls_multi *multi,
         msg(D_TLS_DEBUG_LOW, "TLS: tls_process: killed expiring key");
     }
 
+    if (ks->state < S_ACTIVE)
+    {
+        key_state_alloc_buffers(ks, &session->opt->frame);
+    }
+
     do
     {
         update_time();
@@ -2709,6 +2846,12 @@ tls_process(struct tls_multi *multi,
 
         state_change = false;
 
+        /* nothing to do on a settled key state, see below */
+        if (!key_state_has_buffers(ks))
+        {
+            break;
+        }
+
         /*
          * TLS activity is finished once we get to S_ACTIVE,
          * though we will still process acknowledgements.
@@ -2988,6 +3131,12 @@ tls_process(struct tls_multi *multi,
         dmsg(D_TLS_DEBUG, "Dedicated ACK -> TCP/UDP");
     }
 
+    /* Drop the buffers of a settled key state until it is used again */
+    if (!to_link->len)
+    {
+        key_state_release_buffers(ks);
+    }
+
     /* When should we wake up again? */
     {
         if (ks->state >= S_INITIAL)
@@ -3680,6 +3829,11 @@ tls_pre_decrypt(struct tls_multi *multi,
         reliable_send_purge(ks->send_reliable, &send_ack);
     }
 
+    if (op != P_ACK_V1)
+    {
+        key_state_alloc_buffers(ks, &session->opt->frame);
+    }
+
     if (op != P_ACK_V1 && reliable_can_get(ks->rec_reliable))
     {
         packet_id_type id;
@@ -3952,6 +4106,8 @@ tls_send_payload(struct tls_multi *multi,
 
     if (ks->state >= S_ACTIVE)
     {
+        /* the ciphertext is picked up by tls_process() */
+        key_state_alloc_buffers(ks, &multi->opt.frame);
         if (key_state_write_plaintext_const(&ks->ks_ssl, data, size) == 1)
         {
             ret = true;
@@ -232,6 +232,32 @@ void tls_multi_init_set_options(struct tls_multi *multi,
  */
 void tls_multi_free(struct tls_multi *multi, bool clear);
 
+/**
+ * Return the number of bytes held by the control channel buffers of a
+ * \c tls_multi structure.  Memory held by the TLS library is not
+ * included.
+ *
+ * @param multi        - The \c tls_multi structure to inspect.
+ */
+int tls_multi_buffer_bytes(const struct tls_multi *multi);
+
+/**
+ * Return the number of bytes of a \c tls_multi structure and of the
+ * reliability layer and key source structures of its key states.
+ *
+ * @param multi        - The \c tls_multi structure to inspect.
+ */
+int tls_multi_state_bytes(const struct tls_multi *multi);
+
+/**
+ * Return the number of bytes held by the crypto contexts and the replay
+ * windows of the key states of a \c tls_multi structure, and of its
+ * control channel wrapping where that is not shared between clients.
+ *
+ * @param multi        - The \c tls_multi structure to inspect.
+ */
+int tls_multi_crypto_bytes(const struct tls_multi *multi);
+
 /** @} name Functions for initialization and cleanup of tls_multi structures */
 
 /** @} addtogroup control_processor */
@@ -539,6 +565,34 @@ tls_initial_packet_received(const struct tls_multi *multi)
     return multi->n_sessions > 0;
 }
 
+/*
+ * True once every key state in use is active and fully authenticated.
+ * tls_multi_process() then has nothing to do until one of the
+ * deadlines it reported through its wakeup, or until the next packet.
+ */
+static inline bool
+tls_multi_settled(const struct tls_multi *multi)
+{
+    if (multi->multi_state != CAS_CONNECT_DONE)
+    {
+        return false;
+    }
+    for (int i = 0; i < TM_SIZE; ++i)
+    {
+        for (int j = 0; j < KS_SIZE; ++j)
+        {
+            const struct key_state *ks = &multi->session[i].key[j];
+            if (ks->state >= S_INITIAL
+                && (ks->state < S_ACTIVE || ks->authenticated != KS_AUTH_TRUE)
+                && link_socket_actual_defined(&ks->remote_addr))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 static inline int
 tls_test_payload_len(const struct tls_multi *multi)
 {
@@ -378,6 +378,15 @@ void key_state_ssl_init(struct key_state_ssl *ks_ssl,
  */
 void key_state_ssl_free(struct key_state_ssl *ks_ssl);
 
+/**
+ * Release memory held by the SSL channel which is not needed while no
+ * data is exchanged over it.  Only called when all ciphertext has been
+ * read from the channel.
+ *
+ * @param ks_ssl        The SSL channel's state info
+ */
+void key_state_ssl_release_buffers(struct key_state_ssl *ks_ssl);
+
 /**
  * Reload the Certificate Revocation List for the SSL channel
  *
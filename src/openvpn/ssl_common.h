@@ -150,6 +150,12 @@ struct auth_deferred_status
     char *auth_control_file;
     char *auth_pending_file;
     unsigned int auth_control_status;
+#ifndef _WIN32
+    unsigned int child_job;     /**< job id of the asynchronously running
+                                 *   --auth-user-pass-verify script, 0 if none */
+    char *child_tmp_file;       /**< via-file credentials of \c child_job,
+                                 *   removed once the script has exited */
+#endif
 };
 
 /* key_state_test_auth_control_file return values, these specify the
@@ -1203,6 +1203,12 @@ key_state_ssl_free(struct key_state_ssl *ks_ssl)
     }
 }
 
+void
+key_state_ssl_release_buffers(struct key_state_ssl *ks_ssl)
+{
+    /* the ciphertext queues of bio_ctx are freed as they are read */
+}
+
 int
 key_state_write_plaintext(struct key_state_ssl *ks, struct buffer *buf)
 {
@@ -1925,6 +1925,27 @@ key_state_ssl_free(struct key_state_ssl *ks_ssl)
     }
 }
 
+void
+key_state_ssl_release_buffers(struct key_state_ssl *ks_ssl)
+{
+    BUF_MEM *in, *out;
+
+    /*
+     * A memory BIO keeps the largest buffer it ever needed, which is
+     * that of a whole handshake flight, so give the empty ones new
+     * buffers.  Setting a buffer frees the old one.
+     */
+    if (BIO_pending(ks_ssl->ct_in) || BIO_pending(ks_ssl->ct_out))
+    {
+        return;
+    }
+
+    ASSERT((in = BUF_MEM_new()));
+    ASSERT((out = BUF_MEM_new()));
+    BIO_set_mem_buf(ks_ssl->ct_in, in, BIO_CLOSE);
+    BIO_set_mem_buf(ks_ssl->ct_out, out, BIO_CLOSE);
+}
+
 int
 key_state_write_plaintext(struct key_state_ssl *ks_ssl, struct buffer *buf)
 {
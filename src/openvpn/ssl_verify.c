@@ -990,6 +990,73 @@ key_state_check_auth_pending_file(struct auth_deferred_status *ads,
 }
 
 
+#ifndef _WIN32
+/**
+ *  Forgets about an asynchronously running auth script and removes
+ *  its via-file credentials
+ */
+static void
+key_state_rm_auth_child(struct auth_deferred_status *ads)
+{
+    if (ads->child_job)
+    {
+        openvpn_execve_async_abandon(ads->child_job);
+        ads->child_job = 0;
+    }
+    if (ads->child_tmp_file)
+    {
+        platform_unlink(ads->child_tmp_file);
+        free(ads->child_tmp_file);
+        ads->child_tmp_file = NULL;
+    }
+}
+
+/**
+ *  Checks if an asynchronously started --auth-user-pass-verify script
+ *  has exited and translates its exit code into the deferred status.
+ *  An exit code of 2 means the script deferred the decision itself, in
+ *  which case we keep waiting for the auth control file.
+ */
+static void
+key_state_check_auth_child(struct auth_deferred_status *ads,
+                           struct tls_multi *multi)
+{
+    int script_ret;
+
+    if (!ads->child_job
+        || !openvpn_execve_async_check(ads->child_job, S_SCRIPT|S_EXITCODE,
+                                       "WARNING: Failed running command "
+                                       "(--auth-user-pass-verify)",
+                                       &script_ret))
+    {
+        return;
+    }
+    ads->child_job = 0;
+    key_state_rm_auth_child(ads);
+
+    switch (script_ret)
+    {
+        case 0:
+            ads->auth_control_status = ACF_SUCCEEDED;
+            break;
+
+        case 2:
+            if (!key_state_check_auth_pending_file(ads, multi))
+            {
+                ads->auth_control_status = ACF_FAILED;
+            }
+            break;
+
+        default:
+            ads->auth_control_status = ACF_FAILED;
+            break;
+    }
+    msg(D_HANDSHAKE, "TLS: asynchronous --auth-user-pass-verify script %s",
+        ads->auth_control_status == ACF_SUCCEEDED ? "succeeded"
+        : ads->auth_control_status == ACF_FAILED ? "failed" : "deferred");
+}
+#endif /* ifndef _WIN32 */
+
 /**
  *  Removes auth_pending and auth_control files from file system
  *  and key_state structure
@@ -1004,6 +1071,9 @@ key_state_rm_auth_control_files(struct auth_deferred_status *ads)
         ads->auth_control_file = NULL;
     }
     key_state_rm_auth_pending_file(ads);
+#ifndef _WIN32
+    key_state_rm_auth_child(ads);
+#endif
 }
 
 /**
@@ -1079,9 +1149,11 @@ key_state_test_auth_control_file(struct auth_deferred_status *ads, bool cached)
  * @param cached    If auth control files should be tried to be opened or th
  *                  cached results should be used
  * @param ks        The key_state to update
+ * @param multi     The tls_multi the key_state belongs to
  */
 static void
-update_key_auth_status(bool cached, struct key_state *ks)
+update_key_auth_status(bool cached, struct key_state *ks,
+                       struct tls_multi *multi)
 {
     if (ks->authenticated == KS_AUTH_FALSE)
     {
@@ -1092,6 +1164,9 @@ update_key_auth_status(bool cached, struct key_state *ks)
         enum auth_deferred_result auth_plugin = ACF_DISABLED;
         enum auth_deferred_result auth_script = ACF_DISABLED;
         enum auth_deferred_result auth_man = ACF_DISABLED;
+#ifndef _WIN32
+        key_state_check_auth_child(&ks->script_auth, multi);
+#endif
         auth_plugin = key_state_test_auth_control_file(&ks->plugin_auth, cached);
         auth_script = key_state_test_auth_control_file(&ks->script_auth, cached);
 #ifdef ENABLE_MANAGEMENT
@@ -1169,7 +1244,7 @@ tls_authentication_status(struct tls_multi *multi)
         if (TLS_AUTHENTICATED(multi, ks))
         {
             active++;
-            update_key_auth_status(cached, ks);
+            update_key_auth_status(cached, ks, multi);
 
             if (ks->authenticated == KS_AUTH_FALSE)
             {
@@ -1316,6 +1391,25 @@ verify_user_pass_script(struct tls_session *session, struct tls_multi *multi,
         return OPENVPN_PLUGIN_FUNC_ERROR;
     }
 
+#ifndef _WIN32
+    /* try to run the script without blocking the server, the result is
+     * picked up by key_state_check_auth_child() */
+    const unsigned int job = openvpn_execve_async(&argv, session->opt->es,
+                                                  S_SCRIPT|S_EXITCODE,
+                                                  "--auth-user-pass-verify");
+    if (job)
+    {
+        ks->script_auth.child_job = job;
+        if (tmp_file && strlen(tmp_file) > 0)
+        {
+            ks->script_auth.child_tmp_file = string_alloc(tmp_file, NULL);
+            tmp_file = NULL;
+        }
+        retval = OPENVPN_PLUGIN_FUNC_DEFERRED;
+        goto deferred;
+    }
+#endif
+
     /* call command */
     int script_ret = openvpn_run_script(&argv, session->opt->es, S_EXITCODE,
                                         "--auth-user-pass-verify");
@@ -1348,6 +1442,9 @@ verify_user_pass_script(struct tls_session *session, struct tls_multi *multi,
         /* purge auth control filename (and file itself) for non-deferred returns */
         key_state_rm_auth_control_files(&ks->script_auth);
     }
+#ifndef _WIN32
+deferred:
+#endif
     if (!session->opt->auth_user_pass_verify_script_via_file)
     {
         setenv_del(session->opt->es, "password");
@@ -1729,15 +1826,17 @@ verify_final_auth_checks(struct tls_multi *multi, struct tls_session *session)
 void
 tls_x509_clear_env(struct env_set *es)
 {
-    struct env_item *item = es->list;
-    while (item)
+    int i = 0;
+    while (i < es->count)
     {
-        struct env_item *next = item->next;
-        if (item->string
-            && 0 == strncmp("X509_", item->string, strlen("X509_")))
+        if (0 == strncmp("X509_", es->envp[i], strlen("X509_")))
+        {
+            /* removal shifts the following strings down */
+            env_set_del(es, es->envp[i]);
+        }
+        else
         {
-            env_set_del(es, item->string);
+            ++i;
         }
-        item = next;
     }
 }
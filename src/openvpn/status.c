@@ -40,6 +40,9 @@
  * printf-style interface for outputting status info
  */
 
+/* output is written to the file in chunks of up to this size */
+#define STATUS_WRITE_BUF_SIZE 16384
+
 static const char *
 print_status_mode(unsigned int flags)
 {
@@ -74,7 +77,11 @@ status_open(const char *filename,
         so->msglevel = msglevel;
         so->vout = vout;
         so->fd = -1;
+#ifndef _WIN32
+        so->replace_fd = -1;
+#endif
         buf_reset(&so->read_buf);
+        buf_reset(&so->write_buf);
         event_timeout_clear(&so->et);
         if (filename)
         {
@@ -111,6 +118,12 @@ status_open(const char *filename,
                 {
                     so->read_buf = alloc_buf(512);
                 }
+
+                /* allocate write buffer */
+                if (so->flags & STATUS_OUTPUT_WRITE)
+                {
+                    so->write_buf = alloc_buf(STATUS_WRITE_BUF_SIZE);
+                }
             }
             else
             {
@@ -146,20 +159,117 @@ status_trigger(struct status_output *so)
     }
 }
 
+static int
+status_write_fd(const struct status_output *so)
+{
+#ifndef _WIN32
+    if (so->replace_fd >= 0)
+    {
+        return so->replace_fd;
+    }
+#endif
+    return so->fd;
+}
+
+/* write buffered output to the file */
+static void
+status_write_pending(struct status_output *so)
+{
+    const int fd = status_write_fd(so);
+
+    if (BLEN(&so->write_buf) > 0)
+    {
+        if (fd >= 0 && !so->errors
+            && write(fd, BPTR(&so->write_buf), BLEN(&so->write_buf)) != BLEN(&so->write_buf))
+        {
+            so->errors = true;
+        }
+        buf_clear(&so->write_buf);
+    }
+}
+
 void
 status_reset(struct status_output *so)
 {
     if (so && so->fd >= 0)
     {
+        status_write_pending(so);
         lseek(so->fd, (off_t)0, SEEK_SET);
     }
 }
 
+void
+status_begin_replace(struct status_output *so)
+{
+#ifndef _WIN32
+    if (so && so->fd >= 0 && so->flags == STATUS_OUTPUT_WRITE
+        && !so->replace_disabled)
+    {
+        struct gc_arena gc = gc_new();
+        struct buffer name = alloc_buf_gc(strlen(so->filename) + 5, &gc);
+
+        status_write_pending(so);
+        if (so->replace_fd >= 0)
+        {
+            /* previous replacement abandoned */
+            close(so->replace_fd);
+        }
+        buf_printf(&name, "%s.tmp", so->filename);
+        so->replace_fd = platform_open(BSTR(&name), O_CREAT | O_TRUNC | O_WRONLY,
+                                       S_IRUSR | S_IWUSR);
+        if (so->replace_fd >= 0)
+        {
+            set_cloexec(so->replace_fd);
+            free(so->replace_filename);
+            so->replace_filename = string_alloc(BSTR(&name), NULL);
+            gc_free(&gc);
+            return;
+        }
+        msg(M_WARN | M_ERRNO, "Note: cannot open %s for WRITE, "
+            "the status file will be rewritten in place", BSTR(&name));
+        so->replace_disabled = true;
+        gc_free(&gc);
+    }
+#endif /* ifndef _WIN32 */
+    status_reset(so);
+}
+
+/* move the file written since status_begin_replace() into place */
+static void
+status_finish_replace(struct status_output *so)
+{
+#ifndef _WIN32
+    if (so->replace_fd >= 0)
+    {
+        if (!so->errors && rename(so->replace_filename, so->filename) == 0)
+        {
+            close(so->fd);
+            so->fd = so->replace_fd;
+        }
+        else
+        {
+            if (!so->errors)
+            {
+                msg(M_WARN | M_ERRNO, "Failed to replace status file %s, "
+                    "it will be rewritten in place", so->filename);
+                so->replace_disabled = true;
+            }
+            close(so->replace_fd);
+            platform_unlink(so->replace_filename);
+        }
+        so->replace_fd = -1;
+    }
+#endif
+}
+
 void
 status_flush(struct status_output *so)
 {
     if (so && so->fd >= 0 && (so->flags & STATUS_OUTPUT_WRITE))
     {
+        status_write_pending(so);
+        status_finish_replace(so);
+
 #if defined(HAVE_FTRUNCATE)
         {
             const off_t off = lseek(so->fd, (off_t)0, SEEK_CUR);
@@ -192,6 +302,10 @@ status_close(struct status_output *so)
     bool ret = true;
     if (so)
     {
+        if (so->fd >= 0)
+        {
+            status_write_pending(so);
+        }
         if (so->errors)
         {
             ret = false;
@@ -203,12 +317,25 @@ status_close(struct status_output *so)
                 ret = false;
             }
         }
+#ifndef _WIN32
+        if (so->replace_fd >= 0)
+        {
+            /* abandoned before status_flush() */
+            close(so->replace_fd);
+            platform_unlink(so->replace_filename);
+        }
+        free(so->replace_filename);
+#endif
         free(so->filename);
 
         if (buf_defined(&so->read_buf))
         {
             free_buf(&so->read_buf);
         }
+        if (buf_defined(&so->write_buf))
+        {
+            free_buf(&so->write_buf);
+        }
         free(so);
     }
     else
@@ -249,13 +376,11 @@ status_printf(struct status_output *so, const char *format, ...)
             int len;
             strcat(buf, "\n");
             len = strlen(buf);
-            if (len > 0)
+            if (len > buf_forward_capacity(&so->write_buf))
             {
-                if (write(so->fd, buf, len) != len)
-                {
-                    so->errors = true;
-                }
+                status_write_pending(so);
             }
+            buf_write(&so->write_buf, buf, len);
         }
 
         if (so->vout && !so->errors)
@@ -57,6 +57,13 @@ struct status_output
     const struct virtual_output *vout;
 
     struct buffer read_buf;
+    struct buffer write_buf;    /* output not yet written to fd */
+
+#ifndef _WIN32
+    char *replace_filename;     /* temporary file used by status_begin_replace() */
+    int replace_fd;
+    bool replace_disabled;      /* the file cannot be replaced, write in place */
+#endif
 
     struct event_timeout et;
 
@@ -73,6 +80,16 @@ bool status_trigger(struct status_output *so);
 
 void status_reset(struct status_output *so);
 
+/**
+ * Like status_reset(), but write the new contents to a temporary file
+ * that atomically replaces the file in status_flush(), so that readers
+ * never see a partially written file.  This allows writing the contents
+ * over a longer period of time.  If the temporary file cannot be created
+ * or renamed, e.g. after dropping privileges, this warns once and then
+ * behaves like status_reset().
+ */
+void status_begin_replace(struct status_output *so);
+
 void status_flush(struct status_output *so);
 
 bool status_close(struct status_output *so);
@@ -550,4 +550,11 @@ socket_defined(const socket_descriptor_t sd)
 #define ENABLE_MEMSTATS
 #endif
 
+/*
+ * Enable --event-log option
+ */
+#ifdef TARGET_LINUX
+#define ENABLE_EVENT_LOG
+#endif
+
 #endif /* ifndef SYSHEAD_H */
@@ -0,0 +1,352 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include "wheel.h"
+
+#include "memdbg.h"
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+static inline bool
+wheel_list_empty(const struct wheel_entry *head)
+{
+    return head->next == head;
+}
+
+static inline void
+wheel_bit_set(uint32_t *map, int i)
+{
+    map[i >> 5] |= (uint32_t) 1 << (i & 31);
+}
+
+static inline void
+wheel_bit_clear(uint32_t *map, int i)
+{
+    map[i >> 5] &= ~((uint32_t) 1 << (i & 31));
+}
+
+/* return the first bit set in map at or after i, or -1 */
+static int
+wheel_bit_find(const uint32_t *map, int i)
+{
+    while (i < WHEEL_SLOTS)
+    {
+        uint32_t word = map[i >> 5] >> (i & 31);
+        if (word)
+        {
+            while (!(word & 1))
+            {
+                word >>= 1;
+                ++i;
+            }
+            return i;
+        }
+        i = (i | 31) + 1;
+    }
+    return -1;
+}
+
+/* put e, which expires no earlier than the cursor, in its list */
+static void
+wheel_link(struct wheel *w, struct wheel_entry *e)
+{
+    const time_t round = e->expire / WHEEL_SLOTS;
+    const time_t current = w->cursor / WHEEL_SLOTS;
+    struct wheel_entry *head;
+
+    if (round == current)
+    {
+        const int i = (int) (e->expire & WHEEL_MASK);
+        head = &w->slots[i];
+        wheel_bit_set(w->slots_used, i);
+    }
+    else if (round - current < WHEEL_SLOTS)
+    {
+        const int i = (int) (round & WHEEL_MASK);
+        head = &w->rounds[i];
+        wheel_bit_set(w->rounds_used, i);
+    }
+    else
+    {
+        head = &w->later;
+        if (wheel_list_empty(head) || e->expire < w->later_min)
+        {
+            w->later_min = e->expire;
+        }
+    }
+
+    e->next = head->next;
+    e->prev = head;
+    head->next->prev = e;
+    head->next = e;
+}
+
+static void
+wheel_unlink(struct wheel *w, struct wheel_entry *e)
+{
+    struct wheel_entry *head = e->prev;
+
+    e->prev->next = e->next;
+    e->next->prev = e->prev;
+    e->next = e->prev = NULL;
+
+    /* only a list head is left pointing at itself */
+    if (wheel_list_empty(head))
+    {
+        if (head >= w->slots && head < w->slots + WHEEL_SLOTS)
+        {
+            wheel_bit_clear(w->slots_used, (int) (head - w->slots));
+        }
+        else if (head >= w->rounds && head < w->rounds + WHEEL_SLOTS)
+        {
+            wheel_bit_clear(w->rounds_used, (int) (head - w->rounds));
+        }
+    }
+}
+
+/* move all entries of list src to the end of list dest */
+static void
+wheel_splice(struct wheel_entry *dest, struct wheel_entry *src)
+{
+    if (!wheel_list_empty(src))
+    {
+        src->next->prev = dest->prev;
+        src->prev->next = dest;
+        dest->prev->next = src->next;
+        dest->prev = src->prev;
+        src->next = src->prev = src;
+    }
+}
+
+/* put the entries of list, which is not on the wheel, where they belong */
+static void
+wheel_relink(struct wheel *w, struct wheel_entry *list)
+{
+    while (!wheel_list_empty(list))
+    {
+        struct wheel_entry *e = list->next;
+
+        wheel_unlink(w, e);
+        if (e->expire < w->cursor)
+        {
+            e->expire = w->cursor;
+        }
+        wheel_link(w, e);
+    }
+}
+
+/* the cursor has moved to the first second of a new round */
+static void
+wheel_turn(struct wheel *w)
+{
+    const time_t round = w->cursor / WHEEL_SLOTS;
+    const int i = (int) (round & WHEEL_MASK);
+    struct wheel_entry list;
+
+    list.next = list.prev = &list;
+    wheel_splice(&list, &w->rounds[i]);
+    wheel_bit_clear(w->rounds_used, i);
+
+    /* the last of the following rounds has just come into reach */
+    if (!wheel_list_empty(&w->later)
+        && w->later_min / WHEEL_SLOTS - round < WHEEL_SLOTS)
+    {
+        wheel_splice(&list, &w->later);
+    }
+    wheel_relink(w, &list);
+}
+
+/*
+ * Move the cursor to t after a sleep of more than a round.  Entries
+ * which have expired meanwhile are due at t.
+ */
+static void
+wheel_rebase(struct wheel *w, time_t t)
+{
+    struct wheel_entry list;
+    int i;
+
+    list.next = list.prev = &list;
+    for (i = 0; i < WHEEL_SLOTS; ++i)
+    {
+        wheel_splice(&list, &w->slots[i]);
+        wheel_splice(&list, &w->rounds[i]);
+    }
+    wheel_splice(&list, &w->later);
+    CLEAR(w->slots_used);
+    CLEAR(w->rounds_used);
+
+    w->cursor = t;
+    w->next = 0;
+    wheel_relink(w, &list);
+}
+
+void
+wheel_init(struct wheel *w)
+{
+    int i;
+
+    CLEAR(*w);
+    for (i = 0; i < WHEEL_SLOTS; ++i)
+    {
+        w->slots[i].next = w->slots[i].prev = &w->slots[i];
+        w->rounds[i].next = w->rounds[i].prev = &w->rounds[i];
+    }
+    w->later.next = w->later.prev = &w->later;
+    w->cursor = now;
+}
+
+void
+wheel_add(struct wheel *w, struct wheel_entry *e, time_t expire)
+{
+    /* the slots before the cursor are not looked at again */
+    if (expire < w->cursor)
+    {
+        expire = w->cursor;
+    }
+    if (wheel_entry_defined(e))
+    {
+        if (e->expire == expire)
+        {
+            return;
+        }
+        wheel_remove(w, e);
+    }
+
+    e->expire = expire;
+    wheel_link(w, e);
+    if (w->n++ && w->next && expire < w->next)
+    {
+        w->next = expire;
+    }
+}
+
+void
+wheel_remove(struct wheel *w, struct wheel_entry *e)
+{
+    if (wheel_entry_defined(e))
+    {
+        if (e->expire == w->next)
+        {
+            w->next = 0;
+        }
+        wheel_unlink(w, e);
+        --w->n;
+    }
+}
+
+struct wheel_entry *
+wheel_expired(struct wheel *w, time_t t)
+{
+    if (!w->n)
+    {
+        if (t > w->cursor)
+        {
+            w->cursor = t;
+        }
+        return NULL;
+    }
+
+    if (t - w->cursor >= WHEEL_SLOTS)
+    {
+        wheel_rebase(w, t);
+    }
+
+    while (true)
+    {
+        const time_t base = w->cursor & ~(time_t) WHEEL_MASK;
+        const int i = wheel_bit_find(w->slots_used, (int) (w->cursor & WHEEL_MASK));
+
+        if (i >= 0 && base + i <= t)
+        {
+            w->cursor = base + i;
+            return w->slots[i].next;
+        }
+        if (t < base + WHEEL_SLOTS)
+        {
+            if (t > w->cursor)
+            {
+                w->cursor = t;
+            }
+            return NULL;
+        }
+        w->cursor = base + WHEEL_SLOTS;
+        wheel_turn(w);
+    }
+}
+
+/* return the earliest expiry in list, which is not empty */
+static time_t
+wheel_list_min(const struct wheel_entry *list)
+{
+    const struct wheel_entry *e = list->next;
+    time_t ret = e->expire;
+
+    for (e = e->next; e != list; e = e->next)
+    {
+        if (e->expire < ret)
+        {
+            ret = e->expire;
+        }
+    }
+    return ret;
+}
+
+time_t
+wheel_next(struct wheel *w)
+{
+    int i;
+
+    if (!w->n)
+    {
+        return 0;
+    }
+    if (w->next)
+    {
+        return w->next;
+    }
+
+    i = wheel_bit_find(w->slots_used, (int) (w->cursor & WHEEL_MASK));
+    if (i >= 0)
+    {
+        w->next = (w->cursor & ~(time_t) WHEEL_MASK) + i;
+        return w->next;
+    }
+
+    /* the following rounds, in order from the next one */
+    i = wheel_bit_find(w->rounds_used, (int) ((w->cursor / WHEEL_SLOTS + 1) & WHEEL_MASK));
+    if (i < 0)
+    {
+        i = wheel_bit_find(w->rounds_used, 0);
+    }
+    w->next = wheel_list_min(i >= 0 ? &w->rounds[i] : &w->later);
+    return w->next;
+}
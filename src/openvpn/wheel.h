@@ -0,0 +1,98 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef WHEEL_H
+#define WHEEL_H
+
+/*
+ * A timer wheel with one second slots.
+ *
+ * The server keeps instances whose next wakeup is at least a second
+ * away, which is almost always the case for idle clients waiting on
+ * keepalive, inactivity or renegotiation deadlines, on the wheel
+ * instead of in the treap of schedule.h.  Adding, moving and removing
+ * an entry is O(1).
+ *
+ * Only entries of the current round of WHEEL_SLOTS seconds are kept
+ * in the slots, so a non-empty slot is always due at its second.
+ * Entries of the following rounds wait in one list per round, and
+ * entries further away than that in a single overflow list; they
+ * move into the slots when their round begins.  The earliest expiry
+ * is cached, so neither wheel_expired() nor wheel_next() has to look
+ * at entries which are not due.
+ */
+
+#include "otime.h"
+#include "error.h"
+
+#define WHEEL_SLOTS 256         /* power of 2, multiple of 32 */
+
+struct wheel_entry
+{
+    struct wheel_entry *next;
+    struct wheel_entry *prev;   /* NULL if not on a wheel */
+    time_t expire;
+};
+
+struct wheel
+{
+    struct wheel_entry slots[WHEEL_SLOTS];  /* seconds of the current round */
+    struct wheel_entry rounds[WHEEL_SLOTS]; /* the following rounds */
+    struct wheel_entry later;               /* everything after those */
+    uint32_t slots_used[WHEEL_SLOTS / 32];  /* bit set if list not empty */
+    uint32_t rounds_used[WHEEL_SLOTS / 32];
+    time_t later_min;           /* no entry of later expires before this */
+    time_t cursor;              /* earlier slots have been emptied */
+    time_t next;                /* earliest expiry, 0 if not known */
+    int n;
+};
+
+void wheel_init(struct wheel *w);
+
+/*
+ * Add e, or move it if it is already on the wheel, to expire at
+ * second expire.
+ */
+void wheel_add(struct wheel *w, struct wheel_entry *e, time_t expire);
+
+void wheel_remove(struct wheel *w, struct wheel_entry *e);
+
+/*
+ * Return an entry which has expired at second t, or NULL.  The entry
+ * stays on the wheel until the caller moves or removes it.
+ */
+struct wheel_entry *wheel_expired(struct wheel *w, time_t t);
+
+/*
+ * Return the second at which the earliest entry expires, or 0 if the
+ * wheel is empty.  Call it after wheel_expired() has returned NULL.
+ */
+time_t wheel_next(struct wheel *w);
+
+static inline bool
+wheel_entry_defined(const struct wheel_entry *e)
+{
+    return e->prev != NULL;
+}
+
+#endif /* ifndef WHEEL_H */
@@ -898,31 +898,26 @@ env_block(const struct env_set *es)
 
     if (es)
     {
-        struct env_item *e;
         char *ret;
         char *p;
-        size_t nchars = 1;
+        size_t nchars = 1 + es->len - es->garbage;
         bool path_seen = false;
 
-        for (e = es->list; e != NULL; e = e->next)
-        {
-            nchars += strlen(e->string) + 1;
-        }
-
         nchars += strlen(force_path)+1;
 
         ret = (char *) malloc(nchars);
         check_malloc_return(ret);
 
         p = ret;
-        for (e = es->list; e != NULL; e = e->next)
+        for (int i = 0; i < es->count; ++i)
         {
-            if (env_allowed(e->string))
+            const char *str = es->envp[i];
+            if (env_allowed(str))
             {
-                strcpy(p, e->string);
-                p += strlen(e->string) + 1;
+                strcpy(p, str);
+                p += strlen(str) + 1;
             }
-            if (strncmp(e->string, "PATH=", 5 ) == 0)
+            if (strncmp(str, "PATH=", 5 ) == 0)
             {
                 path_seen = true;
             }
@@ -0,0 +1,794 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * End-to-end load generator, run by "make load-test".
+ *
+ * Starts an openvpn server and N clients on the loopback interface, all
+ * of them separate processes running the real binary, and reports the
+ * handshake rate, the server memory per client, and the throughput and
+ * round trip times of ICMP echo requests sent through every tunnel.
+ * Loss and reordering are injected with --gremlin, so the binary must
+ * be built with --enable-debug (the default).
+ *
+ * The clients run with --ifconfig-noexec, so their tun devices have no
+ * address.  The echo requests are written to the client tun devices and
+ * the replies read back with packet sockets, while the server tun device
+ * is configured and answered by the kernel.  This needs root and Linux.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+
+#define SKIP 77
+
+#define SERVER_NET   "10.231.0.0"
+#define SERVER_MASK  "255.255.0.0"
+#define SERVER_ADDR  0x0ae70001 /* 10.231.0.1 */
+#define SERVER_DEV   "ovls0"
+
+#define WINDOW_MAX   256        /* outstanding echo requests per client */
+#define RTT_MAX      (1 << 20)  /* round trip samples kept */
+#define LOSS_TIMEOUT 1.0        /* seconds before a request is lost */
+
+struct client
+{
+    pid_t pid;
+    char dev[IFNAMSIZ];
+    char log[256];
+    in_addr_t addr;             /* network order, 0 until connected */
+    double connected;           /* seconds since the clients started */
+    int fd;                     /* packet socket on dev */
+    int ifindex;
+    uint16_t seq;
+    int outstanding;
+    double sent_at[WINDOW_MAX];
+    bool pending[WINDOW_MAX];
+};
+
+static struct
+{
+    const char *openvpn;
+    const char *keys;
+    int n_clients;
+    int duration;
+    int gremlin;
+    int size;
+    int window;
+    int port;
+    const char *proto;
+    bool keep;
+} opt = {
+    .openvpn = "../src/openvpn/openvpn",
+    .keys = "../sample/sample-keys",
+    .n_clients = 10,
+    .duration = 10,
+    .size = 100,
+    .window = 8,
+    .port = 11940,
+    .proto = "udp",
+};
+
+static char workdir[] = "/tmp/ovload.XXXXXX";
+static char server_log[256];
+static pid_t server_pid;
+static struct client *clients;
+
+static double
+now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static pid_t
+spawn(const char *log, char *const argv[])
+{
+    const pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        const int fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd >= 0)
+        {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+/* return true if file contains str, and copy the rest of that line */
+static bool
+log_contains(const char *file, const char *str, char *rest, size_t size)
+{
+    char line[2048];
+    bool found = false;
+    FILE *fp = fopen(file, "r");
+
+    if (!fp)
+    {
+        return false;
+    }
+    while (!found && fgets(line, sizeof(line), fp))
+    {
+        const char *p = strstr(line, str);
+        if (p)
+        {
+            found = true;
+            if (rest)
+            {
+                snprintf(rest, size, "%s", p + strlen(str));
+            }
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+static long
+rss_kb(pid_t pid)
+{
+    char file[64], line[256];
+    long ret = -1;
+    FILE *fp;
+
+    snprintf(file, sizeof(file), "/proc/%d/status", (int)pid);
+    fp = fopen(file, "r");
+    if (!fp)
+    {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (sscanf(line, "VmRSS: %ld", &ret) == 1)
+        {
+            break;
+        }
+    }
+    fclose(fp);
+    return ret;
+}
+
+static void
+cleanup(void)
+{
+    int i;
+
+    for (i = 0; clients && i < opt.n_clients; ++i)
+    {
+        if (clients[i].pid > 0)
+        {
+            kill(clients[i].pid, SIGTERM);
+            waitpid(clients[i].pid, NULL, 0);
+        }
+    }
+    if (server_pid > 0)
+    {
+        kill(server_pid, SIGTERM);
+        waitpid(server_pid, NULL, 0);
+    }
+    if (!opt.keep)
+    {
+        char cmd[64];
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", workdir);
+        if (system(cmd) != 0)
+        {
+            fprintf(stderr, "could not remove %s\n", workdir);
+        }
+    }
+    else
+    {
+        printf("logs kept in %s\n", workdir);
+    }
+}
+
+static void
+start_server(void)
+{
+    char port[16], gremlin[16], ca[256], cert[256], key[256], dh[256];
+    char *argv[64];
+    int n = 0;
+
+    snprintf(server_log, sizeof(server_log), "%s/server.log", workdir);
+    snprintf(port, sizeof(port), "%d", opt.port);
+    snprintf(gremlin, sizeof(gremlin), "%d", opt.gremlin);
+    snprintf(ca, sizeof(ca), "%s/ca.crt", opt.keys);
+    snprintf(cert, sizeof(cert), "%s/server.crt", opt.keys);
+    snprintf(key, sizeof(key), "%s/server.key", opt.keys);
+    snprintf(dh, sizeof(dh), "%s/dh2048.pem", opt.keys);
+
+    argv[n++] = (char *)opt.openvpn;
+    argv[n++] = "--server";
+    argv[n++] = SERVER_NET;
+    argv[n++] = SERVER_MASK;
+    argv[n++] = "--topology";
+    argv[n++] = "subnet";
+    argv[n++] = "--dev";
+    argv[n++] = SERVER_DEV;
+    argv[n++] = "--dev-type";
+    argv[n++] = "tun";
+    argv[n++] = "--local";
+    argv[n++] = "127.0.0.1";
+    argv[n++] = "--port";
+    argv[n++] = port;
+    argv[n++] = "--proto";
+    argv[n++] = strcmp(opt.proto, "tcp") ? "udp" : "tcp-server";
+    argv[n++] = "--ca";
+    argv[n++] = ca;
+    argv[n++] = "--cert";
+    argv[n++] = cert;
+    argv[n++] = "--key";
+    argv[n++] = key;
+    argv[n++] = "--dh";
+    argv[n++] = dh;
+    argv[n++] = "--duplicate-cn";
+    argv[n++] = "--keepalive";
+    argv[n++] = "10";
+    argv[n++] = "60";
+    argv[n++] = "--verb";
+    argv[n++] = "3";
+    if (opt.gremlin)
+    {
+        argv[n++] = "--gremlin";
+        argv[n++] = gremlin;
+    }
+    argv[n] = NULL;
+
+    server_pid = spawn(server_log, argv);
+}
+
+static void
+start_client(struct client *cl, int i)
+{
+    char port[16], gremlin[16], ca[256], cert[256], key[256];
+    char *argv[64];
+    int n = 0;
+
+    snprintf(cl->dev, sizeof(cl->dev), "ovlc%d", i);
+    snprintf(cl->log, sizeof(cl->log), "%s/client%d.log", workdir, i);
+    snprintf(port, sizeof(port), "%d", opt.port);
+    snprintf(gremlin, sizeof(gremlin), "%d", opt.gremlin);
+    snprintf(ca, sizeof(ca), "%s/ca.crt", opt.keys);
+    snprintf(cert, sizeof(cert), "%s/client.crt", opt.keys);
+    snprintf(key, sizeof(key), "%s/client.key", opt.keys);
+
+    argv[n++] = (char *)opt.openvpn;
+    argv[n++] = "--client";
+    argv[n++] = "--remote";
+    argv[n++] = "127.0.0.1";
+    argv[n++] = port;
+    argv[n++] = "--proto";
+    argv[n++] = strcmp(opt.proto, "tcp") ? "udp" : "tcp-client";
+    argv[n++] = "--nobind";
+    argv[n++] = "--dev";
+    argv[n++] = cl->dev;
+    argv[n++] = "--dev-type";
+    argv[n++] = "tun";
+    argv[n++] = "--ifconfig-noexec";
+    argv[n++] = "--route-noexec";
+    argv[n++] = "--ca";
+    argv[n++] = ca;
+    argv[n++] = "--cert";
+    argv[n++] = cert;
+    argv[n++] = "--key";
+    argv[n++] = key;
+    argv[n++] = "--connect-retry";
+    argv[n++] = "1";
+    argv[n++] = "--verb";
+    argv[n++] = "3";
+    if (opt.gremlin)
+    {
+        argv[n++] = "--gremlin";
+        argv[n++] = gremlin;
+    }
+    argv[n] = NULL;
+
+    cl->fd = -1;
+    cl->pid = spawn(cl->log, argv);
+}
+
+/* wait for all clients to connect, return the number connected */
+static int
+wait_clients(double start, double timeout)
+{
+    int connected = 0;
+    int i;
+
+    while (connected < opt.n_clients && now_sec() - start < timeout)
+    {
+        usleep(20000);
+        for (i = 0; i < opt.n_clients; ++i)
+        {
+            struct client *cl = &clients[i];
+            char rest[2048];
+
+            if (cl->connected || !log_contains(cl->log, "Initialization Sequence Completed", NULL, 0))
+            {
+                continue;
+            }
+            cl->connected = now_sec() - start;
+            ++connected;
+
+            if (log_contains(cl->log, "PUSH: Received control message: '", rest, sizeof(rest)))
+            {
+                const char *p = strstr(rest, ",ifconfig ");
+                char addr[32];
+                if (p && sscanf(p, ",ifconfig %31[0-9.]", addr) == 1)
+                {
+                    cl->addr = inet_addr(addr);
+                }
+            }
+        }
+    }
+    return connected;
+}
+
+static uint16_t
+cksum(const void *data, int len)
+{
+    const uint8_t *p = data;
+    uint32_t sum = 0;
+
+    while (len > 1)
+    {
+        sum += (p[0] << 8) | p[1];
+        p += 2;
+        len -= 2;
+    }
+    if (len)
+    {
+        sum += p[0] << 8;
+    }
+    while (sum >> 16)
+    {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return htons((uint16_t)~sum);
+}
+
+static bool
+open_client_socket(struct client *cl)
+{
+    struct sockaddr_ll sll;
+    struct ifreq ifr;
+
+    cl->ifindex = if_nametoindex(cl->dev);
+    cl->fd = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+    if (!cl->ifindex || cl->fd < 0)
+    {
+        return false;
+    }
+
+    /* --ifconfig-noexec leaves the device down */
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", cl->dev);
+    if (ioctl(cl->fd, SIOCGIFFLAGS, &ifr) < 0)
+    {
+        return false;
+    }
+    ifr.ifr_flags |= IFF_UP;
+    if (ioctl(cl->fd, SIOCSIFFLAGS, &ifr) < 0)
+    {
+        return false;
+    }
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_IP);
+    sll.sll_ifindex = cl->ifindex;
+    return bind(cl->fd, (struct sockaddr *)&sll, sizeof(sll)) == 0
+           && fcntl(cl->fd, F_SETFL, O_NONBLOCK) == 0;
+}
+
+static bool
+send_echo(struct client *cl, int id)
+{
+    uint8_t pkt[20 + 8 + 1500];
+    const int len = 20 + 8 + opt.size;
+    const int slot = cl->seq % opt.window;
+    struct sockaddr_ll sll;
+    uint32_t daddr = htonl(SERVER_ADDR);
+
+    if (cl->pending[slot])
+    {
+        return false;
+    }
+
+    memset(pkt, 0, len);
+    pkt[0] = 0x45;
+    pkt[2] = len >> 8;
+    pkt[3] = len & 0xff;
+    pkt[8] = 64;
+    pkt[9] = 1;                 /* ICMP */
+    memcpy(pkt + 12, &cl->addr, 4);
+    memcpy(pkt + 16, &daddr, 4);
+    *(uint16_t *)(pkt + 10) = cksum(pkt, 20);
+
+    pkt[20] = 8;                /* echo request */
+    pkt[24] = id >> 8;
+    pkt[25] = id & 0xff;
+    pkt[26] = cl->seq >> 8;
+    pkt[27] = cl->seq & 0xff;
+    memset(pkt + 28, 0xa5, opt.size);
+    *(uint16_t *)(pkt + 22) = cksum(pkt + 20, len - 20);
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_IP);
+    sll.sll_ifindex = cl->ifindex;
+    if (sendto(cl->fd, pkt, len, 0, (struct sockaddr *)&sll, sizeof(sll)) != len)
+    {
+        return false;
+    }
+
+    cl->sent_at[slot] = now_sec();
+    cl->pending[slot] = true;
+    ++cl->outstanding;
+    ++cl->seq;
+    return true;
+}
+
+static int
+compare_double(const void *a, const void *b)
+{
+    const double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double
+percentile(const double *v, int n, double p)
+{
+    return n ? v[(int)((n - 1) * p)] : 0;
+}
+
+static void
+run_traffic(void)
+{
+    struct pollfd *pfd = calloc(opt.n_clients, sizeof(*pfd));
+    double *rtt = malloc(RTT_MAX * sizeof(*rtt));
+    long sent = 0, received = 0, lost = 0;
+    int n_rtt = 0;
+    int active = 0;
+    double start, end, last_scan;
+    int i;
+
+    if (!pfd || !rtt)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (i = 0; i < opt.n_clients; ++i)
+    {
+        struct client *cl = &clients[i];
+        pfd[i].fd = -1;
+        if (cl->addr && open_client_socket(cl))
+        {
+            pfd[i].fd = cl->fd;
+            pfd[i].events = POLLIN;
+            ++active;
+        }
+    }
+    if (!active)
+    {
+        printf("traffic: no client tunnel could be opened\n");
+        free(pfd);
+        free(rtt);
+        return;
+    }
+
+    start = last_scan = now_sec();
+    end = start + opt.duration;
+    while (now_sec() < end)
+    {
+        double t;
+
+        /* keep every window full */
+        for (i = 0; i < opt.n_clients; ++i)
+        {
+            struct client *cl = &clients[i];
+            while (pfd[i].fd >= 0 && cl->outstanding < opt.window && send_echo(cl, i))
+            {
+                ++sent;
+            }
+        }
+
+        if (poll(pfd, opt.n_clients, 10) < 0 && errno != EINTR)
+        {
+            break;
+        }
+
+        t = now_sec();
+        for (i = 0; i < opt.n_clients; ++i)
+        {
+            struct client *cl = &clients[i];
+            uint8_t pkt[2048];
+            ssize_t len;
+
+            if (pfd[i].fd < 0 || !(pfd[i].revents & POLLIN))
+            {
+                continue;
+            }
+            while ((len = recv(cl->fd, pkt, sizeof(pkt), 0)) > 0)
+            {
+                const int hlen = (pkt[0] & 0x0f) * 4;
+                int seq, slot;
+
+                if (len < hlen + 8 || pkt[9] != 1 || pkt[hlen] != 0
+                    || ((pkt[hlen + 4] << 8) | pkt[hlen + 5]) != i)
+                {
+                    continue;
+                }
+                seq = (pkt[hlen + 6] << 8) | pkt[hlen + 7];
+                slot = seq % opt.window;
+                if (!cl->pending[slot] || (uint16_t)(cl->seq - seq) > opt.window)
+                {
+                    continue;
+                }
+                cl->pending[slot] = false;
+                --cl->outstanding;
+                ++received;
+                if (n_rtt < RTT_MAX)
+                {
+                    rtt[n_rtt++] = t - cl->sent_at[slot];
+                }
+            }
+        }
+
+        /* requests without reply are lost */
+        if (t - last_scan > 0.1)
+        {
+            last_scan = t;
+            for (i = 0; i < opt.n_clients; ++i)
+            {
+                struct client *cl = &clients[i];
+                int s;
+                for (s = 0; s < opt.window; ++s)
+                {
+                    if (cl->pending[s] && t - cl->sent_at[s] > LOSS_TIMEOUT)
+                    {
+                        cl->pending[s] = false;
+                        --cl->outstanding;
+                        ++lost;
+                    }
+                }
+            }
+        }
+    }
+
+    {
+        const double elapsed = now_sec() - start;
+        qsort(rtt, n_rtt, sizeof(*rtt), compare_double);
+        printf("traffic: %d tunnels, %ld requests, %ld replies, %ld lost (%.2f%%)\n",
+               active, sent, received, lost, sent ? 100.0 * lost / sent : 0);
+        printf("throughput: %.0f packets/s, %.2f Mbit/s of payload\n",
+               2 * received / elapsed,
+               2 * received * (double)opt.size * 8 / elapsed / 1e6);
+        printf("round trip: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+               percentile(rtt, n_rtt, 0.50) * 1e3,
+               percentile(rtt, n_rtt, 0.90) * 1e3,
+               percentile(rtt, n_rtt, 0.99) * 1e3,
+               percentile(rtt, n_rtt, 1.0) * 1e3);
+    }
+
+    free(pfd);
+    free(rtt);
+}
+
+static void
+usage(void)
+{
+    printf("usage: loadgen [options]\n"
+           "  --openvpn path  openvpn binary (%s)\n"
+           "  --keys dir      directory of the sample keys (%s)\n"
+           "  --clients n     number of clients (%d)\n"
+           "  --duration s    seconds of traffic (%d)\n"
+           "  --gremlin mask  --gremlin for the server and the clients\n"
+           "  --size n        ICMP payload bytes (%d)\n"
+           "  --window n      outstanding requests per client (%d)\n"
+           "  --port n        server port (%d)\n"
+           "  --proto p       udp or tcp (%s)\n"
+           "  --keep          keep the logs\n",
+           opt.openvpn, opt.keys, opt.n_clients, opt.duration, opt.size,
+           opt.window, opt.port, opt.proto);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const struct option longopts[] = {
+        { "openvpn", required_argument, NULL, 'o' },
+        { "keys", required_argument, NULL, 'k' },
+        { "clients", required_argument, NULL, 'n' },
+        { "duration", required_argument, NULL, 'd' },
+        { "gremlin", required_argument, NULL, 'g' },
+        { "size", required_argument, NULL, 's' },
+        { "window", required_argument, NULL, 'w' },
+        { "port", required_argument, NULL, 'p' },
+        { "proto", required_argument, NULL, 'P' },
+        { "keep", no_argument, NULL, 'K' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    double start;
+    long rss_before, rss_after;
+    int c, i, connected;
+
+    while ((c = getopt_long(argc, argv, "", longopts, NULL)) != -1)
+    {
+        switch (c)
+        {
+            case 'o': opt.openvpn = optarg; break;
+
+            case 'k': opt.keys = optarg; break;
+
+            case 'n': opt.n_clients = atoi(optarg); break;
+
+            case 'd': opt.duration = atoi(optarg); break;
+
+            case 'g': opt.gremlin = atoi(optarg); break;
+
+            case 's': opt.size = atoi(optarg); break;
+
+            case 'w': opt.window = atoi(optarg); break;
+
+            case 'p': opt.port = atoi(optarg); break;
+
+            case 'P': opt.proto = optarg; break;
+
+            case 'K': opt.keep = true; break;
+
+            default:
+                usage();
+                return c == 'h' ? 0 : 1;
+        }
+    }
+    if (opt.n_clients < 1 || opt.n_clients > 1000 || opt.duration < 1
+        || opt.size < 0 || opt.size > 1400
+        || opt.window < 1 || opt.window > WINDOW_MAX)
+    {
+        usage();
+        return 1;
+    }
+
+    if (geteuid() != 0)
+    {
+        printf("loadgen needs root to create tun devices, skipping\n");
+        return SKIP;
+    }
+    if (access(opt.openvpn, X_OK) != 0)
+    {
+        printf("%s not found, skipping\n", opt.openvpn);
+        return SKIP;
+    }
+    if (!mkdtemp(workdir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    clients = calloc(opt.n_clients, sizeof(*clients));
+    if (!clients)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    atexit(cleanup);
+
+    /* server */
+    start_server();
+    start = now_sec();
+    while (!log_contains(server_log, "Initialization Sequence Completed", NULL, 0))
+    {
+        if (now_sec() - start > 10 || waitpid(server_pid, NULL, WNOHANG) != 0)
+        {
+            printf("server failed to start, see %s\n", server_log);
+            opt.keep = true;
+            return 1;
+        }
+        usleep(20000);
+    }
+    rss_before = rss_kb(server_pid);
+
+    /* handshakes */
+    start = now_sec();
+    for (i = 0; i < opt.n_clients; ++i)
+    {
+        start_client(&clients[i], i);
+    }
+    connected = wait_clients(start, 30 + opt.n_clients / 10);
+    {
+        double *t = calloc(opt.n_clients, sizeof(*t));
+        double last = 0;
+        int n = 0;
+
+        for (i = 0; t && i < opt.n_clients; ++i)
+        {
+            if (clients[i].connected)
+            {
+                t[n++] = clients[i].connected;
+                last = clients[i].connected > last ? clients[i].connected : last;
+            }
+        }
+        if (t)
+        {
+            qsort(t, n, sizeof(*t), compare_double);
+        }
+        printf("handshakes: %d/%d clients in %.2f s, %.1f/s, "
+               "connect time p50 %.3f s, p99 %.3f s\n",
+               connected, opt.n_clients, last, last > 0 ? connected / last : 0,
+               t ? percentile(t, n, 0.50) : 0, t ? percentile(t, n, 0.99) : 0);
+        free(t);
+    }
+
+    rss_after = rss_kb(server_pid);
+    if (connected && rss_before > 0 && rss_after > 0)
+    {
+        printf("server memory: %ld kB before, %ld kB after, %.1f kB per client\n",
+               rss_before, rss_after, (double)(rss_after - rss_before) / connected);
+    }
+
+    /* traffic */
+    run_traffic();
+
+    return connected == opt.n_clients ? 0 : 1;
+}
+
+#else  /* ifdef __linux__ */
+
+int
+main(int argc, char *argv[])
+{
+    printf("loadgen is only available on Linux, skipping\n");
+    return 77;
+}
+
+#endif /* ifdef __linux__ */
@@ -0,0 +1,313 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Benchmark of client_nat_transform(), run by "make clinat-bench".
+ *
+ * For each rule count given on the command line, random --client-nat
+ * rules are generated: mostly /32 host rules, some /24 and /16 ones,
+ * snat and dnat.  The packets are TCP, half of them addressed inside a
+ * rule and the other half at random.  Every packet is first checked to
+ * be rewritten exactly as by a linear scan of the rules, which is how
+ * the rules were matched before they were hashed, and then both are
+ * timed.
+ *
+ * Each measurement copies a packet into a work buffer and transforms
+ * it; the copy alone is timed too and reported as the baseline.  The
+ * fastest of several runs is reported, to keep scheduling noise out.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <time.h>
+
+#include "clinat.h"
+#include "socket.h"
+
+#define BENCH_PKT_SIZE 60
+#define BENCH_N_PKTS   4096     /* power of 2 */
+#define BENCH_RUNS     5
+#define BENCH_MIN_TIME 0.2      /* seconds per run */
+
+struct bench_pkt {
+    uint8_t data[BENCH_PKT_SIZE];
+    struct packet_info pi;
+    int direction;
+};
+
+static const unsigned int default_counts[] = { 16, 64, 1000, 10000 };
+
+/* keeps the compiler from dropping the work */
+static volatile uint8_t sink;
+
+/* the linear scan: the first rule which maps addr */
+static const struct client_nat_entry *
+linear_lookup(const struct client_nat_option_list *list, int type, in_addr_t addr,
+              int direction)
+{
+    for (int i = 0; i < list->n; ++i)
+    {
+        const struct client_nat_entry *e = &list->entries[i];
+        if (e->type == type
+            && (addr & e->netmask) == (direction ? e->foreign_network : e->network))
+        {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void
+linear_rewrite(const struct client_nat_entry *e, int direction, uint32_t *addr_ptr,
+               int *accumulate)
+{
+    uint32_t addr = *addr_ptr;
+
+    ADD_CHECKSUM_32(*accumulate, addr);
+    addr = (addr & ~e->netmask) | (direction ? e->network : e->foreign_network);
+    SUB_CHECKSUM_32(*accumulate, addr);
+    *addr_ptr = addr;
+}
+
+/* client_nat_transform() with the hash lookups replaced by linear scans */
+static void
+linear_transform(const struct client_nat_option_list *list, struct buffer *buf,
+                 const struct packet_info *pi, int direction)
+{
+    struct openvpn_iphdr *iph = (struct openvpn_iphdr *) (BPTR(buf) + pi->ip_offset);
+    const struct client_nat_entry *snat, *dnat;
+    int accumulate = 0;
+
+    snat = linear_lookup(list, direction ? CN_DNAT : CN_SNAT, iph->saddr, direction);
+    dnat = linear_lookup(list, direction ? CN_SNAT : CN_DNAT, iph->daddr, direction);
+    if (!snat && !dnat)
+    {
+        return;
+    }
+    if (snat)
+    {
+        linear_rewrite(snat, direction, &iph->saddr, &accumulate);
+    }
+    if (dnat)
+    {
+        linear_rewrite(dnat, direction, &iph->daddr, &accumulate);
+    }
+    ADJUST_CHECKSUM(accumulate, iph->check);
+
+    if (pi->l4_offset && pi->l4_proto == OPENVPN_IPPROTO_TCP
+        && pi->l4_len >= (int) sizeof(struct openvpn_tcphdr))
+    {
+        struct openvpn_tcphdr *tc = (struct openvpn_tcphdr *) (BPTR(buf) + pi->l4_offset);
+        ADJUST_CHECKSUM(accumulate, tc->check);
+    }
+}
+
+static double
+now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static in_addr_t
+random_addr(in_addr_t net)
+{
+    return net | htonl(rand() & 0x3ffff);
+}
+
+static void
+add_random_rules(struct client_nat_option_list *list, unsigned int n)
+{
+    const char *masks[] = { "255.255.255.255", "255.255.255.0", "255.255.0.0" };
+    struct gc_arena gc = gc_new();
+
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        const int m = rand() % 10 ? 0 : 1 + rand() % 2;
+        in_addr_t mask;
+        char network[INET_ADDRSTRLEN], foreign_network[INET_ADDRSTRLEN];
+
+        inet_pton(AF_INET, masks[m], &mask);
+        strcpy(network, print_in_addr_t(random_addr(htonl(0x0a000000)) & mask, 0, &gc));
+        strcpy(foreign_network, print_in_addr_t(random_addr(htonl(0xac100000)) & mask, 0, &gc));
+        add_client_nat_to_option_list(list, (rand() & 1) ? "snat" : "dnat",
+                                      network, masks[m], foreign_network, M_WARN);
+    }
+    gc_free(&gc);
+}
+
+/* an address inside a random rule, or a random one */
+static in_addr_t
+packet_addr(const struct client_nat_option_list *list, int direction)
+{
+    if (rand() & 1)
+    {
+        const struct client_nat_entry *e = &list->entries[rand() % list->n];
+        const in_addr_t net = direction ? e->foreign_network : e->network;
+        return net | (random_addr(0) & ~e->netmask);
+    }
+    return random_addr(htonl((rand() & 1) ? 0x0a000000 : 0xac100000));
+}
+
+static void
+make_packets(struct bench_pkt *pkts, const struct client_nat_option_list *list)
+{
+    for (int i = 0; i < BENCH_N_PKTS; ++i)
+    {
+        struct bench_pkt *p = &pkts[i];
+        const in_addr_t src = packet_addr(list, p->direction = rand() & 1);
+        const in_addr_t dst = packet_addr(list, p->direction);
+        struct buffer buf;
+
+        for (int j = 0; j < BENCH_PKT_SIZE; ++j)
+        {
+            p->data[j] = (uint8_t) rand();
+        }
+        p->data[0] = 0x45;
+        p->data[2] = 0;
+        p->data[3] = BENCH_PKT_SIZE;
+        p->data[6] = p->data[7] = 0;
+        p->data[9] = OPENVPN_IPPROTO_TCP;
+        memcpy(p->data + 12, &src, 4);
+        memcpy(p->data + 16, &dst, 4);
+
+        buf_set_read(&buf, p->data, BENCH_PKT_SIZE);
+        packet_info_parse(&p->pi, DEV_TYPE_TUN, &buf);
+    }
+}
+
+typedef void (*transform_fn)(const struct client_nat_option_list *list,
+                             struct buffer *buf, const struct packet_info *pi,
+                             int direction);
+
+static void
+copy_only(const struct client_nat_option_list *list, struct buffer *buf,
+          const struct packet_info *pi, int direction)
+{
+}
+
+/* returns the number of packets which were changed */
+static int
+check_packets(const struct bench_pkt *pkts, const struct client_nat_option_list *list)
+{
+    int changed = 0;
+
+    for (int i = 0; i < BENCH_N_PKTS; ++i)
+    {
+        uint8_t a[BENCH_PKT_SIZE], b[BENCH_PKT_SIZE];
+        struct buffer ba, bb;
+
+        memcpy(a, pkts[i].data, BENCH_PKT_SIZE);
+        memcpy(b, pkts[i].data, BENCH_PKT_SIZE);
+        buf_set_read(&ba, a, BENCH_PKT_SIZE);
+        buf_set_read(&bb, b, BENCH_PKT_SIZE);
+        client_nat_transform(list, &ba, &pkts[i].pi, pkts[i].direction);
+        linear_transform(list, &bb, &pkts[i].pi, pkts[i].direction);
+        if (memcmp(a, b, BENCH_PKT_SIZE))
+        {
+            fprintf(stderr, "packet %d: hashed and linear lookup differ\n", i);
+            exit(1);
+        }
+        changed += !!memcmp(a, pkts[i].data, BENCH_PKT_SIZE);
+    }
+    return changed;
+}
+
+/* nanoseconds per packet, the fastest of BENCH_RUNS runs */
+static double
+time_transform(transform_fn fn, const struct bench_pkt *pkts,
+               const struct client_nat_option_list *list)
+{
+    double best = 0;
+
+    for (int run = 0; run < BENCH_RUNS; ++run)
+    {
+        const double start = now_sec();
+        double elapsed;
+        long n = 0;
+
+        do
+        {
+            for (int i = 0; i < BENCH_N_PKTS; ++i, ++n)
+            {
+                uint8_t work[BENCH_PKT_SIZE];
+                struct buffer buf;
+
+                memcpy(work, pkts[i].data, BENCH_PKT_SIZE);
+                buf_set_read(&buf, work, BENCH_PKT_SIZE);
+                (*fn)(list, &buf, &pkts[i].pi, pkts[i].direction);
+                sink ^= work[12] ^ work[16];
+            }
+            elapsed = now_sec() - start;
+        } while (elapsed < BENCH_MIN_TIME);
+
+        const double ns = elapsed * 1e9 / n;
+        if (!run || ns < best)
+        {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+int
+main(int argc, char *argv[])
+{
+    static struct bench_pkt pkts[BENCH_N_PKTS];
+    const int n_counts = argc > 1 ? argc - 1 : (int) SIZE(default_counts);
+
+    printf("%8s %8s %10s %10s %10s\n", "rules", "changed", "copy", "hashed", "linear");
+    for (int c = 0; c < n_counts; ++c)
+    {
+        const unsigned int n = argc > 1 ? (unsigned int) atoi(argv[c + 1]) : default_counts[c];
+        struct gc_arena gc = gc_new();
+        struct client_nat_option_list *list = new_client_nat_list(&gc);
+
+        if (!n)
+        {
+            fprintf(stderr, "usage: %s [rules]...\n", argv[0]);
+            return 1;
+        }
+
+        srand(n);
+        add_random_rules(list, n);
+        make_packets(pkts, list);
+
+        const int changed = check_packets(pkts, list);
+        const double copy = time_transform(copy_only, pkts, list);
+        const double hashed = time_transform(client_nat_transform, pkts, list);
+        const double linear = time_transform(linear_transform, pkts, list);
+
+        printf("%8u %7d%% %7.1f ns %7.1f ns %7.1f ns\n", n,
+               changed * 100 / BENCH_N_PKTS, copy, hashed, linear);
+        gc_free(&gc);
+    }
+    return 0;
+}
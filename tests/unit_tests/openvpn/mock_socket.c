@@ -0,0 +1,55 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include "socket.h"
+
+/*
+ * The two functions of socket.c which clinat.c needs, without the
+ * resolver and the rest of socket.c.
+ */
+in_addr_t
+getaddr(unsigned int flags, const char *hostname, int resolve_retry_seconds,
+        bool *succeeded, volatile int *signal_received)
+{
+    struct in_addr ia;
+
+    *succeeded = inet_pton(AF_INET, hostname, &ia) == 1;
+    return *succeeded ? ia.s_addr : 0;
+}
+
+const char *
+print_in_addr_t(in_addr_t addr, unsigned int flags, struct gc_arena *gc)
+{
+    struct buffer out = alloc_buf_gc(INET_ADDRSTRLEN, gc);
+
+    inet_ntop(AF_INET, &addr, BSTR(&out), INET_ADDRSTRLEN);
+    return BSTR(&out);
+}
@@ -0,0 +1,461 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "clinat.h"
+#include "socket.h"
+
+#define TEST_PKT_SIZE 60
+#define TEST_N_RULES  5000
+#define TEST_N_PKTS   20000
+
+struct test_clinat {
+    struct gc_arena gc;
+    struct client_nat_option_list *list;
+};
+
+static int
+setup(void **state)
+{
+    struct test_clinat *t = calloc(1, sizeof(*t));
+
+    t->gc = gc_new();
+    t->list = new_client_nat_list(&t->gc);
+    *state = t;
+    return 0;
+}
+
+static int
+teardown(void **state)
+{
+    struct test_clinat *t = *state;
+
+    gc_free(&t->gc);
+    free(t);
+    return 0;
+}
+
+static in_addr_t
+addr(const char *s)
+{
+    struct in_addr ia;
+
+    assert_int_equal(inet_pton(AF_INET, s, &ia), 1);
+    return ia.s_addr;
+}
+
+static void
+test_rule(struct test_clinat *t, const char *type, const char *network,
+          const char *netmask, const char *foreign_network)
+{
+    add_client_nat_to_option_list(t->list, type, network, netmask,
+                                  foreign_network, M_WARN);
+}
+
+/* one's complement sum of 16-bit words, folded */
+static uint16_t
+test_sum(const uint8_t *data, int len)
+{
+    uint32_t sum = 0;
+
+    for (int i = 0; i < len; i += 2)
+    {
+        sum += (data[i] << 8) + data[i + 1];
+    }
+    while (sum >> 16)
+    {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t) sum;
+}
+
+static uint16_t
+test_l4_checksum(const uint8_t *pkt, int hlen, int len)
+{
+    return ip_checksum(AF_INET, pkt + hlen, len - hlen, pkt + 12, pkt + 16, pkt[9]);
+}
+
+/*
+ * An IPv4 packet with ihl 32-bit words of header followed by a TCP or
+ * UDP header and payload, with valid checksums.
+ */
+static void
+test_packet(uint8_t *pkt, int ihl, int proto, in_addr_t src, in_addr_t dst,
+            uint32_t seed)
+{
+    const int hlen = ihl * 4;
+    const int check = hlen + (proto == OPENVPN_IPPROTO_TCP ? 16 : 6);
+    uint16_t sum;
+
+    for (int i = 0; i < TEST_PKT_SIZE; ++i)
+    {
+        pkt[i] = (uint8_t) ((seed + i) * 2654435761u >> 24);
+    }
+    pkt[0] = 0x40 | ihl;
+    pkt[2] = 0;
+    pkt[3] = TEST_PKT_SIZE;
+    pkt[6] = pkt[7] = 0;
+    pkt[9] = proto;
+    memcpy(pkt + 12, &src, 4);
+    memcpy(pkt + 16, &dst, 4);
+    pkt[10] = pkt[11] = 0;
+    sum = ~test_sum(pkt, hlen);
+    pkt[10] = sum >> 8;
+    pkt[11] = sum & 0xff;
+    if (proto == OPENVPN_IPPROTO_TCP)
+    {
+        pkt[hlen + 12] = 0x50;
+    }
+    else
+    {
+        pkt[hlen + 4] = 0;
+        pkt[hlen + 5] = TEST_PKT_SIZE - hlen;
+    }
+
+    pkt[check] = pkt[check + 1] = 0;
+    sum = test_l4_checksum(pkt, hlen, TEST_PKT_SIZE);
+    pkt[check] = sum >> 8;
+    pkt[check + 1] = sum & 0xff;
+}
+
+/* transform len bytes of pkt, from an allocation of exactly that size */
+static void
+test_transform(struct test_clinat *t, uint8_t *pkt, int len, int direction)
+{
+    struct packet_info pi;
+    struct buffer buf;
+    uint8_t *data = gc_malloc(len, false, &t->gc);
+
+    memcpy(data, pkt, len);
+    buf_set_read(&buf, data, len);
+    packet_info_parse(&pi, DEV_TYPE_TUN, &buf);
+    client_nat_transform(t->list, &buf, &pi, direction);
+    memcpy(pkt, data, len);
+}
+
+static void
+assert_addrs(const uint8_t *pkt, in_addr_t src, in_addr_t dst)
+{
+    assert_memory_equal(pkt + 12, &src, 4);
+    assert_memory_equal(pkt + 16, &dst, 4);
+}
+
+static void
+assert_checksums(const uint8_t *pkt)
+{
+    const int hlen = (pkt[0] & 0x0f) * 4;
+
+    assert_int_equal(test_sum(pkt, hlen), 0xffff);
+    assert_int_equal(test_l4_checksum(pkt, hlen, TEST_PKT_SIZE), 0);
+}
+
+static void
+test_clinat_snat_dnat(void **state)
+{
+    struct test_clinat *t = *state;
+    uint8_t pkt[TEST_PKT_SIZE];
+
+    test_rule(t, "snat", "10.8.0.0", "255.255.255.0", "192.168.100.0");
+    test_rule(t, "dnat", "10.8.1.1", "255.255.255.255", "172.16.0.1");
+
+    test_packet(pkt, 5, OPENVPN_IPPROTO_TCP, addr("10.8.0.5"), addr("10.8.1.1"), 1);
+    test_transform(t, pkt, sizeof(pkt), CN_OUTGOING);
+    assert_addrs(pkt, addr("192.168.100.5"), addr("172.16.0.1"));
+    assert_checksums(pkt);
+
+    test_packet(pkt, 5, OPENVPN_IPPROTO_UDP, addr("172.16.0.1"), addr("192.168.100.9"), 2);
+    test_transform(t, pkt, sizeof(pkt), CN_INCOMING);
+    assert_addrs(pkt, addr("10.8.1.1"), addr("10.8.0.9"));
+    assert_checksums(pkt);
+
+    /* no rule matches, the packet is left alone */
+    uint8_t copy[TEST_PKT_SIZE];
+    test_packet(pkt, 5, OPENVPN_IPPROTO_TCP, addr("10.8.2.5"), addr("10.8.1.2"), 3);
+    memcpy(copy, pkt, sizeof(pkt));
+    test_transform(t, pkt, sizeof(pkt), CN_OUTGOING);
+    assert_memory_equal(pkt, copy, sizeof(pkt));
+
+    /* a snat network is not rewritten as a destination */
+    test_packet(pkt, 5, OPENVPN_IPPROTO_TCP, addr("10.8.2.5"), addr("10.8.0.5"), 4);
+    test_transform(t, pkt, sizeof(pkt), CN_OUTGOING);
+    assert_addrs(pkt, addr("10.8.2.5"), addr("10.8.0.5"));
+}
+
+static void
+test_clinat_first_rule_wins(void **state)
+{
+    struct test_clinat *t = *state;
+    uint8_t pkt[TEST_PKT_SIZE];
+
+    /* duplicates and overlaps: the first matching rule wins */
+    test_rule(t, "snat", "10.8.0.0", "255.255.255.0", "192.168.1.0");
+    test_rule(t, "snat", "10.8.0.0", "255.255.255.0", "192.168.2.0");
+    test_rule(t, "snat", "10.8.0.0", "255.255.255.0", "192.168.1.0");
+    test_rule(t, "snat", "10.8.0.0", "255.255.0.0", "192.169.0.0");
+    test_rule(t, "snat", "10.9.0.0", "255.255.0.0", "172.20.0.0");
+    test_rule(t, "snat", "10.9.1.0", "255.255.255.0", "172.21.1.0");
+    /* a later rule for the same foreign network */
+    test_rule(t, "snat", "10.10.0.0", "255.255.255.0", "192.168.1.0");
+    assert_int_equal(t->list->n, 7);
+
+    test_packet(pkt, 5, OPENVPN_IPPROTO_TCP, addr("10.8.0.7"), addr("1.1.1.1"), 1);
+    test_transform(t, pkt, sizeof(pkt), CN_OUTGOING);
+    assert_addrs(pkt, addr("192.168.1.7"), addr("1.1.1.1"));
+
+    test_packet(pkt, 5, OPENVPN_IPPROTO_TCP, addr("10.8.3.7"), addr("1.1.1.1"), 2);
+    test_transform(t, pkt, sizeof(pkt), CN_OUTGOING);
+    assert_addrs(pkt, addr("192.169.3.7"), addr("1.1.1.1"));
+
+    /* the /16 comes first, the later /24 never matches */
+    test_packet(pkt, 5, OPENVPN_IPPROTO_TCP, addr("10.9.1.7"), addr("1.1.1.1"), 3);
+    test_transform(t, pkt, sizeof(pkt), CN_OUTGOING);
+    assert_addrs(pkt, addr("172.20.1.7"), addr("1.1.1.1"));
+
+    test_packet(pkt, 5, OPENVPN_IPPROTO_TCP, addr("1.1.1.1"), addr("192.168.1.7"), 4);
+    test_transform(t, pkt, sizeof(pkt), CN_INCOMING);
+    assert_addrs(pkt, addr("1.1.1.1"), addr("10.8.0.7"));
+
+    test_packet(pkt, 5, OPENVPN_IPPROTO_TCP, addr("1.1.1.1"), addr("192.168.2.7"), 5);
+    test_transform(t, pkt, sizeof(pkt), CN_INCOMING);
+    assert_addrs(pkt, addr("1.1.1.1"), addr("10.8.0.7"));
+    assert_checksums(pkt);
+
+    /* a rejected rule is not added */
+    test_rule(t, "xnat", "10.11.0.0", "255.255.255.0", "192.168.1.0");
+    test_rule(t, "snat", "10.11.0.0", "255.255.255.0", "not-an-address");
+    assert_int_equal(t->list->n, 7);
+}
+
+/* the first rule which maps addr, by scanning all of them */
+static const struct client_nat_entry *
+ref_lookup(const struct client_nat_option_list *list, int type, in_addr_t a,
+           int direction)
+{
+    for (int i = 0; i < list->n; ++i)
+    {
+        const struct client_nat_entry *e = &list->entries[i];
+        if (e->type == type
+            && (a & e->netmask) == (direction ? e->foreign_network : e->network))
+        {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static in_addr_t
+ref_map(const struct client_nat_option_list *list, int type, in_addr_t a,
+        int direction)
+{
+    const struct client_nat_entry *e = ref_lookup(list, type, a, direction);
+
+    if (!e)
+    {
+        return a;
+    }
+    return (a & ~e->netmask) | (direction ? e->network : e->foreign_network);
+}
+
+static in_addr_t
+test_random_addr(in_addr_t net)
+{
+    return net | htonl(rand() & 0x3ffff);
+}
+
+/*
+ * Thousands of random /32, /24 and /16 rules, many of them sharing a
+ * network, fill long probe chains in the hash.  Every packet must be
+ * rewritten as a linear scan of the rules would.
+ */
+static void
+test_clinat_many_rules(void **state)
+{
+    struct test_clinat *t = *state;
+    const char *masks[] = { "255.255.255.255", "255.255.255.0", "255.255.0.0" };
+    const in_addr_t local = addr("10.0.0.0"), foreign = addr("172.16.0.0");
+    uint8_t pkt[TEST_PKT_SIZE];
+    int rewritten = 0;
+
+    srand(1);
+    for (int i = 0; i < TEST_N_RULES; ++i)
+    {
+        const int m = rand() % 10 ? 0 : 1 + rand() % 2;
+        const in_addr_t mask = addr(masks[m]);
+        char network[INET_ADDRSTRLEN], foreign_network[INET_ADDRSTRLEN];
+        struct gc_arena gc = gc_new();
+
+        strcpy(network, print_in_addr_t(test_random_addr(local) & mask, 0, &gc));
+        strcpy(foreign_network, print_in_addr_t(test_random_addr(foreign) & mask, 0, &gc));
+        test_rule(t, (rand() & 1) ? "snat" : "dnat", network, masks[m], foreign_network);
+        gc_free(&gc);
+    }
+    assert_int_equal(t->list->n, TEST_N_RULES);
+
+    for (int i = 0; i < TEST_N_PKTS; ++i)
+    {
+        const int direction = rand() & 1;
+        const int proto = (rand() & 1) ? OPENVPN_IPPROTO_TCP : OPENVPN_IPPROTO_UDP;
+        const in_addr_t src = test_random_addr((rand() & 1) ? local : foreign);
+        const in_addr_t dst = test_random_addr((rand() & 1) ? local : foreign);
+        const int stype = direction ? CN_DNAT : CN_SNAT;
+        const int dtype = direction ? CN_SNAT : CN_DNAT;
+
+        test_packet(pkt, 5, proto, src, dst, i);
+        test_transform(t, pkt, sizeof(pkt), direction);
+        assert_addrs(pkt, ref_map(t->list, stype, src, direction),
+                     ref_map(t->list, dtype, dst, direction));
+        assert_checksums(pkt);
+        rewritten += memcmp(pkt + 12, &src, 4) || memcmp(pkt + 16, &dst, 4);
+    }
+
+    /* the random packets must hit some rules to mean anything */
+    assert_true(rewritten > TEST_N_PKTS / 10);
+
+    /* a copy is indexed the same */
+    struct client_nat_option_list *copy = clone_client_nat_option_list(t->list, &t->gc);
+    assert_int_equal(copy->n, t->list->n);
+    t->list = copy;
+    for (int i = 0; i < TEST_N_PKTS / 10; ++i)
+    {
+        const in_addr_t a = test_random_addr((rand() & 1) ? local : foreign);
+        const int direction = rand() & 1;
+
+        test_packet(pkt, 5, OPENVPN_IPPROTO_TCP, a, a, i);
+        test_transform(t, pkt, sizeof(pkt), direction);
+        assert_addrs(pkt, ref_map(copy, direction ? CN_DNAT : CN_SNAT, a, direction),
+                     ref_map(copy, direction ? CN_SNAT : CN_DNAT, a, direction));
+    }
+}
+
+static void
+test_clinat_udp_zero_checksum(void **state)
+{
+    struct test_clinat *t = *state;
+    uint8_t pkt[TEST_PKT_SIZE];
+
+    test_rule(t, "snat", "10.8.0.0", "255.255.255.0", "192.168.100.0");
+
+    /* no checksum was computed, none must appear */
+    test_packet(pkt, 5, OPENVPN_IPPROTO_UDP, addr("10.8.0.5"), addr("1.1.1.1"), 1);
+    pkt[26] = pkt[27] = 0;
+    test_transform(t, pkt, sizeof(pkt), CN_OUTGOING);
+    assert_addrs(pkt, addr("192.168.100.5"), addr("1.1.1.1"));
+    assert_int_equal(pkt[26], 0);
+    assert_int_equal(pkt[27], 0);
+    assert_int_equal(test_sum(pkt, 20), 0xffff);
+
+    /*
+     * A checksum which becomes zero after the rewrite is sent as all
+     * ones, as zero would mean none.  Find a payload for which it does.
+     */
+    for (uint32_t w = 0; w <= 0xffff; ++w)
+    {
+        test_packet(pkt, 5, OPENVPN_IPPROTO_UDP, addr("192.168.100.5"), addr("1.1.1.1"), 2);
+        pkt[40] = w >> 8;
+        pkt[41] = w & 0xff;
+        pkt[26] = pkt[27] = 0;
+        if (test_l4_checksum(pkt, 20, TEST_PKT_SIZE) == 0)
+        {
+            break;
+        }
+    }
+    const in_addr_t src = addr("10.8.0.5");
+    memcpy(pkt + 12, &src, 4);
+    const uint16_t sum = test_l4_checksum(pkt, 20, TEST_PKT_SIZE);
+    pkt[26] = sum >> 8;
+    pkt[27] = sum & 0xff;
+    assert_int_not_equal(sum, 0);
+
+    test_transform(t, pkt, sizeof(pkt), CN_OUTGOING);
+    assert_addrs(pkt, addr("192.168.100.5"), addr("1.1.1.1"));
+    assert_int_equal(pkt[26], 0xff);
+    assert_int_equal(pkt[27], 0xff);
+    assert_int_equal(test_l4_checksum(pkt, 20, TEST_PKT_SIZE), 0);
+}
+
+static void
+test_clinat_headers(void **state)
+{
+    struct test_clinat *t = *state;
+    uint8_t pkt[TEST_PKT_SIZE], copy[TEST_PKT_SIZE];
+
+    test_rule(t, "snat", "10.8.0.0", "255.255.255.0", "192.168.100.0");
+
+    /* the TCP checksum follows the IP options */
+    test_packet(pkt, 7, OPENVPN_IPPROTO_TCP, addr("10.8.0.5"), addr("1.1.1.1"), 1);
+    test_transform(t, pkt, sizeof(pkt), CN_OUTGOING);
+    assert_addrs(pkt, addr("192.168.100.5"), addr("1.1.1.1"));
+    assert_checksums(pkt);
+
+    /* a non-first fragment only has its IP header rewritten */
+    test_packet(pkt, 5, OPENVPN_IPPROTO_TCP, addr("10.8.0.5"), addr("1.1.1.1"), 2);
+    pkt[6] = 0x00;
+    pkt[7] = 0x10;
+    pkt[10] = pkt[11] = 0;
+    const uint16_t sum = ~test_sum(pkt, 20);
+    pkt[10] = sum >> 8;
+    pkt[11] = sum & 0xff;
+    memcpy(copy, pkt, sizeof(pkt));
+    test_transform(t, pkt, sizeof(pkt), CN_OUTGOING);
+    assert_addrs(pkt, addr("192.168.100.5"), addr("1.1.1.1"));
+    assert_int_equal(test_sum(pkt, 20), 0xffff);
+    assert_memory_equal(pkt + 20, copy + 20, sizeof(pkt) - 20);
+
+    /* a truncated TCP header is not written to */
+    for (int len = 20; len < 40; ++len)
+    {
+        test_packet(pkt, 5, OPENVPN_IPPROTO_TCP, addr("10.8.0.5"), addr("1.1.1.1"), 3);
+        memcpy(copy, pkt, sizeof(pkt));
+        test_transform(t, pkt, len, CN_OUTGOING);
+        assert_addrs(pkt, addr("192.168.100.5"), addr("1.1.1.1"));
+        assert_memory_equal(pkt + 20, copy + 20, sizeof(pkt) - 20);
+    }
+}
+
+const struct CMUnitTest clinat_tests[] = {
+    cmocka_unit_test_setup_teardown(test_clinat_snat_dnat, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_clinat_first_rule_wins, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_clinat_many_rules, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_clinat_udp_zero_checksum, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_clinat_headers, setup, teardown),
+};
+
+int
+main(void)
+{
+    return cmocka_run_group_tests(clinat_tests, NULL, NULL);
+}
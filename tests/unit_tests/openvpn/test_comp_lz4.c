@@ -0,0 +1,306 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "comp.h"
+#include "proto.h"
+
+#if defined(USE_COMP) && defined(ENABLE_LZ4)
+
+#define TEST_MTU       1500
+#define TEST_BUF_SIZE  4096
+#define TEST_HEADROOM  128
+
+struct test_lz4stream {
+    struct gc_arena gc;
+    struct frame frame;
+    struct compress_context *tx;
+    struct compress_context *rx;
+};
+
+static struct compress_context *
+test_lz4stream_init(int dict_size, int resync, bool reliable)
+{
+    struct compress_options opt = {
+        .alg = COMP_ALGV2_LZ4_STREAM,
+        .flags = COMP_F_ALLOW_COMPRESS,
+        .dict_size = dict_size,
+        .resync = resync,
+    };
+    return comp_init(&opt, reliable, DEV_TYPE_TUN);
+}
+
+static int
+setup(void **state)
+{
+    struct test_lz4stream *t = calloc(1, sizeof(*t));
+
+    t->gc = gc_new();
+    t->frame.link_mtu = TEST_MTU;
+    t->frame.link_mtu_dynamic = TEST_MTU;
+    comp_add_to_extra_frame(&t->frame);
+    comp_add_to_extra_buffer(&t->frame);
+    *state = t;
+    return 0;
+}
+
+static int
+teardown(void **state)
+{
+    struct test_lz4stream *t = *state;
+
+    comp_uninit(t->tx);
+    comp_uninit(t->rx);
+    gc_free(&t->gc);
+    free(t);
+    return 0;
+}
+
+/* a syslog message, similar to the previous ones but not identical */
+static struct buffer
+test_packet(struct test_lz4stream *t, int i)
+{
+    struct buffer buf = alloc_buf_gc(TEST_BUF_SIZE, &t->gc);
+
+    ASSERT(buf_init(&buf, TEST_HEADROOM));
+    buf_printf(&buf, "<13>Oct 19 03:21:%02d gateway sshd[%d]: Accepted publickey "
+               "for user%d from 10.8.0.%d port %d ssh2: ED25519 SHA256:%08x",
+               i % 60, 1000 + i, i % 7, i % 250, 40000 + i, i * 2654435761u);
+    buf.len = strlen(BSTR(&buf));
+    return buf;
+}
+
+static struct buffer
+test_compress(struct test_lz4stream *t, struct buffer buf)
+{
+    struct buffer work = alloc_buf_gc(TEST_BUF_SIZE, &t->gc);
+
+    (*t->tx->alg.compress)(&buf, work, t->tx, &t->frame);
+    return buf;
+}
+
+static struct buffer
+test_decompress(struct test_lz4stream *t, const struct buffer *wire)
+{
+    struct buffer buf = alloc_buf_gc(TEST_BUF_SIZE, &t->gc);
+    struct buffer work = alloc_buf_gc(TEST_BUF_SIZE, &t->gc);
+
+    ASSERT(buf_init(&buf, TEST_HEADROOM));
+    ASSERT(buf_copy(&buf, wire));
+    (*t->rx->alg.decompress)(&buf, work, t->rx, &t->frame);
+    return buf;
+}
+
+static void
+assert_round_trip(struct test_lz4stream *t, int i)
+{
+    const struct buffer in = test_packet(t, i);
+    struct buffer wire = test_compress(t, in);
+    struct buffer out = test_decompress(t, &wire);
+
+    assert_int_equal(BLEN(&out), BLEN(&in));
+    assert_memory_equal(BPTR(&out), BPTR(&in), BLEN(&in));
+}
+
+static void
+test_lz4stream_round_trip(void **state)
+{
+    struct test_lz4stream *t = *state;
+    t->tx = test_lz4stream_init(4096, 32, false);
+    t->rx = test_lz4stream_init(4096, 32, false);
+
+    for (int i = 0; i < 100; ++i)
+    {
+        assert_round_trip(t, i);
+    }
+
+    /* with the dictionary, the packets shrink to less than half */
+    assert_true(t->tx->post_compress * 2 < t->tx->pre_compress);
+    assert_int_equal(t->rx->post_decompress, t->tx->pre_compress);
+    assert_int_equal(t->rx->desync_drops, 0);
+}
+
+static void
+test_lz4stream_epoch(void **state)
+{
+    struct test_lz4stream *t = *state;
+    t->tx = test_lz4stream_init(4096, 4, false);
+    t->rx = test_lz4stream_init(4096, 4, false);
+
+    for (int i = 0; i < 80; ++i)
+    {
+        const struct buffer in = test_packet(t, i);
+        struct buffer wire = test_compress(t, in);
+        const uint8_t *head = BPTR(&wire);
+
+        assert_int_equal(head[0], COMP_ALGV2_INDICATOR_BYTE);
+        assert_in_range(head[1], COMP_ALGV2_LZ4_STREAM_BYTE, COMP_ALGV2_LZ4_STREAM_RAW_BYTE);
+        /* the epoch wraps after 16 */
+        assert_int_equal(head[2] >> 4, (i / 4) & 0x0F);
+        assert_int_equal(head[3], i % 4);
+
+        struct buffer out = test_decompress(t, &wire);
+        assert_int_equal(BLEN(&out), BLEN(&in));
+    }
+    assert_int_equal(t->rx->desync_drops, 0);
+}
+
+static void
+test_lz4stream_drop(void **state)
+{
+    struct test_lz4stream *t = *state;
+    t->tx = test_lz4stream_init(4096, 8, false);
+    t->rx = test_lz4stream_init(4096, 8, false);
+
+    for (int i = 0; i < 24; ++i)
+    {
+        const struct buffer in = test_packet(t, i);
+        struct buffer wire = test_compress(t, in);
+
+        if (i == 3)
+        {
+            continue;
+        }
+
+        struct buffer out = test_decompress(t, &wire);
+        if (i > 3 && i < 8)
+        {
+            /* the rest of the epoch of the lost packet is dropped */
+            assert_int_equal(BLEN(&out), 0);
+        }
+        else
+        {
+            assert_int_equal(BLEN(&out), BLEN(&in));
+            assert_memory_equal(BPTR(&out), BPTR(&in), BLEN(&in));
+        }
+    }
+    assert_int_equal(t->rx->desync_drops, 4);
+}
+
+static void
+test_lz4stream_drop_first(void **state)
+{
+    struct test_lz4stream *t = *state;
+    t->tx = test_lz4stream_init(4096, 8, false);
+    t->rx = test_lz4stream_init(4096, 8, false);
+
+    /* a receiver which missed the start of the stream waits for an epoch */
+    for (int i = 0; i < 16; ++i)
+    {
+        struct buffer wire = test_compress(t, test_packet(t, i));
+        if (i > 0)
+        {
+            struct buffer out = test_decompress(t, &wire);
+            assert_int_equal(BLEN(&out) > 0, i >= 8);
+        }
+    }
+}
+
+static void
+test_lz4stream_reliable(void **state)
+{
+    struct test_lz4stream *t = *state;
+
+    /* over TCP, epochs are longer, but still there */
+    t->tx = test_lz4stream_init(4096, 0, true);
+    t->rx = test_lz4stream_init(4096, 0, false);
+    assert_int_equal(t->tx->wu.lz4.resync, COMP_RESYNC_MAX);
+    assert_int_equal(t->rx->wu.lz4.resync, COMP_RESYNC_DEFAULT);
+
+    for (int i = 0; i < COMP_RESYNC_MAX + 10; ++i)
+    {
+        const struct buffer in = test_packet(t, i);
+        struct buffer wire = test_compress(t, in);
+
+        /* a packet dropped after compression, e.g. by a full queue */
+        if (i == 100)
+        {
+            continue;
+        }
+
+        struct buffer out = test_decompress(t, &wire);
+        assert_int_equal(BLEN(&out) > 0, i < 100 || i >= COMP_RESYNC_MAX);
+    }
+    assert_int_equal(t->rx->desync_drops, COMP_RESYNC_MAX - 101);
+}
+
+static void
+test_lz4stream_dict_size(void **state)
+{
+    struct test_lz4stream *t = *state;
+    t->tx = test_lz4stream_init(8192, 8, false);
+    t->rx = test_lz4stream_init(4096, 8, false);
+
+    /* a peer may not make us use a larger dictionary than our own */
+    struct buffer wire = test_compress(t, test_packet(t, 0));
+    struct buffer out = test_decompress(t, &wire);
+    assert_int_equal(BLEN(&out), 0);
+    assert_null(t->rx->wu.lz4.dec_hist);
+
+    /* a smaller one is fine */
+    comp_uninit(t->tx);
+    t->tx = test_lz4stream_init(2048, 8, false);
+    for (int i = 0; i < 20; ++i)
+    {
+        assert_round_trip(t, i);
+    }
+}
+
+const struct CMUnitTest comp_lz4_tests[] = {
+    cmocka_unit_test_setup_teardown(test_lz4stream_round_trip, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_lz4stream_epoch, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_lz4stream_drop, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_lz4stream_drop_first, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_lz4stream_reliable, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_lz4stream_dict_size, setup, teardown),
+};
+
+int
+main(void)
+{
+    return cmocka_run_group_tests(comp_lz4_tests, NULL, NULL);
+}
+
+#else  /* if defined(USE_COMP) && defined(ENABLE_LZ4) */
+
+int
+main(void)
+{
+    return 77; /* skipped, built without LZ4 */
+}
+
+#endif /* if defined(USE_COMP) && defined(ENABLE_LZ4) */
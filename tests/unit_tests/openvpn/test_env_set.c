@@ -0,0 +1,240 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "env_set.h"
+#include "run_command.h"
+
+/* argv.c is only linked for the script helpers of run_command.c */
+int
+__wrap_parse_line(const char *line, char **p, const int n, const char *file,
+                  const int line_num, int msglevel, struct gc_arena *gc)
+{
+    return 0;
+}
+
+static int
+setup_heap(void **state)
+{
+    *state = env_set_create(NULL);
+    return 0;
+}
+
+static int
+teardown_heap(void **state)
+{
+    env_set_destroy(*state);
+    return 0;
+}
+
+static void
+test_env_set_add_get(void **state)
+{
+    struct env_set *es = *state;
+
+    assert_null(env_set_get(es, "foo"));
+
+    env_set_add(es, "foo=bar");
+    env_set_add(es, "foobar=baz");
+    setenv_int(es, "num", 42);
+
+    assert_int_equal(es->count, 3);
+    assert_string_equal(env_set_get(es, "foo"), "foo=bar");
+    assert_string_equal(env_set_get(es, "foobar"), "foobar=baz");
+    assert_string_equal(env_set_get(es, "num"), "num=42");
+    assert_null(env_set_get(es, "fo"));
+    assert_null(es->envp[es->count]);
+}
+
+static void
+test_env_set_replace(void **state)
+{
+    struct env_set *es = *state;
+
+    env_set_add(es, "aa=1");
+    env_set_add(es, "bb=2");
+    env_set_add(es, "aa=3");
+
+    assert_int_equal(es->count, 2);
+    assert_string_equal(env_set_get(es, "aa"), "aa=3");
+    assert_string_equal(env_set_get(es, "bb"), "bb=2");
+
+    /* the replaced string is garbage until the buffer is repacked */
+    assert_int_equal(es->garbage, strlen("aa=1") + 1);
+
+    setenv_str(es, "bb", "longer value");
+    assert_int_equal(es->count, 2);
+    assert_string_equal(env_set_get(es, "bb"), "bb=longer value");
+    assert_null(es->envp[es->count]);
+}
+
+static void
+test_env_set_del(void **state)
+{
+    struct env_set *es = *state;
+
+    env_set_add(es, "aa=1");
+    env_set_add(es, "bb=2");
+    env_set_add(es, "cc=3");
+
+    assert_true(env_set_del(es, "bb"));
+    assert_false(env_set_del(es, "bb"));
+    assert_false(env_set_del(es, "dd"));
+    assert_int_equal(es->count, 2);
+    assert_null(env_set_get(es, "bb"));
+    assert_string_equal(es->envp[0], "aa=1");
+    assert_string_equal(es->envp[1], "cc=3");
+    assert_null(es->envp[2]);
+
+    setenv_del(es, "aa");
+    setenv_del(es, "cc");
+    assert_int_equal(es->count, 0);
+    assert_null(es->envp[0]);
+}
+
+/*
+ * A set whose variables are replaced over and over, like the one of a
+ * client instance, must settle on a fixed buffer size.
+ */
+static void
+test_env_set_reuse(void **state)
+{
+    struct env_set *es = *state;
+    size_t size = 0;
+
+    for (int i = 0; i < 10000; ++i)
+    {
+        setenv_int(es, "bytes_received", i);
+        setenv_int(es, "bytes_sent", i * 3);
+        setenv_str(es, "common_name", (i & 1) ? "client1" : "another-client");
+        if (i == 100)
+        {
+            size = es->size;
+        }
+    }
+    assert_int_equal(es->count, 3);
+    assert_int_equal(es->size, size);
+    assert_string_equal(env_set_get(es, "bytes_received"), "bytes_received=9999");
+    assert_string_equal(env_set_get(es, "bytes_sent"), "bytes_sent=29997");
+    assert_string_equal(env_set_get(es, "common_name"), "common_name=client1");
+}
+
+static void
+test_env_set_incr(void **state)
+{
+    struct env_set *es = *state;
+
+    setenv_str_incr(es, "dns", "1.1.1.1");
+    setenv_str_incr(es, "dns", "8.8.8.8");
+    setenv_str_incr(es, "dns", "9.9.9.9");
+
+    assert_string_equal(env_set_get(es, "dns"), "dns=1.1.1.1");
+    assert_string_equal(env_set_get(es, "dns_1"), "dns_1=8.8.8.8");
+    assert_string_equal(env_set_get(es, "dns_2"), "dns_2=9.9.9.9");
+}
+
+static void
+test_env_set_inherit_gc(void **state)
+{
+    struct gc_arena gc = gc_new();
+    struct env_set *src = *state;
+    struct env_set *es = env_set_create(&gc);
+
+    env_set_add(src, "a=1");
+    env_set_add(src, "b=2");
+    env_set_add(src, "a=3");
+
+    env_set_add(es, "b=old");
+    env_set_add(es, "c=4");
+    env_set_inherit(es, src);
+
+    assert_int_equal(es->count, 3);
+    assert_string_equal(env_set_get(es, "a"), "a=3");
+    assert_string_equal(env_set_get(es, "b"), "b=2");
+    assert_string_equal(env_set_get(es, "c"), "c=4");
+
+    /* the strings are copies */
+    env_set_add(src, "a=5");
+    assert_string_equal(env_set_get(es, "a"), "a=3");
+
+    gc_free(&gc);
+}
+
+static void
+test_env_set_make_array(void **state)
+{
+    struct gc_arena gc = gc_new();
+    struct env_set *es = *state;
+    const char **envp;
+
+    env_set_add(es, "username=u");
+    env_set_add(es, "password=p");
+
+    script_security_set(SSEC_PW_ENV);
+    envp = make_env_array(es, true, &gc);
+    assert_ptr_equal(envp, es->envp);
+
+    script_security_set(SSEC_SCRIPTS);
+    envp = make_env_array(es, true, &gc);
+    assert_string_equal(envp[0], "username=u");
+    assert_null(envp[1]);
+
+    envp = make_env_array(es, false, &gc);
+    assert_string_equal(envp[1], "password=p");
+    assert_null(envp[2]);
+
+    envp = make_env_array(NULL, true, &gc);
+    assert_null(envp[0]);
+
+    gc_free(&gc);
+}
+
+const struct CMUnitTest env_set_tests[] = {
+    cmocka_unit_test_setup_teardown(test_env_set_add_get, setup_heap, teardown_heap),
+    cmocka_unit_test_setup_teardown(test_env_set_replace, setup_heap, teardown_heap),
+    cmocka_unit_test_setup_teardown(test_env_set_del, setup_heap, teardown_heap),
+    cmocka_unit_test_setup_teardown(test_env_set_reuse, setup_heap, teardown_heap),
+    cmocka_unit_test_setup_teardown(test_env_set_incr, setup_heap, teardown_heap),
+    cmocka_unit_test_setup_teardown(test_env_set_inherit_gc, setup_heap, teardown_heap),
+    cmocka_unit_test_setup_teardown(test_env_set_make_array, setup_heap, teardown_heap),
+};
+
+int
+main(void)
+{
+    return cmocka_run_group_tests(env_set_tests, NULL, NULL);
+}
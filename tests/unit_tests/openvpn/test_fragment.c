@@ -0,0 +1,351 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "fragment.h"
+
+#ifdef ENABLE_FRAGMENT
+
+#define TEST_LINK_MTU  1500
+#define TEST_FRAG_MTU  500      /* --fragment */
+#define TEST_MAX_FRAGS 8
+
+struct test_fragment {
+    struct gc_arena gc;
+    struct frame frame;
+    struct fragment_master *tx;
+    struct fragment_master *rx;
+};
+
+/* the fragments of one packet, as they would be sent */
+struct test_frags {
+    int n;
+    struct buffer frag[TEST_MAX_FRAGS];
+};
+
+static int
+setup(void **state)
+{
+    struct test_fragment *t = calloc(1, sizeof(*t));
+
+    t->gc = gc_new();
+    t->frame.link_mtu = TEST_LINK_MTU;
+    t->frame.link_mtu_dynamic = TEST_FRAG_MTU;
+    t->tx = fragment_init(&t->frame);
+    t->rx = fragment_init(&t->frame);
+    fragment_frame_init(t->tx, &t->frame);
+    fragment_frame_init(t->rx, &t->frame);
+    now = 1000;
+    *state = t;
+    return 0;
+}
+
+static int
+teardown(void **state)
+{
+    struct test_fragment *t = *state;
+
+    fragment_free(t->tx);
+    fragment_free(t->rx);
+    gc_free(&t->gc);
+    free(t);
+    return 0;
+}
+
+static struct buffer
+test_packet(struct test_fragment *t, int len, uint8_t fill)
+{
+    struct buffer buf = alloc_buf_gc(BUF_SIZE(&t->frame), &t->gc);
+
+    ASSERT(buf_init(&buf, FRAME_HEADROOM(&t->frame)));
+    for (int i = 0; i < len; ++i)
+    {
+        buf_write_u8(&buf, fill + i);
+    }
+    return buf;
+}
+
+static struct test_frags
+test_fragment_packet(struct test_fragment *t, const struct buffer *pkt)
+{
+    struct test_frags ret = { 0 };
+    struct buffer buf = *pkt;
+
+    fragment_outgoing(t->tx, &buf, &t->frame);
+    do
+    {
+        assert_true(ret.n < TEST_MAX_FRAGS);
+        ret.frag[ret.n] = alloc_buf_gc(BUF_SIZE(&t->frame), &t->gc);
+        ASSERT(buf_init(&ret.frag[ret.n], FRAME_HEADROOM(&t->frame)));
+        ASSERT(buf_copy(&ret.frag[ret.n], &buf));
+        ++ret.n;
+    } while (fragment_ready_to_send(t->tx, &buf, &t->frame));
+    return ret;
+}
+
+/* pass a fragment to the receiver, returns the reassembled packet, if any */
+static struct buffer
+test_receive(struct test_fragment *t, const struct buffer *frag)
+{
+    struct buffer buf = alloc_buf_gc(BUF_SIZE(&t->frame), &t->gc);
+
+    ASSERT(buf_init(&buf, FRAME_HEADROOM(&t->frame)));
+    ASSERT(buf_copy(&buf, frag));
+    fragment_incoming(t->rx, &buf, &t->frame);
+    return buf;
+}
+
+static int
+test_receive_len(struct test_fragment *t, const struct buffer *frag)
+{
+    const struct buffer out = test_receive(t, frag);
+    return BLEN(&out);
+}
+
+static void
+assert_packet_equal(const struct buffer *a, const struct buffer *b)
+{
+    assert_int_equal(BLEN(a), BLEN(b));
+    assert_memory_equal(BPTR(a), BPTR(b), BLEN(a));
+}
+
+static void
+test_fragment_whole(void **state)
+{
+    struct test_fragment *t = *state;
+    const struct buffer pkt = test_packet(t, 200, 1);
+    struct test_frags f = test_fragment_packet(t, &pkt);
+
+    assert_int_equal(f.n, 1);
+    struct buffer out = test_receive(t, &f.frag[0]);
+    assert_packet_equal(&out, &pkt);
+    assert_null(t->rx->incoming.index);
+}
+
+static void
+test_fragment_in_order(void **state)
+{
+    struct test_fragment *t = *state;
+
+    for (int p = 0; p < 10; ++p)
+    {
+        const struct buffer pkt = test_packet(t, 1400, p);
+        struct test_frags f = test_fragment_packet(t, &pkt);
+
+        assert_int_equal(f.n, 3);
+        for (int i = 0; i < f.n; ++i)
+        {
+            struct buffer out = test_receive(t, &f.frag[i]);
+            if (i < f.n - 1)
+            {
+                assert_int_equal(BLEN(&out), 0);
+                assert_int_equal(t->rx->incoming.n, 1);
+            }
+            else
+            {
+                assert_packet_equal(&out, &pkt);
+                assert_int_equal(t->rx->incoming.n, 0);
+            }
+        }
+    }
+}
+
+static void
+test_fragment_reordered(void **state)
+{
+    struct test_fragment *t = *state;
+    const struct buffer a = test_packet(t, 1400, 'a');
+    const struct buffer b = test_packet(t, 1000, 'b');
+    struct test_frags fa = test_fragment_packet(t, &a);
+    struct test_frags fb = test_fragment_packet(t, &b);
+    struct buffer out;
+
+    assert_int_equal(fa.n, 3);
+    assert_int_equal(fb.n, 3);
+
+    /* the fragments of two packets, reordered and interleaved */
+    assert_int_equal(test_receive_len(t, &fb.frag[2]), 0);
+    assert_int_equal(test_receive_len(t, &fa.frag[1]), 0);
+    assert_int_equal(test_receive_len(t, &fa.frag[2]), 0);
+    assert_int_equal(test_receive_len(t, &fb.frag[0]), 0);
+    assert_int_equal(t->rx->incoming.n, 2);
+
+    out = test_receive(t, &fb.frag[1]);
+    assert_packet_equal(&out, &b);
+    assert_int_equal(t->rx->incoming.n, 1);
+
+    out = test_receive(t, &fa.frag[0]);
+    assert_packet_equal(&out, &a);
+    assert_int_equal(t->rx->incoming.n, 0);
+}
+
+static void
+test_fragment_duplicate(void **state)
+{
+    struct test_fragment *t = *state;
+    const struct buffer pkt = test_packet(t, 1400, 'd');
+    struct test_frags f = test_fragment_packet(t, &pkt);
+    struct buffer out;
+
+    assert_int_equal(test_receive_len(t, &f.frag[0]), 0);
+    assert_int_equal(test_receive_len(t, &f.frag[0]), 0);
+    assert_int_equal(test_receive_len(t, &f.frag[2]), 0);
+    out = test_receive(t, &f.frag[1]);
+    assert_packet_equal(&out, &pkt);
+
+    /* a late duplicate starts over, but does not complete a packet */
+    assert_int_equal(test_receive_len(t, &f.frag[1]), 0);
+    assert_int_equal(t->rx->incoming.n, 1);
+}
+
+static void
+test_fragment_expired(void **state)
+{
+    struct test_fragment *t = *state;
+    const struct buffer a = test_packet(t, 1400, 'a');
+    const struct buffer b = test_packet(t, 1400, 'b');
+    struct test_frags fa = test_fragment_packet(t, &a);
+    struct test_frags fb = test_fragment_packet(t, &b);
+    struct buffer out;
+
+    assert_int_equal(test_receive_len(t, &fa.frag[0]), 0);
+    now += FRAG_TTL_SEC / 2;
+    assert_int_equal(test_receive_len(t, &fb.frag[0]), 0);
+    assert_int_equal(t->rx->incoming.n, 2);
+
+    /* only the older packet has expired */
+    now += FRAG_TTL_SEC / 2;
+    fragment_wakeup(t->rx, &t->frame);
+    assert_int_equal(t->rx->incoming.n, 1);
+    assert_ptr_equal(t->rx->incoming.head, t->rx->incoming.tail);
+
+    /* its remaining fragments do not make up a packet */
+    assert_int_equal(test_receive_len(t, &fa.frag[1]), 0);
+    assert_int_equal(test_receive_len(t, &fa.frag[2]), 0);
+
+    /* the other one is still reassembled */
+    assert_int_equal(test_receive_len(t, &fb.frag[2]), 0);
+    out = test_receive(t, &fb.frag[1]);
+    assert_packet_equal(&out, &b);
+
+    now += FRAG_TTL_SEC;
+    fragment_wakeup(t->rx, &t->frame);
+    assert_int_equal(t->rx->incoming.n, 0);
+    assert_null(t->rx->incoming.head);
+    assert_null(t->rx->incoming.tail);
+}
+
+static void
+test_fragment_window(void **state)
+{
+    struct test_fragment *t = *state;
+    const struct buffer old = test_packet(t, 1400, 'o');
+    struct test_frags fo = test_fragment_packet(t, &old);
+
+    assert_int_equal(test_receive_len(t, &fo.frag[0]), 0);
+
+    /*
+     * Incomplete packets are released once FRAG_WINDOW newer sequence
+     * IDs have been seen, also when the IDs wrap.
+     */
+    for (int p = 0; p < N_SEQ_ID + FRAG_WINDOW; ++p)
+    {
+        const struct buffer pkt = test_packet(t, 1000, p);
+        struct test_frags f = test_fragment_packet(t, &pkt);
+
+        assert_int_equal(test_receive_len(t, &f.frag[0]), 0);
+        assert_true(t->rx->incoming.n <= FRAG_WINDOW);
+    }
+    assert_int_equal(t->rx->incoming.n, FRAG_WINDOW);
+    assert_int_equal(test_receive_len(t, &fo.frag[1]), 0);
+    assert_int_equal(test_receive_len(t, &fo.frag[2]), 0);
+}
+
+static void
+test_fragment_bad_header(void **state)
+{
+    struct test_fragment *t = *state;
+    struct buffer buf = test_packet(t, 100, 0);
+    fragment_header_type flags;
+
+    /* FRAG_WHOLE with a sequence ID */
+    flags = htonl((FRAG_WHOLE << FRAG_TYPE_SHIFT) | (5 << FRAG_SEQ_ID_SHIFT));
+    ASSERT(buf_write_prepend(&buf, &flags, sizeof(flags)));
+    assert_int_equal(test_receive_len(t, &buf), 0);
+
+    /* FRAG_TEST is not implemented */
+    buf = test_packet(t, 100, 0);
+    flags = htonl(FRAG_TEST << FRAG_TYPE_SHIFT);
+    ASSERT(buf_write_prepend(&buf, &flags, sizeof(flags)));
+    assert_int_equal(test_receive_len(t, &buf), 0);
+
+    /* a fragment beyond the end of the buffer */
+    buf = test_packet(t, 400, 0);
+    flags = htonl((FRAG_YES_NOTLAST << FRAG_TYPE_SHIFT) | (31 << FRAG_ID_SHIFT));
+    ASSERT(buf_write_prepend(&buf, &flags, sizeof(flags)));
+    assert_int_equal(test_receive_len(t, &buf), 0);
+
+    /* too short for a header */
+    buf = test_packet(t, 2, 0);
+    assert_int_equal(test_receive_len(t, &buf), 0);
+}
+
+const struct CMUnitTest fragment_tests[] = {
+    cmocka_unit_test_setup_teardown(test_fragment_whole, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_fragment_in_order, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_fragment_reordered, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_fragment_duplicate, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_fragment_expired, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_fragment_window, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_fragment_bad_header, setup, teardown),
+};
+
+int
+main(void)
+{
+    return cmocka_run_group_tests(fragment_tests, NULL, NULL);
+}
+
+#else  /* ifdef ENABLE_FRAGMENT */
+
+int
+main(void)
+{
+    return 77; /* skipped, built without --fragment support */
+}
+
+#endif /* ifdef ENABLE_FRAGMENT */
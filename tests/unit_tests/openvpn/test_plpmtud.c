@@ -0,0 +1,309 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "plpmtud.h"
+
+#define TEST_LINK_MTU  1500
+#define TEST_OVERHEAD  41       /* opcode, packet id, HMAC and IV */
+#define TEST_MAX_STEPS 1000
+
+/* the path between us and the peer */
+struct test_path {
+    int mtu;                    /* largest packet delivered, 0 drops all */
+    int block;                  /* cipher block size the packet is padded to */
+    int n_probes;               /* probes sent */
+};
+
+static int
+setup(void **state)
+{
+    struct plpmtud *p = calloc(1, sizeof(*p));
+
+    now = 1000;
+    plpmtud_init(p, PLPMTUD_BASE, TEST_LINK_MTU, TEST_OVERHEAD,
+                 PLPMTUD_DEFAULT_INTERVAL);
+    *state = p;
+    return 0;
+}
+
+static int
+teardown(void **state)
+{
+    free(*state);
+    return 0;
+}
+
+/*
+ * Send a probe the way occ.c does: pad the payload to the probe size
+ * less the overhead of the last probe, and let the link add its own.
+ * Returns true if the search has ended.
+ */
+static bool
+test_send_probe(struct plpmtud *p, struct test_path *path, bool *delivered)
+{
+    const int payload = max_int(p->probe_size - p->overhead, 3);
+    int sent = payload + TEST_OVERHEAD;
+
+    if (path->block > 1)
+    {
+        sent += path->block - sent % path->block;
+    }
+    ++path->n_probes;
+    *delivered = sent <= path->mtu;
+    return plpmtud_probe_sent(p, payload, sent);
+}
+
+/* run the search until it ends, as the timers and acks of occ.c would */
+static void
+test_search(struct plpmtud *p, struct test_path *path)
+{
+    for (int i = 0; i < TEST_MAX_STEPS; ++i)
+    {
+        bool delivered;
+
+        if (plpmtud_probing(p))
+        {
+            if (test_send_probe(p, path, &delivered))
+            {
+                return;
+            }
+            if (delivered)
+            {
+                if (plpmtud_probe_acked(p, p->probe_id))
+                {
+                    return;
+                }
+                /* the next size is probed right away */
+                continue;
+            }
+        }
+
+        now += PLPMTUD_PROBE_INTERVAL;
+        if (plpmtud_timeout(p))
+        {
+            return;
+        }
+    }
+    fail_msg("search did not end after %d steps", TEST_MAX_STEPS);
+}
+
+/* wait for the next search after one has ended */
+static void
+test_wait_interval(struct plpmtud *p)
+{
+    now += p->interval;
+    assert_false(plpmtud_timeout(p));
+    assert_int_equal(p->state, PLPMTUD_BASE_SIZE);
+    assert_true(plpmtud_probing(p));
+}
+
+static void
+test_plpmtud_full_size(void **state)
+{
+    struct plpmtud *p = *state;
+    struct test_path path = { .mtu = TEST_LINK_MTU, .block = 1 };
+
+    assert_int_equal(p->state, PLPMTUD_BASE_SIZE);
+    assert_int_equal(p->probe_size, PLPMTUD_BASE);
+
+    test_search(p, &path);
+    assert_int_equal(p->state, PLPMTUD_COMPLETE);
+    assert_int_equal(p->pmtu, TEST_LINK_MTU);
+
+    /* the base size, then the link MTU */
+    assert_int_equal(path.n_probes, 2);
+}
+
+static void
+test_plpmtud_bisect(void **state)
+{
+    struct plpmtud *p = *state;
+
+    for (int mtu = PLPMTUD_BASE; mtu < TEST_LINK_MTU; mtu += 37)
+    {
+        struct test_path path = { .mtu = mtu, .block = 1 };
+
+        plpmtud_init(p, PLPMTUD_BASE, TEST_LINK_MTU, TEST_OVERHEAD,
+                     PLPMTUD_DEFAULT_INTERVAL);
+        test_search(p, &path);
+        assert_int_equal(p->state, PLPMTUD_COMPLETE);
+        assert_in_range(p->pmtu, mtu - PLPMTUD_STEP, mtu);
+    }
+}
+
+/*
+ * With a block cipher the link size of a probe is rounded up, so the
+ * probe may be larger than the size aimed at.
+ */
+static void
+test_plpmtud_padding(void **state)
+{
+    struct plpmtud *p = *state;
+
+    for (int mtu = PLPMTUD_BASE; mtu < TEST_LINK_MTU; mtu += 3)
+    {
+        struct test_path path = { .mtu = mtu, .block = 16 };
+
+        plpmtud_init(p, PLPMTUD_BASE, TEST_LINK_MTU, TEST_OVERHEAD,
+                     PLPMTUD_DEFAULT_INTERVAL);
+        test_search(p, &path);
+        assert_int_equal(p->state, PLPMTUD_COMPLETE);
+        assert_in_range(p->pmtu, mtu - PLPMTUD_STEP - path.block, mtu);
+    }
+}
+
+static void
+test_plpmtud_no_answer(void **state)
+{
+    struct plpmtud *p = *state;
+    struct test_path path = { .mtu = 0, .block = 1 };
+
+    test_search(p, &path);
+    assert_int_equal(p->state, PLPMTUD_ERROR);
+    assert_int_equal(p->pmtu, 0);
+    assert_int_equal(path.n_probes, PLPMTUD_MAX_PROBES);
+    assert_false(plpmtud_probing(p));
+
+    /* not before the interval has passed, as occ.c checks the timer */
+    test_wait_interval(p);
+    assert_int_equal(p->probe_size, PLPMTUD_BASE);
+}
+
+static void
+test_plpmtud_lost_ack(void **state)
+{
+    struct plpmtud *p = *state;
+    struct test_path path = { .mtu = TEST_LINK_MTU, .block = 1 };
+    bool delivered;
+
+    /* an ack before any probe was sent */
+    assert_false(plpmtud_probe_acked(p, p->probe_id));
+    assert_int_equal(p->state, PLPMTUD_BASE_SIZE);
+
+    /* two base probes whose acks are lost, the third one is answered */
+    for (int i = 0; i < PLPMTUD_MAX_PROBES - 1; ++i)
+    {
+        assert_false(test_send_probe(p, &path, &delivered));
+        now += PLPMTUD_PROBE_INTERVAL;
+        assert_false(plpmtud_timeout(p));
+        assert_true(plpmtud_probing(p));
+    }
+    assert_false(test_send_probe(p, &path, &delivered));
+
+    /* an ack for a wrong id */
+    const uint16_t base_id = p->probe_id;
+    assert_false(plpmtud_probe_acked(p, base_id + 1));
+    assert_int_equal(p->state, PLPMTUD_BASE_SIZE);
+
+    assert_false(plpmtud_probe_acked(p, base_id));
+    assert_int_equal(p->state, PLPMTUD_SEARCHING);
+    assert_int_equal(p->probe_size, TEST_LINK_MTU);
+    assert_int_equal(p->n_probes, 0);
+
+    /* a late duplicate of the base ack */
+    assert_false(plpmtud_probe_acked(p, base_id));
+    assert_int_equal(p->probe_size, TEST_LINK_MTU);
+
+    test_search(p, &path);
+    assert_int_equal(p->pmtu, TEST_LINK_MTU);
+
+    /* acks after the search has ended */
+    assert_false(plpmtud_probe_acked(p, p->probe_id));
+    assert_int_equal(p->state, PLPMTUD_COMPLETE);
+}
+
+/* the search is repeated, and follows a path MTU that changes */
+static void
+test_plpmtud_repeat(void **state)
+{
+    struct plpmtud *p = *state;
+    struct test_path path = { .mtu = 1280, .block = 1 };
+
+    test_search(p, &path);
+    assert_in_range(p->pmtu, 1280 - PLPMTUD_STEP, 1280);
+
+    path.mtu = 1000;
+    test_wait_interval(p);
+    test_search(p, &path);
+    assert_int_equal(p->state, PLPMTUD_COMPLETE);
+    assert_in_range(p->pmtu, 1000 - PLPMTUD_STEP, 1000);
+
+    path.mtu = TEST_LINK_MTU;
+    test_wait_interval(p);
+    test_search(p, &path);
+    assert_int_equal(p->pmtu, TEST_LINK_MTU);
+
+    /* the peer went away */
+    path.mtu = 0;
+    test_wait_interval(p);
+    test_search(p, &path);
+    assert_int_equal(p->state, PLPMTUD_ERROR);
+    assert_int_equal(p->pmtu, 0);
+}
+
+static void
+test_plpmtud_small_link(void **state)
+{
+    struct plpmtud *p = *state;
+    struct test_path path = { .mtu = TEST_LINK_MTU, .block = 1 };
+
+    /* a link MTU below the base size is probed first, and only */
+    plpmtud_init(p, PLPMTUD_BASE, 500, TEST_OVERHEAD, PLPMTUD_DEFAULT_INTERVAL);
+    assert_int_equal(p->probe_size, 500);
+
+    test_search(p, &path);
+    assert_int_equal(p->state, PLPMTUD_COMPLETE);
+    assert_int_equal(p->pmtu, 500);
+    assert_int_equal(path.n_probes, 1);
+}
+
+const struct CMUnitTest plpmtud_tests[] = {
+    cmocka_unit_test_setup_teardown(test_plpmtud_full_size, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_plpmtud_bisect, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_plpmtud_padding, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_plpmtud_no_answer, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_plpmtud_lost_ack, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_plpmtud_repeat, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_plpmtud_small_link, setup, teardown),
+};
+
+int
+main(void)
+{
+    return cmocka_run_group_tests(plpmtud_tests, NULL, NULL);
+}
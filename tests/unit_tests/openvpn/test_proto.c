@@ -0,0 +1,450 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "proto.h"
+
+#define TEST_BUF_SIZE 256
+
+/* 192.168.1.2:53124 -> 8.8.8.8:53, a DNS query for example.com */
+static const uint8_t udp4_addr[2][4] = { { 192, 168, 1, 2 }, { 8, 8, 8, 8 } };
+static const uint8_t udp4[] = {
+    0xcf, 0x84, 0x00, 0x35, 0x00, 0x25, 0x00, 0x00, 0xab, 0xcd, 0x01, 0x00,
+    0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x65, 0x78, 0x61,
+    0x6d, 0x70, 0x6c, 0x65, 0x03, 0x63, 0x6f, 0x6d, 0x00, 0x00, 0x01, 0x00,
+    0x01
+};
+#define UDP4_CHECKSUM 0xe2f4
+
+/* 10.8.0.2:40000 -> 10.8.0.1:22, a SYN with an MSS option */
+static const uint8_t tcp4_addr[2][4] = { { 10, 8, 0, 2 }, { 10, 8, 0, 1 } };
+static const uint8_t tcp4[] = {
+    0x9c, 0x40, 0x00, 0x16, 0x12, 0x34, 0x56, 0x78, 0x00, 0x00, 0x00, 0x00,
+    0x60, 0x02, 0xfa, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x02, 0x04, 0x05, 0xb4
+};
+#define TCP4_CHECKSUM 0x8420
+
+/* fe80::1 -> fe80::2, an echo request with an odd length */
+static const uint8_t icmp6_addr[2][16] = {
+    { 0xfe, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 },
+    { 0xfe, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2 }
+};
+static const uint8_t icmp6[] = {
+    0x80, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 'a', 'b', 'c'
+};
+#define ICMP6_CHECKSUM 0xbe50
+
+static int
+setup(void **state)
+{
+    struct gc_arena *gc = calloc(1, sizeof(*gc));
+
+    *gc = gc_new();
+    *state = gc;
+    return 0;
+}
+
+static int
+teardown(void **state)
+{
+    struct gc_arena *gc = *state;
+
+    gc_free(gc);
+    free(gc);
+    return 0;
+}
+
+/*
+ * Check a known checksum, and that the packet with its checksum filled
+ * in sums to zero, as a receiver verifies it.
+ */
+static void
+assert_checksum(sa_family_t af, const uint8_t *pkt, int len, int check_offset,
+                const uint8_t *src, const uint8_t *dst, int proto,
+                uint16_t expected)
+{
+    uint8_t copy[TEST_BUF_SIZE];
+
+    assert_int_equal(ip_checksum(af, pkt, len, src, dst, proto), expected);
+
+    memcpy(copy, pkt, len);
+    copy[check_offset] = expected >> 8;
+    copy[check_offset + 1] = expected & 0xff;
+    assert_int_equal(ip_checksum(af, copy, len, src, dst, proto), 0);
+}
+
+static void
+test_ip_checksum_known(void **state)
+{
+    assert_checksum(AF_INET, udp4, sizeof(udp4), 6, udp4_addr[0], udp4_addr[1],
+                    OPENVPN_IPPROTO_UDP, UDP4_CHECKSUM);
+    assert_checksum(AF_INET, tcp4, sizeof(tcp4), 16, tcp4_addr[0], tcp4_addr[1],
+                    OPENVPN_IPPROTO_TCP, TCP4_CHECKSUM);
+    assert_checksum(AF_INET6, icmp6, sizeof(icmp6), 2, icmp6_addr[0], icmp6_addr[1],
+                    OPENVPN_IPPROTO_ICMPV6, ICMP6_CHECKSUM);
+}
+
+/* the checksum as it was computed before, one 16-bit word at a time */
+static uint16_t
+ref_checksum(sa_family_t af, const uint8_t *payload, int len,
+             const uint8_t *src, const uint8_t *dst, int proto)
+{
+    const int addr_len = (af == AF_INET) ? 4 : 16;
+    uint32_t sum = 0;
+
+    for (int i = 0; i < len; i += 2)
+    {
+        sum += (payload[i] << 8) + ((i + 1 < len) ? payload[i + 1] : 0);
+    }
+    for (int i = 0; i < addr_len; i += 2)
+    {
+        sum += (src[i] << 8) + src[i + 1];
+        sum += (dst[i] << 8) + dst[i + 1];
+    }
+    sum += len + proto;
+    while (sum >> 16)
+    {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t) ~sum;
+}
+
+static void
+test_ip_checksum_lengths(void **state)
+{
+    uint8_t data[TEST_BUF_SIZE];
+
+    /* all-ones data makes the carries of the wide sum matter */
+    memset(data, 0xff, sizeof(data));
+    for (int len = 0; len <= 64; ++len)
+    {
+        assert_int_equal(ip_checksum(AF_INET6, data, len, data, data, 0xff),
+                         ref_checksum(AF_INET6, data, len, data, data, 0xff));
+    }
+
+    for (int i = 0; i < (int) sizeof(data); ++i)
+    {
+        data[i] = (uint8_t) (i * 167 + 13);
+    }
+    for (int len = 0; len <= (int) sizeof(data) - 4; ++len)
+    {
+        /* unaligned data too */
+        const uint8_t *p = data + (len & 3);
+
+        assert_int_equal(ip_checksum(AF_INET, p, len, data + 1, data + 7,
+                                     OPENVPN_IPPROTO_UDP),
+                         ref_checksum(AF_INET, p, len, data + 1, data + 7,
+                                      OPENVPN_IPPROTO_UDP));
+    }
+}
+
+static void
+test_write_eth(struct buffer *buf, uint16_t proto, bool vlan)
+{
+    const uint8_t mac[OPENVPN_ETH_ALEN] = { 0x02, 0, 0, 0, 0, 1 };
+
+    buf_write(buf, mac, sizeof(mac));
+    buf_write(buf, mac, sizeof(mac));
+    if (vlan)
+    {
+        buf_write_u16(buf, OPENVPN_ETH_P_8021Q);
+        buf_write_u16(buf, 42);
+    }
+    buf_write_u16(buf, proto);
+}
+
+/* an IPv4 header of ihl 32-bit words, followed by payload_len bytes */
+static void
+test_write_ipv4(struct buffer *buf, int ihl, int proto, int payload_len,
+                uint16_t frag_off)
+{
+    buf_write_u8(buf, 0x40 | ihl);
+    buf_write_u8(buf, 0);
+    buf_write_u16(buf, ihl * 4 + payload_len);
+    buf_write_u16(buf, 0x1234);
+    buf_write_u16(buf, frag_off);
+    buf_write_u8(buf, 64);
+    buf_write_u8(buf, proto);
+    buf_write_u16(buf, 0);
+    buf_write(buf, tcp4_addr[0], 4);
+    buf_write(buf, tcp4_addr[1], 4);
+    for (int i = 5; i < ihl; ++i)
+    {
+        buf_write_u32(buf, 0x01010101); /* NOP options */
+    }
+}
+
+static void
+test_write_ipv6(struct buffer *buf, int nexthdr, int payload_len)
+{
+    buf_write_u32(buf, 0x60000000);
+    buf_write_u16(buf, payload_len);
+    buf_write_u8(buf, nexthdr);
+    buf_write_u8(buf, 64);
+    buf_write(buf, icmp6_addr[0], 16);
+    buf_write(buf, icmp6_addr[1], 16);
+}
+
+/*
+ * Parse the first len bytes of buf, from an allocation of exactly that
+ * size so that reading past the end is caught by the sanitizers.
+ */
+static struct packet_info
+test_parse(struct gc_arena *gc, int tunnel_type, const struct buffer *buf, int len)
+{
+    struct packet_info pi;
+    struct buffer exact;
+    uint8_t *data = gc_malloc(len, false, gc);
+
+    assert_true(len <= BLEN(buf));
+    memcpy(data, BPTR(buf), len);
+    buf_set_read(&exact, data, len);
+    packet_info_parse(&pi, tunnel_type, &exact);
+    return pi;
+}
+
+static void
+test_packet_info_tun(void **state)
+{
+    struct gc_arena *gc = *state;
+    struct buffer buf = alloc_buf_gc(TEST_BUF_SIZE, gc);
+    struct packet_info pi;
+
+    test_write_ipv4(&buf, 5, OPENVPN_IPPROTO_TCP, sizeof(tcp4), 0x4000);
+    buf_write(&buf, tcp4, sizeof(tcp4));
+
+    pi = test_parse(gc, DEV_TYPE_TUN, &buf, BLEN(&buf));
+    assert_int_equal(pi.ip_ver, 4);
+    assert_int_equal(pi.ip_offset, 0);
+    assert_true(pi.whole);
+    assert_int_equal(pi.l4_proto, OPENVPN_IPPROTO_TCP);
+    assert_int_equal(pi.l4_offset, 20);
+    assert_int_equal(pi.l4_len, sizeof(tcp4));
+    assert_int_equal(pi.tcp_flags, OPENVPN_TCPH_SYN_MASK);
+
+    /* IP options move the L4 header */
+    buf_reset_len(&buf);
+    test_write_ipv4(&buf, 7, OPENVPN_IPPROTO_UDP, sizeof(udp4), 0);
+    buf_write(&buf, udp4, sizeof(udp4));
+
+    pi = test_parse(gc, DEV_TYPE_TUN, &buf, BLEN(&buf));
+    assert_int_equal(pi.ip_ver, 4);
+    assert_true(pi.whole);
+    assert_int_equal(pi.l4_proto, OPENVPN_IPPROTO_UDP);
+    assert_int_equal(pi.l4_offset, 28);
+    assert_int_equal(pi.l4_len, sizeof(udp4));
+    assert_int_equal(pi.tcp_flags, 0);
+
+    buf_reset_len(&buf);
+    test_write_ipv6(&buf, OPENVPN_IPPROTO_TCP, sizeof(tcp4));
+    buf_write(&buf, tcp4, sizeof(tcp4));
+
+    pi = test_parse(gc, DEV_TYPE_TUN, &buf, BLEN(&buf));
+    assert_int_equal(pi.ip_ver, 6);
+    assert_true(pi.whole);
+    assert_int_equal(pi.l4_proto, OPENVPN_IPPROTO_TCP);
+    assert_int_equal(pi.l4_offset, 40);
+    assert_int_equal(pi.tcp_flags, OPENVPN_TCPH_SYN_MASK);
+}
+
+static void
+test_packet_info_malformed(void **state)
+{
+    struct gc_arena *gc = *state;
+    struct buffer buf = alloc_buf_gc(TEST_BUF_SIZE, gc);
+    struct packet_info pi;
+
+    test_write_ipv4(&buf, 5, OPENVPN_IPPROTO_TCP, sizeof(tcp4), 0);
+    buf_write(&buf, tcp4, sizeof(tcp4));
+
+    /* shorter than an IPv4 header */
+    for (int len = 0; len < 20; ++len)
+    {
+        pi = test_parse(gc, DEV_TYPE_TUN, &buf, len);
+        assert_int_equal(pi.ip_ver, 0);
+    }
+
+    /* truncated TCP header: located, but no flags */
+    for (int len = 20; len < 40; ++len)
+    {
+        pi = test_parse(gc, DEV_TYPE_TUN, &buf, len);
+        assert_int_equal(pi.ip_ver, 4);
+        assert_false(pi.whole);
+        assert_int_equal(pi.l4_offset, 20);
+        assert_int_equal(pi.l4_len, len - 20);
+        assert_int_equal(pi.tcp_flags, 0);
+    }
+
+    /* a header length below the minimum, or beyond the packet */
+    BPTR(&buf)[0] = 0x44;
+    pi = test_parse(gc, DEV_TYPE_TUN, &buf, BLEN(&buf));
+    assert_int_equal(pi.ip_ver, 4);
+    assert_int_equal(pi.l4_offset, 0);
+    assert_int_equal(pi.tcp_flags, 0);
+
+    BPTR(&buf)[0] = 0x4f;
+    pi = test_parse(gc, DEV_TYPE_TUN, &buf, BLEN(&buf));
+    assert_int_equal(pi.l4_offset, 0);
+    assert_int_equal(pi.tcp_flags, 0);
+
+    /* a length which does not match the buffer */
+    BPTR(&buf)[0] = 0x45;
+    BPTR(&buf)[3] += 1;
+    pi = test_parse(gc, DEV_TYPE_TUN, &buf, BLEN(&buf));
+    assert_false(pi.whole);
+    assert_int_equal(pi.l4_offset, 20);
+
+    /* a non-first fragment has no L4 header */
+    buf_reset_len(&buf);
+    test_write_ipv4(&buf, 5, OPENVPN_IPPROTO_TCP, sizeof(tcp4), 0x2000 | 185);
+    buf_write(&buf, tcp4, sizeof(tcp4));
+    pi = test_parse(gc, DEV_TYPE_TUN, &buf, BLEN(&buf));
+    assert_int_equal(pi.ip_ver, 4);
+    assert_true(pi.whole);
+    assert_int_equal(pi.l4_proto, OPENVPN_IPPROTO_TCP);
+    assert_int_equal(pi.l4_offset, 0);
+    assert_int_equal(pi.tcp_flags, 0);
+
+    /* an IPv6 packet shorter than its header */
+    buf_reset_len(&buf);
+    test_write_ipv6(&buf, OPENVPN_IPPROTO_TCP, sizeof(tcp4));
+    buf_write(&buf, tcp4, sizeof(tcp4));
+    for (int len = 20; len < 40; ++len)
+    {
+        pi = test_parse(gc, DEV_TYPE_TUN, &buf, len);
+        assert_int_equal(pi.ip_ver, 6);
+        assert_false(pi.whole);
+        assert_int_equal(pi.l4_offset, 0);
+    }
+
+    /* neither IPv4 nor IPv6 */
+    BPTR(&buf)[0] = 0x50;
+    pi = test_parse(gc, DEV_TYPE_TUN, &buf, BLEN(&buf));
+    assert_int_equal(pi.ip_ver, 0);
+
+    pi = test_parse(gc, DEV_TYPE_NULL, &buf, BLEN(&buf));
+    assert_int_equal(pi.ip_ver, 0);
+}
+
+static void
+test_packet_info_tap(void **state)
+{
+    struct gc_arena *gc = *state;
+    struct buffer buf = alloc_buf_gc(TEST_BUF_SIZE, gc);
+    struct packet_info pi;
+
+    test_write_eth(&buf, OPENVPN_ETH_P_IPV4, false);
+    test_write_ipv4(&buf, 5, OPENVPN_IPPROTO_UDP, sizeof(udp4), 0);
+    buf_write(&buf, udp4, sizeof(udp4));
+
+    pi = test_parse(gc, DEV_TYPE_TAP, &buf, BLEN(&buf));
+    assert_int_equal(pi.ip_ver, 4);
+    assert_int_equal(pi.ip_offset, 14);
+    assert_true(pi.whole);
+    assert_int_equal(pi.l4_offset, 34);
+
+    /* too short for the Ethernet and IPv4 headers */
+    pi = test_parse(gc, DEV_TYPE_TAP, &buf, 33);
+    assert_int_equal(pi.ip_ver, 0);
+
+    /* the Ethernet type must match the IP version */
+    buf_reset_len(&buf);
+    test_write_eth(&buf, OPENVPN_ETH_P_IPV6, false);
+    test_write_ipv4(&buf, 5, OPENVPN_IPPROTO_UDP, sizeof(udp4), 0);
+    buf_write(&buf, udp4, sizeof(udp4));
+    pi = test_parse(gc, DEV_TYPE_TAP, &buf, BLEN(&buf));
+    assert_int_equal(pi.ip_ver, 0);
+
+    buf_reset_len(&buf);
+    test_write_eth(&buf, OPENVPN_ETH_P_ARP, false);
+    test_write_ipv4(&buf, 5, OPENVPN_IPPROTO_UDP, sizeof(udp4), 0);
+    pi = test_parse(gc, DEV_TYPE_TAP, &buf, BLEN(&buf));
+    assert_int_equal(pi.ip_ver, 0);
+
+    buf_reset_len(&buf);
+    test_write_eth(&buf, OPENVPN_ETH_P_IPV6, true);
+    test_write_ipv6(&buf, OPENVPN_IPPROTO_TCP, sizeof(tcp4));
+    buf_write(&buf, tcp4, sizeof(tcp4));
+
+    pi = test_parse(gc, DEV_TYPE_TAP, &buf, BLEN(&buf));
+    assert_int_equal(pi.ip_ver, 6);
+    assert_int_equal(pi.ip_offset, 18);
+    assert_true(pi.whole);
+    assert_int_equal(pi.l4_offset, 58);
+    assert_int_equal(pi.tcp_flags, OPENVPN_TCPH_SYN_MASK);
+}
+
+/* a tagged frame must hold the tag as well as the IPv4 header */
+static void
+test_packet_info_tap_vlan_short(void **state)
+{
+    struct gc_arena *gc = *state;
+    struct buffer buf = alloc_buf_gc(TEST_BUF_SIZE, gc);
+    struct packet_info pi;
+
+    test_write_eth(&buf, OPENVPN_ETH_P_IPV4, true);
+    test_write_ipv4(&buf, 5, OPENVPN_IPPROTO_UDP, sizeof(udp4), 0);
+    buf_write(&buf, udp4, sizeof(udp4));
+
+    for (int len = 0; len < 38; ++len)
+    {
+        pi = test_parse(gc, DEV_TYPE_TAP, &buf, len);
+        assert_int_equal(pi.ip_ver, 0);
+    }
+
+    pi = test_parse(gc, DEV_TYPE_TAP, &buf, 38);
+    assert_int_equal(pi.ip_ver, 4);
+    assert_int_equal(pi.ip_offset, 18);
+    assert_false(pi.whole);
+    assert_int_equal(pi.l4_offset, 38);
+    assert_int_equal(pi.l4_len, 0);
+}
+
+const struct CMUnitTest proto_tests[] = {
+    cmocka_unit_test(test_ip_checksum_known),
+    cmocka_unit_test(test_ip_checksum_lengths),
+    cmocka_unit_test_setup_teardown(test_packet_info_tun, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_packet_info_malformed, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_packet_info_tap, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_packet_info_tap_vlan_short, setup, teardown),
+};
+
+int
+main(void)
+{
+    return cmocka_run_group_tests(proto_tests, NULL, NULL);
+}
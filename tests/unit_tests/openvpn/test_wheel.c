@@ -0,0 +1,361 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2021 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "wheel.h"
+
+/* the slot of the start time is near the end of the wheel */
+#define TEST_START  (1000 * WHEEL_SLOTS - 3)
+#define TEST_N      64
+
+struct test_wheel {
+    struct wheel w;
+    struct wheel_entry e[TEST_N];
+};
+
+static int
+setup(void **state)
+{
+    struct test_wheel *t = calloc(1, sizeof(*t));
+
+    now = TEST_START;
+    wheel_init(&t->w);
+    *state = t;
+    return 0;
+}
+
+static int
+teardown(void **state)
+{
+    free(*state);
+    return 0;
+}
+
+/* remove and return the next entry expired at now */
+static struct wheel_entry *
+test_pop(struct wheel *w)
+{
+    struct wheel_entry *e = wheel_expired(w, now);
+
+    if (e)
+    {
+        assert_true(e->expire <= now);
+        wheel_remove(w, e);
+    }
+    return e;
+}
+
+/*
+ * Sleep until the wheel's next wakeup, as multi_get_timeout() does,
+ * and return the one entry expired then, or NULL.
+ */
+static struct wheel_entry *
+test_sleep(struct wheel *w)
+{
+    const time_t next = wheel_next(w);
+
+    assert_true(next > now);
+    now = next;
+    return test_pop(w);
+}
+
+static void
+test_wheel_empty(void **state)
+{
+    struct test_wheel *t = *state;
+
+    assert_int_equal(wheel_next(&t->w), 0);
+    assert_null(wheel_expired(&t->w, now));
+    now += 10 * WHEEL_SLOTS;
+    assert_null(wheel_expired(&t->w, now));
+    assert_int_equal(t->w.n, 0);
+}
+
+static void
+test_wheel_order(void **state)
+{
+    struct test_wheel *t = *state;
+
+    /* across the end of the wheel */
+    wheel_add(&t->w, &t->e[0], now + 5);
+    wheel_add(&t->w, &t->e[1], now + 1);
+    wheel_add(&t->w, &t->e[2], now + 2);
+    wheel_add(&t->w, &t->e[3], now + 2);
+    assert_int_equal(t->w.n, 4);
+    assert_true(wheel_entry_defined(&t->e[0]));
+
+    assert_null(wheel_expired(&t->w, now));
+    assert_ptr_equal(test_sleep(&t->w), &t->e[1]);
+    assert_int_equal(now, TEST_START + 1);
+    assert_null(test_pop(&t->w));
+
+    struct wheel_entry *a = test_sleep(&t->w);
+    struct wheel_entry *b = test_pop(&t->w);
+    assert_int_equal(now, TEST_START + 2);
+    assert_true((a == &t->e[2] && b == &t->e[3]) || (a == &t->e[3] && b == &t->e[2]));
+    assert_null(test_pop(&t->w));
+
+    assert_ptr_equal(test_sleep(&t->w), &t->e[0]);
+    assert_int_equal(now, TEST_START + 5);
+    assert_false(wheel_entry_defined(&t->e[0]));
+    assert_int_equal(t->w.n, 0);
+    assert_int_equal(wheel_next(&t->w), 0);
+}
+
+static void
+test_wheel_move(void **state)
+{
+    struct test_wheel *t = *state;
+
+    wheel_add(&t->w, &t->e[0], now + 3);
+    wheel_add(&t->w, &t->e[1], now + 4);
+
+    /* later, then earlier */
+    wheel_add(&t->w, &t->e[0], now + 6);
+    assert_int_equal(t->w.n, 2);
+    assert_ptr_equal(test_sleep(&t->w), &t->e[1]);
+    assert_int_equal(now, TEST_START + 4);
+
+    wheel_add(&t->w, &t->e[0], now + 1);
+    assert_ptr_equal(test_sleep(&t->w), &t->e[0]);
+    assert_int_equal(now, TEST_START + 5);
+
+    /* removed before it expired */
+    wheel_add(&t->w, &t->e[2], now + 2);
+    wheel_remove(&t->w, &t->e[2]);
+    wheel_remove(&t->w, &t->e[2]);
+    assert_int_equal(t->w.n, 0);
+    now += 2;
+    assert_null(wheel_expired(&t->w, now));
+
+    /* in the past: due at once */
+    wheel_add(&t->w, &t->e[3], now - 10);
+    assert_ptr_equal(test_pop(&t->w), &t->e[3]);
+}
+
+/* entries of later rounds do not wake the sleeper before they are due */
+static void
+test_wheel_far(void **state)
+{
+    struct test_wheel *t = *state;
+    const time_t start = now;
+
+    wheel_add(&t->w, &t->e[0], start + 3 * WHEEL_SLOTS + 7);
+    wheel_add(&t->w, &t->e[1], start + WHEEL_SLOTS + 7);
+    wheel_add(&t->w, &t->e[2], start + 7);
+    wheel_add(&t->w, &t->e[3], start + WHEEL_SLOTS);
+
+    assert_ptr_equal(test_sleep(&t->w), &t->e[2]);
+    assert_int_equal(now, start + 7);
+    assert_null(test_pop(&t->w));
+
+    assert_ptr_equal(test_sleep(&t->w), &t->e[3]);
+    assert_int_equal(now, start + WHEEL_SLOTS);
+
+    assert_ptr_equal(test_sleep(&t->w), &t->e[1]);
+    assert_int_equal(now, start + WHEEL_SLOTS + 7);
+
+    assert_ptr_equal(test_sleep(&t->w), &t->e[0]);
+    assert_int_equal(now, start + 3 * WHEEL_SLOTS + 7);
+    assert_int_equal(t->w.n, 0);
+}
+
+/* the same for entries beyond the last round, in the overflow list */
+static void
+test_wheel_overflow(void **state)
+{
+    struct test_wheel *t = *state;
+    const time_t start = now;
+    const time_t far = start + 2 * WHEEL_SLOTS * WHEEL_SLOTS;
+
+    wheel_add(&t->w, &t->e[0], far + 1);
+    wheel_add(&t->w, &t->e[1], far);
+    wheel_add(&t->w, &t->e[2], start + WHEEL_SLOTS * WHEEL_SLOTS);
+    wheel_add(&t->w, &t->e[3], start + 2);
+
+    assert_ptr_equal(test_sleep(&t->w), &t->e[3]);
+    assert_ptr_equal(test_sleep(&t->w), &t->e[2]);
+    assert_int_equal(now, start + WHEEL_SLOTS * WHEEL_SLOTS);
+
+    /* wake every round on the way, as the event loop would */
+    while (now + WHEEL_SLOTS < far)
+    {
+        now += WHEEL_SLOTS - 1;
+        assert_null(test_pop(&t->w));
+        assert_int_equal(wheel_next(&t->w), far);
+    }
+    assert_ptr_equal(test_sleep(&t->w), &t->e[1]);
+    assert_int_equal(now, far);
+    assert_ptr_equal(test_sleep(&t->w), &t->e[0]);
+    assert_int_equal(now, far + 1);
+    assert_int_equal(t->w.n, 0);
+}
+
+/* after a long sleep, everything which expired meanwhile is found */
+static void
+test_wheel_long_sleep(void **state)
+{
+    struct test_wheel *t = *state;
+    const time_t start = now;
+
+    for (int i = 0; i < TEST_N; ++i)
+    {
+        wheel_add(&t->w, &t->e[i], start + 1 + i * 37);
+    }
+
+    now = start + 20 * WHEEL_SLOTS;
+    for (int i = 0; i < TEST_N; ++i)
+    {
+        assert_non_null(test_pop(&t->w));
+    }
+    assert_null(test_pop(&t->w));
+    assert_int_equal(t->w.n, 0);
+
+    /* and the wheel works on from there */
+    wheel_add(&t->w, &t->e[0], now + 2);
+    wheel_add(&t->w, &t->e[1], start + 5);
+    assert_ptr_equal(test_pop(&t->w), &t->e[1]);
+    assert_ptr_equal(test_sleep(&t->w), &t->e[0]);
+    assert_int_equal(now, start + 20 * WHEEL_SLOTS + 2);
+
+    /* a sleep of exactly one turn */
+    wheel_add(&t->w, &t->e[2], now + 1);
+    now += WHEEL_SLOTS + 1;
+    assert_ptr_equal(test_pop(&t->w), &t->e[2]);
+}
+
+/*
+ * Random adds, moves, removes and sleeps, compared with the expiry
+ * times: an entry is only returned once it has expired, and never
+ * missed once it has.
+ */
+static void
+test_wheel_random(void **state)
+{
+    struct test_wheel *t = *state;
+
+    srand(1);
+    for (int round = 0; round < 20000; ++round)
+    {
+        struct wheel_entry *e = &t->e[rand() % TEST_N];
+        time_t next;
+
+        switch (rand() % 5)
+        {
+            case 0:
+                wheel_remove(&t->w, e);
+                break;
+
+            case 1:
+                wheel_add(&t->w, e, now + rand() % (4 * WHEEL_SLOTS));
+                break;
+
+            case 2:
+                wheel_add(&t->w, e, now + rand() % (2 * WHEEL_SLOTS * WHEEL_SLOTS));
+                break;
+
+            default:
+                wheel_add(&t->w, e, now + 1 + rand() % 30);
+                break;
+        }
+
+        while ((e = test_pop(&t->w)))
+        {
+        }
+
+        /* nothing expired is left behind */
+        for (int i = 0; i < TEST_N; ++i)
+        {
+            if (wheel_entry_defined(&t->e[i]))
+            {
+                assert_true(t->e[i].expire > now);
+            }
+        }
+
+        /* the wakeup is when the earliest entry expires */
+        time_t earliest = 0;
+        for (int i = 0; i < TEST_N; ++i)
+        {
+            if (wheel_entry_defined(&t->e[i])
+                && (!earliest || t->e[i].expire < earliest))
+            {
+                earliest = t->e[i].expire;
+            }
+        }
+        next = wheel_next(&t->w);
+        assert_int_equal(next, earliest);
+
+        /* sleep to the wakeup, short of it, or far past it */
+        if (next)
+        {
+            switch (rand() % 8)
+            {
+                case 0:
+                    now += rand() % (8 * WHEEL_SLOTS);
+                    break;
+
+                case 1:
+                    now += (next - now) / 2;
+                    break;
+
+                default:
+                    now = next;
+                    break;
+            }
+        }
+        else
+        {
+            now += rand() % 3;
+        }
+    }
+}
+
+const struct CMUnitTest wheel_tests[] = {
+    cmocka_unit_test_setup_teardown(test_wheel_empty, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_wheel_order, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_wheel_move, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_wheel_far, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_wheel_overflow, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_wheel_long_sleep, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_wheel_random, setup, teardown),
+};
+
+int
+main(void)
+{
+    return cmocka_run_group_tests(wheel_tests, NULL, NULL);
+}